@@ -40,6 +40,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Filname: BasicDiffuse.hlsl
 ---------------------------------------------------------------------------
 */
+#include "../Framework/RtrVertex.hlsli"
+
 cbuffer cbPeFrame : register(b0)
 {
 	matrix gVPMat;
@@ -47,10 +49,11 @@ cbuffer cbPeFrame : register(b0)
 	float3 gLightIntensity;
 }
 
-cbuffer cbPerMesh : register(b1)
+struct SPerDraw
 {
-	matrix gWorld;
-}
+	float4x4 World;
+};
+StructuredBuffer<SPerDraw> gPerDraw : register(t8);
 
 Texture2D gAlbedo : register (t0);
 SamplerState gLinearSampler : register(s0);
@@ -60,6 +63,7 @@ struct VS_IN
 	float4 PosL : POSITION;
 	float3 NormalL : NORMAL;
 	float2 TexC : TEXCOORD;
+	uint DrawId : DRAW_ID;
 };
 
 struct VS_OUT
@@ -69,12 +73,13 @@ struct VS_OUT
 	float3 NormalW : NORMAL;
 };
 
-VS_OUT VS(VS_IN vIn)
+VS_OUT VS(VS_IN vIn, uint InstanceID : SV_InstanceID)
 {
 	VS_OUT vOut;
-	vOut.svPos = mul(mul(vIn.PosL, gWorld), gVPMat);
+	const float4x4 World = gPerDraw[GetDrawIndex(vIn.DrawId, InstanceID)].World;
+	vOut.svPos = mul(mul(DecodePosition(vIn.PosL), World), gVPMat);
 	vOut.TexC = vIn.TexC;
-	vOut.NormalW = mul(float4(vIn.NormalL, 0), gWorld).xyz;
+	vOut.NormalW = mul(float4(DecodeDirection(vIn.NormalL), 0), World).xyz;
 	return vOut;
 }
 
@@ -40,6 +40,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Filname: Wireframe.hlsl
 ---------------------------------------------------------------------------
 */
+#include "../Framework/RtrVertex.hlsli"
+
 cbuffer cbPeFrame : register(b0)
 {
 	matrix gVPMat;
@@ -47,17 +49,29 @@ cbuffer cbPeFrame : register(b0)
 	float3 gLightIntensity;
 }
 
-cbuffer cbPerMesh : register(b1)
+struct SPerDraw
 {
-	int gbDoubleSided;
-#ifndef _USE_BONES
-    matrix gWorld;
-#endif
-}
+	int bDoubleSided;
+	uint FirstInstance;
+	uint BonePaletteOffset;  // Where the mesh's palette starts in gBones. The vertex bone IDs are relative to it
+	int pad;
+	float4x4 World;
+};
+StructuredBuffer<SPerDraw> gPerDraw : register(t8);
 
 Texture2D gAlbedo : register (t0);
 SamplerState gLinearSampler : register(s0);
+#ifdef _USE_DUAL_QUATERNIONS
+struct SDualQuaternion
+{
+	float4 Real;
+	float4 Dual;  // 0.5 * Translation * Real
+};
+StructuredBuffer<SDualQuaternion> gBones : register(t1);
+#else
 StructuredBuffer<float4x4> gBones : register(t1);
+#endif
+StructuredBuffer<float4x4> gInstances : register(t2);
 
 struct VS_IN
 {
@@ -70,17 +84,54 @@ struct VS_IN
 	float4 BonesWeights[2] : BONE_WEIGHTS;
 	uint4  BonesIDs[2]    : BONE_IDS;
 #endif
+	uint DrawId : DRAW_ID;
 };
 
 struct VS_OUT
 {
 	float4 svPos : SV_POSITION;
 	float3 NormalW : NORMAL;
+	nointerpolation int bDoubleSided : DOUBLE_SIDED;
 #ifdef _USE_TEXTURE
     float2 TexC : TEXCOORD;
 #endif
 };
 
+#ifdef _USE_DUAL_QUATERNIONS
+float4x4 CalculateWorldMatrixFromBones(float4 BonesWeights[2], uint4  BonesIDs[2])
+{
+	// Dual-quaternion linear blending. Rotations on the other hemisphere from the first bone's are negated, so the blend takes the short way
+	const float4 Pivot = gBones[BonesIDs[0].x].Real;
+	float4 Real = float4(0, 0, 0, 0);
+	float4 Dual = float4(0, 0, 0, 0);
+[unroll]
+	for(int i = 0; i < 2; i++)
+	{
+[unroll]
+		for(int j = 0; j < 4; j++)
+		{
+			SDualQuaternion Bone = gBones[BonesIDs[i][j]];
+			float Weight = (dot(Bone.Real, Pivot) < 0) ? -BonesWeights[i][j] : BonesWeights[i][j];
+			Real += Bone.Real * Weight;
+			Dual += Bone.Dual * Weight;
+		}
+	}
+
+	const float InvLength = rsqrt(dot(Real, Real));
+	Real *= InvLength;
+	Dual *= InvLength;
+
+	// Back to a matrix, so the rest of the shader doesn't care how the bones were blended. The translation is 2 * Dual * conjugate(Real)
+	const float3 t = 2 * (Real.w * Dual.xyz - Dual.w * Real.xyz + cross(Real.xyz, Dual.xyz));
+	const float x = Real.x, y = Real.y, z = Real.z, w = Real.w;
+	float4x4 WorldMat = {
+		float4(1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y), 0),
+		float4(2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x), 0),
+		float4(2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y), 0),
+		float4(t, 1) };
+	return WorldMat;
+}
+#else
 float4x4 CalculateWorldMatrixFromBones(float4 BonesWeights[2], uint4  BonesIDs[2])
 {
 	float4x4 WorldMat = { float4(0, 0, 0, 0), float4(0, 0, 0, 0), float4(0, 0, 0, 0), float4(0, 0, 0, 0) };
@@ -95,22 +146,33 @@ float4x4 CalculateWorldMatrixFromBones(float4 BonesWeights[2], uint4  BonesIDs[2
 
 	return WorldMat;
 }
+#endif
 
-VS_OUT VS(VS_IN vIn)
+VS_OUT VS(VS_IN vIn, uint InstanceID : SV_InstanceID)
 {
 	VS_OUT vOut;
+	const SPerDraw Draw = gPerDraw[GetDrawIndex(vIn.DrawId, InstanceID)];
 	float4x4 World;
 #ifdef _USE_BONES
-	World = CalculateWorldMatrixFromBones(vIn.BonesWeights, vIn.BonesIDs);
+	uint4 BonesIDs[2] = { vIn.BonesIDs[0] + Draw.BonePaletteOffset, vIn.BonesIDs[1] + Draw.BonePaletteOffset };
+	World = CalculateWorldMatrixFromBones(vIn.BonesWeights, BonesIDs);
+#ifdef _USE_INSTANCING
+	World = mul(World, gInstances[Draw.FirstInstance + InstanceID]);
+#else
+	World = mul(World, Draw.World);
+#endif
+#elif defined(_USE_INSTANCING)
+	World = gInstances[Draw.FirstInstance + InstanceID];
 #else
-	World = gWorld;
+	World = Draw.World;
 #endif
 
-	vOut.svPos = mul(mul(vIn.PosL, World), gVPMat);
+	vOut.svPos = mul(mul(DecodePosition(vIn.PosL), World), gVPMat);
 #ifdef _USE_TEXTURE
 	vOut.TexC = vIn.TexC;
 #endif
-	vOut.NormalW = mul(float4(vIn.NormalL, 0), World).xyz;
+	vOut.NormalW = mul(float4(DecodeDirection(vIn.NormalL), 0), World).xyz;
+	vOut.bDoubleSided = Draw.bDoubleSided;
 	return vOut;
 }
 
@@ -118,7 +180,7 @@ float4 SolidPS(VS_OUT vOut) : SV_TARGET
 {
 	float3 n = normalize(vOut.NormalW);
     float NdotL = dot(n, -gLightDirW);
-    if(gbDoubleSided)
+    if(vOut.bDoubleSided)
     {
         NdotL = abs(NdotL);
     }
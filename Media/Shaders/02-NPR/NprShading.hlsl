@@ -40,6 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Filname: NprShading.hlsl
 ---------------------------------------------------------------------------
 */
+#include "../Framework/RtrVertex.hlsli"
 
 cbuffer cbCommonPerFrame : register(b0)
 {
@@ -48,10 +49,11 @@ cbuffer cbCommonPerFrame : register(b0)
 	float3 gLightIntensity;
 }
 
-cbuffer cbPerMesh : register(b1)
+struct SPerDraw
 {
-	matrix gWorld;
-}
+	float4x4 World;
+};
+StructuredBuffer<SPerDraw> gPerDraw : register(t8);
 
 cbuffer cbGooch : register(b2)
 {
@@ -83,6 +85,7 @@ struct VS_IN
 	float4 PosL : POSITION;
 	float3 NormalL : NORMAL;
 	float2 TexC : TEXCOORD;
+	uint DrawId : DRAW_ID;
 };
 
 struct VS_OUT
@@ -93,14 +96,15 @@ struct VS_OUT
 	float3 NormalW : NORMAL;
 };
 
-VS_OUT VS(VS_IN vIn)
+VS_OUT VS(VS_IN vIn, uint InstanceID : SV_InstanceID)
 {
 	VS_OUT vOut;
-    float4 PosW = mul(vIn.PosL, gWorld);
+	const float4x4 World = gPerDraw[GetDrawIndex(vIn.DrawId, InstanceID)].World;
+    float4 PosW = mul(DecodePosition(vIn.PosL), World);
     vOut.PosW = PosW.xyz;
 	vOut.svPos = mul(PosW, gVPMat);
 	vOut.TexC = vIn.TexC;
-	vOut.NormalW = mul(float4(vIn.NormalL, 0), gWorld).xyz;
+	vOut.NormalW = mul(float4(DecodeDirection(vIn.NormalL), 0), World).xyz;
 	return vOut;
 }
 
@@ -40,16 +40,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Filname: SilhouetteShader.hlsl
 ---------------------------------------------------------------------------
 */
+#include "../Framework/RtrVertex.hlsli"
+
 cbuffer cbPeFrame : register(b0)
 {
 	matrix gVPMat;
 	float gLineWidth;
 }
 
-cbuffer cbPerMesh : register(b1)
+struct SPerDraw
 {
-	matrix gWorld;
-}
+	float4x4 World;
+};
+StructuredBuffer<SPerDraw> gPerDraw : register(t8);
 
 Texture2D gAlbedo : register (t0);
 SamplerState gLinearSampler : register(s0);
@@ -58,12 +61,14 @@ struct VS_IN
 {
 	float4 PosL : POSITION;
 	float3 NormalL : NORMAL;
+	uint DrawId : DRAW_ID;
 };
 
-float4 ShellExpansionVS(VS_IN vIn) : SV_POSITION
+float4 ShellExpansionVS(VS_IN vIn, uint InstanceID : SV_InstanceID) : SV_POSITION
 {
-    float3 PosW = mul(vIn.PosL, gWorld).xyz;
-    float3 NormalW = mul(float4(vIn.NormalL, 0), gWorld).xyz;
+	const float4x4 World = gPerDraw[GetDrawIndex(vIn.DrawId, InstanceID)].World;
+    float3 PosW = mul(DecodePosition(vIn.PosL), World).xyz;
+    float3 NormalW = mul(float4(DecodeDirection(vIn.NormalL), 0), World).xyz;
 	PosW += normalize(NormalW) * gLineWidth;
 
 	return mul(float4(PosW, 1), gVPMat);
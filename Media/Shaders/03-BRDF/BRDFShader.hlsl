@@ -40,6 +40,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
     Filname: BrdfShader.hlsl
 ---------------------------------------------------------------------------
 */
+#include "../Framework/RtrVertex.hlsli"
+
 cbuffer cbPeFrame : register(b0)
 {
     float4x4 gVPMat;
@@ -54,15 +56,17 @@ cbuffer cbPeFrame : register(b0)
     float3 gDiffuseColor;
 }
 
-cbuffer cbPerMesh : register(b1)
+struct SPerDraw
 {
-	matrix gWorld;
-}
+	float4x4 World;
+};
+StructuredBuffer<SPerDraw> gPerDraw : register(t8);
 
 struct VS_IN
 {
-	float3 PosL : POSITION;
+	float4 PosL : POSITION;
 	float3 NormalL : NORMAL;
+	uint DrawId : DRAW_ID;
 };
 
 struct VS_OUT
@@ -72,12 +76,13 @@ struct VS_OUT
 	float3 NormalW : NORMAL;
 };
 
-VS_OUT VS(VS_IN vIn)
+VS_OUT VS(VS_IN vIn, uint InstanceID : SV_InstanceID)
 {
 	VS_OUT vOut;
-    vOut.PosW = mul(float4(vIn.PosL,1), gWorld).xyz;
+	const float4x4 World = gPerDraw[GetDrawIndex(vIn.DrawId, InstanceID)].World;
+    vOut.PosW = mul(DecodePosition(vIn.PosL), World).xyz;
 	vOut.svPos = mul(float4(vOut.PosW, 1), gVPMat);
-	vOut.NormalW = mul(vIn.NormalL, (float3x3)gWorld).xyz;
+	vOut.NormalW = mul(DecodeDirection(vIn.NormalL), (float3x3)World).xyz;
 	return vOut;
 }
 
@@ -0,0 +1,88 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrVertex.hlsli
+---------------------------------------------------------------------------*/
+
+// Decoding of the CRtrMesh vertex formats. Shaders which draw meshes are compiled once per format, with the define returned by
+// CRtrMesh::GetVertexFormatDefine(). The vertex inputs keep the same semantics and types for both formats.
+#ifdef _COMPACT_VERTEX
+cbuffer cbVertexDequant : register(b7)
+{
+	float3 gPositionScale;
+	float3 gPositionOffset;
+}
+
+// Inverse of the octahedral encoding in CRtrMesh::CompactVertices()
+float3 OctDecode(float2 e)
+{
+	float3 v = float3(e, 1 - abs(e.x) - abs(e.y));
+	if(v.z < 0)
+	{
+		float2 s = float2(v.x >= 0 ? 1 : -1, v.y >= 0 ? 1 : -1);
+		v.xy = (1 - abs(v.yx)) * s;
+	}
+	return normalize(v);
+}
+#endif
+
+float4 DecodePosition(float4 PosL)
+{
+#ifdef _COMPACT_VERTEX
+	return float4(PosL.xyz * gPositionScale + gPositionOffset, 1);
+#else
+	return PosL;
+#endif
+}
+
+float3 DecodeDirection(float3 DirL)
+{
+#ifdef _COMPACT_VERTEX
+	return OctDecode(DirL.xy);
+#else
+	return DirL;
+#endif
+}
+
+// Techniques keep their per-draw data in a structured buffer at register(t8), see CRtrDrawDataBuffer. The DRAW_ID input is the draw's
+// StartInstanceLocation plus the instance ID, so instanced draws subtract the instance ID to find their record
+uint GetDrawIndex(uint DrawId, uint InstanceID)
+{
+	return DrawId - InstanceID;
+}
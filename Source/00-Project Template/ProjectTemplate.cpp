@@ -54,7 +54,7 @@ const UINT gSampleCount = 1;
 
 HRESULT CProjectTemplate::OnCreateDevice(ID3D11Device* pDevice)
 {
-    m_pModel = CRtrModel::CreateFromFile(L"Tails\\Tails.obj", pDevice);
+    m_pModel = CRtrModel::CreateFromFile(L"Tails\\Tails.obj", pDevice, CRtrModel::LOAD_FLAGS_COMPACT_VERTICES, m_pThreadPool.get());
     m_Camera.SetModelParams(m_pModel->GetCenter(), m_pModel->GetRadius());
     m_pShader = std::make_unique<CShaderTemplate>(pDevice);
     InitUI();
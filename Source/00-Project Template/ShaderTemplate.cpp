@@ -43,84 +43,85 @@ Filename: ShaderTemplate.cpp
 #include "ShaderTemplate.h"
 #include "RtrModel.h"
 
-CShaderTemplate::CShaderTemplate(ID3D11Device* pDevice)
+CShaderTemplate::CShaderTemplate(ID3D11Device* pDevice) :
+	m_DrawData(sizeof(SPerDrawData)),
+	m_CbRing(pDevice),
+	m_PerFrameBlock(0, true, true)
 {
     static const std::wstring ShaderFile = L"00-ProjectTemplate\\ShaderTemplate.hlsl";
 
-    m_VS = CreateVsFromFile(pDevice, ShaderFile, "VS");
-	m_VS->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VpMat));
-	m_VS->VerifyConstantLocation("gLightDirW", 0, offsetof(SPerFrameData, LightDirW));
-	m_VS->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
+	for(UINT Format = 0; Format < CRtrMesh::VERTEX_FORMAT_COUNT; Format++)
+	{
+		const D3D_SHADER_MACRO VsDefines[] = { CRtrMesh::GetVertexFormatDefine(Format), "", nullptr };
+		m_VS[Format] = CreateVsFromFile(pDevice, ShaderFile, "VS", VsDefines);
+		m_VS[Format]->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VpMat));
+		m_VS[Format]->VerifyConstantLocation("gLightDirW", 0, offsetof(SPerFrameData, LightDirW));
+		m_VS[Format]->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
 
-	m_VS->VerifyConstantLocation("gWorld", 1, offsetof(SPerMeshData, World));
+		m_VS[Format]->VerifyStructuredBufferLocation("gPerDraw", CRtrMesh::PER_DRAW_SRV_INDEX);
+	}
 
     m_PS = CreatePsFromFile(pDevice, ShaderFile, "PS");
 	m_PS->VerifyResourceLocation("gAlbedo", 0, 1);
 	m_PS->VerifySamplerLocation("gLinearSampler", 0);
 
-	// Constant buffer
-	D3D11_BUFFER_DESC BufferDesc;
-	BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	BufferDesc.ByteWidth = sizeof(SPerFrameData);
-	BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	BufferDesc.MiscFlags = 0;
-	BufferDesc.StructureByteStride = 0;
-	BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerFrameCb));
-
-	BufferDesc.ByteWidth = sizeof(SPerMeshData);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerModelCb));
-
 	// Sampler state
 	m_pLinearSampler = SSamplerState::TriLinear(pDevice);
 }
 
 void CShaderTemplate::PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData)
 {
-	pCtx->OMSetDepthStencilState(nullptr, 0);
-	pCtx->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-	pCtx->RSSetState(nullptr);
+	m_StateCache.Reset(pCtx);
+	m_StateCache.OMSetDepthStencilState(nullptr, 0);
+	m_StateCache.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+	m_StateCache.RSSetState(nullptr);
+	m_CbRing.Reset();
 	
 	// Update CB
-	UpdateEntireConstantBuffer(pCtx, m_PerFrameCb, PerFrameData);
-	ID3D11Buffer* pCb = m_PerFrameCb.GetInterfacePtr();
-	pCtx->VSSetConstantBuffers(0, 1, &pCb);
-	pCtx->PSSetConstantBuffers(0, 1, &pCb);
-	pCb = m_PerModelCb;
-	pCtx->VSSetConstantBuffers(1, 1, &pCb);
+	m_CbRing.Update(m_StateCache, m_PerFrameBlock, PerFrameData);
 
 	ID3D11SamplerState* pSampler = m_pLinearSampler;
-	pCtx->PSSetSamplers(0, 1, &pSampler);
+	m_StateCache.PSSetSamplers(0, 1, &pSampler);
 
-    pCtx->VSSetShader(m_VS->GetShader(), nullptr, 0);
-    pCtx->PSSetShader(m_PS->GetShader(), nullptr, 0);
+    m_StateCache.PSSetShader(m_PS->GetShader());
 }
 
-void CShaderTemplate::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat)
+void CShaderTemplate::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex)
 {
-	// Update constant buffer
 	const CRtrMaterial* pMaterial = pMesh->GetMaterial();
-	SPerMeshData CbData;
-    CbData.World = WorldMat;
-	UpdateEntireConstantBuffer(pCtx, m_PerModelCb, CbData);
-
-	pMesh->SetDrawState(pCtx, m_VS->GetBlob());
+	const CVertexShader* pVS = m_VS[pMesh->GetVertexFormat()].get();
+	m_MeshBinder.SetDrawState(m_StateCache, pMesh, pVS->GetBlob());
+	m_StateCache.VSSetShader(pVS->GetShader());
 	// Set per-mesh resources
     ID3D11ShaderResourceView* pSrv = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP);
     assert(pSrv);
-    pCtx->PSSetShaderResources(0, 1, &pSrv);
+    m_StateCache.PSSetShaderResources(0, 1, &pSrv);
 
 	UINT IndexCount = pMesh->GetIndexCount();
-	pCtx->DrawIndexed(IndexCount, 0, 0);
+	pCtx->DrawIndexedInstanced(IndexCount, 1, pMesh->GetFirstIndex(), pMesh->GetBaseVertex(), DrawIndex);
 }
 
 void CShaderTemplate::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
 {
-	for(const auto& DrawCmd : pModel->GetDrawList())
+	m_StateCache.Invalidate();
+	m_MeshBinder.Reset();
+	m_DrawStream.Clear();
+	m_DrawStream.AddDrawList(pModel, 0);
+	m_DrawStream.Sort();
+
+	// All the world matrices are written before the first draw. Matrices in structured buffers are column-major, hence the transpose
+	const auto& Packets = m_DrawStream.GetPackets();
+	m_DrawData.Begin(pCtx, UINT(Packets.size()));
+	for(const auto& Packet : Packets)
+	{
+		SPerDrawData Data;
+		Packet.pTransform->Transpose(Data.World);
+		m_DrawData.Add(Data);
+	}
+	m_DrawData.End(m_StateCache);
+
+	for(UINT i = 0; i < Packets.size(); i++)
 	{
-		for(const auto& Mesh : DrawCmd.pMeshes)
-		{
-            DrawMesh(Mesh, pCtx, DrawCmd.Transformation);
-		}
+		DrawMesh(Packets[i].pMesh, pCtx, i);
 	}
 }
\ No newline at end of file
@@ -43,9 +43,12 @@ Filename: ShaderTemplate.h
 #pragma once
 #include "Common.h"
 #include "ShaderUtils.h"
+#include "ConstantBufferRing.h"
+#include "RtrModel\RtrMeshArena.h"
+#include "RtrModel\RtrDrawStream.h"
+#include "RtrModel\RtrDrawData.h"
 
 class CRtrModel;
-class CRtrMesh;
 
 class CShaderTemplate
 {
@@ -54,9 +57,9 @@ public:
 	{
 		float4x4 VpMat;
 		float3 LightDirW;
-		float pad0;
+		float pad0 = 0;
 		float3 LightIntensity;
-		float pad1;
+		float pad1 = 0;
 	};
 	verify_cb_size_alignment(SPerFrameData);
 
@@ -65,21 +68,24 @@ public:
 	void PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData);
 
 private:
-    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat);
+    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex);
 
-	CVertexShaderPtr m_VS;
+	CVertexShaderPtr m_VS[CRtrMesh::VERTEX_FORMAT_COUNT];  // One permutation per mesh vertex format
+	CRtrMeshBinder m_MeshBinder;
+	CDxStateCache m_StateCache;
+	CRtrDrawStream m_DrawStream;
+	CRtrDrawDataBuffer m_DrawData;
 	CPixelShaderPtr  m_PS;
 
-	ID3D11BufferPtr m_PerFrameCb;
-	ID3D11BufferPtr m_PerModelCb;
+	CConstantBufferRing m_CbRing;
+	SConstantBlock m_PerFrameBlock;
 	ID3D11SamplerStatePtr m_pLinearSampler;
 
 	float3 m_LightDir;
 	float3 m_LightIntensity;
 
-	struct SPerMeshData
+	struct SPerDrawData
 	{
-		float4x4 World;
+		float4x4 World;  // Transposed
 	};
-	verify_cb_size_alignment(SPerMeshData);
 };
\ No newline at end of file
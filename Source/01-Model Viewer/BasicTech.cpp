@@ -43,118 +43,171 @@ Filename: BasicTech.cpp
 #include "BasicTech.h"
 #include "Camera.h"
 #include "RtrModel.h"
+#include "ThreadPool.h"
 
-CBasicTech::CBasicTech(ID3D11Device* pDevice)
+static CVertexShaderPtr CreateVS(ID3D11Device* pDevice, const std::wstring& ShaderFile, UINT Format, bool bBones, bool bTexture, bool bInstanced, bool bDualQuaternions = false)
 {
-    static const std::wstring ShaderFile = L"01-ModelViewer\\BasicTech.hlsl";
-
-    m_StaticNoTexVS = CreateVsFromFile(pDevice, ShaderFile, "VS");
-    m_StaticNoTexVS->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VpMat));
-    m_StaticNoTexVS->VerifyConstantLocation("gLightDirW", 0, offsetof(SPerFrameData, LightDirW));
-    m_StaticNoTexVS->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
-
-    m_StaticNoTexVS->VerifyConstantLocation("gWorld", 1, offsetof(SPerMeshData, World));
+    std::vector<D3D_SHADER_MACRO> Defines;
+    const D3D_SHADER_MACRO FormatDefine = { CRtrMesh::GetVertexFormatDefine(Format), "" };
+    Defines.push_back(FormatDefine);
+    const D3D_SHADER_MACRO BonesDefine = { "_USE_BONES", "" };
+    const D3D_SHADER_MACRO TextureDefine = { "_USE_TEXTURE", "" };
+    const D3D_SHADER_MACRO InstancingDefine = { "_USE_INSTANCING", "" };
+    const D3D_SHADER_MACRO DualQuaternionsDefine = { "_USE_DUAL_QUATERNIONS", "" };
+    if(bBones)
+    {
+        Defines.push_back(BonesDefine);
+    }
+    if(bTexture)
+    {
+        Defines.push_back(TextureDefine);
+    }
+    if(bInstanced)
+    {
+        Defines.push_back(InstancingDefine);
+    }
+    if(bDualQuaternions)
+    {
+        Defines.push_back(DualQuaternionsDefine);
+    }
+    const D3D_SHADER_MACRO End = { nullptr, nullptr };
+    Defines.push_back(End);
+    return CreateVsFromFile(pDevice, ShaderFile, "VS", Defines.data());
+}
 
-    const D3D_SHADER_MACRO VsTexDefines[] = { "_USE_TEXTURE", "", nullptr };
-    m_StaticTexVS = CreateVsFromFile(pDevice, ShaderFile, "VS", VsTexDefines);
+CBasicTech::CBasicTech(ID3D11Device* pDevice) :
+    m_Recorder(pDevice),
+    m_CbRing(pDevice),
+    m_PerFrameBlock(0, true, true),
+    m_DrawData(sizeof(SPerDrawData))
+{
+    static const std::wstring ShaderFile = L"01-ModelViewer\\BasicTech.hlsl";
 
-    const D3D_SHADER_MACRO VsBonesDefines[] = { "_USE_TEXTURE", "", nullptr };
-    m_AnimatedNoTexVS = CreateVsFromFile(pDevice, ShaderFile, "VS", VsBonesDefines);
+    for(UINT Format = 0; Format < CRtrMesh::VERTEX_FORMAT_COUNT; Format++)
+    {
+        for(UINT Instanced = 0; Instanced < 2; Instanced++)
+        {
+            const bool bInstanced = (Instanced != 0);
+            m_StaticNoTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, false, false, bInstanced);
+            m_StaticTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, false, true, bInstanced);
+            m_AnimatedNoTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, true, false, bInstanced);
+            m_AnimatedTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, true, true, bInstanced);
+            m_DualQuatNoTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, true, false, bInstanced, true);
+            m_DualQuatTexVS[Instanced][Format] = CreateVS(pDevice, ShaderFile, Format, true, true, bInstanced, true);
+        }
 
-    const D3D_SHADER_MACRO VsTexBonesDefines[] = {"_USE_BONES", "", "_USE_TEXTURE", "", nullptr };
-    m_AnimatedTexVS = CreateVsFromFile(pDevice, ShaderFile, "VS", VsTexBonesDefines);
-	m_AnimatedTexVS->VerifyStructuredBufferLocation("gBones", 1);
+        m_StaticNoTexVS[0][Format]->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VpMat));
+        m_StaticNoTexVS[0][Format]->VerifyConstantLocation("gLightDirW", 0, offsetof(SPerFrameData, LightDirW));
+        m_StaticNoTexVS[0][Format]->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
+        m_StaticNoTexVS[0][Format]->VerifyStructuredBufferLocation("gPerDraw", CRtrMesh::PER_DRAW_SRV_INDEX);
+        m_AnimatedTexVS[0][Format]->VerifyStructuredBufferLocation("gBones", 1);
+        m_DualQuatTexVS[0][Format]->VerifyStructuredBufferLocation("gBones", 1);
+        m_StaticNoTexVS[1][Format]->VerifyStructuredBufferLocation("gInstances", 2);
+    }
 
 	D3D_SHADER_MACRO PsDefines[] = { "_USE_TEXTURE", "", nullptr };
     m_TexPS = CreatePsFromFile(pDevice, ShaderFile, "SolidPS", PsDefines);
 	m_TexPS->VerifyResourceLocation("gAlbedo", 0, 1);
 	m_TexPS->VerifySamplerLocation("gLinearSampler", 0);
-	m_TexPS->VerifyConstantLocation("gbDoubleSided", 1, offsetof(SPerMeshData, bDoubleSided));
 
     m_ColorPS = CreatePsFromFile(pDevice, ShaderFile, "SolidPS");
     m_WireframePS = CreatePsFromFile(pDevice, ShaderFile, "WireframePS");
 
-	// Constant buffer
-	D3D11_BUFFER_DESC BufferDesc;
-	BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	BufferDesc.ByteWidth = sizeof(SPerFrameData);
-	BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	BufferDesc.MiscFlags = 0;
-	BufferDesc.StructureByteStride = 0;
-	BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerFrameCb));
+    // The bones and instance buffers are created on first use, and grow as needed
+    m_InstanceBuffer.Capacity = 0;
 
-	BufferDesc.ByteWidth = sizeof(SPerMeshData);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerModelCb));
+	// Sampler state
+	m_pLinearSampler = SSamplerState::TriLinear(pDevice);
 
-    // Create the structured bones buffer
+    // Rasterizer state
+    m_pNoCullRastState = SRasterizerState::SolidNoCull(pDevice);
+    m_pWireframeRastState = SRasterizerState::Wireframe(pDevice);
+}
+
+void CBasicTech::CreateBonesBuffers(ID3D11Device* pDevice, UINT Capacity)
+{
+    m_BonesCapacity = Capacity;
+    D3D11_BUFFER_DESC BufferDesc;
     BufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-    BufferDesc.ByteWidth = sizeof(float4x4)*m_MaxBones;
+    BufferDesc.ByteWidth = sizeof(float4x4) * Capacity;
+    BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
     BufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
     BufferDesc.StructureByteStride = sizeof(float4x4);
+    BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
     verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_BonesBuffer.Buffer));
-    
+
     D3D11_SHADER_RESOURCE_VIEW_DESC SrvDesc;
     SrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
     SrvDesc.Format = DXGI_FORMAT_UNKNOWN;
     SrvDesc.Buffer.FirstElement = 0;
-    SrvDesc.Buffer.NumElements = m_MaxBones;
+    SrvDesc.Buffer.NumElements = Capacity;
     verify(pDevice->CreateShaderResourceView(m_BonesBuffer.Buffer, &SrvDesc, &m_BonesBuffer.Srv));
 
-	// Sampler state
-	m_pLinearSampler = SSamplerState::TriLinear(pDevice);
-
-    // Rasterizer state
-    m_pNoCullRastState = SRasterizerState::SolidNoCull(pDevice);
-    m_pWireframeRastState = SRasterizerState::Wireframe(pDevice);
+    // Dual quaternions take half the space
+    BufferDesc.ByteWidth = sizeof(SRtrDualQuaternion) * Capacity;
+    BufferDesc.StructureByteStride = sizeof(SRtrDualQuaternion);
+    verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_DualQuatBuffer.Buffer));
+    verify(pDevice->CreateShaderResourceView(m_DualQuatBuffer.Buffer, &SrvDesc, &m_DualQuatBuffer.Srv));
 }
 
 void CBasicTech::PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData, bool bWireframe)
 {
-	pCtx->OMSetDepthStencilState(nullptr, 0);
-	pCtx->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-	pCtx->RSSetState(nullptr);
+	// Every bind goes through the state cache, which drops the ones that wouldn't change anything
+	m_StateCache.Reset(pCtx);
+	m_StateCache.OMSetDepthStencilState(nullptr, 0);
+	m_StateCache.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+	m_StateCache.RSSetState(nullptr);
+	m_CbRing.Reset();
 	
 	// Update CB
-	UpdateEntireConstantBuffer(pCtx, m_PerFrameCb, PerFrameData);
-	ID3D11Buffer* pCb = m_PerFrameCb.GetInterfacePtr();
-	pCtx->VSSetConstantBuffers(0, 1, &pCb);
-	pCtx->PSSetConstantBuffers(0, 1, &pCb);
-	pCb = m_PerModelCb;
-	pCtx->VSSetConstantBuffers(1, 1, &pCb);
-    pCtx->PSSetConstantBuffers(1, 1, &pCb);
+	m_CbRing.Update(m_StateCache, m_PerFrameBlock, PerFrameData);
 
 	ID3D11SamplerState* pSampler = m_pLinearSampler;
-	pCtx->PSSetSamplers(0, 1, &pSampler);
+	m_StateCache.PSSetSamplers(0, 1, &pSampler);
     m_bWireframe = bWireframe;
+    m_PerFrameData = PerFrameData;
+}
+
+UINT CBasicTech::AddDrawData(const CRtrMesh* pMesh, const float4x4& WorldMat, UINT FirstInstance)
+{
+	SPerDrawData Data;
+	Data.bDoubleSided = pMesh->GetMaterial()->IsDoubleSided() ? 1 : 0;
+	Data.FirstInstance = FirstInstance;
+	Data.BonePaletteOffset = pMesh->GetBonePaletteOffset();
+
+	// For skinned meshes WorldMat is the copy transform, applied after the bones. Matrices in structured buffers are column-major, hence the transpose
+	WorldMat.Transpose(Data.World);
+	return m_DrawData.Add(Data);
 }
 
-void CBasicTech::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat, const CRtrModel* pModel)
+void CBasicTech::SetMeshState(CDxStateCache& State, CRtrMeshBinder& MeshBinder, const CRtrMesh* pMesh, bool bInstanced) const
 {
-	// Update constant buffer
 	const CRtrMaterial* pMaterial = pMesh->GetMaterial();
-	SPerMeshData CbData;
-	CbData.bDoubleSided = pMaterial->IsDoubleSided() ? 1 : 0;
-	
 	const CVertexShader* pActiveVS;
+	const UINT Format = pMesh->GetVertexFormat();
+	const UINT Instanced = bInstanced ? 1 : 0;
 	if(pMesh->HasBones())
 	{
-		pActiveVS = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? m_AnimatedTexVS.get() : m_AnimatedNoTexVS.get();
-        CbData.World = float4x4::Identity();
+		if(m_bDualQuatBones)
+		{
+			pActiveVS = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? m_DualQuatTexVS[Instanced][Format].get() : m_DualQuatNoTexVS[Instanced][Format].get();
+		}
+		else
+		{
+			pActiveVS = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? m_AnimatedTexVS[Instanced][Format].get() : m_AnimatedNoTexVS[Instanced][Format].get();
+		}
 	}
 	else
 	{
-		CbData.World = WorldMat;
-        pActiveVS = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? m_StaticTexVS.get() : m_StaticNoTexVS.get();
+        pActiveVS = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? m_StaticTexVS[Instanced][Format].get() : m_StaticNoTexVS[Instanced][Format].get();
     }
-	UpdateEntireConstantBuffer(pCtx, m_PerModelCb, CbData);
-	pMesh->SetDrawState(pCtx, pActiveVS->GetBlob());
-	pCtx->VSSetShader(pActiveVS->GetShader(), nullptr, 0);
+	MeshBinder.SetDrawState(State, pMesh, pActiveVS->GetBlob());
+	State.VSSetShader(pActiveVS->GetShader());
 
     if(m_bWireframe)
     {
-        pCtx->PSSetShader(m_WireframePS->GetShader(), nullptr, 0);
-        pCtx->RSSetState(m_pWireframeRastState);
+        State.PSSetShader(m_WireframePS->GetShader());
+        State.RSSetState(m_pWireframeRastState);
     }
     else
     {
@@ -163,49 +216,330 @@ void CBasicTech::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, cons
 
         if(pSrv)
         {
-            pCtx->PSSetShader(m_TexPS->GetShader(), nullptr, 0);
-            pCtx->PSSetShaderResources(0, 1, &pSrv);
+            State.PSSetShader(m_TexPS->GetShader());
+            State.PSSetShaderResources(0, 1, &pSrv);
         }
         else
         {
-            pCtx->PSSetShader(m_ColorPS->GetShader(), nullptr, 0);
+            State.PSSetShader(m_ColorPS->GetShader());
         }
         ID3D11RasterizerState* pRastState = pMaterial->IsDoubleSided() ? m_pNoCullRastState : nullptr;
-        pCtx->RSSetState(pRastState);
+        State.RSSetState(pRastState);
     }
+}
 
-	UINT IndexCount = pMesh->GetIndexCount();
-	pCtx->DrawIndexed(IndexCount, 0, 0);
+UINT64 CBasicTech::GetSortKey(const CRtrMesh* pMesh, const float4x4& WorldMat) const
+{
+    // The shader permutation depends on the bones and the diffuse map. The vertex format has its own field in the key
+    const UINT Shader = (pMesh->HasBones() ? 2 : 0) | (pMesh->GetMaterial()->GetSRV(CRtrMaterial::DIFFUSE_MAP) ? 1 : 0);
+    const float Depth = CRtrDrawStream::GetViewDepth(pMesh, WorldMat, m_PerFrameData.VpMat);
+    return CRtrDrawStream::MakeSortKey(0, Shader, pMesh->GetMaterialID(), pMesh->GetVertexFormat(), Depth);
 }
 
-void CBasicTech::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
+void CBasicTech::ReplayDrawStream(ID3D11DeviceContext* pCtx)
 {
-    // Update bones if they are present
-    if(pModel->HasBones())
+    if(m_bSortDraws)
     {
-        // Update the buffer
-        const float4x4* pBoneTransforms = pModel->GetBonesMatrices();
+        m_DrawStream.Sort();
+    }
+
+    // Consecutive ranges of the same mesh share the per-draw record. All the records are written before the first draw
+    const auto& Packets = m_DrawStream.GetPackets();
+    auto IsNewDraw = [&Packets](UINT i) { return (i == 0) || (Packets[i].pMesh != Packets[i - 1].pMesh) || (Packets[i].pTransform != Packets[i - 1].pTransform); };
+    m_DrawData.Begin(pCtx, UINT(Packets.size()));
+    m_Draws.clear();
+    UINT DrawIndex = 0;
+    for(UINT i = 0; i < Packets.size(); i++)
+    {
+        const auto& Packet = Packets[i];
+        if(IsNewDraw(i))
+        {
+            // The bones already place skinned meshes, there is no copy transform here
+            DrawIndex = AddDrawData(Packet.pMesh, Packet.pMesh->HasBones() ? float4x4::Identity() : *Packet.pTransform, 0);
+        }
+        SDraw Draw = { Packet.pMesh, Packet.IndexCount, Packet.pMesh->GetFirstIndex() + Packet.FirstIndex, 1, DrawIndex };
+        m_Draws.push_back(Draw);
+        m_DrawnTriangleCount += Packet.IndexCount / 3;
+    }
+    m_DrawData.End(m_StateCache);
+    SubmitDraws(pCtx, false);
+}
+
+void CBasicTech::SubmitDraws(ID3D11DeviceContext* pCtx, bool bInstanced)
+{
+    m_DrawCallCount = UINT(m_Draws.size());
 
-        D3D11_MAPPED_SUBRESOURCE MapData;
+    // The deferred contexts bind the per-frame block where it was uploaded, and the command lists are executed before Record() returns.
+    // The block is bound on the immediate context, so the ring keeps it until then, unless it was dropped before we got here
+    if(m_CbRing.IsResident(m_PerFrameBlock) == false)
+    {
+        m_CbRing.Update(m_StateCache, m_PerFrameBlock, m_PerFrameData);
+    }
+
+    const UINT MaxChunks = m_pThreadPool ? m_pThreadPool->GetThreadCount() : 1;
+    if(m_RecordingContexts.size() < MaxChunks)
+    {
+        m_RecordingContexts.resize(MaxChunks);
+    }
+
+    m_Recorder.Record(pCtx, m_pThreadPool, UINT(m_Draws.size()), [&](ID3D11DeviceContext* pChunkCtx, UINT ChunkID, const CDeferredRecorder::SChunk& Chunk)
+    {
+        if(pChunkCtx == pCtx)
+        {
+            // The immediate context already has the pass state
+            RecordDraws(m_StateCache, m_MeshBinder, Chunk, bInstanced);
+        }
+        else
+        {
+            SRecordingContext& Recording = m_RecordingContexts[ChunkID];
+            Recording.StateCache.Reset(pChunkCtx);
+            Recording.MeshBinder.Reset();
+            BindPassState(Recording.StateCache, bInstanced);
+            RecordDraws(Recording.StateCache, Recording.MeshBinder, Chunk, bInstanced);
+        }
+    });
+
+    if(m_Recorder.GetStats().bDeferred)
+    {
+        // Executing the command lists reset the immediate context's state
+        m_StateCache.Invalidate();
+        m_MeshBinder.Reset();
+    }
+}
+
+void CBasicTech::RecordDraws(CDxStateCache& State, CRtrMeshBinder& MeshBinder, const CDeferredRecorder::SChunk& Chunk, bool bInstanced) const
+{
+    ID3D11DeviceContext* pCtx = State.GetContext();
+    const CRtrMesh* pMesh = nullptr;
+    for(UINT i = Chunk.First; i < Chunk.First + Chunk.Count; i++)
+    {
+        const SDraw& Draw = m_Draws[i];
+        if(Draw.pMesh != pMesh)
+        {
+            pMesh = Draw.pMesh;
+            SetMeshState(State, MeshBinder, pMesh, bInstanced);
+        }
+        pCtx->DrawIndexedInstanced(Draw.IndexCount, Draw.InstanceCount, Draw.StartIndex, pMesh->GetBaseVertex(), Draw.DrawIndex);
+    }
+}
+
+void CBasicTech::BindPassState(CDxStateCache& State, bool bInstanced) const
+{
+    // The default depth, blend and rasterizer states are the ones PrepareForDraw() sets
+    m_CbRing.Rebind(State, m_PerFrameBlock);
+    ID3D11SamplerState* pSampler = m_pLinearSampler;
+    State.PSSetSamplers(0, 1, &pSampler);
+    if(m_pBonesSrv)
+    {
+        State.VSSetShaderResources(1, 1, &m_pBonesSrv);
+    }
+    if(bInstanced)
+    {
+        ID3D11ShaderResourceView* pInstancesSRV = m_InstanceBuffer.Srv.GetInterfacePtr();
+        State.VSSetShaderResources(2, 1, &pInstancesSRV);
+    }
+    m_DrawData.Bind(State);
+}
+
+CDxStateCache::SStats CBasicTech::GetStateStats() const
+{
+    CDxStateCache::SStats Stats = m_StateCache.GetStats();
+    if(m_Recorder.GetStats().bDeferred)
+    {
+        for(UINT i = 0; i < m_Recorder.GetStats().ChunkCount; i++)
+        {
+            Stats.IssuedCalls += m_RecordingContexts[i].StateCache.GetStats().IssuedCalls;
+            Stats.FilteredCalls += m_RecordingContexts[i].StateCache.GetStats().FilteredCalls;
+        }
+    }
+    return Stats;
+}
+
+void CBasicTech::UpdateBones(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
+{
+    // Every skinned mesh only gets the bones in its palette, so the upload is the sum of the palettes rather than a full skeleton per mesh
+    m_bDualQuatBones = false;
+    m_pBonesSrv = nullptr;
+    const UINT PaletteSize = pModel->GetSkinningPaletteSize();
+    if(pModel->HasBones() == false || PaletteSize == 0)
+    {
+        return;
+    }
+
+    if(PaletteSize > m_BonesCapacity)
+    {
+        ID3D11DevicePtr pDevice;
+        pCtx->GetDevice(&pDevice);
+        CreateBonesBuffers(pDevice, max(PaletteSize, m_BonesCapacity * 2));
+    }
+
+    D3D11_MAPPED_SUBRESOURCE MapData;
+    const SRtrDualQuaternion* pDualQuaternions = m_bDualQuaternionSkinning ? pModel->GetBonesDualQuaternions() : nullptr;
+    if(pDualQuaternions)
+    {
+        // 8 floats per bone, and the layout matches the shader's, so no transpose
+        verify(pCtx->Map(m_DualQuatBuffer.Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MapData));
+        SRtrDualQuaternion* pBones = (SRtrDualQuaternion*)MapData.pData;
+        for(UINT MeshID = 0; MeshID < pModel->GetMeshCount(); MeshID++)
+        {
+            const CRtrMesh* pMesh = pModel->GetMesh(MeshID);
+            const auto& Palette = pMesh->GetBonePalette();
+            for(UINT i = 0; i < Palette.size(); i++)
+            {
+                pBones[pMesh->GetBonePaletteOffset() + i] = pDualQuaternions[Palette[i]];
+            }
+        }
+        pCtx->Unmap(m_DualQuatBuffer.Buffer, 0);
+
+        m_pBonesSrv = m_DualQuatBuffer.Srv.GetInterfacePtr();
+        m_StateCache.VSSetShaderResources(1, 1, &m_pBonesSrv);
+        m_bDualQuatBones = true;
+    }
+    else
+    {
+        // Linear blend skinning. Also the fallback for bones that scale, which dual quaternions can't represent
+        const float4x4* pBoneTransforms = pModel->GetBonesMatrices();
         verify(pCtx->Map(m_BonesBuffer.Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MapData));
         float4x4* pBones = (float4x4*)MapData.pData;
-        for(UINT i = 0; i < pModel->GetBonesCount(); i++)
+        for(UINT MeshID = 0; MeshID < pModel->GetMeshCount(); MeshID++)
         {
-            // matrices in structured buffers are always column-major, hence the transpose
-            pBoneTransforms[i].Transpose(pBones[i]);
+            const CRtrMesh* pMesh = pModel->GetMesh(MeshID);
+            const auto& Palette = pMesh->GetBonePalette();
+            for(UINT i = 0; i < Palette.size(); i++)
+            {
+                // matrices in structured buffers are always column-major, hence the transpose
+                pBoneTransforms[Palette[i]].Transpose(pBones[pMesh->GetBonePaletteOffset() + i]);
+            }
         }
         pCtx->Unmap(m_BonesBuffer.Buffer, 0);
 
         // set the buffer
-        ID3D11ShaderResourceView* pBonesSRV = m_BonesBuffer.Srv.GetInterfacePtr();
-        pCtx->VSSetShaderResources(1, 1, &pBonesSRV);
+        m_pBonesSrv = m_BonesBuffer.Srv.GetInterfacePtr();
+        m_StateCache.VSSetShaderResources(1, 1, &m_pBonesSrv);
     }
+}
 
-	for(const auto& DrawCmd : pModel->GetDrawList())
+void CBasicTech::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrLodSelector* pLodSelector, const CRtrClusterCuller* pCuller)
+{
+	m_StateCache.Invalidate();
+	m_MeshBinder.Reset();
+	UpdateBones(pCtx, pModel);
+	m_DrawnTriangleCount = 0;
+	m_DrawCallCount = 0;
+	m_DrawStream.Clear();
+	if(pCuller)
 	{
-		for(const auto& Mesh : DrawCmd.pMeshes)
+		for(const auto& Draw : pCuller->GetDraws())
 		{
-            DrawMesh(Mesh, pCtx, DrawCmd.Transformation, pModel);
+			const UINT64 Key = GetSortKey(Draw.pMesh, *Draw.pTransform);
+			const CRtrClusterCuller::SIndexRange* pRanges = pCuller->GetRanges(Draw);
+			for(UINT i = 0; i < Draw.RangeCount; i++)
+			{
+				m_DrawStream.Add(Key, Draw.pMesh, Draw.pTransform, pRanges[i].FirstIndex, pRanges[i].IndexCount);
+			}
 		}
 	}
-}
\ No newline at end of file
+	else
+	{
+		for(const auto& DrawCmd : pModel->GetDrawList())
+		{
+			for(const auto& Mesh : DrawCmd.pMeshes)
+			{
+				const CRtrMesh::SLod Lod = Mesh->GetLod(pLodSelector ? pLodSelector->SelectLod(Mesh, DrawCmd.Transformation) : 0);
+				m_DrawStream.Add(GetSortKey(Mesh, DrawCmd.Transformation), Mesh, &DrawCmd.Transformation, Lod.FirstIndex, Lod.IndexCount);
+			}
+		}
+	}
+	ReplayDrawStream(pCtx);
+}
+
+void CBasicTech::UpdateInstanceBuffer(ID3D11DeviceContext* pCtx, const std::vector<float4x4>& Transforms)
+{
+	if(Transforms.size() > m_InstanceBuffer.Capacity)
+	{
+		ID3D11DevicePtr pDevice;
+		pCtx->GetDevice(&pDevice);
+		m_InstanceBuffer.Capacity = max(UINT(Transforms.size()), m_InstanceBuffer.Capacity * 2);
+
+		D3D11_BUFFER_DESC BufferDesc;
+		BufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		BufferDesc.ByteWidth = sizeof(float4x4) * m_InstanceBuffer.Capacity;
+		BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		BufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		BufferDesc.StructureByteStride = sizeof(float4x4);
+		BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_InstanceBuffer.Buffer));
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC SrvDesc;
+		SrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		SrvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		SrvDesc.Buffer.FirstElement = 0;
+		SrvDesc.Buffer.NumElements = m_InstanceBuffer.Capacity;
+		verify(pDevice->CreateShaderResourceView(m_InstanceBuffer.Buffer, &SrvDesc, &m_InstanceBuffer.Srv));
+	}
+
+	D3D11_MAPPED_SUBRESOURCE MapData;
+	verify(pCtx->Map(m_InstanceBuffer.Buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MapData));
+	float4x4* pInstances = (float4x4*)MapData.pData;
+	for(UINT i = 0; i < Transforms.size(); i++)
+	{
+		Transforms[i].Transpose(pInstances[i]);
+	}
+	pCtx->Unmap(m_InstanceBuffer.Buffer, 0);
+
+	ID3D11ShaderResourceView* pInstancesSRV = m_InstanceBuffer.Srv.GetInterfacePtr();
+	m_StateCache.VSSetShaderResources(2, 1, &pInstancesSRV);
+}
+
+void CBasicTech::DrawBatches(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrInstanceBatcher& Batcher, bool bInstanced)
+{
+	m_StateCache.Invalidate();
+	m_MeshBinder.Reset();
+	UpdateBones(pCtx, pModel);
+	m_DrawnTriangleCount = 0;
+	m_DrawCallCount = 0;
+	m_DrawStream.Clear();  // The batcher does its own sorting
+	if(Batcher.GetTransforms().empty())
+	{
+		return;
+	}
+
+	const auto& Transforms = Batcher.GetTransforms();
+	if(bInstanced)
+	{
+		UpdateInstanceBuffer(pCtx, Transforms);
+	}
+
+	// One record per batch when instancing, otherwise one record per instance
+	const auto& Batches = Batcher.GetBatches();
+	UINT MaxInstances = 1;
+	for(const auto& Batch : Batches)
+	{
+		MaxInstances = max(MaxInstances, Batch.InstanceCount);
+	}
+	m_DrawData.Begin(pCtx, bInstanced ? UINT(Batches.size()) : UINT(Transforms.size()), bInstanced ? MaxInstances : 1);
+	m_Draws.clear();
+	for(const auto& Batch : Batches)
+	{
+		const CRtrMesh* pMesh = Batch.pMesh;
+		const CRtrMesh::SLod Lod = pMesh->GetLod(Batch.Lod);
+		const UINT StartIndex = pMesh->GetFirstIndex() + Lod.FirstIndex;
+		if(bInstanced)
+		{
+			SDraw Draw = { pMesh, Lod.IndexCount, StartIndex, Batch.InstanceCount, AddDrawData(pMesh, float4x4::Identity(), Batch.FirstInstance) };
+			m_Draws.push_back(Draw);
+		}
+		else
+		{
+			// One draw per instance, for comparison. Skinned meshes get the copy transform in the per-draw record
+			for(UINT i = Batch.FirstInstance; i < Batch.FirstInstance + Batch.InstanceCount; i++)
+			{
+				SDraw Draw = { pMesh, Lod.IndexCount, StartIndex, 1, AddDrawData(pMesh, Transforms[i], 0) };
+				m_Draws.push_back(Draw);
+			}
+		}
+		m_DrawnTriangleCount += Batch.InstanceCount * (Lod.IndexCount / 3);
+	}
+	m_DrawData.End(m_StateCache);
+	SubmitDraws(pCtx, bInstanced);
+}
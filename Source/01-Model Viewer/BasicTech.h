@@ -43,10 +43,18 @@ Filename: BasicTech.h
 #pragma once
 #include "Common.h"
 #include "ShaderUtils.h"
+#include "ConstantBufferRing.h"
+#include "DeferredRecorder.h"
+#include "RtrModel\RtrMeshArena.h"
+#include "RtrModel\RtrMeshlets.h"
+#include "RtrModel\RtrMeshSimplifier.h"
+#include "RtrModel\RtrInstancing.h"
+#include "RtrModel\RtrDrawStream.h"
+#include "RtrModel\RtrDrawData.h"
 
 class CRtrModel;
-class CRtrMesh;
 class CRtrAnimationController;
+class CThreadPool;
 
 class CBasicTech
 {
@@ -55,23 +63,89 @@ public:
 	{
 		float4x4 VpMat;
 		float3 LightDirW;
-		float pad0;
+		float pad0 = 0;
 		float3 LightIntensity;
-		float pad1;
+		float pad1 = 0;
 	};
 	verify_cb_size_alignment(SPerFrameData);
 
 	CBasicTech(ID3D11Device* pDevice);
-    void DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel);
+    // If pLodSelector is not null, every mesh is drawn with the LOD it selects for the draw node.
+    // If pCuller is not null, only the index ranges it found visible are drawn. It must have culled the same model, and it does the LOD selection itself
+    void DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrLodSelector* pLodSelector = nullptr, const CRtrClusterCuller* pCuller = nullptr);
+    // Draws the batches with one DrawIndexedInstanced() each, reading the world matrices from the instance buffer.
+    // Without bInstanced, every instance is drawn separately, which is how DrawModel() works
+    void DrawBatches(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrInstanceBatcher& Batcher, bool bInstanced);
 	void PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData, bool bWireframe);
+	UINT GetDrawnTriangleCount() const { return m_DrawnTriangleCount; }
+	UINT GetDrawCallCount() const { return m_DrawCallCount; }
+	// Issued and filtered binds since the last PrepareForDraw(), including the ones on the recording threads
+	CDxStateCache::SStats GetStateStats() const;
+	// Constant block uploads since the last PrepareForDraw()
+	const CConstantBufferRing::SStats& GetConstantStats() const { return m_CbRing.GetStats(); }
+	bool IsBindingConstantsByOffset() const { return m_CbRing.IsUsingOffsets(); }
+	// Records written to the per-draw buffer by the last DrawModel() or DrawBatches(), all in one upload
+	UINT GetDrawRecordCount() const { return m_DrawData.GetDrawCount(); }
+	// Dual-quaternion skinning needs the model to output dual quaternions, see CRtrModel::SetDualQuaternionOutput().
+	// When the model can't provide them, the linear blend shaders are used
+	void SetDualQuaternionSkinning(bool bEnable) { m_bDualQuaternionSkinning = bEnable; }
+	bool IsUsingDualQuaternions() const { return m_bDualQuatBones; }
+	// DrawModel() records the draws into a stream before replaying it. When sorting is enabled, the stream is sorted by shader,
+	// material, vertex format and depth, otherwise the draws are replayed in the draw list order
+	void SetDrawSorting(bool bEnable) { m_bSortDraws = bEnable; }
+	CRtrDrawStream::SStats GetDrawStreamStats() const { return m_DrawStream.GetStats(); }
+	// Records the draws on the pool's threads, each thread into its own deferred context. See CDeferredRecorder.
+	// Null records on the immediate context. The technique leaves the immediate context's state undefined either way
+	void SetRecordingThreadPool(CThreadPool* pThreadPool) { m_pThreadPool = pThreadPool; }
+	const CDeferredRecorder::SStats& GetRecordingStats() const { return m_Recorder.GetStats(); }
+	bool HasDriverCommandLists() const { return m_Recorder.HasDriverCommandLists(); }
+	void SetAllowEmulatedCommandLists(bool bAllow) { m_Recorder.SetAllowEmulatedCommandLists(bAllow); }
 
 private:
-    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat, const CRtrModel* pModel);
-
-	CVertexShaderPtr m_StaticTexVS;
-	CVertexShaderPtr m_AnimatedTexVS;
-    CVertexShaderPtr m_StaticNoTexVS;
-    CVertexShaderPtr m_AnimatedNoTexVS;
+    // A draw of the current pass. DrawModel() and DrawBatches() fill the list, and SubmitDraws() records it
+    struct SDraw
+    {
+        const CRtrMesh* pMesh;
+        UINT IndexCount;
+        UINT StartIndex;  // Includes the mesh's first index
+        UINT InstanceCount;
+        UINT DrawIndex;
+    };
+
+    // State of a chunk recorded on a deferred context
+    struct SRecordingContext
+    {
+        CDxStateCache StateCache;
+        CRtrMeshBinder MeshBinder;
+    };
+
+    // Writes the mesh's record into the per-draw buffer and returns its draw index
+    UINT AddDrawData(const CRtrMesh* pMesh, const float4x4& WorldMat, UINT FirstInstance);
+    void SubmitDraws(ID3D11DeviceContext* pCtx, bool bInstanced);
+    void RecordDraws(CDxStateCache& State, CRtrMeshBinder& MeshBinder, const CDeferredRecorder::SChunk& Chunk, bool bInstanced) const;
+    // Binds what PrepareForDraw() and the uploads of the pass bound on the immediate context
+    void BindPassState(CDxStateCache& State, bool bInstanced) const;
+    void SetMeshState(CDxStateCache& State, CRtrMeshBinder& MeshBinder, const CRtrMesh* pMesh, bool bInstanced) const;
+    UINT64 GetSortKey(const CRtrMesh* pMesh, const float4x4& WorldMat) const;
+    void ReplayDrawStream(ID3D11DeviceContext* pCtx);
+    void UpdateBones(ID3D11DeviceContext* pCtx, const CRtrModel* pModel);
+    void CreateBonesBuffers(ID3D11Device* pDevice, UINT Capacity);
+    void UpdateInstanceBuffer(ID3D11DeviceContext* pCtx, const std::vector<float4x4>& Transforms);
+
+	// One permutation per mesh vertex format, with and without instancing: [bInstanced][Format]
+	CVertexShaderPtr m_StaticTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+	CVertexShaderPtr m_AnimatedTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+    CVertexShaderPtr m_StaticNoTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+    CVertexShaderPtr m_AnimatedNoTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+    CVertexShaderPtr m_DualQuatTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+    CVertexShaderPtr m_DualQuatNoTexVS[2][CRtrMesh::VERTEX_FORMAT_COUNT];
+    CRtrMeshBinder m_MeshBinder;
+    CDxStateCache m_StateCache;
+    CRtrDrawStream m_DrawStream;
+    std::vector<SDraw> m_Draws;
+    CDeferredRecorder m_Recorder;
+    CThreadPool* m_pThreadPool = nullptr;
+    std::vector<SRecordingContext> m_RecordingContexts;  // One per chunk
 
     CPixelShaderPtr m_TexPS;
 	CPixelShaderPtr m_ColorPS;
@@ -79,25 +153,45 @@ private:
     ID3D11RasterizerStatePtr m_pNoCullRastState;
     ID3D11RasterizerStatePtr m_pWireframeRastState;
 
-	ID3D11BufferPtr m_PerFrameCb;
-	ID3D11BufferPtr m_PerModelCb;
+	CConstantBufferRing m_CbRing;
+	SConstantBlock m_PerFrameBlock;
+	CRtrDrawDataBuffer m_DrawData;
+    // Both hold the model's skinning palette, which is every skinned mesh's palette one after the other. They grow as needed
     struct  
     {
         ID3D11BufferPtr Buffer;
         ID3D11ShaderResourceViewPtr Srv;
     } m_BonesBuffer;
+    struct
+    {
+        ID3D11BufferPtr Buffer;
+        ID3D11ShaderResourceViewPtr Srv;
+    } m_DualQuatBuffer;
+    UINT m_BonesCapacity = 0;
+    ID3D11ShaderResourceView* m_pBonesSrv = nullptr;  // The bones bound by UpdateBones(), null if the model has none
+    struct
+    {
+        ID3D11BufferPtr Buffer;
+        ID3D11ShaderResourceViewPtr Srv;
+        UINT Capacity;
+    } m_InstanceBuffer;
 
 	ID3D11SamplerStatePtr m_pLinearSampler;
 
     bool m_bWireframe;
-
-    static const UINT m_MaxBones = 256;
-
-	struct SPerMeshData
+    bool m_bSortDraws = true;
+    SPerFrameData m_PerFrameData;  // Kept to upload the per-frame block again if the ring dropped it
+    bool m_bDualQuaternionSkinning = false;
+    bool m_bDualQuatBones = false;  // Whether the bones of the current model were uploaded as dual quaternions
+    UINT m_DrawnTriangleCount = 0;
+    UINT m_DrawCallCount = 0;
+
+	struct SPerDrawData
 	{
 		int bDoubleSided;
-		int pad[3];
-        float4x4 World;
+		UINT FirstInstance;      // Instanced shaders read the world matrices from the instance buffer, starting here
+		UINT BonePaletteOffset;  // Skinned shaders read the mesh's bones starting here
+		int pad = 0;
+        float4x4 World;          // Transposed
 	};
-	verify_cb_size_alignment(SPerMeshData);
 };
\ No newline at end of file
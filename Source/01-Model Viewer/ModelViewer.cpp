@@ -42,6 +42,11 @@ Filename: ModelViewer.cpp
 #include "ModelViewer.h"
 #include "resource.h"
 #include "RtrModel.h"
+#include "RtrModel\RtrModelLoader.h"
+#include "RtrModel\RtrMeshOptimizer.h"
+#include "RtrModel\RtrAnimationCrowd.h"
+#include "RtrModel\RtrSkinning.h"
+#include "RtrModel\RtrAnimationBake.h"
 #include "BasicTech.h"
 
 #define _USE_MATH_DEFINES
@@ -70,6 +75,71 @@ void CModelViewer::RenderText(ID3D11DeviceContext* pContext)
     m_pTextRenderer->RenderLine(line);
     m_pTextRenderer->RenderLine(GetGlobalSampleMessage());
     m_pTextRenderer->RenderLine(L"Press 'R' to reset the camera position");
+    if(m_pModel)
+    {
+        WCHAR Str[256];
+        swprintf_s(Str, ARRAYSIZE(Str), L"Drawn triangles: %d in %d draw calls, CPU submit %.2fms", m_pBasicTech->GetDrawnTriangleCount(), m_pBasicTech->GetDrawCallCount(), m_DrawSubmitTime * 1000);
+        std::wstring Line = Str;
+        if(m_bBatched)
+        {
+            Line += L", " + std::to_wstring(m_CopyTransforms.size()) + L" copies in " + std::to_wstring(m_InstanceBatcher.GetBatches().size()) + L" batches";
+        }
+        m_pTextRenderer->RenderLine(Line);
+
+        if(m_bBatched == false)
+        {
+            const CRtrDrawStream::SStats StreamStats = m_pBasicTech->GetDrawStreamStats();
+            swprintf_s(Str, ARRAYSIZE(Str), L"Draw stream (%s): %d packets, %d shader / %d material / %d vertex format switches", m_bSortDraws ? L"sorted" : L"draw list order",
+                StreamStats.PacketCount, StreamStats.ShaderSwitches, StreamStats.MaterialSwitches, StreamStats.FormatSwitches);
+            m_pTextRenderer->RenderLine(Str);
+        }
+
+        const CDxStateCache::SStats& StateStats = m_pBasicTech->GetStateStats();
+        m_pTextRenderer->RenderLine(L"State binds: " + std::to_wstring(StateStats.IssuedCalls) + L" issued, " + std::to_wstring(StateStats.FilteredCalls) + L" filtered as redundant");
+        if(m_bDeferredContexts)
+        {
+            const CDeferredRecorder::SStats& RecordStats = m_pBasicTech->GetRecordingStats();
+            if(RecordStats.bDeferred)
+            {
+                swprintf_s(Str, ARRAYSIZE(Str), L"Recording: %d deferred contexts, record %.2fms, execute %.2fms", RecordStats.ChunkCount, RecordStats.RecordTime * 1000, RecordStats.ExecuteTime * 1000);
+            }
+            else
+            {
+                swprintf_s(Str, ARRAYSIZE(Str), L"Recording: immediate context (%s)", m_pBasicTech->HasDriverCommandLists() ? L"too few draws to split" : L"the driver doesn't support command lists");
+            }
+            m_pTextRenderer->RenderLine(Str);
+        }
+        const CConstantBufferRing::SStats& CbStats = m_pBasicTech->GetConstantStats();
+        swprintf_s(Str, ARRAYSIZE(Str), L"Constant blocks (%s): %d uploads, %d skipped as unchanged, %.1f KB. Per-draw records: %d", m_pBasicTech->IsBindingConstantsByOffset() ? L"ring, bound by offset" : L"one buffer per block",
+            CbStats.Uploads, CbStats.SkippedUploads, CbStats.UploadedBytes / 1024.0f, m_pBasicTech->GetDrawRecordCount());
+        m_pTextRenderer->RenderLine(Str);
+    }
+    if(m_pModel && m_pModel->HasBones())
+    {
+        const bool bDualQuat = m_pBasicTech->IsUsingDualQuaternions();
+        const UINT BoneSize = bDualQuat ? sizeof(SRtrDualQuaternion) : sizeof(float4x4);
+        std::wstring Line = bDualQuat ? L"Skinning: dual quaternions" : L"Skinning: linear blend";
+        if(m_bDualQuaternionSkinning && (bDualQuat == false))
+        {
+            Line += L" (the skeleton scales)";
+        }
+        Line += L", " + std::to_wstring(m_pModel->GetSkinningPaletteSize()) + L" palette entries for " + std::to_wstring(m_pModel->GetBonesCount()) + L" bones";
+        m_pTextRenderer->RenderLine(Line + L", " + std::to_wstring(m_pModel->GetSkinningPaletteSize() * BoneSize) + L" bytes of bones per frame");
+    }
+    if(m_pModel && m_bClusterCulling && (m_bBatched == false))
+    {
+        const CRtrClusterCuller::SStats& Stats = m_ClusterCuller.GetStats();
+        m_pTextRenderer->RenderLine(L"Cluster culling: " + std::to_wstring(Stats.ClusterCount) + L" clusters, " + std::to_wstring(UINT(Stats.GetCullRatio() * 100 + 0.5f)) + L"% culled (" +
+            std::to_wstring(Stats.FrustumCulled) + L" frustum, " + std::to_wstring(Stats.BackfaceCulled) + L" backface)");
+    }
+    if(m_pModelLoader)
+    {
+        m_pTextRenderer->RenderLine(m_pModelLoader->GetProgressString());
+    }
+    for(const auto& StatsLine : m_LoadStatsText)
+    {
+        m_pTextRenderer->RenderLine(StatsLine);
+    }
     m_pTextRenderer->End();
 
 }
@@ -80,22 +150,56 @@ void CModelViewer::OnFrameRender(ID3D11Device* pDevice, ID3D11DeviceContext* pCt
 	pCtx->ClearRenderTargetView(m_pDevice->GetBackBufferRTV(), clearColor);
 	pCtx->ClearDepthStencilView(m_pDevice->GetBackBufferDSV(), D3D11_CLEAR_DEPTH, 1.0, 0);
 
+	// The previous model is drawn until the new one is ready
+	PublishLoadedModel();
+
 	if(m_pModel)
 	{
         if(m_ActiveAnimationID != m_SelectedAnimationID)
         {
             m_ActiveAnimationID = m_SelectedAnimationID;
-            m_pModel->SetActiveAnimation(m_ActiveAnimationID);
+            if(m_CrossFadeTime > 0)
+            {
+                m_pModel->CrossFadeToAnimation(m_ActiveAnimationID, m_CrossFadeTime);
+            }
+            else
+            {
+                m_pModel->SetActiveAnimation(m_ActiveAnimationID);
+            }
         }
         float ElapsedTime = m_bAnimate ? m_Timer.GetElapsedTime() : 0;
+        m_pModel->SetDualQuaternionOutput(m_bDualQuaternionSkinning);
         m_pModel->Animate(ElapsedTime);
+        m_pBasicTech->SetDualQuaternionSkinning(m_bDualQuaternionSkinning);
+        m_pBasicTech->SetDrawSorting(m_bSortDraws);
+        m_pBasicTech->SetRecordingThreadPool(m_bDeferredContexts ? m_pThreadPool.get() : nullptr);
 
         CBasicTech::SPerFrameData TechCB;
         TechCB.VpMat = m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix();
         TechCB.LightIntensity = m_LightIntensity;
         TechCB.LightDirW = m_LightDir;
         m_pBasicTech->PrepareForDraw(pCtx, TechCB, m_bWireframe);
-        m_pBasicTech->DrawModel(pCtx, m_pModel.get());
+        CRtrLodSelector LodSelector(m_Camera);
+        const CRtrLodSelector* pLodSelector = m_bAutomaticLod ? &LodSelector : nullptr;
+        auto SubmitStart = std::chrono::high_resolution_clock::now();
+        m_bBatched = m_bInstancing || (m_StressCopies > 1);
+        if(m_bBatched)
+        {
+            // Cluster culling works on draw nodes, so it doesn't apply to the batches
+            UpdateCopyTransforms();
+            m_InstanceBatcher.Build(m_pModel.get(), m_CopyTransforms, pLodSelector);
+            m_pBasicTech->DrawBatches(pCtx, m_pModel.get(), m_InstanceBatcher, m_bInstancing);
+        }
+        else if(m_bClusterCulling)
+        {
+            m_ClusterCuller.Cull(m_pModel.get(), TechCB.VpMat, m_Camera.GetPosition(), pLodSelector);
+            m_pBasicTech->DrawModel(pCtx, m_pModel.get(), pLodSelector, &m_ClusterCuller);
+        }
+        else
+        {
+            m_pBasicTech->DrawModel(pCtx, m_pModel.get(), pLodSelector);
+        }
+        m_DrawSubmitTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - SubmitStart).count();
 	}
 
     RenderText(pCtx);
@@ -105,7 +209,27 @@ void CModelViewer::InitUI()
 {
 	CGui::SetGlobalHelpMessage("Sample application to load and display a model.\nUse the UI to switch between wireframe and solid mode.");
 	m_pAppGui->AddButton("Load Model", &CModelViewer::LoadModelCallback, this);
+	m_pAppGui->AddButton("Benchmark Load Scaling", &CModelViewer::BenchmarkLoadCallback, this);
+	m_pAppGui->AddButton("Compare OBJ Importers", &CModelViewer::CompareObjImportersCallback, this);
+	m_pAppGui->AddButton("Mesh Optimization Report", &CModelViewer::MeshOptimizationReportCallback, this);
+	m_pAppGui->AddButton("Draw Sort Report", &CModelViewer::DrawSortReportCallback, this);
+	m_pAppGui->AddButton("Submission Scaling Report", &CModelViewer::SubmissionScalingReportCallback, this);
+	m_pAppGui->AddButton("Run Self Checks", &CModelViewer::SelfChecksCallback, this);
 	m_pAppGui->AddCheckBox("Wireframe", &m_bWireframe);
+	m_pAppGui->AddCheckBox("Compact Vertices (on load)", &m_bCompactVertices);
+	m_pAppGui->AddCheckBox("Cluster Culling", &m_bClusterCulling);
+	m_pAppGui->AddCheckBox("Automatic LOD", &m_bAutomaticLod);
+	m_pAppGui->AddCheckBox("Instancing", &m_bInstancing);
+	m_pAppGui->AddCheckBox("Sort Draws", &m_bSortDraws);
+	m_pAppGui->AddCheckBox("Deferred Contexts", &m_bDeferredContexts);
+
+	CGui::dropdown_list CopiesList;
+	for(int Copies = 1; Copies <= 4096; Copies *= 4)
+	{
+		CGui::SDropdownValue Value = { Copies, std::to_string(Copies) };
+		CopiesList.push_back(Value);
+	}
+	m_pAppGui->AddDropdown("Stress Copies", CopiesList, &m_StressCopies);
 	m_pAppGui->AddDir3FVar("Light Direction", &m_LightDir);
 	m_pAppGui->AddRgbColor("Light Intensity", &m_LightIntensity);
 }
@@ -115,6 +239,14 @@ void CModelViewer::SetAnimationUIElements()
     bool bAnim = m_pModel && m_pModel->HasAnimations();
     static const char* AnimateStr = "Animate";
     static const char* ActiveAnimStr = "Active Animation";
+    static const char* CrossFadeStr = "Cross-Fade Time";
+    static const char* DualQuatStr = "Dual-Quaternion Skinning";
+    static const char* BenchmarkStr = "Benchmark Animation Sampling";
+    static const char* CompressionStr = "Animation Compression Report";
+    static const char* CrowdStr = "Benchmark Crowd Animation";
+    static const char* CpuSkinningStr = "Benchmark CPU Skinning";
+    static const char* BakedStr = "Baked Animation Report";
+    static const char* LodStr = "Animation LOD Report";
 
     if(bAnim)
     {
@@ -136,11 +268,27 @@ void CModelViewer::SetAnimationUIElements()
             }
         }
         m_pAppGui->AddDropdown(ActiveAnimStr, List, &m_SelectedAnimationID);
+        m_pAppGui->AddFloatVar(CrossFadeStr, &m_CrossFadeTime, "", 0, 2, 0.05f);
+        m_pAppGui->AddCheckBox(DualQuatStr, &m_bDualQuaternionSkinning);
+        m_pAppGui->AddButton(BenchmarkStr, &CModelViewer::BenchmarkAnimationCallback, this);
+        m_pAppGui->AddButton(CompressionStr, &CModelViewer::AnimationCompressionReportCallback, this);
+        m_pAppGui->AddButton(CrowdStr, &CModelViewer::BenchmarkCrowdCallback, this);
+        m_pAppGui->AddButton(CpuSkinningStr, &CModelViewer::BenchmarkCpuSkinningCallback, this);
+        m_pAppGui->AddButton(BakedStr, &CModelViewer::BakedAnimationReportCallback, this);
+        m_pAppGui->AddButton(LodStr, &CModelViewer::AnimationLodReportCallback, this);
     }
     else
     {
         m_pAppGui->RemoveVar(AnimateStr);
         m_pAppGui->RemoveVar(ActiveAnimStr);
+        m_pAppGui->RemoveVar(CrossFadeStr);
+        m_pAppGui->RemoveVar(DualQuatStr);
+        m_pAppGui->RemoveVar(BenchmarkStr);
+        m_pAppGui->RemoveVar(CompressionStr);
+        m_pAppGui->RemoveVar(CrowdStr);
+        m_pAppGui->RemoveVar(CpuSkinningStr);
+        m_pAppGui->RemoveVar(BakedStr);
+        m_pAppGui->RemoveVar(LodStr);
     }
 }
 
@@ -181,20 +329,640 @@ void CModelViewer::LoadModel()
 	
 	if(GetOpenFileName(&ofn))
 	{
-        m_pModel = CRtrModel::CreateFromFile(filename, m_pDevice->GetD3DDevice());
-		
-		if(m_pModel.get() == NULL)
-		{
-			trace(L"Could not load model");
-			return;
-		}
-
-        SetAnimationUIElements();
-        ResetCamera();
-        m_Timer.ResetClock();
+        // Loading happens on the thread-pool. Replacing an existing loader cancels it
+        m_pModelLoader = std::make_unique<CRtrModelLoader>(filename, pDevice, m_pThreadPool.get(), GetLoadFlags());
 	}
 }
 
+void CModelViewer::PublishLoadedModel()
+{
+    if((m_pModelLoader == nullptr) || (m_pModelLoader->IsReady() == false))
+    {
+        return;
+    }
+
+    std::unique_ptr<CRtrModel> pModel = m_pModelLoader->GetModel();
+    std::wstring Filename = m_pModelLoader->GetFilename();
+    m_pModelLoader = nullptr;
+
+    if(pModel.get() == NULL)
+    {
+        trace(L"Could not load model");
+        return;
+    }
+
+    m_pModel = std::move(pModel);
+    m_ModelFilename = Filename;
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(GetLoadStatsString(m_pModel.get()));
+    m_LoadStatsText.push_back(GetVertexMemoryString(m_pModel.get()));
+    OnModelLoaded();
+}
+
+UINT CModelViewer::GetLoadFlags() const
+{
+    return m_bCompactVertices ? CRtrModel::LOAD_FLAGS_COMPACT_VERTICES : CRtrModel::LOAD_FLAGS_NONE;
+}
+
+std::wstring CModelViewer::GetVertexMemoryString(const CRtrModel* pModel) const
+{
+    float Size = float(pModel->GetVertexBufferSize());
+    float FullSize = float(pModel->GetFullVertexBufferSize());
+    float Saved = FullSize - Size;
+    WCHAR Str[256];
+    swprintf_s(Str, ARRAYSIZE(Str), L"Vertex data: %.1fKB, %.1fKB saved (%.0f%%)", Size / 1024, Saved / 1024, (FullSize > 0) ? Saved * 100 / FullSize : 0);
+    return Str;
+}
+
+std::wstring CModelViewer::GetIndexMetricsString(const CRtrMesh::SIndexMetrics& Before, const CRtrMesh::SIndexMetrics& After)
+{
+    WCHAR Str[256];
+    swprintf_s(Str, ARRAYSIZE(Str), L"ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overdraw %.3f -> %.3f",
+        Before.Acmr, After.Acmr, Before.Atvr, After.Atvr, Before.Overdraw, After.Overdraw);
+    return Str;
+}
+
+void CModelViewer::OnModelLoaded()
+{
+    SetAnimationUIElements();
+    m_CopyTransforms.clear();
+    ResetCamera();
+    m_Timer.ResetClock();
+}
+
+std::wstring CModelViewer::GetLoadStatsString(const CRtrModel* pModel) const
+{
+    const CRtrModel::SLoadStats& Stats = pModel->GetLoadStats();
+    WCHAR Str[256];
+    if(Stats.bFromCache)
+    {
+        swprintf_s(Str, ARRAYSIZE(Str), L"Loaded from cache in %.1fms (map %.1fms, create %.1fms)",
+            Stats.TotalTime * 1000, Stats.ImportTime * 1000, Stats.CreateTime * 1000);
+    }
+    else
+    {
+        swprintf_s(Str, ARRAYSIZE(Str), L"%2d threads: loaded in %.1fms (import %.1fms, pack %.1fms, create %.1fms)",
+            Stats.ThreadCount, Stats.TotalTime * 1000, Stats.ImportTime * 1000, Stats.PackTime * 1000, Stats.CreateTime * 1000);
+    }
+    return Str;
+}
+
+void GUI_CALL CModelViewer::BenchmarkLoadCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->BenchmarkLoad();
+}
+
+void CModelViewer::BenchmarkLoad()
+{
+    if(m_ModelFilename.size() == 0)
+    {
+        trace(L"Load a model before running the benchmark");
+        return;
+    }
+
+    // Resizing the pool joins the workers, so a pending load would block us inside SetThreadCount(). Let it finish first,
+    // the benchmark then runs on the model it loaded
+    if(m_pModelLoader)
+    {
+        m_pModelLoader->Wait();
+        PublishLoadedModel();
+    }
+
+    // Reimport the current model with a growing number of threads. The cache is bypassed, so we measure the entire import pipeline.
+    // The current model is only replaced once a reimport succeeded
+    std::unique_ptr<CRtrModel> pLoaded;
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"Load time scaling:");
+    const UINT MaxThreads = CThreadPool::GetHardwareThreadCount();
+    for(UINT ThreadCount = 1; ; ThreadCount = min(ThreadCount * 2, MaxThreads))
+    {
+        m_pThreadPool->SetThreadCount(ThreadCount);
+        pLoaded = nullptr;
+        std::unique_ptr<CRtrModel> pModel = CRtrModel::CreateFromFile(m_ModelFilename, m_pDevice->GetD3DDevice(), CRtrModel::LOAD_FLAGS_IGNORE_CACHE | GetLoadFlags(), m_pThreadPool.get());
+        if(pModel == nullptr)
+        {
+            m_LoadStatsText.push_back(L"The reimport failed, keeping the current model");
+            break;
+        }
+        m_LoadStatsText.push_back(GetLoadStatsString(pModel.get()));
+        pLoaded = std::move(pModel);
+
+        if(ThreadCount == MaxThreads)
+        {
+            break;
+        }
+    }
+
+    m_pThreadPool->SetThreadCount(MaxThreads);
+    if(pLoaded)
+    {
+        m_pModel = std::move(pLoaded);
+        OnModelLoaded();
+    }
+}
+
+void GUI_CALL CModelViewer::CompareObjImportersCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->CompareObjImporters();
+}
+
+static void FindObjFiles(const std::wstring& Folder, std::vector<std::wstring>& Files)
+{
+    WIN32_FIND_DATA FindData;
+    HANDLE hFind = FindFirstFile((Folder + L"\\*").c_str(), &FindData);
+    if(hFind == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        std::wstring Name = FindData.cFileName;
+        if(FindData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if(Name != L"." && Name != L"..")
+            {
+                FindObjFiles(Folder + L'\\' + Name, Files);
+            }
+        }
+        else if(HasSuffix(Name, std::wstring(L".obj"), false))
+        {
+            Files.push_back(Folder + L'\\' + Name);
+        }
+    } while(FindNextFile(hFind, &FindData));
+    FindClose(hFind);
+}
+
+void CModelViewer::CompareObjImporters()
+{
+    std::vector<std::wstring> Files;
+    FindObjFiles(GetExecutableDirectory() + L"\\..\\..\\..\\Media\\Models", Files);
+
+    // Import every OBJ model with both importers, bypassing the cache. The current model is not replaced
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"OBJ import time, native vs. Assimp:");
+    ID3D11Device* pDevice = m_pDevice->GetD3DDevice();
+    for(const auto& File : Files)
+    {
+        auto pNative = CRtrModel::CreateFromFile(File, pDevice, CRtrModel::LOAD_FLAGS_IGNORE_CACHE, m_pThreadPool.get());
+        auto pAssimp = CRtrModel::CreateFromFile(File, pDevice, CRtrModel::LOAD_FLAGS_IGNORE_CACHE | CRtrModel::LOAD_FLAGS_FORCE_ASSIMP, m_pThreadPool.get());
+        if(pNative == nullptr || pAssimp == nullptr)
+        {
+            continue;
+        }
+
+        float NativeTime = pNative->GetLoadStats().TotalTime;
+        float AssimpTime = pAssimp->GetLoadStats().TotalTime;
+        WCHAR Str[512];
+        swprintf_s(Str, ARRAYSIZE(Str), L"%s: native %.1fms, Assimp %.1fms (%.1fx). Vertices %d/%d, triangles %d/%d",
+            File.substr(File.find_last_of(L'\\') + 1).c_str(), NativeTime * 1000, AssimpTime * 1000, AssimpTime / NativeTime,
+            pNative->GetVertexCount(), pAssimp->GetVertexCount(), pNative->GetPrimitiveCount(), pAssimp->GetPrimitiveCount());
+        m_LoadStatsText.push_back(Str);
+    }
+}
+
+void GUI_CALL CModelViewer::MeshOptimizationReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->MeshOptimizationReport();
+}
+
+void CModelViewer::MeshOptimizationReport()
+{
+    if(m_ModelFilename.size() == 0)
+    {
+        trace(L"Load a model before running the report");
+        return;
+    }
+
+    // The metrics are too slow to measure on every import, so the current model is imported again with them. They are measured when the meshes
+    // are packed, before and after CRtrMeshOptimizer. The current model is not replaced. There's only room for so many lines
+    std::unique_ptr<CRtrModel> pModel = CRtrModel::CreateFromFile(m_ModelFilename, m_pDevice->GetD3DDevice(), CRtrModel::LOAD_FLAGS_INDEX_METRICS | GetLoadFlags(), m_pThreadPool.get());
+    if(pModel == nullptr)
+    {
+        trace(L"Could not load model");
+        return;
+    }
+
+    static const UINT MaxMeshLines = 40;
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"Vertex cache (FIFO, " + std::to_wstring(CRtrMeshOptimizer::DEFAULT_CACHE_SIZE) + L" entries) and overdraw, imported -> optimized:");
+    m_LoadStatsText.push_back(L"Model: " + GetIndexMetricsString(pModel->GetImportedIndexMetrics(), pModel->GetIndexMetrics()));
+    for(UINT i = 0; i < min(pModel->GetMeshCount(), MaxMeshLines); i++)
+    {
+        const CRtrMesh* pMesh = pModel->GetMesh(i);
+        std::wstring Line = L"Mesh " + std::to_wstring(i) + L" (" + std::to_wstring(pMesh->GetIndexCount() / 3) + L" triangles): ";
+        Line += GetIndexMetricsString(pMesh->GetImportedIndexMetrics(), pMesh->GetIndexMetrics());
+        for(UINT Lod = 1; Lod < pMesh->GetLodCount(); Lod++)
+        {
+            Line += (Lod == 1) ? L", LODs: " : L" / ";
+            Line += std::to_wstring(pMesh->GetLod(Lod).IndexCount / 3);
+        }
+        m_LoadStatsText.push_back(Line);
+    }
+
+    if(pModel->GetMeshCount() > MaxMeshLines)
+    {
+        m_LoadStatsText.push_back(L"... and " + std::to_wstring(pModel->GetMeshCount() - MaxMeshLines) + L" more meshes");
+    }
+}
+
+void GUI_CALL CModelViewer::DrawSortReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->DrawSortReport();
+}
+
+void CModelViewer::DrawSortReport()
+{
+    if(m_pModel == nullptr)
+    {
+        trace(L"Load a model before running the report");
+        return;
+    }
+
+    // Records the draw list from the current camera, the same way the technique does, and compares the state switches before and after sorting
+    const float4x4 VpMat = m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix();
+    CRtrDrawStream Stream;
+    Stream.AddDrawList(m_pModel.get(), 0, nullptr, &VpMat);
+    const CRtrDrawStream::SStats Unsorted = Stream.GetStats();
+    Stream.Sort();
+    const CRtrDrawStream::SStats Sorted = Stream.GetStats();
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    swprintf_s(Str, ARRAYSIZE(Str), L"Draw stream, %d packets (shader / material / vertex format switches):", Sorted.PacketCount);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Draw list order: %d / %d / %d", Unsorted.ShaderSwitches, Unsorted.MaterialSwitches, Unsorted.FormatSwitches);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Sorted: %d / %d / %d", Sorted.ShaderSwitches, Sorted.MaterialSwitches, Sorted.FormatSwitches);
+    m_LoadStatsText.push_back(Str);
+
+    // Recording and sorting cost, with the draw list recorded once per stress copy to get a meaningful packet count
+    static const UINT Iterations = 100;
+    static const UINT Copies = 256;
+    auto Start = std::chrono::high_resolution_clock::now();
+    for(UINT i = 0; i < Iterations; i++)
+    {
+        Stream.Clear();
+        for(UINT Copy = 0; Copy < Copies; Copy++)
+        {
+            Stream.AddDrawList(m_pModel.get(), 0, nullptr, &VpMat);
+        }
+    }
+    const float RecordTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() / Iterations;
+
+    std::vector<CRtrDrawStream::SPacket> Recorded = Stream.GetPackets();
+    float SortTime = 0;
+    for(UINT i = 0; i < Iterations; i++)
+    {
+        Stream.Clear();
+        for(const auto& Packet : Recorded)
+        {
+            Stream.Add(Packet.SortKey, Packet.pMesh, Packet.pTransform, Packet.FirstIndex, Packet.IndexCount);
+        }
+        Start = std::chrono::high_resolution_clock::now();
+        Stream.Sort();
+        SortTime += std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count();
+    }
+    SortTime /= Iterations;
+
+    swprintf_s(Str, ARRAYSIZE(Str), L"%d packets: record %.3fms, radix sort %.3fms (%.1f ns per packet)", UINT(Recorded.size()), RecordTime * 1000, SortTime * 1000, SortTime * 1e9f / max(Recorded.size(), size_t(1)));
+    m_LoadStatsText.push_back(Str);
+}
+
+void GUI_CALL CModelViewer::SubmissionScalingReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->SubmissionScalingReport();
+}
+
+void CModelViewer::SubmissionScalingReport()
+{
+    if(m_pModel == nullptr)
+    {
+        trace(L"Load a model before running the report");
+        return;
+    }
+
+    // The stress scene is the largest grid of copies, drawn with one draw call per mesh per copy. It's submitted on the immediate context,
+    // then recorded on deferred contexts with a growing number of threads. Only the CPU submission is timed, the GPU is flushed between the frames
+    static const UINT Copies = 4096;
+    static const UINT FrameCount = 16;
+    const UINT SavedCopies = m_StressCopies;
+    m_StressCopies = Copies;
+    UpdateCopyTransforms();
+    m_InstanceBatcher.Build(m_pModel.get(), m_CopyTransforms, nullptr);
+
+    ID3D11DeviceContext* pCtx = m_pDevice->GetImmediateContext();
+    CBasicTech::SPerFrameData TechCB;
+    TechCB.VpMat = m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix();
+    TechCB.LightIntensity = m_LightIntensity;
+    TechCB.LightDirW = m_LightDir;
+
+    // The emulated command lists are measured too, the report says which ones we got
+    m_pBasicTech->SetAllowEmulatedCommandLists(true);
+    auto TimeSubmit = [&](CThreadPool* pThreadPool) -> float
+    {
+        m_pBasicTech->SetRecordingThreadPool(pThreadPool);
+        float Time = 0;
+        for(UINT Frame = 0; Frame <= FrameCount; Frame++)
+        {
+            m_pBasicTech->PrepareForDraw(pCtx, TechCB, false);
+            auto Start = std::chrono::high_resolution_clock::now();
+            m_pBasicTech->DrawBatches(pCtx, m_pModel.get(), m_InstanceBatcher, false);
+            // The first frame creates the deferred contexts and the input layouts
+            if(Frame > 0)
+            {
+                Time += std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count();
+            }
+            pCtx->Flush();
+        }
+        return Time / FrameCount;
+    };
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    const float ImmediateTime = TimeSubmit(nullptr);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Submission scaling, %d copies, %d draws. Command lists: %s", Copies, m_pBasicTech->GetDrawCallCount(),
+        m_pBasicTech->HasDriverCommandLists() ? L"driver" : L"emulated by the runtime");
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Immediate context: %.2fms", ImmediateTime * 1000);
+    m_LoadStatsText.push_back(Str);
+
+    const UINT MaxThreads = CThreadPool::GetHardwareThreadCount();
+    for(UINT ThreadCount = min(2U, MaxThreads); ThreadCount > 1; ThreadCount = min(ThreadCount * 2, MaxThreads))
+    {
+        m_pThreadPool->SetThreadCount(ThreadCount);
+        const float Time = TimeSubmit(m_pThreadPool.get());
+        const CDeferredRecorder::SStats& Stats = m_pBasicTech->GetRecordingStats();
+        swprintf_s(Str, ARRAYSIZE(Str), L"%2d deferred contexts: %.2fms (record %.2fms, execute %.2fms), %.1fx", Stats.ChunkCount, Time * 1000,
+            Stats.RecordTime * 1000, Stats.ExecuteTime * 1000, ImmediateTime / Time);
+        m_LoadStatsText.push_back(Str);
+
+        if(ThreadCount == MaxThreads)
+        {
+            break;
+        }
+    }
+
+    m_pThreadPool->SetThreadCount(MaxThreads);
+    m_pBasicTech->SetAllowEmulatedCommandLists(false);
+    m_StressCopies = SavedCopies;
+    UpdateCopyTransforms();
+}
+
+void GUI_CALL CModelViewer::SelfChecksCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->SelfChecks();
+}
+
+void CModelViewer::SelfChecks()
+{
+    // Device-free checks of the submission code. The failing checks are traced
+    struct SSelfCheck
+    {
+        const WCHAR* Name;
+        bool (*Run)();
+    };
+    static const SSelfCheck Checks[] =
+    {
+        { L"State cache filtering", &CDxStateCache::SelfCheck },
+        { L"Draw stream sort keys and radix sort", &CRtrDrawStream::SelfCheck },
+        { L"Deferred recording chunks", &CDeferredRecorder::SelfCheck },
+    };
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"Self checks:");
+    for(const auto& Check : Checks)
+    {
+        swprintf_s(Str, ARRAYSIZE(Str), L"%s: %s", Check.Name, Check.Run() ? L"passed" : L"FAILED");
+        m_LoadStatsText.push_back(Str);
+    }
+}
+
+void GUI_CALL CModelViewer::BenchmarkAnimationCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->BenchmarkAnimation();
+}
+
+void CModelViewer::BenchmarkAnimation()
+{
+    if(m_pModel == nullptr || m_pModel->HasAnimations() == false)
+    {
+        trace(L"Load an animated model before running the benchmark");
+        return;
+    }
+
+    // Benchmarks the selected animation, or the first one when showing the bind pose
+    static const UINT SampleCount = 10000;
+    const UINT AnimationID = (m_SelectedAnimationID == BIND_POSE_ANIMATION_ID) ? 0 : m_SelectedAnimationID;
+    const auto Result = m_pModel->GetAnimationController()->BenchmarkSampling(AnimationID, SampleCount);
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    swprintf_s(Str, ARRAYSIZE(Str), L"Animation sampling, %d bones, %d samples (ns per bone, playback / seek):", m_pModel->GetBonesCount(), Result.SampleCount);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Scalar: %.1f / %.1f", Result.ScalarPlaybackNs, Result.ScalarSeekNs);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"SIMD slerp: %.1f / %.1f, max error %.2g", Result.SlerpPlaybackNs, Result.SlerpSeekNs, Result.SlerpMaxError);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"SIMD nlerp: %.1f / %.1f, max error %.2g", Result.NlerpPlaybackNs, Result.NlerpSeekNs, Result.NlerpMaxError);
+    m_LoadStatsText.push_back(Str);
+
+    const auto Hierarchy = m_pModel->GetAnimationController()->BenchmarkHierarchy(AnimationID, SampleCount);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Hierarchy update, %d animated bones (ns per bone):", Hierarchy.AnimatedBoneCount);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"All bones: %.1f, static bones skipped: %.1f, max error %.2g", Hierarchy.FullNs, Hierarchy.SkippingNs, Hierarchy.MaxError);
+    m_LoadStatsText.push_back(Str);
+}
+
+void GUI_CALL CModelViewer::AnimationCompressionReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->AnimationCompressionReport();
+}
+
+void CModelViewer::AnimationCompressionReport()
+{
+    if(m_pModel == nullptr || m_pModel->HasAnimations() == false)
+    {
+        trace(L"Load an animated model before running the report");
+        return;
+    }
+
+    // The errors are measured against the imported keys when the clips are compressed
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"Animation compression (keys, size, max local position/angle error, max bone error in model space):");
+    const CRtrAnimationController* pController = m_pModel->GetAnimationController();
+    for(UINT i = 0; i < pController->GetAnimationsCount(); i++)
+    {
+        const CRtrAnimation::SCompressionStats& Stats = pController->GetAnimation(i)->GetCompressionStats();
+        WCHAR Str[512];
+        swprintf_s(Str, ARRAYSIZE(Str), L"%s: %d -> %d keys, %.1fKB -> %.1fKB (%.1fx), error %.4f / %.3f deg, bone %.4f",
+            string_2_wstring(pController->GetAnimationName(i)).c_str(), Stats.RawKeyCount, Stats.KeyCount, Stats.RawSize / 1024.0f, Stats.CompressedSize / 1024.0f,
+            Stats.RawSize / float(max(Stats.CompressedSize, 1u)), Stats.MaxPositionError, Stats.MaxAngleError * 180 / float(M_PI), Stats.MaxBoneError);
+        m_LoadStatsText.push_back(Str);
+    }
+}
+
+void GUI_CALL CModelViewer::BenchmarkCrowdCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->BenchmarkCrowd();
+}
+
+void CModelViewer::BenchmarkCrowd()
+{
+    if(m_pModel == nullptr || m_pModel->HasAnimations() == false)
+    {
+        trace(L"Load an animated model before running the benchmark");
+        return;
+    }
+
+    // Every instance plays one of the model's clips from a different start time. Each crowd is updated on the main thread only,
+    // then on the whole thread pool
+    static const UINT FrameCount = 30;
+    static const UINT CrowdSizes[] = { 1000, 2500, 5000, 10000 };
+    const CRtrAnimationController* pController = m_pModel->GetAnimationController();
+    m_LoadStatsText.clear();
+    m_LoadStatsText.push_back(L"Crowd animation, " + std::to_wstring(pController->GetBonesCount()) + L" bones per instance (ms per frame, ns per bone):");
+
+    for(UINT Size : CrowdSizes)
+    {
+        CRtrAnimationCrowd Crowd(pController);
+        Crowd.Resize(Size);
+        for(UINT i = 0; i < Size; i++)
+        {
+            const UINT AnimationID = i % pController->GetAnimationsCount();
+            Crowd.SetInstanceAnimation(i, AnimationID, float(i) * 0.618034f);
+        }
+
+        auto TimeUpdate = [&](CThreadPool* pThreadPool) -> float
+        {
+            Crowd.Update(0, pThreadPool);  // Warm up
+            auto Start = std::chrono::high_resolution_clock::now();
+            for(UINT Frame = 0; Frame < FrameCount; Frame++)
+            {
+                Crowd.Update(1.0f / 60.0f, pThreadPool);
+            }
+            return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() / FrameCount;
+        };
+
+        const float SerialTime = TimeUpdate(nullptr);
+        const float ParallelTime = TimeUpdate(m_pThreadPool.get());
+        const float BonesPerFrame = float(Size * pController->GetBonesCount());
+        WCHAR Str[256];
+        swprintf_s(Str, ARRAYSIZE(Str), L"%5d instances: 1 thread %.2fms (%.1fns), %d threads %.2fms (%.1fns), %.1fx",
+            Size, SerialTime * 1000, SerialTime * 1e9f / BonesPerFrame, m_pThreadPool->GetThreadCount(), ParallelTime * 1000, ParallelTime * 1e9f / BonesPerFrame,
+            SerialTime / ParallelTime);
+        m_LoadStatsText.push_back(Str);
+    }
+}
+
+void GUI_CALL CModelViewer::AnimationLodReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->AnimationLodReport();
+}
+
+void CModelViewer::AnimationLodReport()
+{
+    if(m_pModel == nullptr || m_pModel->HasAnimations() == false)
+    {
+        trace(L"Load an animated model before running the report");
+        return;
+    }
+
+    // A square grid of instances around the model, seen from the current camera. The crowd is updated with every instance at full rate,
+    // then with the LOD that the policy picks for each instance
+    static const UINT Side = 50;
+    static const UINT FrameCount = 64;
+    const CRtrAnimationController* pController = m_pModel->GetAnimationController();
+    const float Spacing = m_pModel->GetRadius() * 2.5f;
+    const float4x4 ViewProj = m_Camera.GetViewMatrix() * m_Camera.GetProjMatrix();
+    CRtrAnimationLodPolicy Policy(m_Camera, ViewProj);
+
+    CRtrAnimationCrowd Crowd(pController);
+    Crowd.Resize(Side * Side);
+    std::vector<SRtrAnimationLod> Lods(Side * Side);
+    UINT IntervalCounts[9] = { 0 };
+    for(UINT i = 0; i < Side * Side; i++)
+    {
+        Crowd.SetInstanceAnimation(i, i % pController->GetAnimationsCount(), float(i) * 0.618034f);
+        float x = (float(i % Side) - float(Side - 1) * 0.5f) * Spacing;
+        float z = (float(i / Side) - float(Side - 1) * 0.5f) * Spacing;
+        Lods[i] = Policy.Select(m_pModel->GetCenter() + float3(x, 0, z), m_pModel->GetRadius());
+        IntervalCounts[Lods[i].bVisible ? Lods[i].UpdateInterval : 0]++;
+    }
+
+    auto TimeUpdate = [&](UINT& BonesEvaluated) -> float
+    {
+        Crowd.Update(0, m_pThreadPool.get());  // Warm up
+        BonesEvaluated = 0;
+        auto Start = std::chrono::high_resolution_clock::now();
+        for(UINT Frame = 0; Frame < FrameCount; Frame++)
+        {
+            Crowd.Update(1.0f / 60.0f, m_pThreadPool.get());
+            BonesEvaluated += Crowd.GetStats().BonesEvaluated;
+        }
+        return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() / FrameCount;
+    };
+
+    UINT FullBones, LodBones;
+    const float FullTime = TimeUpdate(FullBones);
+    for(UINT i = 0; i < Side * Side; i++)
+    {
+        Crowd.SetInstanceLod(i, Lods[i]);
+    }
+    const float LodTime = TimeUpdate(LodBones);
+
+    m_LoadStatsText.clear();
+    WCHAR Str[256];
+    swprintf_s(Str, ARRAYSIZE(Str), L"Animation LOD, %d instances of %d bones, %d threads:", Side * Side, pController->GetBonesCount(), m_pThreadPool->GetThreadCount());
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Instances: %d every frame, %d every 2, %d every 4, %d every 8, %d off-screen",
+        IntervalCounts[1], IntervalCounts[2], IntervalCounts[4], IntervalCounts[8], IntervalCounts[0]);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Full rate: %.2fms, %d bones evaluated per frame", FullTime * 1000, FullBones / FrameCount);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"LOD: %.2fms, %d bones evaluated per frame, %.1fx", LodTime * 1000, LodBones / FrameCount, FullTime / LodTime);
+    m_LoadStatsText.push_back(Str);
+}
+
+void CModelViewer::UpdateCopyTransforms()
+{
+    if(m_CopyTransforms.size() == m_StressCopies)
+    {
+        return;
+    }
+
+    // A square grid on the XZ plane, centered on the model. The camera is moved back so that it sees the whole grid
+    const UINT Side = UINT(ceilf(sqrtf(float(m_StressCopies))));
+    const float Spacing = m_pModel->GetRadius() * 2.5f;
+    m_CopyTransforms.clear();
+    for(UINT i = 0; i < m_StressCopies; i++)
+    {
+        float x = (float(i % Side) - float(Side - 1) * 0.5f) * Spacing;
+        float z = (float(i / Side) - float(Side - 1) * 0.5f) * Spacing;
+        m_CopyTransforms.push_back(float4x4::CreateTranslation(x, 0, z));
+    }
+
+    if(Side == 1)
+    {
+        ResetCamera();
+    }
+    else
+    {
+        m_Camera.SetModelParams(m_pModel->GetCenter(), Spacing * Side * 0.75f);
+    }
+}
+
 void CModelViewer::ResetCamera()
 {
     if(m_pModel)
@@ -231,3 +999,99 @@ int WINAPI WinMain(__in HINSTANCE hInstance, __in_opt HINSTANCE hPrevInstance, _
 	p.Run(gWindowName, gWidth, gHeight, gSampleCount, hIcon);
 	return 0;
 }
+
+void GUI_CALL CModelViewer::BenchmarkCpuSkinningCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->BenchmarkCpuSkinning();
+}
+
+void CModelViewer::BenchmarkCpuSkinning()
+{
+    if(m_pModel == nullptr || m_pModel->HasBones() == false)
+    {
+        trace(L"Load an animated model before running the benchmark");
+        return;
+    }
+
+    // Skins the current pose. The result should match the vertex shader to within rounding
+    static const UINT IterationCount = 100;
+    static const float Tolerance = 1e-5f;
+    const auto Result = CRtrCpuSkinner::Benchmark(m_pModel.get(), IterationCount, m_pThreadPool.get());
+    // The benchmark is the only CPU skinning in the viewer, so the decoded vertices go away with it
+    for(UINT i = 0; i < m_pModel->GetMeshCount(); i++)
+    {
+        m_pModel->GetMesh(i)->ReleaseSkinningVertices();
+    }
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    swprintf_s(Str, ARRAYSIZE(Str), L"CPU skinning, %d vertices (million vertices per second):", Result.VertexCount);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"1 thread: %.1f, %d threads: %.1f, %.1fx", Result.SerialVerticesPerSecond * 1e-6f, Result.ThreadCount,
+        Result.ParallelVerticesPerSecond * 1e-6f, Result.ParallelVerticesPerSecond / Result.SerialVerticesPerSecond);
+    m_LoadStatsText.push_back(Str);
+    swprintf_s(Str, ARRAYSIZE(Str), L"Against the shader maths: max error %.2g of the model size, %d ULPs, %s", Result.MaxError, Result.MaxUlpError,
+        (Result.MaxError <= Tolerance) ? L"passed" : L"FAILED");
+    m_LoadStatsText.push_back(Str);
+}
+
+void GUI_CALL CModelViewer::BakedAnimationReportCallback(void* pUserData)
+{
+	CModelViewer* pViewer = reinterpret_cast<CModelViewer*>(pUserData);
+	pViewer->BakedAnimationReport();
+}
+
+void CModelViewer::BakedAnimationReport()
+{
+    if(m_pModel == nullptr || m_pModel->HasAnimations() == false)
+    {
+        trace(L"Load an animated model before running the report");
+        return;
+    }
+
+    // Bakes the selected animation, or the first one when showing the bind pose, at several rates
+    static const float SampleRates[] = { 5, 10, 15, 30, 60 };
+    static const UINT SampleCount = 1000;
+    const CRtrAnimationController* pController = m_pModel->GetAnimationController();
+    const UINT AnimationID = (m_SelectedAnimationID == BIND_POSE_ANIMATION_ID) ? 0 : m_SelectedAnimationID;
+    const UINT BonesCount = pController->GetBonesCount();
+    const float Duration = pController->GetAnimation(AnimationID)->GetDurationInSeconds();
+    const float ModelSize = m_pModel->GetRadius() * 2;
+
+    // Full evaluation, for comparison
+    SRtrAnimationState State;
+    pController->InitState(State, AnimationID);
+    std::vector<float4x4> Scratch(BonesCount), Palette(BonesCount);
+    auto Start = std::chrono::high_resolution_clock::now();
+    for(UINT i = 0; i < SampleCount; i++)
+    {
+        State.TotalTime = fmodf(float(i) * 0.618034f, 1.0f) * Duration;
+        pController->Evaluate(State, Scratch.data(), Palette.data());
+    }
+    const float EvaluateNs = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * 1e9f / float(SampleCount * BonesCount);
+
+    WCHAR Str[256];
+    m_LoadStatsText.clear();
+    swprintf_s(Str, ARRAYSIZE(Str), L"Baked animation, %d bones, %.2fs. Full evaluation %.1fns per bone", BonesCount, Duration, EvaluateNs);
+    m_LoadStatsText.push_back(Str);
+    for(float Rate : SampleRates)
+    {
+        CRtrBakedAnimation::SSettings Settings;
+        Settings.SampleRate = Rate;
+        CRtrBakedAnimation Baked(pController, AnimationID, Settings);
+
+        Start = std::chrono::high_resolution_clock::now();
+        for(UINT i = 0; i < SampleCount; i++)
+        {
+            Baked.Sample(fmodf(float(i) * 0.618034f, 1.0f) * Duration, Palette.data());
+        }
+        const float SampleNs = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * 1e9f / float(SampleCount * BonesCount);
+        const CRtrBakedAnimation::SError Error = Baked.MeasureError(SampleCount);
+
+        swprintf_s(Str, ARRAYSIZE(Str), L"%2.0f FPS: %d frames, %.1fKB, baked in %.1fms, %.1fns per bone, error max %.2g avg %.2g (%.2g%% of the model)",
+            Baked.GetSampleRate(), Baked.GetFrameCount(), float(Baked.GetMemorySize()) / 1024, Baked.GetBakeTime() * 1000, SampleNs,
+            Error.MaxError, Error.AverageError, Error.MaxError * 100 / ModelSize);
+        m_LoadStatsText.push_back(Str);
+    }
+}
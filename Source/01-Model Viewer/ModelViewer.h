@@ -42,8 +42,12 @@ Filename: ModelViewer.h
 #pragma once
 #include "Sample.h"
 #include "Camera.h"
+#include "RtrModel\RtrMesh.h"
+#include "RtrModel\RtrMeshlets.h"
+#include "RtrModel\RtrInstancing.h"
 
 class CRtrModel;
+class CRtrModelLoader;
 class CWireframeTech;
 class CBasicTech;
 
@@ -63,8 +67,39 @@ public:
 
 private:
 	static void GUI_CALL LoadModelCallback(void* pUserData);
+	static void GUI_CALL BenchmarkLoadCallback(void* pUserData);
+	static void GUI_CALL CompareObjImportersCallback(void* pUserData);
+	static void GUI_CALL MeshOptimizationReportCallback(void* pUserData);
+	static void GUI_CALL DrawSortReportCallback(void* pUserData);
+	static void GUI_CALL SubmissionScalingReportCallback(void* pUserData);
+	static void GUI_CALL SelfChecksCallback(void* pUserData);
+	static void GUI_CALL BenchmarkAnimationCallback(void* pUserData);
+	static void GUI_CALL AnimationCompressionReportCallback(void* pUserData);
+	static void GUI_CALL BenchmarkCrowdCallback(void* pUserData);
+	static void GUI_CALL BenchmarkCpuSkinningCallback(void* pUserData);
+	static void GUI_CALL BakedAnimationReportCallback(void* pUserData);
+	static void GUI_CALL AnimationLodReportCallback(void* pUserData);
 	void LoadModel();
+	void BenchmarkLoad();
+	void CompareObjImporters();
+	void MeshOptimizationReport();
+	void DrawSortReport();
+	void SubmissionScalingReport();
+	void SelfChecks();
+	void BenchmarkAnimation();
+	void AnimationCompressionReport();
+	void BenchmarkCrowd();
+	void BenchmarkCpuSkinning();
+	void BakedAnimationReport();
+	void AnimationLodReport();
+	void OnModelLoaded();
+	void PublishLoadedModel();
+	std::wstring GetLoadStatsString(const CRtrModel* pModel) const;
+	std::wstring GetVertexMemoryString(const CRtrModel* pModel) const;
+	static std::wstring GetIndexMetricsString(const CRtrMesh::SIndexMetrics& Before, const CRtrMesh::SIndexMetrics& After);
+	UINT GetLoadFlags() const;
     void ResetCamera();
+    void UpdateCopyTransforms();
     void RenderText(ID3D11DeviceContext* pContext);
     void SetAnimationUIElements();
     void InitUI();
@@ -72,12 +107,29 @@ private:
 	CModelViewCamera m_Camera;
 	std::unique_ptr<CBasicTech> m_pBasicTech;
 	std::unique_ptr<CRtrModel> m_pModel;
+	std::unique_ptr<CRtrModelLoader> m_pModelLoader;
+	CRtrClusterCuller m_ClusterCuller;
+	CRtrInstanceBatcher m_InstanceBatcher;
+	std::vector<float4x4> m_CopyTransforms;
+	std::wstring m_ModelFilename;
+	std::vector<std::wstring> m_LoadStatsText;
 
 	float3 m_LightDir = float3(0.5f, 0, 1);
 	float3 m_LightIntensity = float3(0.66f, 0.66f, 0.66f);
 
 	bool m_bWireframe = false;
+	bool m_bCompactVertices = true;
+	bool m_bClusterCulling = true;
+	bool m_bAutomaticLod = true;
+	bool m_bInstancing = true;
+	bool m_bSortDraws = true;
+	bool m_bDeferredContexts = false;
+	bool m_bBatched = false;  // Whether the last frame was drawn from the instance batches
+	UINT m_StressCopies = 1;
+	float m_DrawSubmitTime = 0;
     bool m_bAnimate = false;
     UINT m_SelectedAnimationID;
     UINT m_ActiveAnimationID;
+    float m_CrossFadeTime = 0.3f;
+    bool m_bDualQuaternionSkinning = false;
 };
\ No newline at end of file
@@ -58,7 +58,7 @@ const char* gPencilUiGroup = "Pencil";
 
 HRESULT CNonPhotoRealisticRenderer::OnCreateDevice(ID3D11Device* pDevice)
 {
-    m_pModel = CRtrModel::CreateFromFile(L"armor\\armor.obj", pDevice);
+    m_pModel = CRtrModel::CreateFromFile(L"armor\\armor.obj", pDevice, CRtrModel::LOAD_FLAGS_COMPACT_VERTICES, m_pThreadPool.get());
     m_Camera.SetModelParams(m_pModel->GetCenter(), m_pModel->GetRadius());
     m_pNprShader = std::make_unique<CNprShading>(pDevice, GetFullScreenPass());
     m_pSilhouetteShader = std::make_unique<CSilhouetteShader>(pDevice);
@@ -47,22 +47,31 @@ Filename: NprShading.cpp
 enum 
 {
 	PER_FRAME_CB_INDEX = 0,
-	PER_MESH_CB_INDEX  = 1,
 	PER_TECHNIQUE_CB_INDEX = 2,
 
 	TOON_SHADE_MAX_CB
 };
 
-CNprShading::CNprShading(ID3D11Device* pDevice, const CFullScreenPass* pFullScreenPass)
+CNprShading::CNprShading(ID3D11Device* pDevice, const CFullScreenPass* pFullScreenPass) :
+	m_DrawData(sizeof(SPerDrawData)),
+	m_CbRing(pDevice),
+	m_PerFrameBlock(PER_FRAME_CB_INDEX, true, true),
+	m_GoochBlock(PER_TECHNIQUE_CB_INDEX, true, true),
+	m_TwoToneBlock(PER_TECHNIQUE_CB_INDEX, true, true),
+	m_PencilBlock(PER_TECHNIQUE_CB_INDEX, true, true)
 {
 	static const std::wstring ShaderFile = L"02-NPR\\NprShading.hlsl";
 
-    m_VS = CreateVsFromFile(pDevice, ShaderFile, "VS");
-	m_VS->VerifyConstantLocation("gVPMat", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, VpMat));
-	m_VS->VerifyConstantLocation("gLightPosW", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, LightPosW));
-	m_VS->VerifyConstantLocation("gLightIntensity", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, LightIntensity));
+	for(UINT Format = 0; Format < CRtrMesh::VERTEX_FORMAT_COUNT; Format++)
+	{
+		const D3D_SHADER_MACRO VsDefines[] = { CRtrMesh::GetVertexFormatDefine(Format), "", nullptr };
+		m_VS[Format] = CreateVsFromFile(pDevice, ShaderFile, "VS", VsDefines);
+		m_VS[Format]->VerifyConstantLocation("gVPMat", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, VpMat));
+		m_VS[Format]->VerifyConstantLocation("gLightPosW", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, LightPosW));
+		m_VS[Format]->VerifyConstantLocation("gLightIntensity", PER_FRAME_CB_INDEX, offsetof(SCommonSettings, LightIntensity));
 
-	m_VS->VerifyConstantLocation("gWorld", PER_MESH_CB_INDEX, offsetof(SPerMeshData, World));
+		m_VS[Format]->VerifyStructuredBufferLocation("gPerDraw", CRtrMesh::PER_DRAW_SRV_INDEX);
+	}
 
     m_BasicDiffusePS = CreatePsFromFile(pDevice, ShaderFile, "BasicDiffusePS");
 	m_BasicDiffusePS->VerifyResourceLocation("gAlbedo", 0, 1);
@@ -106,64 +115,37 @@ CNprShading::CNprShading(ID3D11Device* pDevice, const CFullScreenPass* pFullScre
 		m_PencilSRV[i] = CreateShaderResourceViewFromFile(pDevice, Filename.c_str(), true);
 	}
 
-    // Constant buffer
-    D3D11_BUFFER_DESC BufferDesc;
-    BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    BufferDesc.ByteWidth = sizeof(SCommonSettings);
-    BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-    BufferDesc.MiscFlags = 0;
-    BufferDesc.StructureByteStride = 0;
-    BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-    verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerFrameCB));
-
-    BufferDesc.ByteWidth = sizeof(SPerMeshData);
-    verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerMeshCB));
-
-	BufferDesc.ByteWidth = sizeof(SGoochSettings);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_GoochCB));
-
-	BufferDesc.ByteWidth = sizeof(STwoToneSettings);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_TwoToneCB));
-
-	BufferDesc.ByteWidth = sizeof(SPencilSettings);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PencilCb));
-
     // Sampler state
 	m_pLinearSampler = SSamplerState::TriLinear(pDevice);
 }
 
 void CNprShading::PrepareForDraw(ID3D11DeviceContext* pCtx, const SDrawSettings& DrawSettings)
 {
-	pCtx->OMSetDepthStencilState(nullptr, 0);
-	pCtx->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-	pCtx->RSSetState(nullptr);
-	
-	std::vector<ID3D11Buffer*> pCBs(TOON_SHADE_MAX_CB);
-	pCBs[PER_FRAME_CB_INDEX] = m_PerFrameCB;
-	pCBs[PER_MESH_CB_INDEX] = m_PerMeshCB;
+	m_StateCache.Reset(pCtx);
+	m_StateCache.OMSetDepthStencilState(nullptr, 0);
+	m_StateCache.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+	m_StateCache.RSSetState(nullptr);
+	m_CbRing.Reset();
 
 	// Update CB
-	UpdateEntireConstantBuffer(pCtx, m_PerFrameCB, DrawSettings.Common);
+	m_CbRing.Update(m_StateCache, m_PerFrameBlock, DrawSettings.Common);
 
 	ID3D11SamplerState* pSampler = m_pLinearSampler;
-	pCtx->PSSetSamplers(0, 1, &pSampler);
+	m_StateCache.PSSetSamplers(0, 1, &pSampler);
 
-    pCtx->VSSetShader(m_VS->GetShader(), nullptr, 0);
 	m_Mode = DrawSettings.Mode;
     switch(m_Mode)
     {
 	case BLINN_PHONG:
-		pCtx->PSSetShader(m_BasicDiffusePS->GetShader(), nullptr, 0);
+		m_StateCache.PSSetShader(m_BasicDiffusePS->GetShader());
 		break;
     case GOOCH_SHADING:
-		pCtx->PSSetShader(m_GoochPS->GetShader(), nullptr, 0);
-		UpdateEntireConstantBuffer(pCtx, m_GoochCB, DrawSettings.Gooch);
-		pCBs[PER_TECHNIQUE_CB_INDEX] = m_GoochCB;
+		m_StateCache.PSSetShader(m_GoochPS->GetShader());
+		m_CbRing.Update(m_StateCache, m_GoochBlock, DrawSettings.Gooch);
 		break;
 	case TWO_TONE_SHADING:
-		pCtx->PSSetShader(m_TwoTonePS->GetShader(), nullptr, 0);
-		UpdateEntireConstantBuffer(pCtx, m_TwoToneCB, DrawSettings.HardShading);
-		pCBs[PER_TECHNIQUE_CB_INDEX] = m_TwoToneCB;
+		m_StateCache.PSSetShader(m_TwoTonePS->GetShader());
+		m_CbRing.Update(m_StateCache, m_TwoToneBlock, DrawSettings.HardShading);
 		break;
 	case NDOTL_PENCIL_SHADING:
 	case LUMINANCE_PENCIL_SHADING:
@@ -174,58 +156,67 @@ void CNprShading::PrepareForDraw(ID3D11DeviceContext* pCtx, const SDrawSettings&
 			pStrokes[i] = m_PencilSRV[i];
 		}
 		ID3D11PixelShader* pPS = (m_Mode == LUMINANCE_PENCIL_SHADING) ? m_LuminancePencilPS->GetShader() : m_NdotLPencilPS->GetShader();
-		pCtx->PSSetShader(pPS, nullptr, 0);
-		pCtx->PSSetShaderResources(1, ARRAYSIZE(m_PencilSRV), &pStrokes[0]);
-		UpdateEntireConstantBuffer(pCtx, m_PencilCb, DrawSettings.Pencil);
-		pCBs[PER_TECHNIQUE_CB_INDEX] = m_PencilCb;
+		m_StateCache.PSSetShader(pPS);
+		m_StateCache.PSSetShaderResources(1, ARRAYSIZE(m_PencilSRV), &pStrokes[0]);
+		m_CbRing.Update(m_StateCache, m_PencilBlock, DrawSettings.Pencil);
 		break;
 	}
 	default:
         assert(0);
     }
-
-	pCtx->PSSetConstantBuffers(0, UINT(pCBs.size()), &pCBs[0]);
-	pCtx->VSSetConstantBuffers(0, UINT(pCBs.size()), &pCBs[0]);
 }
 
-void CNprShading::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat)
+void CNprShading::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex)
 {
-	// Update constant buffer
 	const CRtrMaterial* pMaterial = pMesh->GetMaterial();
-	SPerMeshData CbData;
-    CbData.World = WorldMat;
-	UpdateEntireConstantBuffer(pCtx, m_PerMeshCB, CbData);
 
-	pMesh->SetDrawState(pCtx, m_VS->GetBlob());
+	// The vertex shader depends on the mesh vertex format
+	const CVertexShader* pVS = m_VS[pMesh->GetVertexFormat()].get();
+	m_MeshBinder.SetDrawState(m_StateCache, pMesh, pVS->GetBlob());
+	m_StateCache.VSSetShader(pVS->GetShader());
 
 	// Set per-mesh resources
 	ID3D11ShaderResourceView* pSrv = pMaterial->GetSRV(CRtrMaterial::DIFFUSE_MAP);
 	assert(pSrv);
-	pCtx->PSSetShaderResources(0, 1, &pSrv);
+	m_StateCache.PSSetShaderResources(0, 1, &pSrv);
 
 	UINT IndexCount = pMesh->GetIndexCount();
-	pCtx->DrawIndexed(IndexCount, 0, 0);
+	pCtx->DrawIndexedInstanced(IndexCount, 1, pMesh->GetFirstIndex(), pMesh->GetBaseVertex(), DrawIndex);
 }
 
 void CNprShading::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
 {
+	m_StateCache.Invalidate();
 	if(m_Mode == LUMINANCE_PENCIL_SHADING || m_Mode == NDOTL_PENCIL_SHADING)
 	{
 		DrawPencilBackground(pCtx);
 	}
 
-	for(const auto& DrawCmd : pModel->GetDrawList())
+	m_MeshBinder.Reset();
+	m_DrawStream.Clear();
+	m_DrawStream.AddDrawList(pModel, 0);
+	m_DrawStream.Sort();
+
+	// All the world matrices are written before the first draw. Matrices in structured buffers are column-major, hence the transpose
+	const auto& Packets = m_DrawStream.GetPackets();
+	m_DrawData.Begin(pCtx, UINT(Packets.size()));
+	for(const auto& Packet : Packets)
 	{
-		for(const auto& Mesh : DrawCmd.pMeshes)
-		{
-            DrawMesh(Mesh, pCtx, DrawCmd.Transformation);
-		}
+		SPerDrawData Data;
+		Packet.pTransform->Transpose(Data.World);
+		m_DrawData.Add(Data);
+	}
+	m_DrawData.End(m_StateCache);
+
+	for(UINT i = 0; i < Packets.size(); i++)
+	{
+		DrawMesh(Packets[i].pMesh, pCtx, i);
 	}
 }
 
 void CNprShading::DrawPencilBackground(ID3D11DeviceContext* pCtx)
 {
 	ID3D11ShaderResourceView* pSrv = m_BackgroundSRV.GetInterfacePtr();
-	pCtx->PSSetShaderResources(0, 1, &pSrv);
-	m_pFullScreenPass->Draw(pCtx, m_BackgroundPS->GetShader());
+	m_StateCache.PSSetShaderResources(0, 1, &pSrv);
+	m_pFullScreenPass->Draw(m_StateCache, m_BackgroundPS->GetShader());
 }
\ No newline at end of file
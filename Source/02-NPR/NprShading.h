@@ -43,9 +43,12 @@ Filename: NprShading.h
 #pragma once
 #include "Common.h"
 #include "ShaderUtils.h"
+#include "ConstantBufferRing.h"
+#include "RtrModel\RtrMeshArena.h"
+#include "RtrModel\RtrDrawStream.h"
+#include "RtrModel\RtrDrawData.h"
 
 class CRtrModel;
-class CRtrMesh;
 class CFullScreenPass;
 
 /* Resources:
@@ -118,30 +121,34 @@ public:
 	void PrepareForDraw(ID3D11DeviceContext* pCtx, const SDrawSettings& DrawSettings);
 
 private:
-    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat);
+    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex);
 	void DrawPencilBackground(ID3D11DeviceContext* pCtx);
 
 	// Common
-	CVertexShaderPtr m_VS;
+	CVertexShaderPtr m_VS[CRtrMesh::VERTEX_FORMAT_COUNT];  // One permutation per mesh vertex format
+	CRtrMeshBinder m_MeshBinder;
+	CDxStateCache m_StateCache;
+	CRtrDrawStream m_DrawStream;
+	CRtrDrawDataBuffer m_DrawData;
     CPixelShaderPtr  m_BasicDiffusePS;
 
-	ID3D11BufferPtr m_PerFrameCB;
-	ID3D11BufferPtr m_PerMeshCB;
+	CConstantBufferRing m_CbRing;
+	SConstantBlock m_PerFrameBlock;
 	ID3D11SamplerStatePtr m_pLinearSampler;
 
 	// Gooch - http://artis.imag.fr/~Cyril.Soler/DEA/NonPhotoRealisticRendering/Papers/p447-gooch.pdf
 	CPixelShaderPtr  m_GoochPS;
-	ID3D11BufferPtr m_GoochCB;
+	SConstantBlock m_GoochBlock;
 
 	// Two Tone (Hard Shading) - http://markmark.net/npar/npar2000_lake_et_al.pdf
 	CPixelShaderPtr m_TwoTonePS;
-	ID3D11BufferPtr m_TwoToneCB;
+	SConstantBlock m_TwoToneBlock;
 	SHADING_MODE m_Mode;
 
 
 	// Pencil shader
 	const CFullScreenPass* m_pFullScreenPass;
-	ID3D11BufferPtr m_PencilCb;
+	SConstantBlock m_PencilBlock;
 	CPixelShaderPtr m_BackgroundPS;
 	CPixelShaderPtr m_LuminancePencilPS;
 	CPixelShaderPtr m_NdotLPencilPS;
@@ -149,9 +156,8 @@ private:
 	ID3D11ShaderResourceViewPtr m_PencilSRV[4];
 	
 
-	struct SPerMeshData
+	struct SPerDrawData
 	{
-		float4x4 World;
+		float4x4 World;  // Transposed
 	};
-	verify_cb_size_alignment(SPerMeshData);
 };
\ No newline at end of file
@@ -43,29 +43,24 @@ Filename: EdgeShader.cpp
 #include "SilhouetteShader.h"
 #include "RtrModel.h"
 
-CSilhouetteShader::CSilhouetteShader(ID3D11Device* pDevice)
+CSilhouetteShader::CSilhouetteShader(ID3D11Device* pDevice) :
+    m_DrawData(sizeof(SPerDrawData)),
+    m_CbRing(pDevice),
+    m_ShellExpansionBlock(0, true, true)
 {
     static const std::wstring ShaderFile = L"02-NPR\\SilhouetteShader.hlsl";
 
-    m_ShellExpansionVS = CreateVsFromFile(pDevice, ShaderFile, "ShellExpansionVS");
-	m_ShellExpansionVS->VerifyConstantLocation("gVPMat", 0, offsetof(SShellExpansionData, VpMat));
-	m_ShellExpansionVS->VerifyConstantLocation("gLineWidth", 0, offsetof(SShellExpansionData, LineWidth));
+    for(UINT Format = 0; Format < CRtrMesh::VERTEX_FORMAT_COUNT; Format++)
+    {
+        const D3D_SHADER_MACRO VsDefines[] = { CRtrMesh::GetVertexFormatDefine(Format), "", nullptr };
+        m_ShellExpansionVS[Format] = CreateVsFromFile(pDevice, ShaderFile, "ShellExpansionVS", VsDefines);
+        m_ShellExpansionVS[Format]->VerifyConstantLocation("gVPMat", 0, offsetof(SShellExpansionData, VpMat));
+        m_ShellExpansionVS[Format]->VerifyConstantLocation("gLineWidth", 0, offsetof(SShellExpansionData, LineWidth));
+        m_ShellExpansionVS[Format]->VerifyStructuredBufferLocation("gPerDraw", CRtrMesh::PER_DRAW_SRV_INDEX);
+    }
 
     m_PS = CreatePsFromFile(pDevice, ShaderFile, "PS");
 
-    // Constant buffer
-    D3D11_BUFFER_DESC BufferDesc;
-    BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-    BufferDesc.ByteWidth = sizeof(SShellExpansionData);
-    BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-    BufferDesc.MiscFlags = 0;
-    BufferDesc.StructureByteStride = 0;
-    BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-    verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_ShellExpansionCB));
-
-    BufferDesc.ByteWidth = sizeof(SPerMeshData);
-    verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerModelCb));
-
     // Front-face culling rasterizer state
     D3D11_RASTERIZER_DESC RsDesc;
     RsDesc.AntialiasedLineEnable = FALSE;
@@ -86,45 +81,53 @@ void CSilhouetteShader::PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFram
     m_Mode = PerFrameData.Mode;
     if(m_Mode == SHELL_EXPANSION)
     {
-        pCtx->OMSetDepthStencilState(nullptr, 0);
-        pCtx->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-        pCtx->RSSetState(m_CullFrontFaceRS);
+        m_StateCache.Reset(pCtx);
+        m_StateCache.OMSetDepthStencilState(nullptr, 0);
+        m_StateCache.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+        m_StateCache.RSSetState(m_CullFrontFaceRS);
+        m_CbRing.Reset();
 
         // Update CB
-        UpdateEntireConstantBuffer(pCtx, m_ShellExpansionCB, PerFrameData.ShellExpansion);
-        ID3D11Buffer* pCb = m_ShellExpansionCB.GetInterfacePtr();
-        pCtx->VSSetConstantBuffers(0, 1, &pCb);
-        pCtx->PSSetConstantBuffers(0, 1, &pCb);
-        pCb = m_PerModelCb;
-        pCtx->VSSetConstantBuffers(1, 1, &pCb);
-
-        pCtx->VSSetShader(m_ShellExpansionVS->GetShader(), nullptr, 0);
-        pCtx->PSSetShader(m_PS->GetShader(), nullptr, 0);
+        m_CbRing.Update(m_StateCache, m_ShellExpansionBlock, PerFrameData.ShellExpansion);
+
+        m_StateCache.PSSetShader(m_PS->GetShader());
     }
 }
 
-void CSilhouetteShader::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat)
+void CSilhouetteShader::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex)
 {
-	// Update constant buffer
-	SPerMeshData CbData;
-    CbData.World = WorldMat;
-	UpdateEntireConstantBuffer(pCtx, m_PerModelCb, CbData);
-	pMesh->SetDrawState(pCtx, m_ShellExpansionVS->GetBlob());
+	const CVertexShader* pVS = m_ShellExpansionVS[pMesh->GetVertexFormat()].get();
+	m_MeshBinder.SetDrawState(m_StateCache, pMesh, pVS->GetBlob());
+	m_StateCache.VSSetShader(pVS->GetShader());
 
 	UINT IndexCount = pMesh->GetIndexCount();
-	pCtx->DrawIndexed(IndexCount, 0, 0);
+	pCtx->DrawIndexedInstanced(IndexCount, 1, pMesh->GetFirstIndex(), pMesh->GetBaseVertex(), DrawIndex);
 }
 
 void CSilhouetteShader::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
 {
     if(m_Mode == SHELL_EXPANSION)
     {
-        for(const auto& DrawCmd : pModel->GetDrawList())
+        m_StateCache.Invalidate();
+        m_MeshBinder.Reset();
+        m_DrawStream.Clear();
+        m_DrawStream.AddDrawList(pModel, 0);
+        m_DrawStream.Sort();
+
+        // All the world matrices are written before the first draw. Matrices in structured buffers are column-major, hence the transpose
+        const auto& Packets = m_DrawStream.GetPackets();
+        m_DrawData.Begin(pCtx, UINT(Packets.size()));
+        for(const auto& Packet : Packets)
+        {
+            SPerDrawData Data;
+            Packet.pTransform->Transpose(Data.World);
+            m_DrawData.Add(Data);
+        }
+        m_DrawData.End(m_StateCache);
+
+        for(UINT i = 0; i < Packets.size(); i++)
         {
-            for(const auto& Mesh : DrawCmd.pMeshes)
-            {
-                DrawMesh(Mesh, pCtx, DrawCmd.Transformation);
-            }
+            DrawMesh(Packets[i].pMesh, pCtx, i);
         }
     }
 }
\ No newline at end of file
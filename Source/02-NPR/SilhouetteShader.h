@@ -43,9 +43,12 @@ Filename: SilhouetteShader.h
 #pragma once
 #include "Common.h"
 #include "ShaderUtils.h"
+#include "ConstantBufferRing.h"
+#include "RtrModel\RtrMeshArena.h"
+#include "RtrModel\RtrDrawStream.h"
+#include "RtrModel\RtrDrawData.h"
 
 class CRtrModel;
-class CRtrMesh;
 
 class CSilhouetteShader
 {
@@ -76,20 +79,23 @@ public:
 	void PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData);
 
 private:
-    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat);
+    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex);
 
-    CVertexShaderPtr  m_ShellExpansionVS;
+    CVertexShaderPtr  m_ShellExpansionVS[CRtrMesh::VERTEX_FORMAT_COUNT];  // One permutation per mesh vertex format
+    CRtrMeshBinder m_MeshBinder;
+    CDxStateCache m_StateCache;
+    CRtrDrawStream m_DrawStream;
+    CRtrDrawDataBuffer m_DrawData;
 	CPixelShaderPtr  m_PS;
 
-	ID3D11BufferPtr m_ShellExpansionCB;
-	ID3D11BufferPtr m_PerModelCb;
+	CConstantBufferRing m_CbRing;
+	SConstantBlock m_ShellExpansionBlock;
     ID3D11RasterizerStatePtr m_CullFrontFaceRS;
 
     SHADING_MODE m_Mode;
 
-	struct SPerMeshData
+	struct SPerDrawData
 	{
-		float4x4 World;
+		float4x4 World;  // Transposed
 	};
-	verify_cb_size_alignment(SPerMeshData);
 };
\ No newline at end of file
@@ -42,6 +42,7 @@ Filename: BRDF.cpp
 #include "BRDF.h"
 #include "resource.h"
 #include "RtrModel.h"
+#include "RtrModel\RtrModelLoader.h"
 #include "BrdfShader.h"
 
 #define _USE_MATH_DEFINES
@@ -91,8 +92,22 @@ void CBrdf::LoadModel(UINT ModelIndex)
     if(m_ActiveModel != ModelIndex)
     {
         m_ActiveModel = ModelIndex;
-        m_pModel = CRtrModel::CreateFromFile(gModelFiles[ModelIndex].second, m_pDevice->GetD3DDevice());
-        m_Camera.SetModelParams(m_pModel->GetCenter(), m_pModel->GetRadius());
+        // The current model is drawn until the new one is ready. Replacing an existing loader cancels it
+        m_pModelLoader = std::make_unique<CRtrModelLoader>(gModelFiles[ModelIndex].second, m_pDevice->GetD3DDevice(), m_pThreadPool.get(), CRtrModel::LOAD_FLAGS_COMPACT_VERTICES);
+    }
+}
+
+void CBrdf::PublishLoadedModel()
+{
+    if(m_pModelLoader && m_pModelLoader->IsReady())
+    {
+        std::unique_ptr<CRtrModel> pModel = m_pModelLoader->GetModel();
+        m_pModelLoader = nullptr;
+        if(pModel)
+        {
+            m_pModel = std::move(pModel);
+            m_Camera.SetModelParams(m_pModel->GetCenter(), m_pModel->GetRadius());
+        }
     }
 }
 
@@ -102,6 +117,10 @@ void CBrdf::RenderText(ID3D11DeviceContext* pContext)
 	std::wstring line(gWindowName);
 	m_pTextRenderer->RenderLine(gWindowName);
 	m_pTextRenderer->RenderLine(GetGlobalSampleMessage() + L"\n'B' cycles between BRDF modes");
+    if(m_pModelLoader)
+    {
+        m_pTextRenderer->RenderLine(m_pModelLoader->GetProgressString());
+    }
 	m_pTextRenderer->End();
 }
 
@@ -110,6 +129,7 @@ void CBrdf::OnFrameRender(ID3D11Device* pDevice, ID3D11DeviceContext* pCtx)
     float clearColor[] = { 0.32f, 0.41f, 0.82f, 1 };
     pCtx->ClearRenderTargetView(m_pDevice->GetBackBufferRTV(), clearColor);
     pCtx->ClearDepthStencilView(m_pDevice->GetBackBufferDSV(), D3D11_CLEAR_DEPTH, 1.0, 0);
+    PublishLoadedModel();
     
     if(m_LightCutoffEnd >= m_LightCutoffStart)
     {
@@ -124,8 +144,12 @@ void CBrdf::OnFrameRender(ID3D11Device* pDevice, ID3D11DeviceContext* pCtx)
     m_ShaderData.CutoffScale = 1.0f/(m_LightCutoffEnd - m_LightCutoffStart);
     m_ShaderData.CutoffOffset = -m_LightCutoffStart / (m_LightCutoffEnd - m_LightCutoffStart);
 
-    m_pShader->PrepareForDraw(pCtx, m_ShaderData, m_BrdfModel);
-    m_pShader->DrawModel(pCtx, m_pModel.get());
+    if(m_pModel)
+    {
+        m_pShader->PrepareForDraw(pCtx, m_ShaderData, m_BrdfModel);
+        CRtrLodSelector LodSelector(m_Camera);
+        m_pShader->DrawModel(pCtx, m_pModel.get(), m_bAutomaticLod ? &LodSelector : nullptr);
+    }
 
     RenderText(pCtx);
 }
@@ -166,6 +190,7 @@ void CBrdf::InitUI()
     m_pAppGui->AddCheckBox("Enable Diffuse", &m_bDiffuseEnabled);
     m_pAppGui->AddCheckBox("Enable Specular", &m_bSpecularEnabled);
     m_pAppGui->AddCheckBox("Enable Ambient", &m_bAmbientEnabled);
+    m_pAppGui->AddCheckBox("Automatic LOD", &m_bAutomaticLod);
     m_pAppGui->AddRgbColor("Light Intensity", &m_ShaderData.LightIntensity);
     m_pAppGui->AddRgbColor("Ambient Intensity", &m_ShaderData.AmbientIntensity);
     m_pAppGui->AddFloatVar("Cutoff Start", &m_LightCutoffStart, "", 0, 100, 1);
@@ -45,6 +45,7 @@ Filename: BRDF.h
 #include "BrdfShader.h"
 
 class CRtrModel;
+class CRtrModelLoader;
 
 class CBrdf : public CSample
 {
@@ -65,8 +66,10 @@ public:
 private:
 	void RenderText(ID3D11DeviceContext* pContext);
     void InitUI();
+    void PublishLoadedModel();
 
     std::unique_ptr<CRtrModel> m_pModel;
+    std::unique_ptr<CRtrModelLoader> m_pModelLoader;
     std::unique_ptr<CBrdfShader> m_pShader;
     CModelViewCamera m_Camera;
     UINT m_ActiveModel = UINT(-1);
@@ -82,6 +85,7 @@ private:
     bool m_bAmbientEnabled = true;
     bool m_bSpecularEnabled = true;
     bool m_bDiffuseEnabled = true;
+    bool m_bAutomaticLod = true;
 
     bool m_bRightButtonDown = false;
     bool m_bMiddleButtonDown = false;
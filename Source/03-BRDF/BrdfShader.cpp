@@ -43,18 +43,25 @@ Filename: BrdfShader.cpp
 #include "BrdfShader.h"
 #include "RtrModel.h"
 
-CBrdfShader::CBrdfShader(ID3D11Device* pDevice)
+CBrdfShader::CBrdfShader(ID3D11Device* pDevice) :
+    m_DrawData(sizeof(SPerDrawData)),
+    m_CbRing(pDevice),
+    m_PerFrameBlock(0, true, true)
 {
     static const std::wstring ShaderFile = L"03-BRDF\\BrdfShader.hlsl";
 
-    m_VS = CreateVsFromFile(pDevice, ShaderFile, "VS");
-	m_VS->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VPMat));
-	m_VS->VerifyConstantLocation("gLightPosW", 0, offsetof(SPerFrameData, LightPosW));
-	m_VS->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
-    m_VS->VerifyConstantLocation("gAmbientIntensity", 0, offsetof(SPerFrameData, AmbientIntensity));
-    m_VS->VerifyConstantLocation("gCameraPosW", 0, offsetof(SPerFrameData, CameraPosW));
-
-	m_VS->VerifyConstantLocation("gWorld", 1, offsetof(SPerMeshData, World));
+	for(UINT Format = 0; Format < CRtrMesh::VERTEX_FORMAT_COUNT; Format++)
+	{
+		const D3D_SHADER_MACRO VsDefines[] = { CRtrMesh::GetVertexFormatDefine(Format), "", nullptr };
+		m_VS[Format] = CreateVsFromFile(pDevice, ShaderFile, "VS", VsDefines);
+		m_VS[Format]->VerifyConstantLocation("gVPMat", 0, offsetof(SPerFrameData, VPMat));
+		m_VS[Format]->VerifyConstantLocation("gLightPosW", 0, offsetof(SPerFrameData, LightPosW));
+		m_VS[Format]->VerifyConstantLocation("gLightIntensity", 0, offsetof(SPerFrameData, LightIntensity));
+		m_VS[Format]->VerifyConstantLocation("gAmbientIntensity", 0, offsetof(SPerFrameData, AmbientIntensity));
+		m_VS[Format]->VerifyConstantLocation("gCameraPosW", 0, offsetof(SPerFrameData, CameraPosW));
+
+		m_VS[Format]->VerifyStructuredBufferLocation("gPerDraw", CRtrMesh::PER_DRAW_SRV_INDEX);
+	}
 
     m_NoSpecPS = CreatePsFromFile(pDevice, ShaderFile, "NoSpecPS");
     m_PhongPS = CreatePsFromFile(pDevice, ShaderFile, "PhongPS");
@@ -65,72 +72,65 @@ CBrdfShader::CBrdfShader(ID3D11Device* pDevice)
     m_BlinnPhongPS->VerifyConstantLocation("gDiffuseColor", 0, offsetof(SPerFrameData, DiffuseColor));
     m_BlinnPhongPS->VerifyConstantLocation("gCutoffScale", 0, offsetof(SPerFrameData, CutoffScale));
     m_BlinnPhongPS->VerifyConstantLocation("gCutoffOffset", 0, offsetof(SPerFrameData, CutoffOffset));
-
-	// Constant buffer
-	D3D11_BUFFER_DESC BufferDesc;
-	BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	BufferDesc.ByteWidth = sizeof(SPerFrameData);
-	BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	BufferDesc.MiscFlags = 0;
-	BufferDesc.StructureByteStride = 0;
-	BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerFrameCb));
-
-	BufferDesc.ByteWidth = sizeof(SPerMeshData);
-	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_PerModelCb));
 }
 
 void CBrdfShader::PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData, BRDF_MODEL BrdfMode)
 {
-	pCtx->OMSetDepthStencilState(nullptr, 0);
-	pCtx->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
-	pCtx->RSSetState(nullptr);
+	m_StateCache.Reset(pCtx);
+	m_StateCache.OMSetDepthStencilState(nullptr, 0);
+	m_StateCache.OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+	m_StateCache.RSSetState(nullptr);
+	m_CbRing.Reset();
 	
 	// Update CB
-	UpdateEntireConstantBuffer(pCtx, m_PerFrameCb, PerFrameData);
-    ID3D11Buffer* pCb[2] = {m_PerFrameCb.GetInterfacePtr(), m_PerModelCb.GetInterfacePtr()};
-	pCtx->VSSetConstantBuffers(0, 2, pCb);
-	pCtx->PSSetConstantBuffers(0, 2, pCb);
-
-    pCtx->VSSetShader(m_VS->GetShader(), nullptr, 0);
+	m_CbRing.Update(m_StateCache, m_PerFrameBlock, PerFrameData);
 
     switch(BrdfMode)
     {
     case CBrdfShader::BRDF_MODEL::NO_BRDF:
-        pCtx->PSSetShader(m_NoSpecPS->GetShader(), nullptr, 0);
+        m_StateCache.PSSetShader(m_NoSpecPS->GetShader());
         break;
     case CBrdfShader::BRDF_MODEL::PHONG:
-        pCtx->PSSetShader(m_PhongPS->GetShader(), nullptr, 0);
+        m_StateCache.PSSetShader(m_PhongPS->GetShader());
         break;
     case CBrdfShader::BRDF_MODEL::BLINN_PHONG:
-        pCtx->PSSetShader(m_BlinnPhongPS->GetShader(), nullptr, 0);
+        m_StateCache.PSSetShader(m_BlinnPhongPS->GetShader());
         break;
     default:
         break;
     }
 }
 
-void CBrdfShader::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat)
+void CBrdfShader::DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex, UINT FirstIndex, UINT IndexCount)
 {
-	// Update constant buffer
-	const CRtrMaterial* pMaterial = pMesh->GetMaterial();
-	SPerMeshData CbData;
-    CbData.World = WorldMat;
-    UpdateEntireConstantBuffer(pCtx, m_PerModelCb, CbData);
+	const CVertexShader* pVS = m_VS[pMesh->GetVertexFormat()].get();
+	m_MeshBinder.SetDrawState(m_StateCache, pMesh, pVS->GetBlob());
+	m_StateCache.VSSetShader(pVS->GetShader());
 
-	pMesh->SetDrawState(pCtx, m_VS->GetBlob());
-
-    UINT IndexCount = pMesh->GetIndexCount();
-	pCtx->DrawIndexed(IndexCount, 0, 0);
+	pCtx->DrawIndexedInstanced(IndexCount, 1, pMesh->GetFirstIndex() + FirstIndex, pMesh->GetBaseVertex(), DrawIndex);
 }
 
-void CBrdfShader::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel)
+void CBrdfShader::DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrLodSelector* pLodSelector)
 {
-	for(const auto& DrawCmd : pModel->GetDrawList())
+	m_StateCache.Invalidate();
+	m_MeshBinder.Reset();
+	m_DrawStream.Clear();
+	m_DrawStream.AddDrawList(pModel, 0, pLodSelector);
+	m_DrawStream.Sort();
+
+	// All the world matrices are written before the first draw. Matrices in structured buffers are column-major, hence the transpose
+	const auto& Packets = m_DrawStream.GetPackets();
+	m_DrawData.Begin(pCtx, UINT(Packets.size()));
+	for(const auto& Packet : Packets)
+	{
+		SPerDrawData Data;
+		Packet.pTransform->Transpose(Data.World);
+		m_DrawData.Add(Data);
+	}
+	m_DrawData.End(m_StateCache);
+
+	for(UINT i = 0; i < Packets.size(); i++)
 	{
-		for(const auto& Mesh : DrawCmd.pMeshes)
-		{
-            DrawMesh(Mesh, pCtx, DrawCmd.Transformation);
-		}
+		DrawMesh(Packets[i].pMesh, pCtx, i, Packets[i].FirstIndex, Packets[i].IndexCount);
 	}
 }
\ No newline at end of file
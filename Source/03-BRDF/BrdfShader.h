@@ -43,9 +43,13 @@ Filename: BrdfShader.h
 #pragma once
 #include "Common.h"
 #include "ShaderUtils.h"
+#include "ConstantBufferRing.h"
+#include "RtrModel\RtrMeshArena.h"
+#include "RtrModel\RtrDrawStream.h"
+#include "RtrModel\RtrDrawData.h"
+#include "RtrModel\RtrMeshSimplifier.h"
 
 class CRtrModel;
-class CRtrMesh;
 
 class CBrdfShader
 {
@@ -78,26 +82,30 @@ public:
     verify_cb_size_alignment(SPerFrameData);
 
     CBrdfShader(ID3D11Device* pDevice);
-    void DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel);
+    // If pLodSelector is not null, every mesh is drawn with the LOD it selects for the draw node
+    void DrawModel(ID3D11DeviceContext* pCtx, const CRtrModel* pModel, const CRtrLodSelector* pLodSelector = nullptr);
 	void PrepareForDraw(ID3D11DeviceContext* pCtx, const SPerFrameData& PerFrameData, BRDF_MODEL BrdfMode);
 
 private:
-    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, const float4x4& WorldMat);
+    void DrawMesh(const CRtrMesh* pMesh, ID3D11DeviceContext* pCtx, UINT DrawIndex, UINT FirstIndex, UINT IndexCount);
 
-	CVertexShaderPtr m_VS;
+	CVertexShaderPtr m_VS[CRtrMesh::VERTEX_FORMAT_COUNT];  // One permutation per mesh vertex format
+	CRtrMeshBinder m_MeshBinder;
+	CDxStateCache m_StateCache;
+	CRtrDrawStream m_DrawStream;
+	CRtrDrawDataBuffer m_DrawData;
     CPixelShaderPtr  m_NoSpecPS;
 	CPixelShaderPtr  m_PhongPS;
     CPixelShaderPtr  m_BlinnPhongPS;
 
-	ID3D11BufferPtr m_PerFrameCb;
-	ID3D11BufferPtr m_PerModelCb;
+	CConstantBufferRing m_CbRing;
+	SConstantBlock m_PerFrameBlock;
 
 	float3 m_LightDir;
 	float3 m_LightIntensity;
 
-	struct SPerMeshData
+	struct SPerDrawData
 	{
-		float4x4 World;
+		float4x4 World;  // Transposed
 	};
-	verify_cb_size_alignment(SPerMeshData);
 };
\ No newline at end of file
@@ -94,6 +94,16 @@ const float4x4& CModelViewCamera::GetProjMatrix()
     return m_ProjMat;
 }
 
+float CModelViewCamera::GetScreenSize(const float3& Position, float Size) const
+{
+    float Distance = (Position - m_Position).Length();
+    if(Distance <= 0)
+    {
+        return D3D11_FLOAT32_MAX;
+    }
+    return Size / (2 * Distance * tanf(m_FovY * 0.5f));
+}
+
 CModelViewCamera::CModelViewCamera()
 {
 }
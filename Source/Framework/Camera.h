@@ -54,6 +54,8 @@ public:
     void SetModelParams(const float3& Center, float Radius, float DistanceInRadius = 5);
 	float3 Project2DCrdToUnitSphere(float2 xy);
     const float3& GetPosition() const { return m_Position; }
+    // Fraction of the viewport height covered by a camera-facing segment of length Size, centered at Position. Uses the last calculated matrices
+    float GetScreenSize(const float3& Position, float Size) const;
     const float4x4& GetViewMatrix();
     const float4x4& GetProjMatrix();
 
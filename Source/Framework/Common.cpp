@@ -61,6 +61,15 @@ void trace(const std::wstring& file, const std::wstring& line, HRESULT hr, const
 	trace(error_msg);
 }
 
+void CSelfCheck::operator()(bool bPassed, const char* Name)
+{
+	if(bPassed == false)
+	{
+		trace(m_Owner + "::SelfCheck() failed: " + Name);
+		m_bPassed = false;
+	}
+}
+
 HRESULT FindFileInCommonDirs(const std::wstring& filename, std::wstring& result)
 {
 	// We don't actively search for the shader file, it's either in the current directory or in the media shader directory
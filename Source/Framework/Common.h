@@ -46,6 +46,7 @@ Filename: Common.h
 #include <memory>
 #include "RtrMath.h"
 #include "DxState.h"
+#include "DxStateCache.h"
 #include "StringUtils.h"
 
 #define WIDEN2(x) L ## x
@@ -60,6 +61,18 @@ void trace(const std::string& msg);
 void trace(const std::wstring& msg);
 void trace(const std::wstring& file, const std::wstring& line, HRESULT hr, const std::wstring& msg);
 
+// Collects the results of a device-free SelfCheck(), see CModelViewer::SelfChecks(). A failed check is traced with the owner's name
+class CSelfCheck
+{
+public:
+	CSelfCheck(const char* Owner) : m_Owner(Owner) {}
+	void operator()(bool bPassed, const char* Name);
+	bool Passed() const { return m_bPassed; }
+private:
+	std::string m_Owner;
+	bool m_bPassed = true;
+};
+
 #ifdef _DEBUG
 #define verify(a) {HRESULT __hr = a; if(FAILED(__hr)) { trace( __WIDEFILE__, __WIDELINE__, __hr, L#a); } }
 #define verify_return(a) {HRESULT __hr = a; if(FAILED(__hr)) { trace( __WIDEFILE__, __WIDELINE__, __hr, L#a); return __hr;} }
@@ -0,0 +1,274 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: ConstantBufferRing.cpp
+---------------------------------------------------------------------------*/
+#include "ConstantBufferRing.h"
+
+// FNV-1a over 64-bit words. Constant blocks are multiples of 16 bytes
+static UINT64 HashBlock(const void* pData, UINT Size)
+{
+	const UINT64* pWords = (const UINT64*)pData;
+	UINT64 Hash = 14695981039346656037ULL;
+	for(UINT i = 0; i < Size / sizeof(UINT64); i++)
+	{
+		Hash = (Hash ^ pWords[i]) * 1099511628211ULL;
+	}
+	return Hash;
+}
+
+CConstantBufferRing::CConstantBufferRing(ID3D11Device* pDevice, UINT Size)
+{
+	// Binding by offset needs D3D11.1, and mapping a constant buffer with NO_OVERWRITE needs the driver to support it
+	D3D11_FEATURE_DATA_D3D11_OPTIONS Options = { 0 };
+	m_bOffsets = SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &Options, sizeof(Options)));
+	m_bOffsets = m_bOffsets && Options.ConstantBufferOffsetting && Options.MapNoOverwriteOnDynamicConstantBuffer;
+
+	m_Size = (Size + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+	m_Offset = m_Size;  // The first allocation discards the buffer
+	memset(m_pBound, 0, sizeof(m_pBound));
+	if(m_bOffsets)
+	{
+		CreateBuffer(pDevice);
+	}
+}
+
+void CConstantBufferRing::CreateBuffer(ID3D11Device* pDevice)
+{
+	D3D11_BUFFER_DESC BufferDesc;
+	BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	BufferDesc.ByteWidth = m_Size;
+	BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	BufferDesc.MiscFlags = 0;
+	BufferDesc.StructureByteStride = 0;
+	BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	SBuffer Buffer;
+	Buffer.Generation = 0;
+	verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &Buffer.pBuffer));
+	m_Buffers.push_back(Buffer);
+}
+
+void CConstantBufferRing::Update(CDxStateCache& State, SConstantBlock& Block, const void* pData, UINT Size)
+{
+	const UINT64 Hash = HashBlock(pData, Size);
+	if(m_bOffsets == false || State.GetContext1() == nullptr)
+	{
+		UpdateFallback(State, Block, pData, Size, Hash);
+		return;
+	}
+
+	if(IsResident(Block) && Block.Hash == Hash)
+	{
+		m_Stats.SkippedUploads++;
+	}
+	else
+	{
+		const UINT AlignedSize = (Size + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+		assert(AlignedSize <= m_Size);
+		const bool bWrap = (m_Offset + AlignedSize > m_Size);
+		if(bWrap)
+		{
+			Wrap(State.GetContext(), &Block);
+		}
+
+		// Blocks before the offset might still be in use by the GPU, but NO_OVERWRITE promises we don't touch them
+		SBuffer& Buffer = m_Buffers[m_Current];
+		D3D11_MAPPED_SUBRESOURCE MapInfo;
+		verify(State.GetContext()->Map(Buffer.pBuffer, 0, bWrap ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &MapInfo));
+		memcpy((BYTE*)MapInfo.pData + m_Offset, pData, Size);
+		State.GetContext()->Unmap(Buffer.pBuffer, 0);
+
+		Block.Hash = Hash;
+		Block.BufferIndex = m_Current;
+		Block.Generation = Buffer.Generation;
+		Block.FirstConstant = m_Offset / 16;
+		Block.NumConstants = AlignedSize / 16;
+		m_Offset += AlignedSize;
+		m_Stats.Uploads++;
+		m_Stats.UploadedBytes += Size;
+	}
+
+	Bind(State, Block);
+}
+
+void CConstantBufferRing::Wrap(ID3D11DeviceContext* pCtx, const SConstantBlock* pUpdated)
+{
+	// Discarding a buffer drops the blocks in it. The current buffer is reused unless a bound block is in it.
+	// The block being updated doesn't count, it's bound again at its new offset
+	UINT Next = UINT(m_Buffers.size());
+	for(UINT i = 0; i < m_Buffers.size(); i++)
+	{
+		const UINT Candidate = (m_Current + i) % UINT(m_Buffers.size());
+		if(IsHoldingBoundBlock(Candidate, pUpdated) == false)
+		{
+			Next = Candidate;
+			break;
+		}
+	}
+	if(Next == m_Buffers.size())
+	{
+		ID3D11DevicePtr pDevice;
+		pCtx->GetDevice(&pDevice);
+		CreateBuffer(pDevice);
+	}
+
+	m_Current = Next;
+	m_Buffers[Next].Generation = ++m_Generation;
+	m_Offset = 0;
+	m_Stats.Wraps++;
+}
+
+bool CConstantBufferRing::IsHoldingBoundBlock(UINT BufferIndex, const SConstantBlock* pUpdated) const
+{
+	for(UINT Stage = 0; Stage < STAGE_COUNT; Stage++)
+	{
+		for(const SConstantBlock* pBound : m_pBound[Stage])
+		{
+			if(pBound && pBound != pUpdated && pBound->BufferIndex == BufferIndex && IsResident(*pBound))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool CConstantBufferRing::IsResident(const SConstantBlock& Block) const
+{
+	if(Block.pFallbackCb)
+	{
+		return Block.Generation != 0;
+	}
+	return Block.Generation != 0 && Block.BufferIndex < m_Buffers.size() && Block.Generation == m_Buffers[Block.BufferIndex].Generation;
+}
+
+void CConstantBufferRing::Reset()
+{
+	memset(m_pBound, 0, sizeof(m_pBound));
+	m_Stats = SStats();
+}
+
+void CConstantBufferRing::Rebind(CDxStateCache& State, const SConstantBlock& Block) const
+{
+	ID3D11Buffer* pCb = Block.pFallbackCb;
+	if(pCb)
+	{
+		if(Block.bVertexShader)
+		{
+			State.VSSetConstantBuffers(Block.Slot, 1, &pCb);
+		}
+		if(Block.bPixelShader)
+		{
+			State.PSSetConstantBuffers(Block.Slot, 1, &pCb);
+		}
+		return;
+	}
+
+	assert(IsResident(Block));
+	pCb = m_Buffers[Block.BufferIndex].pBuffer;
+	if(Block.bVertexShader)
+	{
+		State.VSSetConstantBuffers1(Block.Slot, 1, &pCb, &Block.FirstConstant, &Block.NumConstants);
+	}
+	if(Block.bPixelShader)
+	{
+		State.PSSetConstantBuffers1(Block.Slot, 1, &pCb, &Block.FirstConstant, &Block.NumConstants);
+	}
+}
+
+void CConstantBufferRing::Bind(CDxStateCache& State, SConstantBlock& Block)
+{
+	ID3D11Buffer* pCb = m_Buffers[Block.BufferIndex].pBuffer;
+	if(Block.bVertexShader)
+	{
+		m_pBound[VS_STAGE][Block.Slot] = &Block;
+		State.VSSetConstantBuffers1(Block.Slot, 1, &pCb, &Block.FirstConstant, &Block.NumConstants);
+	}
+	if(Block.bPixelShader)
+	{
+		m_pBound[PS_STAGE][Block.Slot] = &Block;
+		State.PSSetConstantBuffers1(Block.Slot, 1, &pCb, &Block.FirstConstant, &Block.NumConstants);
+	}
+}
+
+void CConstantBufferRing::UpdateFallback(CDxStateCache& State, SConstantBlock& Block, const void* pData, UINT Size, UINT64 Hash)
+{
+	if(Block.pFallbackCb == nullptr || Block.NumConstants * 16 != Size)
+	{
+		ID3D11DevicePtr pDevice;
+		State.GetContext()->GetDevice(&pDevice);
+		D3D11_BUFFER_DESC BufferDesc;
+		BufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		BufferDesc.ByteWidth = Size;
+		BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		BufferDesc.MiscFlags = 0;
+		BufferDesc.StructureByteStride = 0;
+		BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &Block.pFallbackCb));
+		Block.NumConstants = Size / 16;
+		Block.Generation = 0;
+	}
+
+	// The block's buffer keeps its contents until the next upload, so there's no generation to check
+	if(Block.Generation != 0 && Block.Hash == Hash)
+	{
+		m_Stats.SkippedUploads++;
+	}
+	else
+	{
+		D3D11_MAPPED_SUBRESOURCE MapInfo;
+		verify(State.GetContext()->Map(Block.pFallbackCb, 0, D3D11_MAP_WRITE_DISCARD, 0, &MapInfo));
+		memcpy(MapInfo.pData, pData, Size);
+		State.GetContext()->Unmap(Block.pFallbackCb, 0);
+		Block.Hash = Hash;
+		Block.Generation = 1;
+		m_Stats.Uploads++;
+		m_Stats.UploadedBytes += Size;
+	}
+
+	ID3D11Buffer* pCb = Block.pFallbackCb;
+	if(Block.bVertexShader)
+	{
+		State.VSSetConstantBuffers(Block.Slot, 1, &pCb);
+	}
+	if(Block.bPixelShader)
+	{
+		State.PSSetConstantBuffers(Block.Slot, 1, &pCb);
+	}
+}
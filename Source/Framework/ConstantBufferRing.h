@@ -0,0 +1,136 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: ConstantBufferRing.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "Common.h"
+#include "ShaderUtils.h"
+#include <vector>
+
+// A constant buffer which is always bound to the same slot. It remembers where its contents were last uploaded,
+// so that blocks whose contents didn't change are bound again without an upload
+struct SConstantBlock
+{
+	SConstantBlock(UINT Slot, bool bVertexShader, bool bPixelShader) : Slot(Slot), bVertexShader(bVertexShader), bPixelShader(bPixelShader) {}
+
+	UINT Slot;
+	bool bVertexShader;
+	bool bPixelShader;
+
+	// Set by the ring
+	UINT64 Hash = 0;
+	UINT BufferIndex = 0;  // Ring buffer of the last upload
+	UINT Generation = 0;   // Generation of that buffer at the last upload, 0 if the block was never uploaded
+	UINT FirstConstant = 0;
+	UINT NumConstants = 0;
+	ID3D11BufferPtr pFallbackCb;  // Only used when the device can't bind constant buffers by offset
+};
+
+// Suballocates constant blocks from large dynamic buffers. Blocks are written straight into the buffer with D3D11_MAP_WRITE_NO_OVERWRITE
+// and bound by offset. When the buffer is full, the ring moves on to a buffer which holds none of the bound blocks and discards it,
+// so the bound blocks stay valid without a copy of their data. A buffer is only added when all of them hold a bound block.
+// Devices which can't bind constant buffers by offset get a dedicated buffer per block
+class CConstantBufferRing
+{
+public:
+	// Constant buffer offsets must be multiples of 16 constants
+	static const UINT BLOCK_ALIGNMENT = 256;
+	static const UINT DEFAULT_SIZE = 1024 * 1024;
+
+	struct SStats
+	{
+		UINT Uploads = 0;
+		UINT SkippedUploads = 0;  // Blocks whose contents matched the last upload
+		UINT UploadedBytes = 0;
+		UINT Wraps = 0;
+	};
+
+	CConstantBufferRing(ID3D11Device* pDevice, UINT Size = DEFAULT_SIZE);
+
+	// Uploads the data unless it's the same as the block's last upload, and binds the block through the state cache
+	template<typename T>
+	void Update(CDxStateCache& State, SConstantBlock& Block, const T& Data)
+	{
+		verify_cb_size_alignment(T);
+		Update(State, Block, &Data, sizeof(T));
+	}
+	void Update(CDxStateCache& State, SConstantBlock& Block, const void* pData, UINT Size);
+
+	// Call at the start of the technique's frame. Forgets the bound blocks and clears the stats
+	void Reset();
+	// Binds the block's last upload without tracking it. For deferred contexts, which start without any state. The block must have been
+	// updated this frame, and must still be resident when the command list is executed
+	void Rebind(CDxStateCache& State, const SConstantBlock& Block) const;
+	// Returns true if the block's last upload is still in the ring. The buffers of the bound blocks are never discarded,
+	// so a block stays resident at least until another block is bound to its slot or Reset() is called
+	bool IsResident(const SConstantBlock& Block) const;
+
+	bool IsUsingOffsets() const { return m_bOffsets; }
+	const SStats& GetStats() const { return m_Stats; }
+
+private:
+	// Moves on to a buffer which holds no bound block other than pUpdated, adding one if needed. The caller discards it
+	void Wrap(ID3D11DeviceContext* pCtx, const SConstantBlock* pUpdated);
+	bool IsHoldingBoundBlock(UINT BufferIndex, const SConstantBlock* pUpdated) const;
+	void CreateBuffer(ID3D11Device* pDevice);
+	void Bind(CDxStateCache& State, SConstantBlock& Block);
+	void UpdateFallback(CDxStateCache& State, SConstantBlock& Block, const void* pData, UINT Size, UINT64 Hash);
+
+	enum
+	{
+		VS_STAGE,
+		PS_STAGE,
+		STAGE_COUNT
+	};
+	SConstantBlock* m_pBound[STAGE_COUNT][D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+
+	struct SBuffer
+	{
+		ID3D11BufferPtr pBuffer;
+		UINT Generation;  // Ring generation of the last discard
+	};
+	std::vector<SBuffer> m_Buffers;
+	UINT m_Current = 0;
+	UINT m_Size;
+	UINT m_Offset;
+	UINT m_Generation = 0;
+	bool m_bOffsets;
+	SStats m_Stats;
+};
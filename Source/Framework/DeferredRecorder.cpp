@@ -0,0 +1,219 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: DeferredRecorder.cpp
+---------------------------------------------------------------------------*/
+#include "DeferredRecorder.h"
+#include "ThreadPool.h"
+#include <chrono>
+
+void CDeferredRecorder::SplitIntoChunks(UINT ItemCount, UINT MaxChunks, UINT MinChunkSize, std::vector<SChunk>& Chunks)
+{
+	Chunks.clear();
+	if(ItemCount == 0)
+	{
+		return;
+	}
+
+	// The first (ItemCount % ChunkCount) chunks get one extra item
+	const UINT ChunkCount = max(1U, min(max(MaxChunks, 1U), ItemCount / max(MinChunkSize, 1U)));
+	const UINT ChunkSize = ItemCount / ChunkCount;
+	const UINT Remainder = ItemCount % ChunkCount;
+	UINT First = 0;
+	for(UINT i = 0; i < ChunkCount; i++)
+	{
+		SChunk Chunk;
+		Chunk.First = First;
+		Chunk.Count = ChunkSize + ((i < Remainder) ? 1 : 0);
+		Chunks.push_back(Chunk);
+		First += Chunk.Count;
+	}
+	assert(First == ItemCount);
+}
+
+CDeferredRecorder::CDeferredRecorder(ID3D11Device* pDevice) : m_pDevice(pDevice)
+{
+	D3D11_FEATURE_DATA_THREADING Threading = { 0 };
+	m_bDriverCommandLists = SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &Threading, sizeof(Threading))) && Threading.DriverCommandLists;
+}
+
+UINT CDeferredRecorder::Record(ID3D11DeviceContext* pImmediateCtx, CThreadPool* pThreadPool, UINT ItemCount, const RecordFunc& RecordChunk)
+{
+	m_Stats = SStats();
+	SplitIntoChunks(ItemCount, pThreadPool ? pThreadPool->GetThreadCount() : 1, m_MinChunkSize, m_Chunks);
+	m_Stats.ChunkCount = UINT(m_Chunks.size());
+
+	if((m_Chunks.size() > 1) && (m_bDriverCommandLists || m_bAllowEmulated))
+	{
+		RecordDeferred(pImmediateCtx, pThreadPool, RecordChunk);
+	}
+	else
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		for(UINT ChunkID = 0; ChunkID < m_Chunks.size(); ChunkID++)
+		{
+			RecordChunk(pImmediateCtx, ChunkID, m_Chunks[ChunkID]);
+		}
+		m_Stats.RecordTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count();
+	}
+	return m_Stats.ChunkCount;
+}
+
+void CDeferredRecorder::RecordDeferred(ID3D11DeviceContext* pImmediateCtx, CThreadPool* pThreadPool, const RecordFunc& RecordChunk)
+{
+	// Deferred contexts don't inherit anything from the immediate context, so they get its output bindings
+	ID3D11RenderTargetView* pRtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	ID3D11DepthStencilView* pDsv;
+	pImmediateCtx->OMGetRenderTargets(ARRAYSIZE(pRtvs), pRtvs, &pDsv);
+	D3D11_VIEWPORT Viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+	UINT ViewportCount = ARRAYSIZE(Viewports);
+	pImmediateCtx->RSGetViewports(&ViewportCount, Viewports);
+
+	while(m_DeferredContexts.size() < m_Chunks.size())
+	{
+		ID3D11DeviceContextPtr pCtx;
+		verify(m_pDevice->CreateDeferredContext(0, &pCtx));
+		m_DeferredContexts.push_back(pCtx);
+	}
+	m_CommandLists.resize(m_Chunks.size());
+	m_Stats.bDeferred = true;
+
+	auto Start = std::chrono::high_resolution_clock::now();
+	pThreadPool->ParallelFor(UINT(m_Chunks.size()), [&](UINT ChunkID)
+	{
+		ID3D11DeviceContext* pCtx = m_DeferredContexts[ChunkID];
+		pCtx->OMSetRenderTargets(ARRAYSIZE(pRtvs), pRtvs, pDsv);
+		pCtx->RSSetViewports(ViewportCount, Viewports);
+		RecordChunk(pCtx, ChunkID, m_Chunks[ChunkID]);
+		// FALSE resets the deferred context to the default state, ready for the next frame
+		verify(pCtx->FinishCommandList(FALSE, &m_CommandLists[ChunkID]));
+	});
+	auto Recorded = std::chrono::high_resolution_clock::now();
+	m_Stats.RecordTime = std::chrono::duration<float>(Recorded - Start).count();
+
+	// Not saving and restoring the immediate context state around every command list is the fast path. Only the output bindings are restored
+	for(auto& pCommandList : m_CommandLists)
+	{
+		pImmediateCtx->ExecuteCommandList(pCommandList, FALSE);
+		pCommandList = nullptr;
+	}
+	pImmediateCtx->OMSetRenderTargets(ARRAYSIZE(pRtvs), pRtvs, pDsv);
+	pImmediateCtx->RSSetViewports(ViewportCount, Viewports);
+	m_Stats.ExecuteTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Recorded).count();
+
+	// OMGetRenderTargets() added references
+	for(ID3D11RenderTargetView* pRtv : pRtvs)
+	{
+		if(pRtv)
+		{
+			pRtv->Release();
+		}
+	}
+	if(pDsv)
+	{
+		pDsv->Release();
+	}
+}
+
+// The chunks cover the items in order, there are at most MaxChunks of them, and their sizes differ by one item at most
+static bool IsValidSplit(UINT ItemCount, UINT MaxChunks, UINT MinChunkSize, const std::vector<CDeferredRecorder::SChunk>& Chunks)
+{
+	if(ItemCount == 0)
+	{
+		return Chunks.empty();
+	}
+	if(Chunks.empty() || Chunks.size() > max(MaxChunks, 1U))
+	{
+		return false;
+	}
+
+	UINT First = 0;
+	UINT MinCount = UINT(-1);
+	UINT MaxCount = 0;
+	for(const auto& Chunk : Chunks)
+	{
+		if(Chunk.First != First || Chunk.Count == 0)
+		{
+			return false;
+		}
+		First += Chunk.Count;
+		MinCount = min(MinCount, Chunk.Count);
+		MaxCount = max(MaxCount, Chunk.Count);
+	}
+
+	// A single chunk may be smaller than MinChunkSize, when there are fewer items than that
+	const bool bMinSize = (Chunks.size() == 1) || (MinCount >= MinChunkSize);
+	return (First == ItemCount) && (MaxCount - MinCount <= 1) && bMinSize;
+}
+
+bool CDeferredRecorder::SelfCheck()
+{
+	CSelfCheck Check("CDeferredRecorder");
+	std::vector<SChunk> Chunks;
+
+	SplitIntoChunks(0, 4, 16, Chunks);
+	Check(Chunks.empty(), "no items give no chunks");
+
+	SplitIntoChunks(10, 4, 16, Chunks);
+	Check(Chunks.size() == 1 && Chunks[0].First == 0 && Chunks[0].Count == 10, "fewer items than MinChunkSize give a single chunk");
+
+	SplitIntoChunks(100, 0, 16, Chunks);
+	Check(Chunks.size() == 1 && Chunks[0].Count == 100, "MaxChunks of 0 gives a single chunk");
+
+	SplitIntoChunks(100, 4, 0, Chunks);
+	Check(Chunks.size() == 4 && IsValidSplit(100, 4, 0, Chunks), "MinChunkSize of 0 splits into MaxChunks");
+
+	SplitIntoChunks(10, 3, 1, Chunks);
+	Check(Chunks.size() == 3 && Chunks[0].Count == 4 && Chunks[1].Count == 3 && Chunks[2].Count == 3, "the first chunks get the remainder");
+
+	bool bSweep = true;
+	for(UINT ItemCount = 0; ItemCount <= 300; ItemCount++)
+	{
+		for(UINT MaxChunks = 0; MaxChunks <= 9; MaxChunks++)
+		{
+			for(UINT MinChunkSize = 0; MinChunkSize <= 40; MinChunkSize += 8)
+			{
+				SplitIntoChunks(ItemCount, MaxChunks, MinChunkSize, Chunks);
+				bSweep = bSweep && IsValidSplit(ItemCount, MaxChunks, MinChunkSize, Chunks);
+			}
+		}
+	}
+	Check(bSweep, "the chunks keep the item order and differ by one item at most");
+	return Check.Passed();
+}
@@ -0,0 +1,109 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: DeferredRecorder.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "Common.h"
+#include <vector>
+#include <functional>
+
+class CThreadPool;
+
+// Records a long list of draws on several threads. The list is split into contiguous chunks, each chunk is recorded into its own deferred
+// context on the thread pool, and the command lists are executed on the immediate context in chunk order.
+// When the driver doesn't support command lists, the runtime emulates them, which is usually slower than recording on a single thread.
+// In that case the recorder falls back to recording the chunks on the immediate context
+class CDeferredRecorder
+{
+public:
+	struct SChunk
+	{
+		UINT First;
+		UINT Count;
+	};
+
+	struct SStats
+	{
+		UINT ChunkCount = 0;
+		bool bDeferred = false;  // Whether the chunks were recorded on deferred contexts
+		float RecordTime = 0;    // In seconds, from the first chunk's start to the last chunk's end
+		float ExecuteTime = 0;   // In seconds, executing all the command lists
+	};
+
+	// Records one chunk of items into pCtx. Chunks run concurrently, so the function may only write per-chunk state.
+	// Deferred contexts start with the default pipeline state, except for the render targets and viewports, which are copied from the immediate context
+	typedef std::function<void(ID3D11DeviceContext* pCtx, UINT ChunkID, const SChunk& Chunk)> RecordFunc;
+
+	static const UINT DEFAULT_MIN_CHUNK_SIZE = 128;
+
+	// Splits ItemCount items into at most MaxChunks contiguous chunks of at least MinChunkSize items, unless there are fewer items than that.
+	// The chunks keep the item order and their sizes differ by one item at most. It doesn't use the device, so it can be checked without one
+	static void SplitIntoChunks(UINT ItemCount, UINT MaxChunks, UINT MinChunkSize, std::vector<SChunk>& Chunks);
+	// Checks SplitIntoChunks() on the edge cases and on a sweep of item counts. Returns false and traces the failing checks
+	static bool SelfCheck();
+
+	CDeferredRecorder(ID3D11Device* pDevice);
+
+	// Records the items with one chunk per thread of the pool, and returns the number of chunks.
+	// Without a pool, with a single chunk, or without driver command lists, the chunks are recorded in order on pImmediateCtx, which the recorder
+	// doesn't touch itself, so that path can be driven by a fake context. After executing the command lists the immediate context is in the default
+	// state, except for the render targets and the viewports. Callers must invalidate whatever state they shadow
+	UINT Record(ID3D11DeviceContext* pImmediateCtx, CThreadPool* pThreadPool, UINT ItemCount, const RecordFunc& RecordChunk);
+
+	// Whether the driver records command lists natively
+	bool HasDriverCommandLists() const { return m_bDriverCommandLists; }
+	// Use deferred contexts even when the runtime emulates the command lists, to measure the emulation
+	void SetAllowEmulatedCommandLists(bool bAllow) { m_bAllowEmulated = bAllow; }
+	void SetMinChunkSize(UINT Size) { m_MinChunkSize = max(Size, 1U); }
+	const SStats& GetStats() const { return m_Stats; }
+
+private:
+	void RecordDeferred(ID3D11DeviceContext* pImmediateCtx, CThreadPool* pThreadPool, const RecordFunc& RecordChunk);
+
+	ID3D11DevicePtr m_pDevice;
+	bool m_bDriverCommandLists;
+	bool m_bAllowEmulated = false;
+	UINT m_MinChunkSize = DEFAULT_MIN_CHUNK_SIZE;
+
+	std::vector<SChunk> m_Chunks;
+	std::vector<ID3D11DeviceContextPtr> m_DeferredContexts;  // One per chunk, created on first use
+	std::vector<ID3D11CommandListPtr> m_CommandLists;
+	SStats m_Stats;
+};
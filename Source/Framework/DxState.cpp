@@ -41,6 +41,7 @@ Filename: DxState.cpp
 ---------------------------------------------------------------------------*/
 #include "Common.h"
 #include "DxState.h"
+#include "DxStateCache.h"
 #include "WICTextureLoader.h"
 #include "DDSTextureLoader.h"
 #include "StringUtils.h"
@@ -184,3 +185,108 @@ ID3D11SamplerState* SSamplerState::Point(ID3D11Device* pDevice)
 	return pLinearSampler;
 
 }
+
+CSetDepthState::CSetDepthState(ID3D11DeviceContext* pCtx, ID3D11DepthStencilState* pState, UINT StenilRef)
+{
+	m_pCtx = pCtx;
+	m_pCtx->OMGetDepthStencilState(&m_pState, &m_StenilRef);
+	m_pCtx->OMSetDepthStencilState(pState, StenilRef);
+}
+
+CSetDepthState::CSetDepthState(CDxStateCache& Cache, ID3D11DepthStencilState* pState, UINT StenilRef)
+{
+	m_pCtx = Cache.GetContext();
+	m_pCache = &Cache;
+	ID3D11DepthStencilState* pPrevState;
+	if(Cache.GetDepthStencilState(pPrevState, m_StenilRef))
+	{
+		m_pState = pPrevState;
+	}
+	else
+	{
+		m_pCtx->OMGetDepthStencilState(&m_pState, &m_StenilRef);
+	}
+	Cache.OMSetDepthStencilState(pState, StenilRef);
+}
+
+CSetDepthState::~CSetDepthState()
+{
+	if(m_pCache)
+	{
+		m_pCache->OMSetDepthStencilState(m_pState, m_StenilRef);
+	}
+	else
+	{
+		m_pCtx->OMSetDepthStencilState(m_pState, m_StenilRef);
+	}
+}
+
+CSetVertexShader::CSetVertexShader(ID3D11DeviceContext* pCtx, ID3D11VertexShader* pVS)
+{
+	m_pCtx = pCtx;
+	m_pCtx->VSGetShader(&m_VS, nullptr, nullptr);
+	m_pCtx->VSSetShader(pVS, nullptr, 0);
+}
+
+CSetVertexShader::CSetVertexShader(CDxStateCache& Cache, ID3D11VertexShader* pVS)
+{
+	m_pCtx = Cache.GetContext();
+	m_pCache = &Cache;
+	ID3D11VertexShader* pPrevVS;
+	if(Cache.GetVertexShader(pPrevVS))
+	{
+		m_VS = pPrevVS;
+	}
+	else
+	{
+		m_pCtx->VSGetShader(&m_VS, nullptr, nullptr);
+	}
+	Cache.VSSetShader(pVS);
+}
+
+CSetVertexShader::~CSetVertexShader()
+{
+	if(m_pCache)
+	{
+		m_pCache->VSSetShader(m_VS);
+	}
+	else
+	{
+		m_pCtx->VSSetShader(m_VS, nullptr, 0);
+	}
+}
+
+CSetPixelShader::CSetPixelShader(ID3D11DeviceContext* pCtx, ID3D11PixelShader* pPS)
+{
+	m_pCtx = pCtx;
+	m_pCtx->PSGetShader(&m_PS, nullptr, nullptr);
+	pCtx->PSSetShader(pPS, nullptr, 0);
+}
+
+CSetPixelShader::CSetPixelShader(CDxStateCache& Cache, ID3D11PixelShader* pPS)
+{
+	m_pCtx = Cache.GetContext();
+	m_pCache = &Cache;
+	ID3D11PixelShader* pPrevPS;
+	if(Cache.GetPixelShader(pPrevPS))
+	{
+		m_PS = pPrevPS;
+	}
+	else
+	{
+		m_pCtx->PSGetShader(&m_PS, nullptr, nullptr);
+	}
+	Cache.PSSetShader(pPS);
+}
+
+CSetPixelShader::~CSetPixelShader()
+{
+	if(m_pCache)
+	{
+		m_pCache->PSSetShader(m_PS);
+	}
+	else
+	{
+		m_pCtx->PSSetShader(m_PS, nullptr, 0);
+	}
+}
@@ -40,7 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 Filename: DxState.h
 ---------------------------------------------------------------------------*/
 #pragma once
-#include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.inl>
 #include <comdef.h>
 #include <string>
@@ -50,6 +50,8 @@ Filename: DxState.h
 // Device
 MAKE_SMART_COM_PTR(ID3D11Device);
 MAKE_SMART_COM_PTR(ID3D11DeviceContext);
+MAKE_SMART_COM_PTR(ID3D11DeviceContext1);
+MAKE_SMART_COM_PTR(ID3D11CommandList);
 MAKE_SMART_COM_PTR(ID3D11InputLayout);
 
 // DXGI
@@ -88,6 +90,8 @@ MAKE_SMART_COM_PTR(ID3D11BlendState);
 MAKE_SMART_COM_PTR(ID3D11SamplerState);
 
 ID3D11ShaderResourceView* CreateShaderResourceViewFromFile(ID3D11Device* pDevice, const std::wstring& Filename, bool bSrgb);
+// Decodes the image and generates the mip-chain on the CPU. Doesn't use the immediate context, so it's safe to call from worker threads
+ID3D11ShaderResourceView* CreateShaderResourceViewFromFileThreadSafe(ID3D11Device* pDevice, const std::wstring& Filename, bool bSrgb);
 
 
 // Common states
@@ -115,23 +119,20 @@ struct SSamplerState
 };
 
 
+class CDxStateCache;
+
+// The state helpers restore the previous state when they go out of scope.
+// The overloads which take a state cache read the previous state from it when it's known, instead of a get round-trip on the context
 class CSetDepthState
 {
 public:
-	CSetDepthState(ID3D11DeviceContext* pCtx, ID3D11DepthStencilState* pState, UINT StenilRef)
-	{
-		m_pCtx = pCtx;
-		m_pCtx->OMGetDepthStencilState(&m_pState, &m_StenilRef);
-		m_pCtx->OMSetDepthStencilState(pState, StenilRef);
-	}
-
-	~CSetDepthState()
-	{
-		m_pCtx->OMSetDepthStencilState(m_pState, m_StenilRef);
-	}
+	CSetDepthState(ID3D11DeviceContext* pCtx, ID3D11DepthStencilState* pState, UINT StenilRef);
+	CSetDepthState(CDxStateCache& Cache, ID3D11DepthStencilState* pState, UINT StenilRef);
+	~CSetDepthState();
 
 private:
 	ID3D11DeviceContext* m_pCtx;
+	CDxStateCache* m_pCache = nullptr;
 	ID3D11DepthStencilStatePtr m_pState;
 	UINT m_StenilRef;
 };
@@ -139,37 +140,25 @@ private:
 class CSetVertexShader
 {
 public:
-	CSetVertexShader(ID3D11DeviceContext* pCtx, ID3D11VertexShader* pVS)
-	{
-		m_pCtx = pCtx;
-		m_pCtx->VSGetShader(&m_VS, nullptr, nullptr);
-		m_pCtx->VSSetShader(pVS, nullptr, 0);
-	}
-
-	~CSetVertexShader()
-	{
-		m_pCtx->VSSetShader(m_VS, nullptr, 0);
-	}
+	CSetVertexShader(ID3D11DeviceContext* pCtx, ID3D11VertexShader* pVS);
+	CSetVertexShader(CDxStateCache& Cache, ID3D11VertexShader* pVS);
+	~CSetVertexShader();
+
 private:
 	ID3D11DeviceContext* m_pCtx;
-	ID3D11VertexShader* m_VS;
+	CDxStateCache* m_pCache = nullptr;
+	ID3D11VertexShaderPtr m_VS;
 };
 
 class CSetPixelShader
 {
 public:
-	CSetPixelShader(ID3D11DeviceContext* pCtx, ID3D11PixelShader* pPS)
-	{
-		m_pCtx = pCtx;
-		m_pCtx->PSGetShader(&m_PS, nullptr, nullptr);
-		pCtx->PSSetShader(pPS, nullptr, 0);
-	}
-
-	~CSetPixelShader()
-	{
-		m_pCtx->PSSetShader(m_PS, nullptr, 0);
-	}
+	CSetPixelShader(ID3D11DeviceContext* pCtx, ID3D11PixelShader* pPS);
+	CSetPixelShader(CDxStateCache& Cache, ID3D11PixelShader* pPS);
+	~CSetPixelShader();
+
 private:
 	ID3D11DeviceContext* m_pCtx;
-	ID3D11PixelShader* m_PS;
+	CDxStateCache* m_pCache = nullptr;
+	ID3D11PixelShaderPtr m_PS;
 };
\ No newline at end of file
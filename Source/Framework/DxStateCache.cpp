@@ -0,0 +1,479 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: DxStateCache.cpp
+---------------------------------------------------------------------------*/
+#include "Common.h"
+#include "DxStateCache.h"
+#include <vector>
+
+bool CDxStateCache::SBlend::operator==(const SBlend& Other) const
+{
+	return pState == Other.pState && SampleMask == Other.SampleMask && memcmp(BlendFactor, Other.BlendFactor, sizeof(BlendFactor)) == 0;
+}
+
+void CDxStateCache::SContextTarget::VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	assert(pCtx1 != nullptr);
+	if(pCtx1)
+	{
+		pCtx1->VSSetConstantBuffers1(StartSlot, Count, ppBuffers, pFirstConstant, pNumConstants);
+	}
+}
+
+void CDxStateCache::SContextTarget::PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	assert(pCtx1 != nullptr);
+	if(pCtx1)
+	{
+		pCtx1->PSSetConstantBuffers1(StartSlot, Count, ppBuffers, pFirstConstant, pNumConstants);
+	}
+}
+
+void CDxStateCache::Reset(ID3D11DeviceContext* pCtx)
+{
+	if(pCtx != m_Context.pCtx)
+	{
+		m_Context.pCtx1 = nullptr;
+		pCtx->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_Context.pCtx1);
+	}
+	m_Context.pCtx = pCtx;
+	m_pTarget = nullptr;
+	m_Stats = SStats();
+	Invalidate();
+}
+
+void CDxStateCache::Reset(IDxStateTarget* pTarget)
+{
+	m_pTarget = pTarget;
+	m_Stats = SStats();
+	Invalidate();
+}
+
+void CDxStateCache::Invalidate()
+{
+	m_VS.bKnown = false;
+	m_PS.bKnown = false;
+	for(UINT Stage = 0; Stage < STAGE_COUNT; Stage++)
+	{
+		for(auto& Slot : m_ConstantBuffers[Stage])
+		{
+			Slot.bKnown = false;
+		}
+		for(auto& Slot : m_Srvs[Stage])
+		{
+			Slot.bKnown = false;
+		}
+	}
+	for(auto& Slot : m_Samplers)
+	{
+		Slot.bKnown = false;
+	}
+
+	m_InputLayout.bKnown = false;
+	for(auto& Slot : m_VertexBuffers)
+	{
+		Slot.bKnown = false;
+	}
+	m_IndexBuffer.bKnown = false;
+	m_Topology.bKnown = false;
+
+	m_RasterizerState.bKnown = false;
+	m_DepthStencilState.bKnown = false;
+	m_BlendState.bKnown = false;
+}
+
+bool CDxStateCache::Filter(bool bChanged)
+{
+	if(bChanged)
+	{
+		m_Stats.IssuedCalls++;
+	}
+	else
+	{
+		m_Stats.FilteredCalls++;
+	}
+	return bChanged;
+}
+
+template<typename T, UINT N>
+bool CDxStateCache::UpdateSlots(TShadow<T>(&Slots)[N], UINT StartSlot, UINT Count, const T* pValues, UINT& First, UINT& Last)
+{
+	First = Count;
+	Last = 0;
+	for(UINT i = 0; i < Count; i++)
+	{
+		const UINT Slot = StartSlot + i;
+		const bool bChanged = (Slot < N) ? Slots[Slot].Update(pValues[i]) : true;
+		if(bChanged)
+		{
+			First = min(First, i);
+			Last = i;
+		}
+	}
+	return First < Count;
+}
+
+void CDxStateCache::VSSetShader(ID3D11VertexShader* pVS)
+{
+	if(Filter(m_VS.Update(pVS)))
+	{
+		GetTarget().VSSetShader(pVS);
+	}
+}
+
+void CDxStateCache::PSSetShader(ID3D11PixelShader* pPS)
+{
+	if(Filter(m_PS.Update(pPS)))
+	{
+		GetTarget().PSSetShader(pPS);
+	}
+}
+
+void CDxStateCache::SetConstantBuffers(STAGE Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	assert(StartSlot + Count <= MAX_CB_SLOTS);
+	SConstantBuffer Buffers[MAX_CB_SLOTS];
+	for(UINT i = 0; i < Count; i++)
+	{
+		Buffers[i].pBuffer = ppBuffers[i];
+		Buffers[i].FirstConstant = pFirstConstant ? pFirstConstant[i] : 0;
+		Buffers[i].NumConstants = pNumConstants ? pNumConstants[i] : 0;
+	}
+
+	UINT First, Last;
+	if(Filter(UpdateSlots(m_ConstantBuffers[Stage], StartSlot, Count, Buffers, First, Last)))
+	{
+		// Only the slots which changed are bound
+		const UINT Slot = StartSlot + First;
+		const UINT SlotCount = Last - First + 1;
+		if(pFirstConstant)
+		{
+			if(Stage == VERTEX_STAGE)
+			{
+				GetTarget().VSSetConstantBuffers1(Slot, SlotCount, ppBuffers + First, pFirstConstant + First, pNumConstants + First);
+			}
+			else
+			{
+				GetTarget().PSSetConstantBuffers1(Slot, SlotCount, ppBuffers + First, pFirstConstant + First, pNumConstants + First);
+			}
+		}
+		else if(Stage == VERTEX_STAGE)
+		{
+			GetTarget().VSSetConstantBuffers(Slot, SlotCount, ppBuffers + First);
+		}
+		else
+		{
+			GetTarget().PSSetConstantBuffers(Slot, SlotCount, ppBuffers + First);
+		}
+	}
+}
+
+void CDxStateCache::SetShaderResources(STAGE Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs)
+{
+	UINT First, Last;
+	if(Filter(UpdateSlots(m_Srvs[Stage], StartSlot, Count, ppSrvs, First, Last)))
+	{
+		if(Stage == VERTEX_STAGE)
+		{
+			GetTarget().VSSetShaderResources(StartSlot + First, Last - First + 1, ppSrvs + First);
+		}
+		else
+		{
+			GetTarget().PSSetShaderResources(StartSlot + First, Last - First + 1, ppSrvs + First);
+		}
+	}
+}
+
+void CDxStateCache::VSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers)
+{
+	SetConstantBuffers(VERTEX_STAGE, StartSlot, Count, ppBuffers, nullptr, nullptr);
+}
+
+void CDxStateCache::PSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers)
+{
+	SetConstantBuffers(PIXEL_STAGE, StartSlot, Count, ppBuffers, nullptr, nullptr);
+}
+
+void CDxStateCache::VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	SetConstantBuffers(VERTEX_STAGE, StartSlot, Count, ppBuffers, pFirstConstant, pNumConstants);
+}
+
+void CDxStateCache::PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants)
+{
+	SetConstantBuffers(PIXEL_STAGE, StartSlot, Count, ppBuffers, pFirstConstant, pNumConstants);
+}
+
+void CDxStateCache::VSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs)
+{
+	SetShaderResources(VERTEX_STAGE, StartSlot, Count, ppSrvs);
+}
+
+void CDxStateCache::PSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs)
+{
+	SetShaderResources(PIXEL_STAGE, StartSlot, Count, ppSrvs);
+}
+
+void CDxStateCache::PSSetSamplers(UINT StartSlot, UINT Count, ID3D11SamplerState* const* ppSamplers)
+{
+	UINT First, Last;
+	if(Filter(UpdateSlots(m_Samplers, StartSlot, Count, ppSamplers, First, Last)))
+	{
+		GetTarget().PSSetSamplers(StartSlot + First, Last - First + 1, ppSamplers + First);
+	}
+}
+
+void CDxStateCache::IASetInputLayout(ID3D11InputLayout* pLayout)
+{
+	if(Filter(m_InputLayout.Update(pLayout)))
+	{
+		GetTarget().IASetInputLayout(pLayout);
+	}
+}
+
+void CDxStateCache::IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets)
+{
+	if(StartSlot + Count > MAX_VB_SLOTS)
+	{
+		// Not shadowed, forget whatever we knew about the slots in the range
+		for(UINT Slot = StartSlot; Slot < MAX_VB_SLOTS; Slot++)
+		{
+			m_VertexBuffers[Slot].bKnown = false;
+		}
+		Filter(true);
+		GetTarget().IASetVertexBuffers(StartSlot, Count, ppBuffers, pStrides, pOffsets);
+		return;
+	}
+
+	SVertexBuffer Buffers[MAX_VB_SLOTS];
+	for(UINT i = 0; i < Count; i++)
+	{
+		Buffers[i].pBuffer = ppBuffers[i];
+		Buffers[i].Stride = pStrides[i];
+		Buffers[i].Offset = pOffsets[i];
+	}
+
+	UINT First, Last;
+	if(Filter(UpdateSlots(m_VertexBuffers, StartSlot, Count, Buffers, First, Last)))
+	{
+		GetTarget().IASetVertexBuffers(StartSlot + First, Last - First + 1, ppBuffers + First, pStrides + First, pOffsets + First);
+	}
+}
+
+void CDxStateCache::IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT Format, UINT Offset)
+{
+	const SIndexBuffer IndexBuffer = { pBuffer, Format, Offset };
+	if(Filter(m_IndexBuffer.Update(IndexBuffer)))
+	{
+		GetTarget().IASetIndexBuffer(pBuffer, Format, Offset);
+	}
+}
+
+void CDxStateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology)
+{
+	if(Filter(m_Topology.Update(Topology)))
+	{
+		GetTarget().IASetPrimitiveTopology(Topology);
+	}
+}
+
+void CDxStateCache::RSSetState(ID3D11RasterizerState* pState)
+{
+	if(Filter(m_RasterizerState.Update(pState)))
+	{
+		GetTarget().RSSetState(pState);
+	}
+}
+
+void CDxStateCache::OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT StencilRef)
+{
+	const SDepthStencil DepthStencil = { pState, StencilRef };
+	if(Filter(m_DepthStencilState.Update(DepthStencil)))
+	{
+		GetTarget().OMSetDepthStencilState(pState, StencilRef);
+	}
+}
+
+void CDxStateCache::OMSetBlendState(ID3D11BlendState* pState, const FLOAT BlendFactor[4], UINT SampleMask)
+{
+	// A null blend factor is the same as a factor of 1
+	SBlend Blend;
+	Blend.pState = pState;
+	Blend.SampleMask = SampleMask;
+	for(UINT i = 0; i < 4; i++)
+	{
+		Blend.BlendFactor[i] = BlendFactor ? BlendFactor[i] : 1.0f;
+	}
+
+	if(Filter(m_BlendState.Update(Blend)))
+	{
+		GetTarget().OMSetBlendState(pState, Blend.BlendFactor, SampleMask);
+	}
+}
+
+bool CDxStateCache::GetVertexShader(ID3D11VertexShader*& pVS) const
+{
+	pVS = m_VS.Value;
+	return m_VS.bKnown;
+}
+
+bool CDxStateCache::GetPixelShader(ID3D11PixelShader*& pPS) const
+{
+	pPS = m_PS.Value;
+	return m_PS.bKnown;
+}
+
+bool CDxStateCache::GetDepthStencilState(ID3D11DepthStencilState*& pState, UINT& StencilRef) const
+{
+	pState = m_DepthStencilState.Value.pState;
+	StencilRef = m_DepthStencilState.Value.StencilRef;
+	return m_DepthStencilState.bKnown;
+}
+
+// Records the calls which reach the context. The cache never dereferences the objects, so the checks use made up pointers
+class CRecordingTarget : public IDxStateTarget
+{
+public:
+	struct SCall
+	{
+		const char* Name;
+		UINT StartSlot;
+		UINT Count;
+	};
+	std::vector<SCall> Calls;
+
+	void VSSetShader(ID3D11VertexShader*) override { Record("VSSetShader"); }
+	void PSSetShader(ID3D11PixelShader*) override { Record("PSSetShader"); }
+	void VSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const*) override { Record("VSSetConstantBuffers", StartSlot, Count); }
+	void PSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const*) override { Record("PSSetConstantBuffers", StartSlot, Count); }
+	void VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const*, const UINT*, const UINT*) override { Record("VSSetConstantBuffers1", StartSlot, Count); }
+	void PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const*, const UINT*, const UINT*) override { Record("PSSetConstantBuffers1", StartSlot, Count); }
+	void VSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const*) override { Record("VSSetShaderResources", StartSlot, Count); }
+	void PSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const*) override { Record("PSSetShaderResources", StartSlot, Count); }
+	void PSSetSamplers(UINT StartSlot, UINT Count, ID3D11SamplerState* const*) override { Record("PSSetSamplers", StartSlot, Count); }
+	void IASetInputLayout(ID3D11InputLayout*) override { Record("IASetInputLayout"); }
+	void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const*, const UINT*, const UINT*) override { Record("IASetVertexBuffers", StartSlot, Count); }
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT) override { Record("IASetIndexBuffer"); }
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) override { Record("IASetPrimitiveTopology"); }
+	void RSSetState(ID3D11RasterizerState*) override { Record("RSSetState"); }
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT) override { Record("OMSetDepthStencilState"); }
+	void OMSetBlendState(ID3D11BlendState*, const FLOAT[4], UINT) override { Record("OMSetBlendState"); }
+
+	// Returns true if the calls since the last Take() are exactly the expected ones, and forgets them
+	bool Take(const std::vector<SCall>& Expected)
+	{
+		bool bMatch = (Calls.size() == Expected.size());
+		for(size_t i = 0; bMatch && i < Calls.size(); i++)
+		{
+			bMatch = (strcmp(Calls[i].Name, Expected[i].Name) == 0) && (Calls[i].StartSlot == Expected[i].StartSlot) && (Calls[i].Count == Expected[i].Count);
+		}
+		Calls.clear();
+		return bMatch;
+	}
+
+private:
+	void Record(const char* Name, UINT StartSlot = 0, UINT Count = 1)
+	{
+		SCall Call = { Name, StartSlot, Count };
+		Calls.push_back(Call);
+	}
+};
+
+template<typename T>
+static T* FakeObject(UINT_PTR ID)
+{
+	return reinterpret_cast<T*>(ID * 16);
+}
+
+bool CDxStateCache::SelfCheck()
+{
+	CRecordingTarget Target;
+	CDxStateCache Cache;
+	Cache.Reset(&Target);
+	CSelfCheck Check("CDxStateCache");
+
+	ID3D11VertexShader* pVS = FakeObject<ID3D11VertexShader>(1);
+	Cache.VSSetShader(pVS);
+	Cache.VSSetShader(pVS);
+	Check(Target.Take({ { "VSSetShader", 0, 1 } }), "a repeated shader is filtered");
+	Cache.Invalidate();
+	Cache.VSSetShader(pVS);
+	Check(Target.Take({ { "VSSetShader", 0, 1 } }), "the state is issued again after Invalidate()");
+
+	// Only the slots which changed are bound
+	ID3D11Buffer* Buffers[3] = { FakeObject<ID3D11Buffer>(2), FakeObject<ID3D11Buffer>(3), FakeObject<ID3D11Buffer>(4) };
+	Cache.PSSetConstantBuffers(0, 3, Buffers);
+	Check(Target.Take({ { "PSSetConstantBuffers", 0, 3 } }), "a new constant buffer range is bound");
+	std::swap(Buffers[1], Buffers[2]);
+	Cache.PSSetConstantBuffers(0, 3, Buffers);
+	Check(Target.Take({ { "PSSetConstantBuffers", 1, 2 } }), "only the changed constant buffer slots are bound");
+	Cache.VSSetConstantBuffers(0, 3, Buffers);
+	Check(Target.Take({ { "VSSetConstantBuffers", 0, 3 } }), "the stages are shadowed separately");
+
+	// A range of the same buffer is a different bind
+	const UINT FirstConstant[2] = { 0, 16 };
+	const UINT NumConstants[2] = { 16, 16 };
+	Cache.VSSetConstantBuffers1(2, 1, Buffers, FirstConstant, NumConstants);
+	Cache.VSSetConstantBuffers1(2, 1, Buffers, FirstConstant, NumConstants);
+	Cache.VSSetConstantBuffers1(2, 1, Buffers, FirstConstant + 1, NumConstants + 1);
+	Check(Target.Take({ { "VSSetConstantBuffers1", 2, 1 }, { "VSSetConstantBuffers1", 2, 1 } }), "constant buffer ranges are compared by offset");
+
+	// Vertex buffers past the shadowed slots are always issued
+	ID3D11Buffer* VertexBuffers[MAX_VB_SLOTS + 1] = {};
+	UINT Strides[MAX_VB_SLOTS + 1] = {};
+	UINT Offsets[MAX_VB_SLOTS + 1] = {};
+	Cache.IASetVertexBuffers(0, MAX_VB_SLOTS + 1, VertexBuffers, Strides, Offsets);
+	Cache.IASetVertexBuffers(0, MAX_VB_SLOTS + 1, VertexBuffers, Strides, Offsets);
+	Check(Target.Take({ { "IASetVertexBuffers", 0, MAX_VB_SLOTS + 1 }, { "IASetVertexBuffers", 0, MAX_VB_SLOTS + 1 } }), "unshadowed vertex buffer slots are issued");
+	Cache.IASetVertexBuffers(0, 1, VertexBuffers, Strides, Offsets);
+	Check(Target.Take({ { "IASetVertexBuffers", 0, 1 } }), "an unshadowed bind forgets the shadowed slots");
+
+	// A null blend factor is a factor of 1
+	const FLOAT One[4] = { 1, 1, 1, 1 };
+	ID3D11BlendState* pBlend = FakeObject<ID3D11BlendState>(5);
+	Cache.OMSetBlendState(pBlend, nullptr, 0xffffffff);
+	Cache.OMSetBlendState(pBlend, One, 0xffffffff);
+	Cache.OMSetBlendState(pBlend, One, 0xff);
+	Check(Target.Take({ { "OMSetBlendState", 0, 1 }, { "OMSetBlendState", 0, 1 } }), "blend states are compared by factor and mask");
+
+	const SStats& Stats = Cache.GetStats();
+	Check(Stats.IssuedCalls == 12 && Stats.FilteredCalls == 3, "the stats count the issued and filtered binds");
+	return Check.Passed();
+}
@@ -0,0 +1,246 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: DxStateCache.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "DxState.h"
+
+// The context calls issued by CDxStateCache. Forwarded to a device context, or recorded by the fake context of CDxStateCache::SelfCheck()
+class IDxStateTarget
+{
+public:
+	virtual ~IDxStateTarget() {}
+	virtual void VSSetShader(ID3D11VertexShader* pVS) = 0;
+	virtual void PSSetShader(ID3D11PixelShader* pPS) = 0;
+	virtual void VSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers) = 0;
+	virtual void PSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers) = 0;
+	virtual void VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+	virtual void PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+	virtual void VSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs) = 0;
+	virtual void PSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs) = 0;
+	virtual void PSSetSamplers(UINT StartSlot, UINT Count, ID3D11SamplerState* const* ppSamplers) = 0;
+	virtual void IASetInputLayout(ID3D11InputLayout* pLayout) = 0;
+	virtual void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT Format, UINT Offset) = 0;
+	virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) = 0;
+	virtual void RSSetState(ID3D11RasterizerState* pState) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT StencilRef) = 0;
+	virtual void OMSetBlendState(ID3D11BlendState* pState, const FLOAT BlendFactor[4], UINT SampleMask) = 0;
+};
+
+// Shadows the pipeline state of a device context and drops the binds which wouldn't change it.
+// The cache only knows about the binds that went through it, call Invalidate() whenever something else might have used the context.
+// It never reads the state back from the context, so it can be driven by a recording fake context
+class CDxStateCache
+{
+public:
+	// Slots shadowed per stage. Binds to slots beyond them are always issued
+	static const UINT MAX_CB_SLOTS = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	static const UINT MAX_SRV_SLOTS = 16;
+	static const UINT MAX_SAMPLER_SLOTS = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	static const UINT MAX_VB_SLOTS = 4;
+
+	struct SStats
+	{
+		UINT IssuedCalls = 0;
+		UINT FilteredCalls = 0;
+	};
+
+	// Starts a new frame on pCtx. Forgets the shadowed state and clears the stats
+	void Reset(ID3D11DeviceContext* pCtx);
+	// Same, on a target which isn't a device context. GetContext() returns null until the next Reset(pCtx)
+	void Reset(IDxStateTarget* pTarget);
+	// Forgets the shadowed state, so the next bind of every state is issued
+	void Invalidate();
+
+	ID3D11DeviceContext* GetContext() const { return m_pTarget ? nullptr : m_Context.pCtx; }
+	// Null when the runtime doesn't support D3D11.1
+	ID3D11DeviceContext1* GetContext1() const { return m_pTarget ? nullptr : m_Context.pCtx1.GetInterfacePtr(); }
+	const SStats& GetStats() const { return m_Stats; }
+
+	void VSSetShader(ID3D11VertexShader* pVS);
+	void PSSetShader(ID3D11PixelShader* pPS);
+	void VSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers);
+	void PSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers);
+	// Bind a range of each buffer, in 16-byte constants. Require GetContext1()
+	void VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void VSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs);
+	void PSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs);
+	void PSSetSamplers(UINT StartSlot, UINT Count, ID3D11SamplerState* const* ppSamplers);
+
+	void IASetInputLayout(ID3D11InputLayout* pLayout);
+	void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets);
+	void IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT Format, UINT Offset);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology);
+
+	void RSSetState(ID3D11RasterizerState* pState);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT StencilRef);
+	void OMSetBlendState(ID3D11BlendState* pState, const FLOAT BlendFactor[4], UINT SampleMask);
+
+	// Return false when the state isn't known to the cache
+	bool GetVertexShader(ID3D11VertexShader*& pVS) const;
+	bool GetPixelShader(ID3D11PixelShader*& pPS) const;
+	bool GetDepthStencilState(ID3D11DepthStencilState*& pState, UINT& StencilRef) const;
+
+	// Drives a cache with a recording fake context, and checks which binds reach it. Doesn't need a device.
+	// Returns false and traces the failing checks
+	static bool SelfCheck();
+
+private:
+	enum STAGE
+	{
+		VERTEX_STAGE,
+		PIXEL_STAGE,
+		STAGE_COUNT
+	};
+
+	template<typename T>
+	struct TShadow
+	{
+		T Value;
+		bool bKnown = false;
+
+		// Returns true if the bind changes the state
+		bool Update(const T& NewValue)
+		{
+			if(bKnown && Value == NewValue)
+			{
+				return false;
+			}
+			Value = NewValue;
+			bKnown = true;
+			return true;
+		}
+	};
+
+	// Binding an entire buffer is shadowed as an empty range
+	struct SConstantBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		UINT FirstConstant;
+		UINT NumConstants;
+		bool operator==(const SConstantBuffer& Other) const { return pBuffer == Other.pBuffer && FirstConstant == Other.FirstConstant && NumConstants == Other.NumConstants; }
+	};
+
+	struct SVertexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		UINT Stride;
+		UINT Offset;
+		bool operator==(const SVertexBuffer& Other) const { return pBuffer == Other.pBuffer && Stride == Other.Stride && Offset == Other.Offset; }
+	};
+
+	struct SIndexBuffer
+	{
+		ID3D11Buffer* pBuffer;
+		DXGI_FORMAT Format;
+		UINT Offset;
+		bool operator==(const SIndexBuffer& Other) const { return pBuffer == Other.pBuffer && Format == Other.Format && Offset == Other.Offset; }
+	};
+
+	struct SDepthStencil
+	{
+		ID3D11DepthStencilState* pState;
+		UINT StencilRef;
+		bool operator==(const SDepthStencil& Other) const { return pState == Other.pState && StencilRef == Other.StencilRef; }
+	};
+
+	struct SBlend
+	{
+		ID3D11BlendState* pState;
+		FLOAT BlendFactor[4];
+		UINT SampleMask;
+		bool operator==(const SBlend& Other) const;
+	};
+
+	// Updates the shadowed slots of the range. Returns false if none of them changed, otherwise [First, Last] is the part of the range which has to be bound
+	template<typename T, UINT N>
+	static bool UpdateSlots(TShadow<T>(&Slots)[N], UINT StartSlot, UINT Count, const T* pValues, UINT& First, UINT& Last);
+	bool Filter(bool bChanged);
+	void SetConstantBuffers(STAGE Stage, UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants);
+	void SetShaderResources(STAGE Stage, UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs);
+
+	// Forwards to the device context. The ranged constant buffer binds require pCtx1
+	struct SContextTarget : public IDxStateTarget
+	{
+		ID3D11DeviceContext* pCtx = nullptr;
+		ID3D11DeviceContext1Ptr pCtx1;
+
+		void VSSetShader(ID3D11VertexShader* pVS) override { pCtx->VSSetShader(pVS, nullptr, 0); }
+		void PSSetShader(ID3D11PixelShader* pPS) override { pCtx->PSSetShader(pPS, nullptr, 0); }
+		void VSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers) override { pCtx->VSSetConstantBuffers(StartSlot, Count, ppBuffers); }
+		void PSSetConstantBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers) override { pCtx->PSSetConstantBuffers(StartSlot, Count, ppBuffers); }
+		void VSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) override;
+		void PSSetConstantBuffers1(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) override;
+		void VSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs) override { pCtx->VSSetShaderResources(StartSlot, Count, ppSrvs); }
+		void PSSetShaderResources(UINT StartSlot, UINT Count, ID3D11ShaderResourceView* const* ppSrvs) override { pCtx->PSSetShaderResources(StartSlot, Count, ppSrvs); }
+		void PSSetSamplers(UINT StartSlot, UINT Count, ID3D11SamplerState* const* ppSamplers) override { pCtx->PSSetSamplers(StartSlot, Count, ppSamplers); }
+		void IASetInputLayout(ID3D11InputLayout* pLayout) override { pCtx->IASetInputLayout(pLayout); }
+		void IASetVertexBuffers(UINT StartSlot, UINT Count, ID3D11Buffer* const* ppBuffers, const UINT* pStrides, const UINT* pOffsets) override { pCtx->IASetVertexBuffers(StartSlot, Count, ppBuffers, pStrides, pOffsets); }
+		void IASetIndexBuffer(ID3D11Buffer* pBuffer, DXGI_FORMAT Format, UINT Offset) override { pCtx->IASetIndexBuffer(pBuffer, Format, Offset); }
+		void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) override { pCtx->IASetPrimitiveTopology(Topology); }
+		void RSSetState(ID3D11RasterizerState* pState) override { pCtx->RSSetState(pState); }
+		void OMSetDepthStencilState(ID3D11DepthStencilState* pState, UINT StencilRef) override { pCtx->OMSetDepthStencilState(pState, StencilRef); }
+		void OMSetBlendState(ID3D11BlendState* pState, const FLOAT BlendFactor[4], UINT SampleMask) override { pCtx->OMSetBlendState(pState, BlendFactor, SampleMask); }
+	};
+
+	// m_Context is used when m_pTarget is null. It isn't kept as a pointer to the member, so the cache can be copied
+	IDxStateTarget& GetTarget() { return m_pTarget ? *m_pTarget : m_Context; }
+
+	SContextTarget m_Context;
+	IDxStateTarget* m_pTarget = nullptr;
+	SStats m_Stats;
+
+	TShadow<ID3D11VertexShader*> m_VS;
+	TShadow<ID3D11PixelShader*> m_PS;
+	TShadow<SConstantBuffer> m_ConstantBuffers[STAGE_COUNT][MAX_CB_SLOTS];
+	TShadow<ID3D11ShaderResourceView*> m_Srvs[STAGE_COUNT][MAX_SRV_SLOTS];
+	TShadow<ID3D11SamplerState*> m_Samplers[MAX_SAMPLER_SLOTS];
+
+	TShadow<ID3D11InputLayout*> m_InputLayout;
+	TShadow<SVertexBuffer> m_VertexBuffers[MAX_VB_SLOTS];
+	TShadow<SIndexBuffer> m_IndexBuffer;
+	TShadow<D3D11_PRIMITIVE_TOPOLOGY> m_Topology;
+
+	TShadow<ID3D11RasterizerState*> m_RasterizerState;
+	TShadow<SDepthStencil> m_DepthStencilState;
+	TShadow<SBlend> m_BlendState;
+};
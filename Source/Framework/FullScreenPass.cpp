@@ -103,4 +103,20 @@ void CFullScreenPass::Draw(ID3D11DeviceContext* pCtx, ID3D11PixelShader* pPs) co
 	pCtx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
 
 	pCtx->Draw(4, 0);
-}
\ No newline at end of file
+}
+
+void CFullScreenPass::Draw(CDxStateCache& State, ID3D11PixelShader* pPs) const
+{
+	CSetDepthState Ds(State, m_pNoDepthTest, 0);
+	CSetVertexShader Vs(State, m_VS->GetShader());
+	CSetPixelShader Ps(State, pPs);
+
+	UINT stride = sizeof(SVertex);
+	UINT offset = 0;
+	ID3D11Buffer* pVB = m_VB.GetInterfacePtr();
+	State.IASetVertexBuffers(0, 1, &pVB, &stride, &offset);
+	State.IASetInputLayout(m_InputLayout);
+	State.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+	State.GetContext()->Draw(4, 0);
+}
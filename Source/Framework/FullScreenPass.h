@@ -49,6 +49,8 @@ class CFullScreenPass
 public:
 	CFullScreenPass(ID3D11Device* pDevice);
 	void Draw(ID3D11DeviceContext* pCtx, ID3D11PixelShader* pPs) const;
+	// Same, but binds through the cache so that it stays in sync with the context
+	void Draw(CDxStateCache& State, ID3D11PixelShader* pPs) const;
 private:
 	ID3D11BufferPtr m_VB;
 	ID3D11InputLayoutPtr m_InputLayout;
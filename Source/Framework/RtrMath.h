@@ -72,6 +72,48 @@ inline quaternion CreateQuaternionFromVectors(const float3& from, const float3&
 	return quat;
 }
 
+// A * B for affine matrices (last column 0, 0, 0, 1) in the row-vector convention. Skips the products with the constant column
+inline DirectX::XMMATRIX MultiplyAffine(DirectX::FXMMATRIX A, DirectX::CXMMATRIX B)
+{
+	using namespace DirectX;
+	XMMATRIX Result;
+	for(UINT i = 0; i < 3; i++)
+	{
+		Result.r[i] = XMVectorMultiplyAdd(XMVectorSplatZ(A.r[i]), B.r[2], XMVectorMultiplyAdd(XMVectorSplatY(A.r[i]), B.r[1], XMVectorMultiply(XMVectorSplatX(A.r[i]), B.r[0])));
+	}
+	Result.r[3] = XMVectorMultiplyAdd(XMVectorSplatZ(A.r[3]), B.r[2], XMVectorMultiplyAdd(XMVectorSplatY(A.r[3]), B.r[1], XMVectorMultiplyAdd(XMVectorSplatX(A.r[3]), B.r[0], B.r[3])));
+	return Result;
+}
+
+// The 6 planes of the frustum of a (model-)view-projection matrix, normalized and facing inwards. A point P is inside when
+// dot(Plane.xyz, P) + Plane.w >= 0 for all of them
+inline void ExtractFrustumPlanes(const float4x4& ViewProj, float4 Planes[6])
+{
+	for(UINT i = 0; i < 3; i++)
+	{
+		float4 Column(ViewProj.m[0][i], ViewProj.m[1][i], ViewProj.m[2][i], ViewProj.m[3][i]);
+		float4 W(ViewProj.m[0][3], ViewProj.m[1][3], ViewProj.m[2][3], ViewProj.m[3][3]);
+		Planes[i * 2] = (i == 2) ? Column : W + Column;  // D3D clip space z starts at 0
+		Planes[i * 2 + 1] = W - Column;
+	}
+	for(UINT i = 0; i < 6; i++)
+	{
+		Planes[i] /= float3(Planes[i].x, Planes[i].y, Planes[i].z).Length();
+	}
+}
+
+inline bool IsSphereInFrustum(const float4 Planes[6], const float3& Center, float Radius)
+{
+	for(UINT i = 0; i < 6; i++)
+	{
+		if(Planes[i].x * Center.x + Planes[i].y * Center.y + Planes[i].z * Center.z + Planes[i].w < -Radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 inline float FovFromFocalLength(int FocalLength)
 {
 	const float x = 43.266f; // Diagonal length of 24*36mm image
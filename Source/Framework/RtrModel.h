@@ -43,13 +43,18 @@ Filename: RtrModel.h
 #include "Common.h"
 #include "RtrModel\RtrMaterial.h"
 #include "RtrModel\RtrMesh.h"
+#include "RtrModel\RtrMeshArena.h"
 #include "RtrModel\RtrAnimationController.h"
 #include <vector>
 #include <map>
+#include <functional>
 
 struct aiScene;
 struct aiNode;
 template<typename T> class aiMatrix4x4t;
+struct SRtrModelCacheKey;
+class CThreadPool;
+class CRtrBinaryReader;
 
 float4x4 aiMatToD3D(const aiMatrix4x4t<float>& aiMat);
 
@@ -65,7 +70,41 @@ using ModelDrawList = std::vector < SDrawListNode > ;
 class CRtrModel
 {
 public:
-    static std::unique_ptr<CRtrModel> CreateFromFile(const std::wstring& Filename, ID3D11Device* pDevice);
+    enum LOAD_FLAGS
+    {
+        LOAD_FLAGS_NONE = 0,
+        LOAD_FLAGS_IGNORE_CACHE = 0x1,  // Always import the source file. The cooked cache will be overwritten
+        LOAD_FLAGS_FORCE_ASSIMP = 0x2,  // Use Assimp for OBJ files instead of the native importer
+        LOAD_FLAGS_COMPACT_VERTICES = 0x4,  // Store the vertices in CRtrMesh::VERTEX_FORMAT_COMPACT
+        LOAD_FLAGS_INDEX_METRICS = 0x8,     // Measure the index metrics before and after CRtrMeshOptimizer. Slow, meant for reports. Implies LOAD_FLAGS_IGNORE_CACHE
+    };
+
+    struct SLoadStats
+    {
+        bool bFromCache = false;
+        UINT ThreadCount = 1;
+        float ImportTime = 0;   // Source file import or cache mapping, in seconds
+        float PackTime = 0;     // CPU-side mesh packing
+        float CreateTime = 0;   // Materials and GPU resources creation
+        float TotalTime = 0;
+    };
+
+    enum LOAD_STAGE
+    {
+        LOAD_STAGE_PARSE,
+        LOAD_STAGE_POST_PROCESS,
+        LOAD_STAGE_TEXTURE_DECODE,
+        LOAD_STAGE_MESH_BUILD,
+
+        LOAD_STAGE_COUNT
+    };
+
+    // Progress is in the range [0, 1]. Calls are serialized, but can come from any of the loading threads. Return false to cancel the load
+    using LoadProgressCallback = std::function<bool(LOAD_STAGE Stage, float Progress)>;
+
+    // If pThreadPool is not null, it will be used to decode the textures and pack the meshes in parallel.
+    // The function only uses the device, never the immediate context, so it can be called from a worker thread. See CRtrModelLoader for async loading.
+    static std::unique_ptr<CRtrModel> CreateFromFile(const std::wstring& Filename, ID3D11Device* pDevice, UINT Flags = LOAD_FLAGS_NONE, CThreadPool* pThreadPool = nullptr, const LoadProgressCallback& ProgressCallback = nullptr);
 	~CRtrModel();
 	const CRtrMaterial* GetMaterial(UINT MaterialID) const { return m_Materials[MaterialID]; }
 
@@ -73,28 +112,62 @@ public:
 	const float3& GetCenter() const { return m_Center; }
 	UINT GetVertexCount() { return m_VertexCount; }
 	UINT GetPrimitiveCount() { return m_PrimitiveCount; }
+
+	// Vertex memory used by the model, and the memory the same vertices take in CRtrMesh::VERTEX_FORMAT_FULL
+	UINT GetVertexBufferSize() const { return m_VertexBufferSize; }
+	UINT GetFullVertexBufferSize() const { return m_FullVertexBufferSize; }
+
+	// Index buffer metrics of the entire model, before and after CRtrMeshOptimizer. Per-mesh metrics are available from the meshes
+	const CRtrMesh::SIndexMetrics& GetImportedIndexMetrics() const { return m_ImportedIndexMetrics; }
+	const CRtrMesh::SIndexMetrics& GetIndexMetrics() const { return m_IndexMetrics; }
+	UINT GetMeshCount() const { return UINT(m_Meshes.size()); }
+	const CRtrMesh* GetMesh(UINT MeshID) const { return m_Meshes[MeshID]; }
 		
 	const ModelDrawList& GetDrawList() const { return m_DrawList; }
+	const SLoadStats& GetLoadStats() const { return m_LoadStats; }
 
     // Animations
     void Animate(float ElapsedTime);
 	bool HasBones() const { return m_AnimationController->GetBonesCount()!= 0; }
     UINT GetBonesCount() const {return m_AnimationController->GetBonesCount();}
     const float4x4* GetBonesMatrices() const{ return m_AnimationController->GetBonesMatrices(); }
+    void SetDualQuaternionOutput(bool bEnable) { m_AnimationController->SetDualQuaternionOutput(bEnable); }
+    const SRtrDualQuaternion* GetBonesDualQuaternions() const { return m_AnimationController->GetBonesDualQuaternions(); }
+    // The palettes of all the skinned meshes, one after the other. See CRtrMesh::GetBonePaletteOffset()
+    UINT GetSkinningPaletteSize() const { return m_SkinningPaletteSize; }
 
     bool HasAnimations() const { return m_AnimationController->GetAnimationsCount() != 0; }
     void SetActiveAnimation(UINT ID) {m_AnimationController->SetActiveAnimation(ID);}
+    void CrossFadeToAnimation(UINT ID, float FadeDuration) {m_AnimationController->CrossFadeToAnimation(ID, FadeDuration);}
     UINT GetAnimationsCount() const {return m_AnimationController->GetAnimationsCount();}
     const std::string& GetAnimationName(UINT ID) const {return m_AnimationController->GetAnimationName(ID);}
+    const CRtrAnimationController* GetAnimationController() const { return m_AnimationController.get(); }
 
 private:
 	CRtrModel();
-	bool Init(const aiScene* pScene, ID3D11Device* pDevice, const std::string& ModelFolder);
-	bool CreateMaterials(const aiScene* pScene, ID3D11Device* pDevice, const std::string& ModelFolder);
-	bool CreateDrawList(const aiScene* pScene, ID3D11Device* pDevice);
+	struct SLoadContext;
+	bool Init(const aiScene* pScene, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData);
+	bool CreateMaterials(const aiScene* pScene, SLoadContext& Ctx);
+	bool CreateMaterials(const std::vector<CRtrMaterial::SDesc>& Descs, SLoadContext& Ctx);
+	bool CreateDrawList(const aiScene* pScene, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData);
 	void CreateAnimations(const aiScene* pScene);
 
-	bool ParseAiSceneNode(const aiNode* pCurrnet, const aiScene* pScene, ID3D11Device* pDevice, std::map<UINT, UINT>& AiToRtrMeshId);
+	// Quantizes all the meshes relative to the model's bounding box, so that they share the dequantization constants
+	void CompactMeshes(std::vector<CRtrMesh::SMeshData>& MeshData, SLoadContext& Ctx);
+
+	// Creates the meshes, sub-allocating the ones with the same vertex layout from a shared arena. m_Meshes follows the source order
+	void CreateMeshes(ID3D11Device* pDevice, std::vector<CRtrMeshArena::SMeshSource>& Meshes);
+	void CreateMeshes(ID3D11Device* pDevice, const std::vector<CRtrMesh::SMeshData>& MeshData);
+
+	// Creates the draw list nodes and assigns an RtrMesh ID to every unique aiMesh. The meshes themselves are created later
+	void ParseAiSceneNode(const aiNode* pCurrnet, std::map<UINT, UINT>& AiToRtrMeshId, std::vector<UINT>& UniqueAiMeshes, std::vector<std::vector<UINT>>& NodeMeshIDs);
+
+	// Native OBJ import, see CRtrObjImporter
+	bool InitFromObj(const std::wstring& Filename, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData);
+
+	// Cooked model cache
+	bool InitFromCache(CRtrBinaryReader& Reader, SLoadContext& Ctx);
+	void SaveToCache(const std::wstring& CacheFile, const SRtrModelCacheKey& Key, const std::vector<CRtrMesh::SMeshData>& MeshData) const;
 
 	void CalculateModelProperties();
     float m_Radius;
@@ -102,9 +175,16 @@ private:
 
 	UINT m_VertexCount;
 	UINT m_PrimitiveCount;
+	UINT m_VertexBufferSize;
+	UINT m_FullVertexBufferSize;
+	UINT m_SkinningPaletteSize = 0;
+	CRtrMesh::SIndexMetrics m_ImportedIndexMetrics;
+	CRtrMesh::SIndexMetrics m_IndexMetrics;
 
 	std::vector<const CRtrMaterial*> m_Materials;
 	ModelDrawList m_DrawList;
 	std::vector<CRtrMesh*> m_Meshes;
+	std::vector<std::unique_ptr<CRtrMeshArena>> m_Arenas;
     std::unique_ptr<CRtrAnimationController> m_AnimationController;    
+	SLoadStats m_LoadStats;
 };
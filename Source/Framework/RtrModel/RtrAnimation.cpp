@@ -41,127 +41,368 @@ Filename: RtrAnimation.cpp
 ---------------------------------------------------------------------------*/
 #include "RtrAnimation.h"
 #include "RtrAnimationController.h"
+#include "RtrModelCache.h"
 #include "anim.h"
+#include <algorithm>
+#include <cfloat>
 
-CRtrAnimation::CRtrAnimation(const aiAnimation* pAiAnimation, const CRtrAnimationController* pAnimationController) : m_Name(pAiAnimation->mName.C_Str())
+CRtrAnimation::CRtrAnimation(const aiAnimation* pAiAnimation, const CRtrAnimationController* pAnimationController, const CRtrAnimationCompressor::SSettings& Settings) :
+	m_Name(pAiAnimation->mName.C_Str())
 {
 	assert(pAiAnimation->mNumMeshChannels == 0);
 	m_Duration = float(pAiAnimation->mDuration);
 	m_TicksPerSecond = pAiAnimation->mTicksPerSecond ? float(pAiAnimation->mTicksPerSecond) : 25;
 	
-	m_AnimationSets.resize(pAiAnimation->mNumChannels);
+	std::vector<SRawAnimationSet> RawSets(pAiAnimation->mNumChannels);
 	for(UINT i = 0; i < pAiAnimation->mNumChannels; i++)
 	{
 		const aiNodeAnim* pAiNode = pAiAnimation->mChannels[i];
-		m_AnimationSets[i].BoneID = pAnimationController->GetBoneIdFromName(pAiNode->mNodeName.C_Str());
+		SRawAnimationSet& Set = RawSets[i];
+		Set.BoneID = pAnimationController->GetBoneIdFromName(pAiNode->mNodeName.C_Str());
 		
 		for(UINT j = 0; j < pAiNode->mNumPositionKeys; j++)
 		{
 			const aiVectorKey& Key = pAiNode->mPositionKeys[j];
-			SAnimationKey<float3> Position;
-			Position.Value = float3(Key.mValue.x, Key.mValue.y, Key.mValue.z);
-			Position.Time = float(Key.mTime);
-			m_AnimationSets[i].Translation.Keys.push_back(Position);
+			Set.Translation.Times.push_back(float(Key.mTime));
+			Set.Translation.Values.push_back(float3(Key.mValue.x, Key.mValue.y, Key.mValue.z));
 		}
 
 		for(UINT j = 0; j < pAiNode->mNumScalingKeys; j++)
 		{
 			const aiVectorKey& Key = pAiNode->mScalingKeys[j];
-			SAnimationKey<float3> Scale;
-			Scale.Value = float3(Key.mValue.x, Key.mValue.y, Key.mValue.z);
-			Scale.Time = float(Key.mTime);
-			m_AnimationSets[i].Scaling.Keys.push_back(Scale);
+			Set.Scaling.Times.push_back(float(Key.mTime));
+			Set.Scaling.Values.push_back(float3(Key.mValue.x, Key.mValue.y, Key.mValue.z));
 		}
 
 		for(UINT j = 0; j < pAiNode->mNumRotationKeys; j++)
 		{
 			const aiQuatKey& Key = pAiNode->mRotationKeys[j];
-			SAnimationKey<quaternion> Rotation;
-			Rotation.Value = quaternion(Key.mValue.x, Key.mValue.y, Key.mValue.z, Key.mValue.w);
-			Rotation.Time = float(Key.mTime);
-			m_AnimationSets[i].Rotation.Keys.push_back(Rotation);
+			Set.Rotation.Times.push_back(float(Key.mTime));
+			Set.Rotation.Values.push_back(quaternion(Key.mValue.x, Key.mValue.y, Key.mValue.z, Key.mValue.w));
 		}
 	}
+
+	Compress(RawSets, Settings);
+	InitBoneChannels(pAnimationController->GetBonesCount());
+	m_CompressionStats.MaxBoneError = MeasureBoneError(RawSets, pAnimationController);
 }
 
-template<typename T>
-UINT FindCurrentFrame(T Channel, float Ticks, float LastUpdateTime)
+CRtrAnimation::CRtrAnimation(CRtrBinaryReader& Reader, UINT BonesCount) : m_Name(Reader.ReadString())
 {
-    UINT CurKeyID = Channel.LastKeyUsed;
-    while(CurKeyID < Channel.Keys.size() - 1)
+	m_Duration = Reader.Read<float>();
+	m_TicksPerSecond = Reader.Read<float>();
+	m_CompressionStats = Reader.Read<SCompressionStats>();
+	m_AnimationSets.resize(Reader.Read<UINT>());
+	for(auto& Set : m_AnimationSets)
 	{
-        if(Channel.Keys[CurKeyID + 1].Time > Ticks)
-		{
-			break;
-		}
-		CurKeyID++;
+		Set.BoneID = Reader.Read<UINT>();
+		Set.TranslationRange = Reader.Read<SRtrTranslationRange>();
+		Reader.ReadArray(Set.Translation.Times);
+		Reader.ReadArray(Set.Translation.Values);
+		Reader.ReadArray(Set.Scaling.Times);
+		Reader.ReadArray(Set.Scaling.Values);
+		Reader.ReadArray(Set.Rotation.Times);
+		Reader.ReadArray(Set.Rotation.Values);
 	}
-	return CurKeyID;
+	InitBoneChannels(BonesCount);
 }
 
-float3 Interpolate(const float3& Start, const float3& End, float Ratio)
+void CRtrAnimation::Serialize(CRtrBinaryWriter& Writer) const
 {
-	return Start + ((End - Start) * Ratio);
+	Writer.WriteString(m_Name);
+	Writer.Write(m_Duration);
+	Writer.Write(m_TicksPerSecond);
+	Writer.Write(m_CompressionStats);
+	Writer.Write(UINT(m_AnimationSets.size()));
+	for(const auto& Set : m_AnimationSets)
+	{
+		Writer.Write(Set.BoneID);
+		Writer.Write(Set.TranslationRange);
+		Writer.WriteArray(Set.Translation.Times);
+		Writer.WriteArray(Set.Translation.Values);
+		Writer.WriteArray(Set.Scaling.Times);
+		Writer.WriteArray(Set.Scaling.Values);
+		Writer.WriteArray(Set.Rotation.Times);
+		Writer.WriteArray(Set.Rotation.Values);
+	}
 }
 
-quaternion Interpolate(const quaternion& Start, const quaternion& End, float Ratio)
+void CRtrAnimation::InitBoneChannels(UINT BonesCount)
 {
-	return quaternion::Slerp(Start, End, Ratio);
+	m_BoneChannels.assign(BonesCount, INVALID_CHANNEL);
+	for(UINT i = 0; i < m_AnimationSets.size(); i++)
+	{
+		assert(m_AnimationSets[i].BoneID < BonesCount);
+		m_BoneChannels[m_AnimationSets[i].BoneID] = i;
+	}
 }
 
-template<typename _KeyType>
-_KeyType CRtrAnimation::CalcCurrentKey(SAnimationChannel<_KeyType>& Channel, float Ticks, float LastUpdateTime)
+float CRtrAnimation::GetTicks(float TotalTime) const
 {
-	_KeyType CurValue;
-	if(Channel.Keys.size() > 0)
+	if(m_Duration <= 0)
+	{
+		return 0;
+	}
+	float Ticks = fmod(TotalTime * m_TicksPerSecond, m_Duration);
+	return (Ticks < 0) ? Ticks + m_Duration : Ticks;
+}
+
+// Finds the keys around Ticks. Past the last key (or before the first one) the channel wraps around, interpolating from the
+// last key to the first one. Returns false if the channel has no keys
+static bool FindKeys(const std::vector<float>& Times, float Ticks, float Duration, UINT& Cursor, UINT& Key0, UINT& Key1, float& Ratio)
+{
+	const UINT Count = UINT(Times.size());
+	if(Count == 0)
+	{
+		return false;
+	}
+
+	const float FirstTime = Times[0];
+	const float LastTime = Times[Count - 1];
+	if(Ticks < FirstTime || Ticks >= LastTime)
+	{
+		Key0 = Count - 1;
+		Key1 = 0;
+		float Span = Duration - LastTime + FirstTime;
+		float Elapsed = (Ticks >= LastTime) ? Ticks - LastTime : Ticks + Duration - LastTime;
+		Ratio = (Span > 0) ? min(Elapsed / Span, 1.0f) : 0;
+		Cursor = Key0;
+		return true;
+	}
+
+	// Playback stays on the cached key or moves to the next one. Anything else is a seek
+	UINT Key = Cursor;
+	bool bInSegment = (Key + 1 < Count) && (Times[Key] <= Ticks) && (Ticks < Times[Key + 1]);
+	if(bInSegment == false)
 	{
-		if(Ticks < LastUpdateTime)
+		if((Key + 2 < Count) && (Times[Key + 1] <= Ticks) && (Ticks < Times[Key + 2]))
 		{
-			Channel.LastKeyUsed = 0;
+			Key++;
 		}
-	
-		// search for the next keyframe
-		UINT CurKeyIndex = FindCurrentFrame(Channel, Ticks, LastUpdateTime);
-		UINT NextKeyIndex = (CurKeyIndex + 1) % Channel.Keys.size();
-		const SAnimationKey<_KeyType>& CurKey = Channel.Keys[CurKeyIndex];
-		const SAnimationKey<_KeyType>& NextKey = Channel.Keys[NextKeyIndex];
-
-		assert(Ticks >= CurKey.Time);
-		// Interpolate between them
-		float diff = NextKey.Time - CurKey.Time;
-		if(diff < 0)
+		else
+		{
+			Key = UINT(std::upper_bound(Times.begin(), Times.end(), Ticks) - Times.begin()) - 1;
+		}
+	}
+
+	Cursor = Key;
+	Key0 = Key;
+	Key1 = Key + 1;
+	Ratio = (Ticks - Times[Key0]) / (Times[Key1] - Times[Key0]);
+	return true;
+}
+
+void CRtrAnimation::Sample(float TotalTime, const CRtrPose& BindPose, CRtrPose::ROTATION_INTERPOLATION Interpolation, std::vector<UINT>& Cursors, CRtrPose& Pose, const BYTE* pBoneMask) const
+{
+	const UINT BonesCount = UINT(m_BoneChannels.size());
+	assert(BindPose.GetBoneCount() == BonesCount);
+	assert(Cursors.size() == GetCursorCount());
+	if(Pose.GetBoneCount() != BonesCount)
+	{
+		Pose.Resize(BonesCount);
+	}
+
+	const float Ticks = GetTicks(TotalTime);
+	for(UINT BlockID = 0; BlockID < Pose.GetBlockCount(); BlockID++)
+	{
+		// Gather the keys around Ticks into a start and an end block, then interpolate the 4 bones together
+		CRtrPose::SBlock Start = BindPose.GetBlock(BlockID);
+		CRtrPose::SBlock End = Start;
+		float RatioT[CRtrPose::BLOCK_SIZE] = {0};
+		float RatioR[CRtrPose::BLOCK_SIZE] = {0};
+		float RatioS[CRtrPose::BLOCK_SIZE] = {0};
+		bool bAnimated = false;
+
+		for(UINT Lane = 0; Lane < CRtrPose::BLOCK_SIZE; Lane++)
 		{
-			diff += m_Duration;
+			const UINT BoneID = BlockID * CRtrPose::BLOCK_SIZE + Lane;
+			if(BoneID >= BonesCount || m_BoneChannels[BoneID] == INVALID_CHANNEL || (pBoneMask && pBoneMask[BoneID] == 0))
+			{
+				continue;
+			}
+
+			const UINT SetID = m_BoneChannels[BoneID];
+			const SAnimationSet& Set = m_AnimationSets[SetID];
+			UINT* pCursors = &Cursors[SetID * 3];
+			UINT Key0, Key1;
+			if(FindKeys(Set.Translation.Times, Ticks, m_Duration, pCursors[0], Key0, Key1, RatioT[Lane]))
+			{
+				Start.SetTranslation(Lane, Set.TranslationRange.Unpack(Set.Translation.Values[Key0]));
+				End.SetTranslation(Lane, Set.TranslationRange.Unpack(Set.Translation.Values[Key1]));
+			}
+			if(FindKeys(Set.Rotation.Times, Ticks, m_Duration, pCursors[1], Key0, Key1, RatioR[Lane]))
+			{
+				Start.SetRotation(Lane, CRtrAnimationCompressor::UnpackRotation(Set.Rotation.Values[Key0]));
+				End.SetRotation(Lane, CRtrAnimationCompressor::UnpackRotation(Set.Rotation.Values[Key1]));
+			}
+			if(FindKeys(Set.Scaling.Times, Ticks, m_Duration, pCursors[2], Key0, Key1, RatioS[Lane]))
+			{
+				Start.SetScale(Lane, Set.Scaling.Values[Key0]);
+				End.SetScale(Lane, Set.Scaling.Values[Key1]);
+			}
+			bAnimated = true;
 		}
-		else if(diff == 0)
+
+		if(bAnimated)
 		{
-			CurValue = CurKey.Value;
+			CRtrPose::InterpolateBlock(Start, End, RatioT, RatioR, RatioS, Interpolation, Pose.GetBlock(BlockID));
 		}
 		else
 		{
-			float ratio = (Ticks - CurKey.Time) / diff;
-			CurValue = Interpolate(CurKey.Value, NextKey.Value, ratio);
+			Pose.GetBlock(BlockID) = Start;
 		}
-		Channel.LastKeyUsed = CurKeyIndex;
 	}
-	return CurValue;
 }
 
-void CRtrAnimation::Animate(float TotalTime, CRtrAnimationController* pAnimationController)
+static float3 Interpolate(const float3& Start, const float3& End, float Ratio)
 {
-	// Calculate the relative time
-	float Ticks = fmod(TotalTime * m_TicksPerSecond, m_Duration);
+	return Start + ((End - Start) * Ratio);
+}
 
-	for(auto& Key : m_AnimationSets)
+static quaternion Interpolate(const quaternion& Start, const quaternion& End, float Ratio)
+{
+	return quaternion::Slerp(Start, End, Ratio);
+}
+
+// Unpack() decompresses a stored value
+template<typename T, typename StoredT, typename UnpackFunc>
+static T SampleChannel(const std::vector<float>& Times, const std::vector<StoredT>& Values, UnpackFunc Unpack, float Ticks, float Duration, UINT& Cursor, const T& Default)
+{
+	UINT Key0, Key1;
+	float Ratio;
+	if(FindKeys(Times, Ticks, Duration, Cursor, Key0, Key1, Ratio) == false)
+	{
+		return Default;
+	}
+	return Interpolate(Unpack(Values[Key0]), Unpack(Values[Key1]), Ratio);
+}
+
+void CRtrAnimation::SampleScalar(float TotalTime, const CRtrPose& BindPose, std::vector<UINT>& Cursors, float4x4* pLocalTransforms) const
+{
+	assert(Cursors.size() == GetCursorCount());
+	const float Ticks = GetTicks(TotalTime);
+	auto UnpackScale = [](const float3& S) { return S; };
+
+	for(UINT SetID = 0; SetID < m_AnimationSets.size(); SetID++)
+	{
+		const SAnimationSet& Set = m_AnimationSets[SetID];
+		UINT* pCursors = &Cursors[SetID * 3];
+		float3 Translation, Scale;
+		quaternion Rotation;
+		BindPose.GetBone(Set.BoneID, Translation, Rotation, Scale);
+		auto UnpackTranslation = [&Set](const SRtrPackedTranslation& P) { return Set.TranslationRange.Unpack(P); };
+
+		Translation = SampleChannel(Set.Translation.Times, Set.Translation.Values, UnpackTranslation, Ticks, m_Duration, pCursors[0], Translation);
+		Rotation = SampleChannel(Set.Rotation.Times, Set.Rotation.Values, &CRtrAnimationCompressor::UnpackRotation, Ticks, m_Duration, pCursors[1], Rotation);
+		Scale = SampleChannel(Set.Scaling.Times, Set.Scaling.Values, UnpackScale, Ticks, m_Duration, pCursors[2], Scale);
+
+		pLocalTransforms[Set.BoneID] = float4x4::CreateScale(Scale) * float4x4::CreateFromQuaternion(Rotation) * float4x4::CreateTranslation(Translation);
+	}
+}
+
+template<typename ChannelT>
+static UINT GetChannelSize(const ChannelT& Channel)
+{
+	return UINT(Channel.Times.size() * sizeof(float) + Channel.Values.size() * sizeof(Channel.Values[0]));
+}
+
+void CRtrAnimation::Compress(const std::vector<SRawAnimationSet>& RawSets, const CRtrAnimationCompressor::SSettings& Settings)
+{
+	SCompressionStats& Stats = m_CompressionStats;
+	m_AnimationSets.resize(RawSets.size());
+	for(UINT i = 0; i < RawSets.size(); i++)
 	{
-		float4x4 Translation = float4x4::CreateTranslation(CalcCurrentKey(Key.Translation, Ticks, Key.LastUpdateTime));
-		float4x4 Scaling = float4x4::CreateScale(CalcCurrentKey(Key.Scaling, Ticks, Key.LastUpdateTime));
-        quaternion q = CalcCurrentKey(Key.Rotation, Ticks, Key.LastUpdateTime);
- 		float4x4 Rotation = float4x4::CreateFromQuaternion(q);
+		const SRawAnimationSet& Raw = RawSets[i];
+		SAnimationSet& Set = m_AnimationSets[i];
+		Set.BoneID = Raw.BoneID;
 
-		Key.LastUpdateTime = Ticks;
+		// Translations are quantized relative to the range of their bone. A clip-wide range spreads the 16 bits over the whole
+		// extent of the root motion, and its step can exceed the tolerance
+		float3 RangeMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		float3 RangeMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for(const auto& T : Raw.Translation.Values)
+		{
+			RangeMin = float3::Min(RangeMin, T);
+			RangeMax = float3::Max(RangeMax, T);
+		}
+		if(RangeMin.x > RangeMax.x)
+		{
+			RangeMin = RangeMax = float3(0, 0, 0);
+		}
+		Set.TranslationRange.Create(RangeMin, RangeMax);
+
+		float Error = CRtrAnimationCompressor::CompressTranslations(Raw.Translation.Times, Raw.Translation.Values, Set.TranslationRange,
+			Settings.PositionTolerance, Set.Translation.Times, Set.Translation.Values);
+		Stats.MaxPositionError = max(Stats.MaxPositionError, Error);
+		Error = CRtrAnimationCompressor::CompressRotations(Raw.Rotation.Times, Raw.Rotation.Values, Settings.AngleTolerance, Set.Rotation.Times, Set.Rotation.Values);
+		Stats.MaxAngleError = max(Stats.MaxAngleError, Error);
+		CRtrAnimationCompressor::CompressScales(Raw.Scaling.Times, Raw.Scaling.Values, Settings.ScaleTolerance, Set.Scaling.Times, Set.Scaling.Values);
+
+		Stats.RawKeyCount += UINT(Raw.Translation.Times.size() + Raw.Rotation.Times.size() + Raw.Scaling.Times.size());
+		Stats.KeyCount += UINT(Set.Translation.Times.size() + Set.Rotation.Times.size() + Set.Scaling.Times.size());
+		Stats.RawSize += GetChannelSize(Raw.Translation) + GetChannelSize(Raw.Rotation) + GetChannelSize(Raw.Scaling);
+		Stats.CompressedSize += sizeof(Set.TranslationRange) + GetChannelSize(Set.Translation) + GetChannelSize(Set.Rotation) + GetChannelSize(Set.Scaling);
+	}
+}
+
+float CRtrAnimation::MeasureBoneError(const std::vector<SRawAnimationSet>& RawSets, const CRtrAnimationController* pAnimationController) const
+{
+	// Sample the compressed and the imported clip at every imported key time, and compare the bone positions in model space.
+	// A bone's error includes the errors of its ancestors
+	std::vector<float> Times;
+	for(const auto& Raw : RawSets)
+	{
+		Times.insert(Times.end(), Raw.Translation.Times.begin(), Raw.Translation.Times.end());
+		Times.insert(Times.end(), Raw.Rotation.Times.begin(), Raw.Rotation.Times.end());
+		Times.insert(Times.end(), Raw.Scaling.Times.begin(), Raw.Scaling.Times.end());
+	}
+	std::sort(Times.begin(), Times.end());
+	Times.erase(std::unique(Times.begin(), Times.end()), Times.end());
+
+	const UINT BonesCount = pAnimationController->GetBonesCount();
+	const CRtrPose& BindPose = pAnimationController->GetBindPose();
+	std::vector<UINT> Cursors(GetCursorCount());
+	std::vector<UINT> RawCursors(RawSets.size() * 3);
+	CRtrPose Pose;
+	std::vector<float4x4> Local(BonesCount), Global(BonesCount);
+	std::vector<float4x4> RawLocal(BonesCount), RawGlobal(BonesCount);
+	BindPose.ComposeMatrices(RawLocal.data());
+	auto Identity = [](const float3& v) { return v; };
+	auto IdentityQ = [](const quaternion& q) { return q; };
+
+	float MaxError = 0;
+	for(float Time : Times)
+	{
+		const float Seconds = Time / m_TicksPerSecond;
+		Sample(Seconds, BindPose, CRtrPose::SLERP, Cursors, Pose);
+		Pose.ComposeMatrices(Local.data());
 
-		float4x4 T = Scaling * Rotation * Translation;
-		pAnimationController->SetBoneLocalTransform(Key.BoneID, T);
+		const float Ticks = GetTicks(Seconds);
+		for(UINT i = 0; i < RawSets.size(); i++)
+		{
+			const SRawAnimationSet& Raw = RawSets[i];
+			float3 Translation, Scale;
+			quaternion Rotation;
+			BindPose.GetBone(Raw.BoneID, Translation, Rotation, Scale);
+			Translation = SampleChannel(Raw.Translation.Times, Raw.Translation.Values, Identity, Ticks, m_Duration, RawCursors[i * 3], Translation);
+			Rotation = SampleChannel(Raw.Rotation.Times, Raw.Rotation.Values, IdentityQ, Ticks, m_Duration, RawCursors[i * 3 + 1], Rotation);
+			Scale = SampleChannel(Raw.Scaling.Times, Raw.Scaling.Values, Identity, Ticks, m_Duration, RawCursors[i * 3 + 2], Scale);
+			RawLocal[Raw.BoneID] = float4x4::CreateScale(Scale) * float4x4::CreateFromQuaternion(Rotation) * float4x4::CreateTranslation(Translation);
+		}
+
+		// Parents come before their children
+		for(UINT Bone = 0; Bone < BonesCount; Bone++)
+		{
+			Global[Bone] = Local[Bone];
+			RawGlobal[Bone] = RawLocal[Bone];
+			const UINT ParentID = pAnimationController->GetBoneParentID(Bone);
+			if(ParentID != INVALID_BONE_ID)
+			{
+				Global[Bone] *= Global[ParentID];
+				RawGlobal[Bone] *= RawGlobal[ParentID];
+			}
+			MaxError = max(MaxError, (Global[Bone].Translation() - RawGlobal[Bone].Translation()).Length());
+		}
 	}
+	return MaxError;
 }
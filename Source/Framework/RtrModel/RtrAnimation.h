@@ -42,48 +42,88 @@ Filename: RtrAnimation.h
 #pragma once
 #include "..\Common.h"
 #include <vector>
+#include "RtrPose.h"
+#include "RtrAnimationCompression.h"
 
 struct aiAnimation;
 struct aiNodeAnim;
 class CRtrAnimationController;
+class CRtrBinaryWriter;
+class CRtrBinaryReader;
 
 class CRtrAnimation
 {
 public:
-	CRtrAnimation(const aiAnimation* pAiAnimation, const CRtrAnimationController* pAnimationController);
-	void Animate(float TotalTime, CRtrAnimationController* pAnimationController);
+	CRtrAnimation(const aiAnimation* pAiAnimation, const CRtrAnimationController* pAnimationController, const CRtrAnimationCompressor::SSettings& Settings);
+	CRtrAnimation(CRtrBinaryReader& Reader, UINT BonesCount);
+	void Serialize(CRtrBinaryWriter& Writer) const;
     const std::string& GetName() const {return m_Name;}
+	float GetDurationInSeconds() const { return m_Duration / m_TicksPerSecond; }
+
+	// Every channel caches the last key it used, so playback finds its keys in O(1) and seeking costs a binary search.
+	// The cursors are kept by the caller, so the same animation can be sampled at different times
+	UINT GetCursorCount() const { return UINT(m_AnimationSets.size()) * 3; }
+	bool HasChannel(UINT BoneID) const { return m_BoneChannels[BoneID] != INVALID_CHANNEL; }
+
+	// Samples the local pose at TotalTime (in seconds), 4 bones at a time. The animation loops.
+	// Bones without channels get their BindPose transform. When pBoneMask isn't null, bones with a 0 entry are skipped and get it too
+	void Sample(float TotalTime, const CRtrPose& BindPose, CRtrPose::ROTATION_INTERPOLATION Interpolation, std::vector<UINT>& Cursors, CRtrPose& Pose, const BYTE* pBoneMask = nullptr) const;
+
+	// One bone at a time, building and multiplying a matrix per channel. Only the animated bones are written.
+	// Used as the reference for Sample()
+	void SampleScalar(float TotalTime, const CRtrPose& BindPose, std::vector<UINT>& Cursors, float4x4* pLocalTransforms) const;
+
+	struct SCompressionStats
+	{
+		UINT RawKeyCount = 0;
+		UINT KeyCount = 0;
+		UINT RawSize = 0;            // Bytes of key data, before and after compression
+		UINT CompressedSize = 0;
+		float MaxPositionError = 0;  // Local space, in model units. Includes the quantization, which can exceed the tolerance
+		float MaxAngleError = 0;     // Local space, in radians
+		float MaxBoneError = 0;      // Bone positions in model space, in model units
+	};
+	const SCompressionStats& GetCompressionStats() const { return m_CompressionStats; }
 
 private:
     const std::string m_Name;
 	float m_Duration;
 	float m_TicksPerSecond;
 
+	// Times and values live in separate arrays, so the key search only touches the times
 	template<typename T>
-	struct SAnimationKey
+	struct SAnimationChannel
 	{
-		T Value;
-		float Time;
+		std::vector<float> Times;
+		std::vector<T> Values;
 	};
 
-	template<typename T>
-	struct SAnimationChannel
+	// Values are stored compressed, see CRtrAnimationCompressor
+	struct SAnimationSet
 	{
-		std::vector<SAnimationKey<T>> Keys;
-		UINT LastKeyUsed = 0;
+		UINT BoneID;
+		SRtrTranslationRange TranslationRange;
+		SAnimationChannel<SRtrPackedTranslation> Translation;
+		SAnimationChannel<float3> Scaling;
+		SAnimationChannel<SRtrPackedQuaternion> Rotation;
 	};
 
-	struct SAnimationSet
+	// The keys as imported. Only used while compressing
+	struct SRawAnimationSet
 	{
 		UINT BoneID;
 		SAnimationChannel<float3> Translation;
 		SAnimationChannel<float3> Scaling;
 		SAnimationChannel<quaternion> Rotation;
-		float LastUpdateTime = 0;
 	};
 
 	std::vector<SAnimationSet> m_AnimationSets;
-
-	template<typename _KeyType>
-	_KeyType CalcCurrentKey(SAnimationChannel<_KeyType>& Channel, float Ticks, float LastUpdateTime);
+	std::vector<UINT> m_BoneChannels;  // Bone ID -> animation set, or INVALID_CHANNEL
+	SCompressionStats m_CompressionStats;
+
+	static const UINT INVALID_CHANNEL = UINT(-1);
+	void InitBoneChannels(UINT BonesCount);
+	float GetTicks(float TotalTime) const;
+	void Compress(const std::vector<SRawAnimationSet>& RawSets, const CRtrAnimationCompressor::SSettings& Settings);
+	float MeasureBoneError(const std::vector<SRawAnimationSet>& RawSets, const CRtrAnimationController* pAnimationController) const;
 };
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationBake.cpp
+---------------------------------------------------------------------------*/
+#include "RtrAnimationBake.h"
+#include "RtrAnimationController.h"
+#include <chrono>
+using namespace DirectX;
+
+static const UINT gRowsPerBone = 3;
+
+CRtrBakedAnimation::CRtrBakedAnimation(const CRtrAnimationController* pController, UINT AnimationID, const SSettings& Settings) :
+	m_pController(pController), m_AnimationID(AnimationID), m_BonesCount(pController->GetBonesCount())
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+	m_Duration = pController->GetAnimation(AnimationID)->GetDurationInSeconds();
+	m_SampleRate = max(Settings.SampleRate, 1e-3f);
+	const UINT FrameSize = m_BonesCount * gRowsPerBone * sizeof(float4);
+	if(Settings.MaxMemory && FrameSize)
+	{
+		// A looping clip needs at least 2 frames
+		const UINT MaxFrames = max(Settings.MaxMemory / FrameSize, 2u);
+		m_SampleRate = min(m_SampleRate, float(MaxFrames) / max(m_Duration, 1e-6f));
+	}
+	m_FrameCount = max(UINT(ceilf(m_Duration * m_SampleRate - 1e-3f)), 1u);
+	m_Rows.resize(m_FrameCount * m_BonesCount * gRowsPerBone);
+
+	// The palette keeps the bones that the clip doesn't animate between frames, so it must not be reset between evaluations
+	SRtrAnimationState State;
+	pController->InitState(State, AnimationID);
+	std::vector<float4x4> Scratch(m_BonesCount), Palette(m_BonesCount);
+	for(UINT Frame = 0; Frame < m_FrameCount; Frame++)
+	{
+		State.TotalTime = float(Frame) / m_SampleRate;
+		pController->Evaluate(State, Scratch.data(), Palette.data());
+
+		float4* pRows = &m_Rows[Frame * m_BonesCount * gRowsPerBone];
+		for(UINT Bone = 0; Bone < m_BonesCount; Bone++)
+		{
+			const XMMATRIX Transposed = XMMatrixTranspose(XMLoadFloat4x4(&Palette[Bone]));
+			for(UINT Row = 0; Row < gRowsPerBone; Row++)
+			{
+				XMStoreFloat4(&pRows[Bone * gRowsPerBone + Row], Transposed.r[Row]);
+			}
+		}
+	}
+	m_BakeTime = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count();
+}
+
+void CRtrBakedAnimation::Sample(float TotalTime, float4x4* pPalette) const
+{
+	// Frames are 1/SampleRate apart, except for the last one which is followed by the clip's end, where it loops back to frame 0
+	float Time = (m_Duration > 0) ? fmodf(TotalTime, m_Duration) : 0;
+	Time = (Time < 0) ? Time + m_Duration : Time;
+	const UINT Frame0 = min(UINT(Time * m_SampleRate), m_FrameCount - 1);
+	const UINT Frame1 = (Frame0 + 1 == m_FrameCount) ? 0 : Frame0 + 1;
+	const float Time0 = float(Frame0) / m_SampleRate;
+	const float Span = min(float(Frame0 + 1) / m_SampleRate, m_Duration) - Time0;
+	const XMVECTOR Ratio = XMVectorReplicate((Span > 0) ? min((Time - Time0) / Span, 1.0f) : 0);
+
+	const float4* pRows0 = &m_Rows[Frame0 * m_BonesCount * gRowsPerBone];
+	const float4* pRows1 = &m_Rows[Frame1 * m_BonesCount * gRowsPerBone];
+	XMMATRIX Transposed;
+	Transposed.r[3] = XMVectorSet(0, 0, 0, 1);
+	for(UINT Bone = 0; Bone < m_BonesCount; Bone++)
+	{
+		for(UINT Row = 0; Row < gRowsPerBone; Row++)
+		{
+			const UINT i = Bone * gRowsPerBone + Row;
+			Transposed.r[Row] = XMVectorLerpV(XMLoadFloat4(&pRows0[i]), XMLoadFloat4(&pRows1[i]), Ratio);
+		}
+		XMStoreFloat4x4(&pPalette[Bone], XMMatrixTranspose(Transposed));
+	}
+}
+
+CRtrBakedAnimation::SError CRtrBakedAnimation::MeasureError(UINT SampleCount) const
+{
+	SError Error;
+	if(SampleCount == 0 || m_BonesCount == 0)
+	{
+		return Error;
+	}
+
+	SRtrAnimationState State;
+	m_pController->InitState(State, m_AnimationID);
+	std::vector<float4x4> Scratch(m_BonesCount), Exact(m_BonesCount), Baked(m_BonesCount);
+	double Sum = 0;
+	for(UINT i = 0; i < SampleCount; i++)
+	{
+		// Scattered with the golden ratio, so the times fall everywhere between the frames
+		State.TotalTime = fmodf(float(i) * 0.618034f, 1.0f) * m_Duration;
+		m_pController->Evaluate(State, Scratch.data(), Exact.data());
+		Sample(State.TotalTime, Baked.data());
+		for(UINT Bone = 0; Bone < m_BonesCount; Bone++)
+		{
+			const float3 BindPosition = m_pController->GetBindGlobalTransform(Bone).Translation();
+			const float Distance = (float3::Transform(BindPosition, Exact[Bone]) - float3::Transform(BindPosition, Baked[Bone])).Length();
+			Error.MaxError = max(Error.MaxError, Distance);
+			Sum += Distance;
+		}
+	}
+	Error.AverageError = float(Sum / double(SampleCount * m_BonesCount));
+	return Error;
+}
+
+ID3D11ShaderResourceViewPtr CRtrBakedAnimation::CreateTextureSrv(ID3D11Device* pDevice) const
+{
+	D3D11_TEXTURE2D_DESC Desc;
+	Desc.Width = m_BonesCount * gRowsPerBone;
+	Desc.Height = m_FrameCount;
+	Desc.MipLevels = 1;
+	Desc.ArraySize = 1;
+	Desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	Desc.SampleDesc.Count = 1;
+	Desc.SampleDesc.Quality = 0;
+	Desc.Usage = D3D11_USAGE_IMMUTABLE;
+	Desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	Desc.CPUAccessFlags = 0;
+	Desc.MiscFlags = 0;
+
+	D3D11_SUBRESOURCE_DATA Data;
+	Data.pSysMem = m_Rows.data();
+	Data.SysMemPitch = Desc.Width * sizeof(float4);
+	Data.SysMemSlicePitch = 0;
+
+	ID3D11Texture2DPtr pTexture;
+	ID3D11ShaderResourceViewPtr pSrv;
+	verify(pDevice->CreateTexture2D(&Desc, &Data, &pTexture));
+	verify(pDevice->CreateShaderResourceView(pTexture, nullptr, &pSrv));
+	return pSrv;
+}
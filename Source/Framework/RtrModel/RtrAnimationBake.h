@@ -0,0 +1,95 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationBake.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+
+class CRtrAnimationController;
+
+// A clip sampled at a fixed rate into a table of bone palettes. Playback is a lookup and a lerp between two frames, without the key
+// search and the hierarchy update, which is good enough for background characters.
+// Each palette matrix is stored as 3 float4 rows of its transpose (the 4th column of an affine matrix is constant), frame after frame and
+// bone after bone. The table can be used as-is as a StructuredBuffer<float4>, or as an R32G32B32A32 texture with a frame per row
+class CRtrBakedAnimation
+{
+public:
+	struct SSettings
+	{
+		float SampleRate = 30;  // Frames per second
+		UINT MaxMemory = 0;     // In bytes. If not 0, the sample rate is lowered until the table fits
+	};
+
+	CRtrBakedAnimation(const CRtrAnimationController* pController, UINT AnimationID, const SSettings& Settings = SSettings());
+
+	// Writes GetBonesCount() palette matrices. The clip loops, like CRtrAnimation
+	void Sample(float TotalTime, float4x4* pPalette) const;
+
+	// Compares Sample() with the controller's full evaluation at SampleCount times between the baked frames.
+	// The error is the distance between the two palettes' images of each bone's bind position, in model units
+	struct SError
+	{
+		float MaxError = 0;
+		float AverageError = 0;
+	};
+	SError MeasureError(UINT SampleCount) const;
+
+	// The table as a texture, GetBonesCount() * 3 texels wide and GetFrameCount() high
+	ID3D11ShaderResourceViewPtr CreateTextureSrv(ID3D11Device* pDevice) const;
+
+	UINT GetAnimationID() const { return m_AnimationID; }
+	UINT GetBonesCount() const { return m_BonesCount; }
+	UINT GetFrameCount() const { return m_FrameCount; }
+	float GetSampleRate() const { return m_SampleRate; }
+	float GetBakeTime() const { return m_BakeTime; }
+	UINT GetMemorySize() const { return UINT(m_Rows.size() * sizeof(float4)); }
+	const std::vector<float4>& GetRows() const { return m_Rows; }
+
+private:
+	const CRtrAnimationController* m_pController;
+	UINT m_AnimationID;
+	UINT m_BonesCount;
+	UINT m_FrameCount = 0;
+	float m_SampleRate = 0;
+	float m_Duration = 0;  // In seconds
+	float m_BakeTime = 0;  // In seconds
+	std::vector<float4> m_Rows;
+};
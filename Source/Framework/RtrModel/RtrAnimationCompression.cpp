@@ -0,0 +1,253 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationCompression.cpp
+---------------------------------------------------------------------------*/
+#include "RtrAnimationCompression.h"
+
+static const float gSqrt2 = 1.41421356f;
+static const UINT gQuaternionComponentMax = (1 << 15) - 1;
+
+void SRtrTranslationRange::Create(const float3& RangeMin, const float3& RangeMax)
+{
+	Min = RangeMin;
+	Step = (RangeMax - RangeMin) / 65535.0f;
+}
+
+static UINT16 QuantizeComponent(float Value, float Min, float Step)
+{
+	if(Step <= 0)
+	{
+		return 0;
+	}
+	float q = (Value - Min) / Step + 0.5f;
+	return UINT16(max(0.0f, min(q, 65535.0f)));
+}
+
+SRtrPackedTranslation SRtrTranslationRange::Pack(const float3& T) const
+{
+	SRtrPackedTranslation P;
+	P.Bits[0] = QuantizeComponent(T.x, Min.x, Step.x);
+	P.Bits[1] = QuantizeComponent(T.y, Min.y, Step.y);
+	P.Bits[2] = QuantizeComponent(T.z, Min.z, Step.z);
+	return P;
+}
+
+SRtrPackedQuaternion CRtrAnimationCompressor::PackRotation(const quaternion& Q)
+{
+	quaternion Normalized;
+	Q.Normalize(Normalized);
+	const float c[4] = { Normalized.x, Normalized.y, Normalized.z, Normalized.w };
+	UINT Largest = 0;
+	for(UINT i = 1; i < 4; i++)
+	{
+		if(fabsf(c[i]) > fabsf(c[Largest]))
+		{
+			Largest = i;
+		}
+	}
+
+	// q and -q are the same rotation. Flipping makes the largest component positive, so it can be rebuilt from the other three.
+	// The other components are within [-1/sqrt(2), 1/sqrt(2)]
+	const float Sign = (c[Largest] < 0) ? -1.0f : 1.0f;
+	UINT64 Bits = Largest;
+	UINT Shift = 2;
+	for(UINT i = 0; i < 4; i++)
+	{
+		if(i != Largest)
+		{
+			float Unorm = (c[i] * Sign * gSqrt2) * 0.5f + 0.5f;
+			UINT q = UINT(max(0.0f, min(Unorm * gQuaternionComponentMax + 0.5f, float(gQuaternionComponentMax))));
+			Bits |= UINT64(q) << Shift;
+			Shift += 15;
+		}
+	}
+
+	SRtrPackedQuaternion P;
+	P.Bits[0] = UINT16(Bits);
+	P.Bits[1] = UINT16(Bits >> 16);
+	P.Bits[2] = UINT16(Bits >> 32);
+	return P;
+}
+
+quaternion CRtrAnimationCompressor::UnpackRotation(const SRtrPackedQuaternion& P)
+{
+	const UINT64 Bits = UINT64(P.Bits[0]) | (UINT64(P.Bits[1]) << 16) | (UINT64(P.Bits[2]) << 32);
+	const UINT Largest = UINT(Bits & 3);
+	float c[4];
+	float SumSq = 0;
+	UINT Shift = 2;
+	for(UINT i = 0; i < 4; i++)
+	{
+		if(i != Largest)
+		{
+			UINT q = UINT(Bits >> Shift) & gQuaternionComponentMax;
+			c[i] = (float(q) / gQuaternionComponentMax * 2 - 1) / gSqrt2;
+			SumSq += c[i] * c[i];
+			Shift += 15;
+		}
+	}
+	c[Largest] = sqrtf(max(0.0f, 1 - SumSq));
+	return quaternion(c[0], c[1], c[2], c[3]);
+}
+
+static float3 Interpolate(const float3& Start, const float3& End, float Ratio)
+{
+	return Start + ((End - Start) * Ratio);
+}
+
+static quaternion Interpolate(const quaternion& Start, const quaternion& End, float Ratio)
+{
+	return quaternion::Slerp(Start, End, Ratio);
+}
+
+static float Distance(const float3& a, const float3& b)
+{
+	return (a - b).Length();
+}
+
+static float Angle(const quaternion& a, const quaternion& b)
+{
+	// The angle of conjugate(a) * b. acos() of the dot product alone loses too much precision for angles this small
+	const float3 va(a.x, a.y, a.z);
+	const float3 vb(b.x, b.y, b.z);
+	const float3 v = vb * a.w - va * b.w - va.Cross(vb);
+	return 2 * atan2f(v.Length(), fabsf(a.Dot(b)));
+}
+
+// Unpack(i) returns key i after quantization, Error() compares two values
+template<typename T, typename PackedT, typename UnpackFunc, typename ErrorFunc>
+static float CompressChannel(const std::vector<float>& Times, const std::vector<T>& Values, const std::vector<PackedT>& Packed, UnpackFunc Unpack, ErrorFunc Error,
+	float Tolerance, std::vector<float>& OutTimes, std::vector<PackedT>& OutValues)
+{
+	OutTimes.clear();
+	OutValues.clear();
+	const UINT Count = UINT(Times.size());
+	if(Count == 0)
+	{
+		return 0;
+	}
+
+	// Constant channels keep a single key
+	std::vector<UINT> Kept(1, 0);
+	const T First = Unpack(Packed[0]);
+	float MaxError = 0;
+	for(UINT i = 0; i < Count; i++)
+	{
+		MaxError = max(MaxError, Error(First, Values[i]));
+	}
+
+	if(MaxError > Tolerance)
+	{
+		// Returns the largest error of the keys skipped by interpolating from key First to key Last. Stops once over the tolerance
+		auto SegmentError = [&](UINT FirstKey, UINT LastKey) -> float
+		{
+			const T Start = Unpack(Packed[FirstKey]);
+			const T End = Unpack(Packed[LastKey]);
+			float SegmentMax = 0;
+			for(UINT i = FirstKey + 1; i < LastKey && SegmentMax <= Tolerance; i++)
+			{
+				float Ratio = (Times[i] - Times[FirstKey]) / (Times[LastKey] - Times[FirstKey]);
+				SegmentMax = max(SegmentMax, Error(Interpolate(Start, End, Ratio), Values[i]));
+			}
+			return SegmentMax;
+		};
+
+		// Greedy, every segment grows for as long as the keys it skips stay within the tolerance
+		MaxError = 0;
+		UINT Start = 0;
+		while(Start + 1 < Count)
+		{
+			UINT End = Start + 1;
+			while((End + 1 < Count) && (SegmentError(Start, End + 1) <= Tolerance))
+			{
+				End++;
+			}
+			MaxError = max(MaxError, SegmentError(Start, End));
+			MaxError = max(MaxError, Error(Unpack(Packed[End]), Values[End]));
+			Kept.push_back(End);
+			Start = End;
+		}
+		MaxError = max(MaxError, Error(First, Values[0]));
+	}
+
+	OutTimes.reserve(Kept.size());
+	OutValues.reserve(Kept.size());
+	for(UINT Key : Kept)
+	{
+		OutTimes.push_back(Times[Key]);
+		OutValues.push_back(Packed[Key]);
+	}
+	return MaxError;
+}
+
+float CRtrAnimationCompressor::CompressTranslations(const std::vector<float>& Times, const std::vector<float3>& Values, const SRtrTranslationRange& Range, float Tolerance,
+	std::vector<float>& OutTimes, std::vector<SRtrPackedTranslation>& OutValues)
+{
+	std::vector<SRtrPackedTranslation> Packed(Values.size());
+	for(size_t i = 0; i < Values.size(); i++)
+	{
+		Packed[i] = Range.Pack(Values[i]);
+	}
+	auto Unpack = [&Range](const SRtrPackedTranslation& P) { return Range.Unpack(P); };
+	auto Error = [](const float3& a, const float3& b) { return Distance(a, b); };
+	return CompressChannel(Times, Values, Packed, Unpack, Error, max(Tolerance, Range.GetMaxError()), OutTimes, OutValues);
+}
+
+float CRtrAnimationCompressor::CompressRotations(const std::vector<float>& Times, const std::vector<quaternion>& Values, float Tolerance,
+	std::vector<float>& OutTimes, std::vector<SRtrPackedQuaternion>& OutValues)
+{
+	std::vector<SRtrPackedQuaternion> Packed(Values.size());
+	for(size_t i = 0; i < Values.size(); i++)
+	{
+		Packed[i] = PackRotation(Values[i]);
+	}
+	auto Unpack = [](const SRtrPackedQuaternion& P) { return UnpackRotation(P); };
+	auto Error = [](const quaternion& a, const quaternion& b) { return Angle(a, b); };
+	return CompressChannel(Times, Values, Packed, Unpack, Error, Tolerance, OutTimes, OutValues);
+}
+
+float CRtrAnimationCompressor::CompressScales(const std::vector<float>& Times, const std::vector<float3>& Values, float Tolerance,
+	std::vector<float>& OutTimes, std::vector<float3>& OutValues)
+{
+	// Scales are rarely animated, so they are only reduced
+	auto Unpack = [](const float3& S) { return S; };
+	auto Error = [](const float3& a, const float3& b) { return Distance(a, b); };
+	return CompressChannel(Times, Values, Values, Unpack, Error, Tolerance, OutTimes, OutValues);
+}
@@ -0,0 +1,97 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationCompression.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+
+// Smallest-three rotation in 48 bits: the index of the largest component (2 bits), and the other three in 15 bits each.
+// The largest component is rebuilt from the unit length
+struct SRtrPackedQuaternion
+{
+	UINT16 Bits[3];
+};
+
+// Translation quantized to 16 bits per component, relative to the translation range of its bone
+struct SRtrPackedTranslation
+{
+	UINT16 Bits[3];
+};
+
+struct SRtrTranslationRange
+{
+	float3 Min;
+	float3 Step;  // Extent / 65535
+
+	void Create(const float3& RangeMin, const float3& RangeMax);
+	float GetMaxError() const { return Step.Length() * 0.5f; }  // Distance from any value in the range to its quantized value
+	SRtrPackedTranslation Pack(const float3& T) const;
+	float3 Unpack(const SRtrPackedTranslation& P) const
+	{
+		return float3(Min.x + float(P.Bits[0]) * Step.x, Min.y + float(P.Bits[1]) * Step.y, Min.z + float(P.Bits[2]) * Step.z);
+	}
+};
+
+// Import-time animation compression. Keys the interpolation of their neighbors rebuilds within a tolerance are removed,
+// and the remaining ones are quantized. The removal is measured against the quantized keys.
+// Quantization alone can exceed the tolerance, so the returned error is what the final data actually meets. The last key is always kept, so the loop from the last key to the first one doesn't change
+class CRtrAnimationCompressor
+{
+public:
+	struct SSettings
+	{
+		float PositionTolerance = 0.001f;  // Model units
+		float AngleTolerance = 0.001f;     // Radians
+		float ScaleTolerance = 0.0001f;
+	};
+
+	static SRtrPackedQuaternion PackRotation(const quaternion& Q);
+	static quaternion UnpackRotation(const SRtrPackedQuaternion& P);
+
+	// Each returns the largest error of the raw keys after compression.
+	// Translations raise the tolerance to Range.GetMaxError() when the range is too wide for it, instead of keeping every key
+	static float CompressTranslations(const std::vector<float>& Times, const std::vector<float3>& Values, const SRtrTranslationRange& Range, float Tolerance,
+		std::vector<float>& OutTimes, std::vector<SRtrPackedTranslation>& OutValues);
+	static float CompressRotations(const std::vector<float>& Times, const std::vector<quaternion>& Values, float Tolerance,
+		std::vector<float>& OutTimes, std::vector<SRtrPackedQuaternion>& OutValues);
+	static float CompressScales(const std::vector<float>& Times, const std::vector<float3>& Values, float Tolerance,
+		std::vector<float>& OutTimes, std::vector<float3>& OutValues);
+};
@@ -42,9 +42,12 @@ Filename: RtrAnimationController.cpp
 #include "RtrAnimationController.h"
 #include "scene.h"
 #include "..\RtrModel.h"
+#include "RtrModelCache.h"
 #include <fstream>
+#include <chrono>
+using namespace DirectX;
 
-void DumpBonesHeirarchy(const std::string& filename, SRtrBone* pBone, UINT count)
+void DumpBonesHeirarchy(const std::string& filename, const std::vector<std::string>& Names, const std::vector<UINT>& Parents)
 {
     std::ofstream dotfile;
     dotfile.open(filename.c_str(), 'w');
@@ -52,13 +55,12 @@ void DumpBonesHeirarchy(const std::string& filename, SRtrBone* pBone, UINT count
     // Header
     dotfile << "digraph BonesGraph {" << std::endl;
 
-    for(UINT i = 0; i < count; i++)
+    for(UINT i = 0; i < Names.size(); i++)
     {
-        const SRtrBone& bone = pBone[i];
-        if(bone.ParentID != INVALID_BONE_ID)
+        if(Parents[i] != INVALID_BONE_ID)
         {
-            std::string Parent = pBone[bone.ParentID].Name;
-            std::string Me = bone.Name;
+            std::string Parent = Names[Parents[i]];
+            std::string Me = Names[i];
             std::replace(Parent.begin(), Parent.end(), '.', '_');
             std::replace(Me.begin(), Me.end(), '.', '_');
 
@@ -71,7 +73,7 @@ void DumpBonesHeirarchy(const std::string& filename, SRtrBone* pBone, UINT count
     dotfile.close();
 }
 
-CRtrAnimationController::CRtrAnimationController(const aiScene* pScene)
+CRtrAnimationController::CRtrAnimationController(const aiScene* pScene, const CRtrAnimationCompressor::SSettings& CompressionSettings)
 {
     if(pScene->HasAnimations())
 	{
@@ -79,11 +81,55 @@ CRtrAnimationController::CRtrAnimationController(const aiScene* pScene)
 		m_Animations.resize(pScene->mNumAnimations);
 		for(UINT i = 0; i < pScene->mNumAnimations; i++)
 		{
-			m_Animations[i] = std::make_unique<CRtrAnimation>(pScene->mAnimations[i], this);
+			m_Animations[i] = std::make_unique<CRtrAnimation>(pScene->mAnimations[i], this, CompressionSettings);
 		}
+		InitializeAnimatedBones();
+		InitializeLeafBones();
 	}
 }
 
+CRtrAnimationController::CRtrAnimationController(CRtrBinaryReader& Reader)
+{
+    m_BonesCount = Reader.Read<UINT>();
+    Reader.ReadArray(m_BoneParents);
+    Reader.ReadArray(m_BoneOffsets);
+    Reader.ReadArray(m_BindLocalTransforms);
+    m_BoneNames.resize(m_BonesCount);
+    for(UINT i = 0; i < m_BonesCount; i++)
+    {
+        m_BoneNames[i] = Reader.ReadString();
+        m_BoneNameToIdMap[m_BoneNames[i]] = i;
+    }
+    InitializeBindPose();
+
+    m_Animations.resize(Reader.Read<UINT>());
+    for(auto& Animation : m_Animations)
+    {
+        Animation = std::make_unique<CRtrAnimation>(Reader, m_BonesCount);
+    }
+    InitializeAnimatedBones();
+    InitializeLeafBones();
+}
+
+void CRtrAnimationController::Serialize(CRtrBinaryWriter& Writer) const
+{
+    // Bones are stored parent-before-child, the order Evaluate() relies on
+    Writer.Write(m_BonesCount);
+    Writer.WriteArray(m_BoneParents);
+    Writer.WriteArray(m_BoneOffsets);
+    Writer.WriteArray(m_BindLocalTransforms);
+    for(const auto& Name : m_BoneNames)
+    {
+        Writer.WriteString(Name);
+    }
+
+    Writer.Write(UINT(m_Animations.size()));
+    for(const auto& Animation : m_Animations)
+    {
+        Animation->Serialize(Writer);
+    }
+}
+
 void CRtrAnimationController::InitializeBones(const aiScene* pScene)
 {
     // Go over all the meshes, and find the bones that are being used
@@ -116,18 +162,46 @@ void CRtrAnimationController::InitializeBones(const aiScene* pScene)
 
         // Now create the hierarchy
         m_BonesCount = UINT(m_BoneNameToIdMap.size());
-        m_Bones.resize(m_BonesCount);
+        m_BoneParents.resize(m_BonesCount);
+        m_BoneNames.resize(m_BonesCount);
+        m_BindLocalTransforms.resize(m_BonesCount);
+        m_BoneOffsets.resize(m_BonesCount);
         UINT bonesCount = InitBone(pScene->mRootNode, INVALID_BONE_ID, 0);
         _Unreferenced_parameter_(bonesCount);
         assert(m_BonesCount == bonesCount);
-//        DumpBonesHeirarchy("bones.dot", &m_Bones[0], m_BonesCount);
+//        DumpBonesHeirarchy("bones.dot", m_BoneNames, m_BoneParents);
 
         InitializeBonesOffsetMatrices(pScene);
 
-        m_BoneTransforms.resize(m_BonesCount);
+        InitializeBindPose();
     }
 }
 
+void CRtrAnimationController::InitializeBindPose()
+{
+    // Bones without animation channels keep their original transform, so the sampler needs it in TRS form
+    m_BindPose.Resize(m_BonesCount);
+    // Bones that no clip animates keep their bind pose palette, so it is computed once here
+    m_BindGlobalTransforms.resize(m_BonesCount);
+    m_BindPalette.resize(m_BonesCount);
+    for(UINT i = 0; i < m_BonesCount; i++)
+    {
+        float4x4 Local = m_BindLocalTransforms[i];
+        float3 Translation, Scale;
+        quaternion Rotation;
+        Local.Decompose(Scale, Rotation, Translation);
+        m_BindPose.SetBone(i, Translation, Rotation, Scale);
+
+        const UINT ParentID = m_BoneParents[i];
+        m_BindGlobalTransforms[i] = (ParentID == INVALID_BONE_ID) ? Local : Local * m_BindGlobalTransforms[ParentID];
+        m_BindPalette[i] = m_BoneOffsets[i] * m_BindGlobalTransforms[i];
+    }
+    m_BoneTransforms.resize(m_BonesCount);
+    m_GlobalTransforms.resize(m_BonesCount);
+    InitState(m_State, BIND_POSE_ANIMATION_ID);
+    Evaluate(m_State, m_GlobalTransforms.data(), m_BoneTransforms.data());
+}
+
 UINT CRtrAnimationController::InitBone(const aiNode* pCurNode, UINT ParentID, UINT BoneID)
 {
     assert(m_BoneNameToIdMap.find(pCurNode->mName.C_Str()) != m_BoneNameToIdMap.end());
@@ -135,19 +209,10 @@ UINT CRtrAnimationController::InitBone(const aiNode* pCurNode, UINT ParentID, UI
     m_BoneNameToIdMap[pCurNode->mName.C_Str()] = BoneID;
 
     assert(BoneID < m_BonesCount);
-    SRtrBone& Bone = m_Bones[BoneID];
-    Bone.Name = pCurNode->mName.C_Str();
-    Bone.ParentID = ParentID;
-    Bone.BoneID = BoneID;
-    Bone.LocalTransform = aiMatToD3D(pCurNode->mTransformation);
-    Bone.OriginalLocalTransform = Bone.LocalTransform;
-    Bone.GlobalTransform = Bone.LocalTransform;
-
-    if(ParentID != INVALID_BONE_ID)
-    {
-        Bone.GlobalTransform *= m_Bones[ParentID].GlobalTransform;
-    }
-
+    const UINT CurBoneID = BoneID;
+    m_BoneNames[CurBoneID] = pCurNode->mName.C_Str();
+    m_BoneParents[CurBoneID] = ParentID;
+    m_BindLocalTransforms[CurBoneID] = aiMatToD3D(pCurNode->mTransformation);
     BoneID++;
 
     for(UINT i = 0; i < pCurNode->mNumChildren; i++)
@@ -155,7 +220,7 @@ UINT CRtrAnimationController::InitBone(const aiNode* pCurNode, UINT ParentID, UI
         // Check that the child is actually used
         if(m_BoneNameToIdMap.find(pCurNode->mChildren[i]->mName.C_Str()) != m_BoneNameToIdMap.end())
         {
-            BoneID = InitBone(pCurNode->mChildren[i], Bone.BoneID, BoneID);
+            BoneID = InitBone(pCurNode->mChildren[i], CurBoneID, BoneID);
         }
     }
     return BoneID;
@@ -172,34 +237,339 @@ void CRtrAnimationController::InitializeBonesOffsetMatrices(const aiScene* pScen
             const aiBone* pAiBone = pAiMesh->mBones[BoneID];
             auto RtrBoneIt = m_BoneNameToIdMap.find(pAiBone->mName.C_Str());
             assert(RtrBoneIt != m_BoneNameToIdMap.end());
-            SRtrBone& RtrBone = m_Bones[RtrBoneIt->second];
-            RtrBone.Offset = aiMatToD3D(pAiBone->mOffsetMatrix);
+            m_BoneOffsets[RtrBoneIt->second] = aiMatToD3D(pAiBone->mOffsetMatrix);
         }
     }
 }
 
-void CRtrAnimationController::SetBoneLocalTransform(UINT BoneID, const float4x4& Transform)
+void CRtrAnimationController::InitializeAnimatedBones()
 {
-	assert(BoneID < m_BonesCount);
-	m_Bones[BoneID].LocalTransform = Transform;
+    // A bone is animated if it has a channel or if its parent is animated. Parents come before their children
+    m_AnimatedBones.resize(m_Animations.size());
+    for(UINT AnimationID = 0; AnimationID < m_Animations.size(); AnimationID++)
+    {
+        std::vector<BYTE>& Animated = m_AnimatedBones[AnimationID];
+        Animated.resize(m_BonesCount);
+        for(UINT i = 0; i < m_BonesCount; i++)
+        {
+            const UINT ParentID = m_BoneParents[i];
+            const bool bParentAnimated = (ParentID != INVALID_BONE_ID) && Animated[ParentID];
+            Animated[i] = (bParentAnimated || m_Animations[AnimationID]->HasChannel(i)) ? 1 : 0;
+        }
+    }
+}
+
+void CRtrAnimationController::InitializeLeafBones()
+{
+    std::vector<BYTE> HasChildren(m_BonesCount, 0);
+    for(UINT i = 0; i < m_BonesCount; i++)
+    {
+        if(m_BoneParents[i] != INVALID_BONE_ID)
+        {
+            HasChildren[m_BoneParents[i]] = 1;
+        }
+    }
+
+    m_LeafBoneLengths.assign(m_BonesCount, FLT_MAX);
+    m_LeafBindOffsets.resize(m_BonesCount);
+    for(UINT i = 0; i < m_BonesCount; i++)
+    {
+        const UINT ParentID = m_BoneParents[i];
+        if(HasChildren[i] == 0 && ParentID != INVALID_BONE_ID)
+        {
+            m_LeafBoneLengths[i] = (m_BindGlobalTransforms[i].Translation() - m_BindGlobalTransforms[ParentID].Translation()).Length();
+            m_LeafBindOffsets[i] = m_BoneOffsets[i] * m_BindLocalTransforms[i];
+        }
+    }
+}
+
+void CRtrAnimationController::SetMinLeafBoneLength(SRtrAnimationState& State, float MinLength) const
+{
+    if(State.MinLeafBoneLength != MinLength)
+    {
+        State.MinLeafBoneLength = MinLength;
+        UpdateAnimatedBones(State);
+    }
+}
+
+void CRtrAnimationController::UpdateAnimatedBones(SRtrAnimationState& State) const
+{
+    State.AnimatedBones.assign(m_BonesCount, 0);
+    auto Merge = [&](UINT AnimationID)
+    {
+        if(AnimationID != BIND_POSE_ANIMATION_ID)
+        {
+            const std::vector<BYTE>& Animated = m_AnimatedBones[AnimationID];
+            for(UINT i = 0; i < m_BonesCount; i++)
+            {
+                State.AnimatedBones[i] |= Animated[i];
+            }
+        }
+    };
+
+    Merge(State.ActiveAnimation);
+    if(State.FadeDuration > 0)
+    {
+        Merge(State.FadeAnimation);
+    }
+    for(const auto& Layer : State.Layers)
+    {
+        Merge(Layer.AnimationID);
+    }
+
+    // Dropping a leaf only saves work if its parent is animated, otherwise the whole leaf is static
+    State.RigidBones.clear();
+    if(State.MinLeafBoneLength > 0)
+    {
+        for(UINT i = 0; i < m_BonesCount; i++)
+        {
+            if(State.AnimatedBones[i] && m_LeafBoneLengths[i] < State.MinLeafBoneLength)
+            {
+                State.AnimatedBones[i] = 0;
+                if(State.AnimatedBones[m_BoneParents[i]])
+                {
+                    State.RigidBones.push_back(i);
+                }
+            }
+        }
+    }
+
+    State.AnimatedBlocks.assign((m_BonesCount + CRtrPose::BLOCK_SIZE - 1) / CRtrPose::BLOCK_SIZE, 0);
+    State.AnimatedBoneCount = 0;
+    for(UINT i = 0; i < m_BonesCount; i++)
+    {
+        State.AnimatedBlocks[i / CRtrPose::BLOCK_SIZE] |= State.AnimatedBones[i];
+        State.AnimatedBoneCount += State.AnimatedBones[i];
+    }
+    State.bStaticBonesDirty = true;
 }
 
 void CRtrAnimationController::Animate(float ElapsedTime)
 {
-    if(m_ActiveAnimation != BIND_POSE_ANIMATION_ID)
+    Advance(m_State, ElapsedTime);
+    Evaluate(m_State, m_GlobalTransforms.data(), m_BoneTransforms.data());
+
+    m_bDualQuaternionsValid = false;
+    if(m_bDualQuaternionOutput && m_BonesCount)
+    {
+        m_BoneDualQuaternions.resize(m_BonesCount);
+        m_bDualQuaternionsValid = ConvertToDualQuaternions(m_BoneTransforms.data(), m_BonesCount, m_BoneDualQuaternions.data());
+    }
+}
+
+bool CRtrAnimationController::ConvertToDualQuaternions(const float4x4* pPalette, UINT BonesCount, SRtrDualQuaternion* pDualQuaternions)
+{
+    static const float Tolerance = 1e-3f;
+    for(UINT i = 0; i < BonesCount; i++)
+    {
+        const float4x4& M = pPalette[i];
+        const float3 X(M._11, M._12, M._13), Y(M._21, M._22, M._23), Z(M._31, M._32, M._33);
+        if(fabsf(X.LengthSquared() - 1) > Tolerance || fabsf(Y.LengthSquared() - 1) > Tolerance || fabsf(Z.LengthSquared() - 1) > Tolerance ||
+            X.Cross(Y).Dot(Z) < 0)
+        {
+            return false;
+        }
+
+        // Dual = 0.5 * (T, 0) * Real
+        const quaternion Real = quaternion::CreateFromRotationMatrix(M);
+        const float3 T = M.Translation();
+        const float3 RealV(Real.x, Real.y, Real.z);
+        const float3 DualV = 0.5f * (Real.w * T + T.Cross(RealV));
+        pDualQuaternions[i].Real = float4(Real.x, Real.y, Real.z, Real.w);
+        pDualQuaternions[i].Dual = float4(DualV.x, DualV.y, DualV.z, -0.5f * T.Dot(RealV));
+    }
+    return true;
+}
+
+void CRtrAnimationController::InitState(SRtrAnimationState& State, UINT AnimationID, float StartTime) const
+{
+    assert(AnimationID == BIND_POSE_ANIMATION_ID || AnimationID < m_Animations.size());
+    State.ActiveAnimation = AnimationID;
+    State.TotalTime = StartTime;
+    State.KeyCursors.assign((AnimationID == BIND_POSE_ANIMATION_ID) ? 0 : m_Animations[AnimationID]->GetCursorCount(), 0);
+    State.FadeDuration = 0;
+    State.FadeAnimation = BIND_POSE_ANIMATION_ID;
+    State.FadeCursors.clear();
+    State.Layers.clear();
+    UpdateAnimatedBones(State);
+}
+
+void CRtrAnimationController::Advance(SRtrAnimationState& State, float ElapsedTime) const
+{
+    State.TotalTime += ElapsedTime;
+    for(auto& Layer : State.Layers)
+    {
+        Layer.TotalTime += ElapsedTime;
+    }
+
+    if(State.FadeDuration > 0)
+    {
+        State.FadeTime += ElapsedTime;
+        State.FadeElapsed += ElapsedTime;
+        if(State.FadeElapsed >= State.FadeDuration)
+        {
+            State.FadeDuration = 0;
+            State.FadeAnimation = BIND_POSE_ANIMATION_ID;
+            State.FadeCursors.clear();
+            UpdateAnimatedBones(State);
+        }
+    }
+}
+
+void CRtrAnimationController::SamplePose(UINT AnimationID, float TotalTime, std::vector<UINT>& KeyCursors, const BYTE* pBoneMask, CRtrPose& Pose) const
+{
+    if(AnimationID == BIND_POSE_ANIMATION_ID)
+    {
+        Pose = m_BindPose;
+    }
+    else
+    {
+        m_Animations[AnimationID]->Sample(TotalTime, m_BindPose, CRtrPose::SLERP, KeyCursors, Pose, pBoneMask);
+    }
+}
+
+void CRtrAnimationController::Evaluate(SRtrAnimationState& State, float4x4* pScratch, float4x4* pBonePalette) const
+{
+    if(State.AnimatedBoneCount == 0)
+    {
+        // Nothing moves, only the bind pose palette might need writing
+        UpdateHierarchy(State, pScratch, pBonePalette);
+        return;
+    }
+
+    // Only the animated bones are sampled, the dropped leaves don't need their channels
+    const BYTE* pBoneMask = (State.MinLeafBoneLength > 0) ? State.AnimatedBones.data() : nullptr;
+    SamplePose(State.ActiveAnimation, State.TotalTime, State.KeyCursors, pBoneMask, State.Pose);
+
+    if(State.FadeDuration > 0)
+    {
+        // Blend back towards the previous clip. Its weight eases out from 1 to 0
+        SamplePose(State.FadeAnimation, State.FadeTime, State.FadeCursors, pBoneMask, State.LayerPose);
+        const float t = State.FadeElapsed / State.FadeDuration;
+        State.Pose.Blend(State.LayerPose, 1 - t * t * (3 - 2 * t), nullptr);
+    }
+
+    for(auto& Layer : State.Layers)
     {
-        m_TotalTime += ElapsedTime;
-        m_Animations[m_ActiveAnimation]->Animate(m_TotalTime, this);
+        if(Layer.Weight <= 0)
+        {
+            continue;
+        }
+
+        SamplePose(Layer.AnimationID, Layer.TotalTime, Layer.KeyCursors, pBoneMask, State.LayerPose);
+        if(Layer.Mode == SRtrAnimationLayer::ADDITIVE)
+        {
+            State.Pose.Add(State.LayerPose, Layer.ReferencePose, Layer.Weight, Layer.pMask);
+        }
+        else
+        {
+            State.Pose.Blend(State.LayerPose, Layer.Weight, Layer.pMask);
+        }
     }
 
+    UpdateHierarchy(State, pScratch, pBonePalette);
+}
+
+void CRtrAnimationController::UpdateHierarchy(SRtrAnimationState& State, float4x4* pScratch, float4x4* pBonePalette) const
+{
+    if(State.bStaticBonesDirty)
+    {
+        for(UINT i = 0; i < m_BonesCount; i++)
+        {
+            if(State.AnimatedBones[i] == 0)
+            {
+                pBonePalette[i] = m_BindPalette[i];
+            }
+        }
+        State.bStaticBonesDirty = false;
+    }
+
+    // The local transforms of the animated bones are composed into the scratch buffer, which then becomes their global
+    // transforms in place. Parents come before their children, so a parent is always global by the time its children need it.
+    // A parent that isn't animated is still in its bind pose
+    State.Pose.ComposeMatrices(pScratch, State.AnimatedBlocks.data());
     for(UINT i = 0; i < m_BonesCount; i++)
     {
-        m_Bones[i].GlobalTransform = m_Bones[i].LocalTransform;
-        if(m_Bones[i].ParentID != INVALID_BONE_ID)
+        if(State.AnimatedBones[i] == 0)
         {
-            m_Bones[i].GlobalTransform *= m_Bones[m_Bones[i].ParentID].GlobalTransform;
+            continue;
+        }
+
+        XMMATRIX Global = XMLoadFloat4x4(&pScratch[i]);
+        const UINT ParentID = m_BoneParents[i];
+        if(ParentID != INVALID_BONE_ID)
+        {
+            const float4x4& Parent = State.AnimatedBones[ParentID] ? pScratch[ParentID] : m_BindGlobalTransforms[ParentID];
+            Global = MultiplyAffine(Global, XMLoadFloat4x4(&Parent));
+            XMStoreFloat4x4(&pScratch[i], Global);
+        }
+        XMStoreFloat4x4(&pBonePalette[i], MultiplyAffine(XMLoadFloat4x4(&m_BoneOffsets[i]), Global));
+    }
+
+    // The dropped leaves have no children, so only their palette is needed
+    for(UINT i : State.RigidBones)
+    {
+        XMStoreFloat4x4(&pBonePalette[i], MultiplyAffine(XMLoadFloat4x4(&m_LeafBindOffsets[i]), XMLoadFloat4x4(&pScratch[m_BoneParents[i]])));
+    }
+}
+
+void CRtrAnimationController::CrossFade(SRtrAnimationState& State, UINT AnimationID, float FadeDuration, float StartTime) const
+{
+    assert(AnimationID == BIND_POSE_ANIMATION_ID || AnimationID < m_Animations.size());
+    if(FadeDuration > 0)
+    {
+        State.FadeAnimation = State.ActiveAnimation;
+        State.FadeTime = State.TotalTime;
+        State.FadeCursors.swap(State.KeyCursors);
+        State.FadeElapsed = 0;
+        State.FadeDuration = FadeDuration;
+    }
+    else
+    {
+        State.FadeDuration = 0;
+    }
+
+    State.ActiveAnimation = AnimationID;
+    State.TotalTime = StartTime;
+    State.KeyCursors.assign((AnimationID == BIND_POSE_ANIMATION_ID) ? 0 : m_Animations[AnimationID]->GetCursorCount(), 0);
+    UpdateAnimatedBones(State);
+}
+
+UINT CRtrAnimationController::AddLayer(SRtrAnimationState& State, UINT AnimationID, SRtrAnimationLayer::BLEND_MODE Mode, float Weight, const float* pMask, float StartTime) const
+{
+    assert(AnimationID < m_Animations.size());
+    State.Layers.push_back(SRtrAnimationLayer());
+    SRtrAnimationLayer& Layer = State.Layers.back();
+    Layer.AnimationID = AnimationID;
+    Layer.TotalTime = StartTime;
+    Layer.KeyCursors.assign(m_Animations[AnimationID]->GetCursorCount(), 0);
+    Layer.Mode = Mode;
+    Layer.Weight = Weight;
+    Layer.pMask = pMask;
+
+    if(Mode == SRtrAnimationLayer::ADDITIVE)
+    {
+        // Additive layers apply their difference from the clip's first frame
+        std::vector<UINT> Cursors(Layer.KeyCursors);
+        m_Animations[AnimationID]->Sample(0, m_BindPose, CRtrPose::SLERP, Cursors, Layer.ReferencePose);
+    }
+    UpdateAnimatedBones(State);
+    return UINT(State.Layers.size() - 1);
+}
+
+void CRtrAnimationController::CreateBoneMask(UINT RootBoneID, std::vector<float>& Mask) const
+{
+    assert(RootBoneID < m_BonesCount);
+    // Parents come before their children, so a single pass finds the whole subtree
+    Mask.assign(m_BonesCount, 0);
+    Mask[RootBoneID] = 1;
+    for(UINT i = RootBoneID + 1; i < m_BonesCount; i++)
+    {
+        const UINT ParentID = m_BoneParents[i];
+        if(ParentID != INVALID_BONE_ID && Mask[ParentID] != 0)
+        {
+            Mask[i] = 1;
         }
-        m_BoneTransforms[i] = m_Bones[i].Offset * m_Bones[i].GlobalTransform;
     }
 }
 
@@ -212,14 +582,145 @@ UINT CRtrAnimationController::GetBoneIdFromName(const std::string& Name) const
 
 void CRtrAnimationController::SetActiveAnimation(UINT ID)
 {
-    assert(ID == BIND_POSE_ANIMATION_ID || ID < m_Animations.size());
-    m_ActiveAnimation = ID;
-    if(ID == BIND_POSE_ANIMATION_ID)
+    InitState(m_State, ID);
+}
+
+CRtrAnimationController::SSamplingBenchmark CRtrAnimationController::BenchmarkSampling(UINT AnimationID, UINT SampleCount) const
+{
+    assert(AnimationID < m_Animations.size());
+    const CRtrAnimation* pAnimation = m_Animations[AnimationID].get();
+    SSamplingBenchmark Result;
+    Result.SampleCount = SampleCount;
+    if(m_BonesCount == 0 || SampleCount == 0)
+    {
+        return Result;
+    }
+
+    // Playback advances at 60 FPS. Seeking jumps around the clip with the golden ratio, so consecutive samples are far apart
+    std::vector<float> PlaybackTimes(SampleCount);
+    std::vector<float> SeekTimes(SampleCount);
+    const float Duration = pAnimation->GetDurationInSeconds();
+    for(UINT i = 0; i < SampleCount; i++)
+    {
+        PlaybackTimes[i] = float(i) / 60.0f;
+        SeekTimes[i] = fmodf(float(i) * 0.618034f, 1.0f) * Duration;
+    }
+
+    std::vector<float4x4> ScalarTransforms(m_BonesCount);
+    std::vector<float4x4> SimdTransforms(m_BonesCount);
+    m_BindPose.ComposeMatrices(ScalarTransforms.data());
+    std::vector<UINT> ScalarCursors(pAnimation->GetCursorCount());
+    std::vector<UINT> SimdCursors(pAnimation->GetCursorCount());
+    CRtrPose Pose;
+    const float NsPerBone = 1e9f / float(SampleCount * m_BonesCount);
+
+    auto TimeScalar = [&](const std::vector<float>& Times) -> float
+    {
+        std::fill(ScalarCursors.begin(), ScalarCursors.end(), 0);
+        auto Start = std::chrono::high_resolution_clock::now();
+        for(float Time : Times)
+        {
+            pAnimation->SampleScalar(Time, m_BindPose, ScalarCursors, ScalarTransforms.data());
+        }
+        return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * NsPerBone;
+    };
+
+    auto TimeSimd = [&](const std::vector<float>& Times, CRtrPose::ROTATION_INTERPOLATION Interpolation) -> float
+    {
+        std::fill(SimdCursors.begin(), SimdCursors.end(), 0);
+        auto Start = std::chrono::high_resolution_clock::now();
+        for(float Time : Times)
+        {
+            pAnimation->Sample(Time, m_BindPose, Interpolation, SimdCursors, Pose);
+            Pose.ComposeMatrices(SimdTransforms.data());
+        }
+        return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * NsPerBone;
+    };
+
+    auto MaxError = [&](CRtrPose::ROTATION_INTERPOLATION Interpolation) -> float
+    {
+        float Error = 0;
+        for(float Time : SeekTimes)
+        {
+            pAnimation->SampleScalar(Time, m_BindPose, ScalarCursors, ScalarTransforms.data());
+            pAnimation->Sample(Time, m_BindPose, Interpolation, SimdCursors, Pose);
+            Pose.ComposeMatrices(SimdTransforms.data());
+            for(UINT Bone = 0; Bone < m_BonesCount; Bone++)
+            {
+                const float* pScalar = &ScalarTransforms[Bone]._11;
+                const float* pSimd = &SimdTransforms[Bone]._11;
+                for(UINT i = 0; i < 16; i++)
+                {
+                    Error = max(Error, fabsf(pScalar[i] - pSimd[i]));
+                }
+            }
+        }
+        return Error;
+    };
+
+    Result.ScalarPlaybackNs = TimeScalar(PlaybackTimes);
+    Result.ScalarSeekNs = TimeScalar(SeekTimes);
+    Result.SlerpPlaybackNs = TimeSimd(PlaybackTimes, CRtrPose::SLERP);
+    Result.SlerpSeekNs = TimeSimd(SeekTimes, CRtrPose::SLERP);
+    Result.NlerpPlaybackNs = TimeSimd(PlaybackTimes, CRtrPose::NLERP);
+    Result.NlerpSeekNs = TimeSimd(SeekTimes, CRtrPose::NLERP);
+    Result.SlerpMaxError = MaxError(CRtrPose::SLERP);
+    Result.NlerpMaxError = MaxError(CRtrPose::NLERP);
+    return Result;
+}
+CRtrAnimationController::SHierarchyBenchmark CRtrAnimationController::BenchmarkHierarchy(UINT AnimationID, UINT SampleCount) const
+{
+    assert(AnimationID < m_Animations.size());
+    SHierarchyBenchmark Result;
+    Result.SampleCount = SampleCount;
+    if(m_BonesCount == 0 || SampleCount == 0)
     {
-        for(auto& Bone : m_Bones)
+        return Result;
+    }
+
+    SRtrAnimationState State;
+    InitState(State, AnimationID);
+    SamplePose(AnimationID, m_Animations[AnimationID]->GetDurationInSeconds() * 0.5f, State.KeyCursors, nullptr, State.Pose);
+    Result.AnimatedBoneCount = State.AnimatedBoneCount;
+
+    std::vector<float4x4> FullScratch(m_BonesCount), FullPalette(m_BonesCount);
+    std::vector<float4x4> Scratch(m_BonesCount), Palette(m_BonesCount);
+    const float NsPerBone = 1e9f / float(SampleCount * m_BonesCount);
+
+    // The update before the static bones were skipped: every bone, float4x4 products
+    auto Start = std::chrono::high_resolution_clock::now();
+    for(UINT Sample = 0; Sample < SampleCount; Sample++)
+    {
+        State.Pose.ComposeMatrices(FullScratch.data());
+        for(UINT i = 0; i < m_BonesCount; i++)
+        {
+            const UINT ParentID = m_BoneParents[i];
+            if(ParentID != INVALID_BONE_ID)
+            {
+                FullScratch[i] *= FullScratch[ParentID];
+            }
+            FullPalette[i] = m_BoneOffsets[i] * FullScratch[i];
+        }
+    }
+    Result.FullNs = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * NsPerBone;
+
+    // The first update writes the static bones, like it would when the animation starts
+    UpdateHierarchy(State, Scratch.data(), Palette.data());
+    Start = std::chrono::high_resolution_clock::now();
+    for(UINT Sample = 0; Sample < SampleCount; Sample++)
+    {
+        UpdateHierarchy(State, Scratch.data(), Palette.data());
+    }
+    Result.SkippingNs = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count() * NsPerBone;
+
+    for(UINT Bone = 0; Bone < m_BonesCount; Bone++)
+    {
+        const float* pFull = &FullPalette[Bone]._11;
+        const float* pSkipping = &Palette[Bone]._11;
+        for(UINT i = 0; i < 16; i++)
         {
-            Bone.LocalTransform = Bone.OriginalLocalTransform;
+            Result.MaxError = max(Result.MaxError, fabsf(pFull[i] - pSkipping[i]));
         }
     }
-    m_TotalTime = 0;
-}
\ No newline at end of file
+    return Result;
+}
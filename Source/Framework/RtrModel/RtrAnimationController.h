@@ -48,51 +48,181 @@ Filename: RtrAnimationController.h
 struct aiScene;
 struct aiNode;
 class CRtrModel;
-struct SRtrBone;
+class CRtrBinaryWriter;
+class CRtrBinaryReader;
 
 #define INVALID_BONE_ID UINT(-1)
 #define BIND_POSE_ANIMATION_ID UINT(-1)
 
-struct SRtrBone
+// A rigid bone transform in 8 floats. Real is the rotation, Dual is 0.5 * Translation * Real
+struct SRtrDualQuaternion
 {
-    UINT ParentID;
-    UINT BoneID;
-    std::string Name;
-    float4x4 Offset;
-    float4x4 LocalTransform;
-    float4x4 OriginalLocalTransform;
-    float4x4 GlobalTransform;
+    float4 Real;
+    float4 Dual;
+};
+
+// A clip blended on top of the base clip. Override layers blend towards the clip's pose, additive layers add the clip's
+// difference from its first frame
+struct SRtrAnimationLayer
+{
+    enum BLEND_MODE
+    {
+        OVERRIDE,
+        ADDITIVE,
+    };
+
+    UINT AnimationID = BIND_POSE_ANIMATION_ID;
+    float TotalTime = 0;
+    std::vector<UINT> KeyCursors;
+    BLEND_MODE Mode = OVERRIDE;
+    float Weight = 1;
+    const float* pMask = nullptr;  // A weight per bone, see CreateBoneMask(). Owned by the caller. Null affects every bone
+    CRtrPose ReferencePose;        // Additive layers only
+};
+
+// What one animated instance owns. The controller holds the skeleton and the clips, which any number of instances can share
+struct SRtrAnimationState
+{
+    // The base clip
+    UINT ActiveAnimation = BIND_POSE_ANIMATION_ID;
+    float TotalTime = 0;
+    std::vector<UINT> KeyCursors;
+
+    // During a cross-fade, the previous base clip keeps playing and fades out over FadeDuration
+    UINT FadeAnimation = BIND_POSE_ANIMATION_ID;
+    float FadeTime = 0;
+    float FadeElapsed = 0;
+    float FadeDuration = 0;  // 0 when not fading
+    std::vector<UINT> FadeCursors;
+
+    std::vector<SRtrAnimationLayer> Layers;  // Applied in order
+
+    CRtrPose Pose;
+    CRtrPose LayerPose;  // Scratch for the fade and the layers
+
+    // Bones that the clips above animate, directly or through an ancestor. The other bones keep their bind pose palette,
+    // which is only written again when this set changes
+    std::vector<BYTE> AnimatedBones;
+    std::vector<BYTE> AnimatedBlocks;  // Per CRtrPose block
+    UINT AnimatedBoneCount = 0;
+    bool bStaticBonesDirty = true;
+
+    // Animated leaf bones shorter than MinLeafBoneLength aren't sampled, they follow their parent in their bind pose.
+    // See CRtrAnimationController::SetMinLeafBoneLength()
+    float MinLeafBoneLength = 0;
+    std::vector<UINT> RigidBones;
 };
 
 class CRtrAnimationController
 {
 public:
-	CRtrAnimationController(const aiScene* pScene);
+	CRtrAnimationController() = default;  // No bones or animations
+	CRtrAnimationController(const aiScene* pScene, const CRtrAnimationCompressor::SSettings& CompressionSettings = CRtrAnimationCompressor::SSettings());
+	CRtrAnimationController(CRtrBinaryReader& Reader);
+	void Serialize(CRtrBinaryWriter& Writer) const;
     void Animate(float ElapsedTime);
-	void Reset() { m_TotalTime = 0; }
+	void Reset() { m_State.TotalTime = 0; }
 
     UINT GetAnimationsCount() const { return UINT(m_Animations.size()); }
     const std::string& GetAnimationName(UINT ID) const { return m_Animations[ID]->GetName();}
+    const CRtrAnimation* GetAnimation(UINT ID) const { return m_Animations[ID].get(); }
     void SetActiveAnimation(UINT ID);
 
     const float4x4* GetBonesMatrices() const { return &m_BoneTransforms[0]; }
+    // When enabled, Animate() also converts the palette to dual quaternions. Bones that scale or mirror can't be represented,
+    // GetBonesDualQuaternions() returns null while any of them does and the matrices must be used instead
+    void SetDualQuaternionOutput(bool bEnable) { m_bDualQuaternionOutput = bEnable; }
+    const SRtrDualQuaternion* GetBonesDualQuaternions() const { return m_bDualQuaternionsValid ? m_BoneDualQuaternions.data() : nullptr; }
+    // Returns false if any of the matrices isn't a rotation and a translation
+    static bool ConvertToDualQuaternions(const float4x4* pPalette, UINT BonesCount, SRtrDualQuaternion* pDualQuaternions);
     UINT GetBonesCount() const {return m_BonesCount;}
 
+    // The controller animates its own instance with Animate(). Other instances keep their own state and are evaluated here.
+    // Evaluate() doesn't modify the controller, so different states can be evaluated concurrently.
+    // pScratch and pBonePalette hold GetBonesCount() matrices each. A state must always be evaluated into the same palette,
+    // since bones that aren't animated are only written when the animated set changes. pScratch can be shared
+    void InitState(SRtrAnimationState& State, UINT AnimationID, float StartTime = 0) const;
+    void Advance(SRtrAnimationState& State, float ElapsedTime) const;
+    void Evaluate(SRtrAnimationState& State, float4x4* pScratch, float4x4* pBonePalette) const;
+
+    // Blending. Every clip is sampled into a local-space pose and blended there, only the result is composed into matrices.
+    // CrossFade() switches the base clip over FadeDuration seconds. A new fade starts from the current base clip.
+    // AddLayer() returns the layer index, the layer can then be tuned through State.Layers
+    void CrossFade(SRtrAnimationState& State, UINT AnimationID, float FadeDuration, float StartTime = 0) const;
+    UINT AddLayer(SRtrAnimationState& State, UINT AnimationID, SRtrAnimationLayer::BLEND_MODE Mode, float Weight, const float* pMask = nullptr, float StartTime = 0) const;
+    // Weight 1 for RootBoneID and its descendants, 0 for the rest
+    void CreateBoneMask(UINT RootBoneID, std::vector<float>& Mask) const;
+    void CrossFadeToAnimation(UINT ID, float FadeDuration) { CrossFade(m_State, ID, FadeDuration); }
+
+    // Level of detail. The length of a leaf bone is the bind pose distance from its parent, in model space
+    void SetMinLeafBoneLength(SRtrAnimationState& State, float MinLength) const;
+
     UINT GetBoneIdFromName(const std::string& Name) const;
-	void SetBoneLocalTransform(UINT BoneID, const float4x4& Transform);
+    UINT GetBoneParentID(UINT BoneID) const { return m_BoneParents[BoneID]; }
+    const CRtrPose& GetBindPose() const { return m_BindPose; }
+    const float4x4& GetBindGlobalTransform(UINT BoneID) const { return m_BindGlobalTransforms[BoneID]; }
+
+	// Times the scalar and the SIMD sampling of an animation, playing it at 60 FPS and seeking to scattered times.
+	// Timings are per bone, and include building the local matrices
+	struct SSamplingBenchmark
+	{
+		UINT SampleCount = 0;
+		float ScalarPlaybackNs = 0;
+		float ScalarSeekNs = 0;
+		float SlerpPlaybackNs = 0;
+		float SlerpSeekNs = 0;
+		float NlerpPlaybackNs = 0;
+		float NlerpSeekNs = 0;
+		float SlerpMaxError = 0;  // Largest local matrix element difference from the scalar path
+		float NlerpMaxError = 0;
+	};
+	SSamplingBenchmark BenchmarkSampling(UINT AnimationID, UINT SampleCount) const;
+
+	// Times the hierarchy update of a sampled pose (composing the local matrices, the global transforms and the palette),
+	// with every bone going through float4x4 products and with the static bones skipped and the SIMD affine products.
+	// Timings are per bone of the skeleton
+	struct SHierarchyBenchmark
+	{
+		UINT SampleCount = 0;
+		UINT AnimatedBoneCount = 0;
+		float FullNs = 0;
+		float SkippingNs = 0;
+		float MaxError = 0;  // Largest palette element difference between the two
+	};
+	SHierarchyBenchmark BenchmarkHierarchy(UINT AnimationID, UINT SampleCount) const;
 private:
+    // Hot data, read on every update. Bones are stored parent-before-child
+    std::vector<UINT> m_BoneParents;
+    std::vector<float4x4> m_BoneOffsets;
+    std::vector<float4x4> m_BindGlobalTransforms;
+    std::vector<float4x4> m_BindPalette;
+    std::vector<std::vector<BYTE>> m_AnimatedBones;  // Per animation, see SRtrAnimationState::AnimatedBones
+    std::vector<float> m_LeafBoneLengths;            // FLT_MAX for the bones that have children
+    std::vector<float4x4> m_LeafBindOffsets;         // Offset * BindLocal, the palette of a rigid leaf relative to its parent
+
+    // Cold data, only used when loading
     std::map<std::string, UINT> m_BoneNameToIdMap;
-    std::vector<SRtrBone> m_Bones;
+    std::vector<std::string> m_BoneNames;
+    std::vector<float4x4> m_BindLocalTransforms;
+
     std::vector<float4x4> m_BoneTransforms;
+    std::vector<float4x4> m_GlobalTransforms;
+    std::vector<SRtrDualQuaternion> m_BoneDualQuaternions;
+    bool m_bDualQuaternionOutput = false;
+    bool m_bDualQuaternionsValid = false;
+    CRtrPose m_BindPose;
 	std::vector<std::unique_ptr<CRtrAnimation>> m_Animations;
+    SRtrAnimationState m_State;
 
     UINT m_BonesCount = 0;
-	float m_TotalTime = 0;
-    UINT m_ActiveAnimation = BIND_POSE_ANIMATION_ID;
 
     void InitializeBones(const aiScene* pScene);
     UINT InitBone(const aiNode* pNode, UINT ParentID, UINT BoneID);
     void InitializeBonesOffsetMatrices(const aiScene* pScene);
-
-    void CalculateBoneTransforms();
+    void InitializeBindPose();
+    void InitializeAnimatedBones();
+    void InitializeLeafBones();
+    void UpdateAnimatedBones(SRtrAnimationState& State) const;
+    void UpdateHierarchy(SRtrAnimationState& State, float4x4* pScratch, float4x4* pBonePalette) const;
+    void SamplePose(UINT AnimationID, float TotalTime, std::vector<UINT>& KeyCursors, const BYTE* pBoneMask, CRtrPose& Pose) const;
 };
\ No newline at end of file
@@ -0,0 +1,224 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationCrowd.cpp
+---------------------------------------------------------------------------*/
+#include "RtrAnimationCrowd.h"
+#include "RtrAnimationBake.h"
+#include "..\ThreadPool.h"
+
+using namespace DirectX;
+
+CRtrAnimationCrowd::CRtrAnimationCrowd(const CRtrAnimationController* pController) : m_pController(pController)
+{
+}
+
+void CRtrAnimationCrowd::Resize(UINT InstanceCount)
+{
+	const UINT OldCount = GetInstanceCount();
+	m_States.resize(InstanceCount);
+	m_BakedAnimations.resize(InstanceCount, nullptr);
+	m_Lods.resize(InstanceCount);
+	m_Keyframes.resize(InstanceCount);
+	for(UINT i = OldCount; i < InstanceCount; i++)
+	{
+		m_pController->InitState(m_States[i], BIND_POSE_ANIMATION_ID);
+	}
+	m_Palettes.resize(InstanceCount * GetBonesCount());
+	m_Scratch.resize((InstanceCount + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	m_ChunkStats.resize(m_Scratch.size());
+	for(auto& Scratch : m_Scratch)
+	{
+		Scratch.resize(GetBonesCount());
+	}
+}
+
+void CRtrAnimationCrowd::SetInstanceAnimation(UINT InstanceID, UINT AnimationID, float StartTime)
+{
+	m_pController->InitState(m_States[InstanceID], AnimationID, StartTime);
+	m_BakedAnimations[InstanceID] = nullptr;
+	m_Lods[InstanceID].PendingTime = 0;
+	m_Lods[InstanceID].bSnap = true;
+}
+
+void CRtrAnimationCrowd::SetInstanceBakedAnimation(UINT InstanceID, const CRtrBakedAnimation* pBaked, float StartTime)
+{
+	assert(pBaked->GetBonesCount() == GetBonesCount());
+	m_pController->InitState(m_States[InstanceID], pBaked->GetAnimationID(), StartTime);
+	m_BakedAnimations[InstanceID] = pBaked;
+	m_Lods[InstanceID].PendingTime = 0;
+	m_Lods[InstanceID].bSnap = true;
+}
+
+void CRtrAnimationCrowd::SetInstanceLod(UINT InstanceID, const SRtrAnimationLod& Lod)
+{
+	assert(Lod.UpdateInterval > 0);
+	SInstanceLod& Instance = m_Lods[InstanceID];
+	if(Lod.UpdateInterval != Instance.Lod.UpdateInterval)
+	{
+		// The state is now evaluated into a different palette, which needs the static bones too
+		m_States[InstanceID].bStaticBonesDirty = true;
+		Instance.Phase = InstanceID % Lod.UpdateInterval;
+		if(Lod.UpdateInterval > 1 && m_Keyframes[InstanceID].empty())
+		{
+			m_Keyframes[InstanceID].resize(GetBonesCount() * 2);
+			Instance.bSnap = true;
+		}
+		else if(Instance.Lod.UpdateInterval == 1)
+		{
+			Instance.bSnap = true;
+		}
+	}
+	m_pController->SetMinLeafBoneLength(m_States[InstanceID], Lod.MinLeafBoneLength);
+	Instance.Lod = Lod;
+}
+
+void CRtrAnimationCrowd::EvaluateInstance(UINT InstanceID, float4x4* pScratch, float4x4* pPalette, SStats& Stats)
+{
+	SRtrAnimationState& State = m_States[InstanceID];
+	const float ElapsedTime = m_Lods[InstanceID].PendingTime;
+	m_Lods[InstanceID].PendingTime = 0;
+	if(m_BakedAnimations[InstanceID])
+	{
+		State.TotalTime += ElapsedTime;
+		m_BakedAnimations[InstanceID]->Sample(State.TotalTime, pPalette);
+		Stats.BakedInstances++;
+		return;
+	}
+	m_pController->Advance(State, ElapsedTime);
+	m_pController->Evaluate(State, pScratch, pPalette);
+	Stats.EvaluatedInstances++;
+	Stats.BonesEvaluated += State.AnimatedBoneCount;
+}
+
+void CRtrAnimationCrowd::UpdateChunk(UINT ChunkID, float ElapsedTime)
+{
+	const UINT BonesCount = GetBonesCount();
+	const UINT First = ChunkID * CHUNK_SIZE;
+	const UINT Last = min(First + CHUNK_SIZE, GetInstanceCount());
+	float4x4* pScratch = m_Scratch[ChunkID].data();
+	SStats& Stats = m_ChunkStats[ChunkID];
+	Stats = SStats();
+	for(UINT i = First; i < Last; i++)
+	{
+		SInstanceLod& Instance = m_Lods[i];
+		float4x4* pPalette = &m_Palettes[i * BonesCount];
+		Instance.PendingTime += ElapsedTime;
+		if(Instance.Lod.bVisible == false)
+		{
+			// Frozen. All the time spent off-screen is applied at once when the instance comes back
+			Instance.bSnap = true;
+			Stats.FrozenInstances++;
+			continue;
+		}
+
+		const UINT Interval = Instance.Lod.UpdateInterval;
+		if(Interval == 1)
+		{
+			EvaluateInstance(i, pScratch, pPalette, Stats);
+			continue;
+		}
+
+		float4x4* pPrevious = m_Keyframes[i].data();
+		float4x4* pNext = pPrevious + BonesCount;
+		const UINT Frame = (m_FrameID + Instance.Phase) % Interval;
+		if(Instance.bSnap)
+		{
+			EvaluateInstance(i, pScratch, pNext, Stats);
+			memcpy(pPrevious, pNext, sizeof(float4x4) * BonesCount);
+			Instance.bSnap = false;
+		}
+		else if(Frame == 0)
+		{
+			memcpy(pPrevious, pNext, sizeof(float4x4) * BonesCount);
+			EvaluateInstance(i, pScratch, pNext, Stats);
+		}
+		else
+		{
+			Stats.InterpolatedInstances++;
+		}
+
+		// The palette is one interval behind the clip, so that it always lies between two evaluated palettes.
+		// Blending the matrices shrinks the rotations slightly, which is not visible over a few frames
+		const XMVECTOR t = XMVectorReplicate(float(Frame) / float(Interval));
+		for(UINT Bone = 0; Bone < BonesCount; Bone++)
+		{
+			const XMMATRIX Previous = XMLoadFloat4x4(&pPrevious[Bone]);
+			const XMMATRIX Next = XMLoadFloat4x4(&pNext[Bone]);
+			XMMATRIX Result;
+			for(UINT Row = 0; Row < 4; Row++)
+			{
+				Result.r[Row] = XMVectorLerpV(Previous.r[Row], Next.r[Row], t);
+			}
+			XMStoreFloat4x4(&pPalette[Bone], Result);
+		}
+	}
+}
+
+void CRtrAnimationCrowd::Update(float ElapsedTime, CThreadPool* pThreadPool)
+{
+	if(GetBonesCount() == 0)
+	{
+		return;
+	}
+
+	const UINT ChunkCount = UINT(m_Scratch.size());
+	if(pThreadPool)
+	{
+		pThreadPool->ParallelFor(ChunkCount, [this, ElapsedTime](UINT ChunkID) { UpdateChunk(ChunkID, ElapsedTime); });
+	}
+	else
+	{
+		for(UINT ChunkID = 0; ChunkID < ChunkCount; ChunkID++)
+		{
+			UpdateChunk(ChunkID, ElapsedTime);
+		}
+	}
+
+	m_Stats = SStats();
+	for(const auto& Stats : m_ChunkStats)
+	{
+		m_Stats.EvaluatedInstances += Stats.EvaluatedInstances;
+		m_Stats.BakedInstances += Stats.BakedInstances;
+		m_Stats.InterpolatedInstances += Stats.InterpolatedInstances;
+		m_Stats.FrozenInstances += Stats.FrozenInstances;
+		m_Stats.BonesEvaluated += Stats.BonesEvaluated;
+	}
+	m_FrameID++;
+}
@@ -0,0 +1,112 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationCrowd.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+#include "RtrAnimationController.h"
+#include "RtrAnimationLod.h"
+
+class CThreadPool;
+class CRtrBakedAnimation;
+
+// Many instances of one skeleton, each playing its own clip at its own time. The skeleton and the clips stay in the controller,
+// an instance only owns its SRtrAnimationState. The bone palettes of all the instances are stored in one contiguous array,
+// instance after instance, ready to be copied into a GPU buffer
+class CRtrAnimationCrowd
+{
+public:
+	CRtrAnimationCrowd(const CRtrAnimationController* pController);
+
+	// New instances start in the bind pose
+	void Resize(UINT InstanceCount);
+	void SetInstanceAnimation(UINT InstanceID, UINT AnimationID, float StartTime = 0);
+	// The instance plays a baked clip, which is much cheaper than evaluating it. pBaked is owned by the caller and must outlive its use
+	void SetInstanceBakedAnimation(UINT InstanceID, const CRtrBakedAnimation* pBaked, float StartTime = 0);
+
+	// Animation level of detail, see CRtrAnimationLodPolicy. New instances are evaluated every frame. Instances with the same
+	// UpdateInterval are spread evenly across the frames, and interpolate their palettes in between, one interval behind their clip
+	void SetInstanceLod(UINT InstanceID, const SRtrAnimationLod& Lod);
+
+	// Advances and evaluates every instance. The instances are split into chunks, which run on the pool's threads.
+	// If pThreadPool is null, everything runs on the calling thread
+	void Update(float ElapsedTime, CThreadPool* pThreadPool);
+
+	UINT GetInstanceCount() const { return UINT(m_States.size()); }
+	UINT GetBonesCount() const { return m_pController->GetBonesCount(); }
+	const float4x4* GetBonePalette(UINT InstanceID) const { return &m_Palettes[InstanceID * GetBonesCount()]; }
+	const std::vector<float4x4>& GetPalettes() const { return m_Palettes; }
+
+	static const UINT CHUNK_SIZE = 64;  // Instances per task
+
+	struct SStats
+	{
+		UINT EvaluatedInstances = 0;
+		UINT BakedInstances = 0;
+		UINT InterpolatedInstances = 0;
+		UINT FrozenInstances = 0;
+		UINT BonesEvaluated = 0;  // Bones sampled and composed by the controller. The number to budget the CPU time with
+	};
+	const SStats& GetStats() const { return m_Stats; }  // Of the last Update()
+
+private:
+	const CRtrAnimationController* m_pController;
+	std::vector<SRtrAnimationState> m_States;
+	std::vector<const CRtrBakedAnimation*> m_BakedAnimations;  // Per instance, null for the evaluated ones. They use State.TotalTime too
+	std::vector<float4x4> m_Palettes;
+	std::vector<std::vector<float4x4>> m_Scratch;  // One per chunk, so chunks never share memory
+
+	struct SInstanceLod
+	{
+		SRtrAnimationLod Lod;
+		UINT Phase = 0;
+		float PendingTime = 0;  // Elapsed time that the state hasn't been advanced by yet
+		bool bSnap = true;      // The next update starts over instead of interpolating from the previous one
+	};
+	std::vector<SInstanceLod> m_Lods;
+	std::vector<std::vector<float4x4>> m_Keyframes;  // The previous and the next palettes of the interpolated instances
+	std::vector<SStats> m_ChunkStats;
+	SStats m_Stats;
+	UINT m_FrameID = 0;
+
+	void UpdateChunk(UINT ChunkID, float ElapsedTime);
+	void EvaluateInstance(UINT InstanceID, float4x4* pScratch, float4x4* pPalette, SStats& Stats);
+};
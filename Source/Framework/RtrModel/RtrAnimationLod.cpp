@@ -0,0 +1,77 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationLod.cpp
+---------------------------------------------------------------------------*/
+#include "RtrAnimationLod.h"
+#include "..\Camera.h"
+
+CRtrAnimationLodPolicy::CRtrAnimationLodPolicy(const CModelViewCamera& Camera, const float4x4& ViewProj, const SSettings& Settings) :
+	m_Camera(Camera), m_Settings(Settings)
+{
+	ExtractFrustumPlanes(ViewProj, m_Planes);
+}
+
+SRtrAnimationLod CRtrAnimationLodPolicy::Select(const float3& Center, float Radius, float ModelScale) const
+{
+	SRtrAnimationLod Lod;
+	Lod.bVisible = IsSphereInFrustum(m_Planes, Center, Radius);
+
+	const float ScreenSize = m_Camera.GetScreenSize(Center, Radius * 2);
+	if(ScreenSize < m_Settings.EighthRateScreenSize)
+	{
+		Lod.UpdateInterval = 8;
+	}
+	else if(ScreenSize < m_Settings.QuarterRateScreenSize)
+	{
+		Lod.UpdateInterval = 4;
+	}
+	else if(ScreenSize < m_Settings.HalfRateScreenSize)
+	{
+		Lod.UpdateInterval = 2;
+	}
+
+	// The screen size is linear in the length, so the threshold is found from the size of one model space unit
+	const float UnitScreenSize = m_Camera.GetScreenSize(Center, ModelScale);
+	if(m_Settings.MinLeafBoneScreenSize > 0 && UnitScreenSize > 0)
+	{
+		Lod.MinLeafBoneLength = m_Settings.MinLeafBoneScreenSize / UnitScreenSize;
+	}
+	return Lod;
+}
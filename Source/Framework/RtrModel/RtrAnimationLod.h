@@ -0,0 +1,79 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrAnimationLod.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+
+class CModelViewCamera;
+
+// How an animated instance is updated, see CRtrAnimationCrowd::SetInstanceLod()
+struct SRtrAnimationLod
+{
+	UINT UpdateInterval = 1;      // Evaluated once every UpdateInterval frames, interpolated in between
+	float MinLeafBoneLength = 0;  // Leaf bones shorter than this (in model space) follow their parent rigidly
+	bool bVisible = true;         // Off-screen instances are frozen, and catch up when they come back
+};
+
+// Picks the animation LOD of an instance from its bounding sphere. Instances that cover a smaller part of the viewport are
+// updated less often and lose their small leaf bones. Create one per frame, since it caches the frustum planes
+class CRtrAnimationLodPolicy
+{
+public:
+	struct SSettings
+	{
+		// Screen sizes are fractions of the viewport height. Below each size, the update interval doubles
+		float HalfRateScreenSize = 0.25f;
+		float QuarterRateScreenSize = 0.1f;
+		float EighthRateScreenSize = 0.04f;
+		// Leaf bones shorter than this on screen are dropped. 0 keeps all of them
+		float MinLeafBoneScreenSize = 0.005f;
+	};
+
+	CRtrAnimationLodPolicy(const CModelViewCamera& Camera, const float4x4& ViewProj, const SSettings& Settings = SSettings());
+
+	// Center and Radius are in world space. ModelScale converts model space lengths into world space
+	SRtrAnimationLod Select(const float3& Center, float Radius, float ModelScale = 1) const;
+
+private:
+	const CModelViewCamera& m_Camera;
+	SSettings m_Settings;
+	float4 m_Planes[6];
+};
@@ -0,0 +1,241 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrBonePartitioner.cpp
+---------------------------------------------------------------------------*/
+#include "RtrBonePartitioner.h"
+#include <algorithm>
+
+static const UINT gMaxBonesPerVertex = CRtrMesh::MAX_BONES_PER_VERTEX;
+static const UINT gInvalidID = UINT(-1);
+
+static const float* GetWeights(const CRtrMesh::SMeshDesc& Desc, const BYTE* pVertex)
+{
+	return (const float*)(pVertex + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS]);
+}
+
+// Unused slots get palette ID 0, their weight is 0 anyway
+static void WriteBoneIDs(const CRtrMesh::SMeshDesc& Desc, BYTE* pVertex, const UINT* pVertexBones, const std::vector<UINT>& PaletteIDs)
+{
+	BYTE* pBoneIDs = pVertex + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_IDS];
+	const float* pWeights = GetWeights(Desc, pVertex);
+	for(UINT j = 0; j < gMaxBonesPerVertex; j++)
+	{
+		pBoneIDs[j] = (pWeights[j] != 0) ? BYTE(PaletteIDs[pVertexBones[j]]) : 0;
+	}
+}
+
+template<typename IndexType>
+static void CopyIndices(const void* pSrc, std::vector<UINT>& Dst)
+{
+	const IndexType* pIndices = (const IndexType*)pSrc;
+	for(UINT i = 0; i < Dst.size(); i++)
+	{
+		Dst[i] = pIndices[i];
+	}
+}
+
+template<typename IndexType>
+static void StoreIndices(const std::vector<UINT>& Src, std::vector<BYTE>& Dst)
+{
+	Dst.resize(sizeof(IndexType) * Src.size());
+	IndexType* pIndices = (IndexType*)Dst.data();
+	for(UINT Index : Src)
+	{
+		*pIndices++ = IndexType(Index);
+	}
+}
+
+// A part being built. The vertices and bones are IDs in the source mesh, the indices point into Vertices
+struct SPart
+{
+	std::vector<UINT> Bones;
+	std::vector<UINT> Vertices;
+	std::vector<UINT> Indices;
+};
+
+static void CreatePart(const CRtrMesh::SMeshData& Src, const std::vector<UINT>& MeshBones, const std::vector<UINT>& VertexBones, const std::vector<UINT>& PaletteIDs,
+	const SPart& Part, UINT IndicesPerPrimitive, CRtrMesh::SMeshData& Dst)
+{
+	CRtrMesh::SMeshDesc& Desc = Dst.Desc;
+	Desc = Src.Desc;
+	Desc.VertexCount = UINT(Part.Vertices.size());
+	Desc.IndexCount = UINT(Part.Indices.size());
+	Desc.PrimitiveCount = Desc.IndexCount / IndicesPerPrimitive;
+	Desc.BonePaletteSize = UINT(Part.Bones.size());
+	Desc.BoundingBox = RTR_BOX_F();
+
+	const UINT Stride = Desc.VertexStride;
+	Dst.Vertices.resize(Stride * Desc.VertexCount);
+	for(UINT i = 0; i < Desc.VertexCount; i++)
+	{
+		const UINT SrcID = Part.Vertices[i];
+		BYTE* pVertex = Dst.Vertices.data() + i * Stride;
+		memcpy(pVertex, Src.Vertices.data() + SrcID * Stride, Stride);
+		WriteBoneIDs(Desc, pVertex, &VertexBones[SrcID * gMaxBonesPerVertex], PaletteIDs);
+
+		const float3& Position = *(const float3*)(pVertex + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION]);
+		Desc.BoundingBox.Min = float3::Min(Desc.BoundingBox.Min, Position);
+		Desc.BoundingBox.Max = float3::Max(Desc.BoundingBox.Max, Position);
+	}
+
+	Dst.BonePalette.resize(Part.Bones.size());
+	for(UINT i = 0; i < Part.Bones.size(); i++)
+	{
+		Dst.BonePalette[i] = MeshBones[Part.Bones[i]];
+	}
+
+	// Same index type choice as the importer
+	if(Desc.IndexCount < D3D11_16BIT_INDEX_STRIP_CUT_VALUE)
+	{
+		Desc.IndexType = DXGI_FORMAT_R16_UINT;
+		StoreIndices<UINT16>(Part.Indices, Dst.Indices);
+	}
+	else
+	{
+		Desc.IndexType = DXGI_FORMAT_R32_UINT;
+		StoreIndices<UINT32>(Part.Indices, Dst.Indices);
+	}
+}
+
+void CRtrBonePartitioner::Partition(CRtrMesh::SMeshData& Data, const std::vector<UINT>& MeshBones, const std::vector<UINT>& VertexBones, std::vector<CRtrMesh::SMeshData>& Parts)
+{
+	const CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	assert(Desc.VertexFormat == CRtrMesh::VERTEX_FORMAT_FULL);
+	assert(VertexBones.size() == Desc.VertexCount * gMaxBonesPerVertex);
+
+	// Mesh bone ID to palette ID, gInvalidID for the bones that aren't in the current palette
+	std::vector<UINT> PaletteIDs(MeshBones.size(), gInvalidID);
+	if(MeshBones.size() <= MAX_PALETTE_BONES)
+	{
+		for(UINT i = 0; i < MeshBones.size(); i++)
+		{
+			PaletteIDs[i] = i;
+		}
+		for(UINT i = 0; i < Desc.VertexCount; i++)
+		{
+			WriteBoneIDs(Desc, Data.Vertices.data() + i * Desc.VertexStride, &VertexBones[i * gMaxBonesPerVertex], PaletteIDs);
+		}
+		Data.BonePalette = MeshBones;
+		Data.Desc.BonePaletteSize = UINT(MeshBones.size());
+		Parts.push_back(std::move(Data));
+		return;
+	}
+
+	std::vector<UINT> Indices(Desc.IndexCount);
+	if(Desc.IndexType == DXGI_FORMAT_R16_UINT)
+	{
+		CopyIndices<UINT16>(Data.Indices.data(), Indices);
+	}
+	else
+	{
+		CopyIndices<UINT32>(Data.Indices.data(), Indices);
+	}
+	const UINT IndicesPerPrimitive = (Desc.Topology == D3D11_PRIMITIVE_TOPOLOGY_POINTLIST) ? 1 : ((Desc.Topology == D3D11_PRIMITIVE_TOPOLOGY_LINELIST) ? 2 : 3);
+
+	// Greedy split. The primitives are taken in their original order, which usually keeps neighbours together, and a new part starts
+	// whenever the bones of the next primitive don't fit into the current palette. Vertices shared by several parts are duplicated
+	std::vector<UINT> PartVertexIDs(Desc.VertexCount, gInvalidID);
+	SPart Part;
+	UINT NewBones[3 * gMaxBonesPerVertex];
+	auto GatherNewBones = [&](UINT First) -> UINT
+	{
+		UINT Count = 0;
+		for(UINT k = 0; k < IndicesPerPrimitive; k++)
+		{
+			const UINT Vertex = Indices[First + k];
+			const float* pWeights = GetWeights(Desc, Data.Vertices.data() + Vertex * Desc.VertexStride);
+			for(UINT j = 0; j < gMaxBonesPerVertex; j++)
+			{
+				const UINT Bone = VertexBones[Vertex * gMaxBonesPerVertex + j];
+				if(pWeights[j] != 0 && PaletteIDs[Bone] == gInvalidID && std::find(NewBones, NewBones + Count, Bone) == NewBones + Count)
+				{
+					NewBones[Count++] = Bone;
+				}
+			}
+		}
+		return Count;
+	};
+
+	auto FlushPart = [&]()
+	{
+		Parts.push_back(CRtrMesh::SMeshData());
+		CreatePart(Data, MeshBones, VertexBones, PaletteIDs, Part, IndicesPerPrimitive, Parts.back());
+		for(UINT Bone : Part.Bones)
+		{
+			PaletteIDs[Bone] = gInvalidID;
+		}
+		for(UINT Vertex : Part.Vertices)
+		{
+			PartVertexIDs[Vertex] = gInvalidID;
+		}
+		Part = SPart();
+	};
+
+	for(UINT First = 0; First + IndicesPerPrimitive <= Indices.size(); First += IndicesPerPrimitive)
+	{
+		UINT NewCount = GatherNewBones(First);
+		if(Part.Bones.size() + NewCount > MAX_PALETTE_BONES)
+		{
+			FlushPart();
+			NewCount = GatherNewBones(First);
+		}
+
+		for(UINT i = 0; i < NewCount; i++)
+		{
+			PaletteIDs[NewBones[i]] = UINT(Part.Bones.size());
+			Part.Bones.push_back(NewBones[i]);
+		}
+		for(UINT k = 0; k < IndicesPerPrimitive; k++)
+		{
+			const UINT Vertex = Indices[First + k];
+			if(PartVertexIDs[Vertex] == gInvalidID)
+			{
+				PartVertexIDs[Vertex] = UINT(Part.Vertices.size());
+				Part.Vertices.push_back(Vertex);
+			}
+			Part.Indices.push_back(PartVertexIDs[Vertex]);
+		}
+	}
+
+	if(Part.Indices.empty() == false)
+	{
+		FlushPart();
+	}
+}
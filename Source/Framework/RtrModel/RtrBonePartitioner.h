@@ -0,0 +1,56 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrBonePartitioner.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+// Vertices store their bone IDs as bytes, so a draw can reference at most MAX_PALETTE_BONES bones. Every skinned mesh gets a compact palette
+// with only the bones it references, and the meshes that reference more are split into parts that each fit into a palette.
+// Runs on CPU data, before the mesh is optimized
+class CRtrBonePartitioner
+{
+public:
+	static const UINT MAX_PALETTE_BONES = 256;
+
+	// MeshBones are the skeleton IDs of the bones the mesh references. VertexBones holds MAX_BONES_PER_VERTEX indices into MeshBones per vertex,
+	// one for each weight. Data must be VERTEX_FORMAT_FULL. It is moved into Parts when it doesn't need splitting
+	static void Partition(CRtrMesh::SMeshData& Data, const std::vector<UINT>& MeshBones, const std::vector<UINT>& VertexBones, std::vector<CRtrMesh::SMeshData>& Parts);
+};
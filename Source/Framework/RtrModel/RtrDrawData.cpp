@@ -0,0 +1,140 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrDrawData.cpp
+---------------------------------------------------------------------------*/
+#include "RtrDrawData.h"
+#include <vector>
+
+CRtrDrawDataBuffer::CRtrDrawDataBuffer(UINT RecordSize) : m_RecordSize(RecordSize)
+{
+	assert((RecordSize % 16) == 0);
+}
+
+void CRtrDrawDataBuffer::CreateBuffers(ID3D11Device* pDevice, UINT Capacity, UINT IdCapacity)
+{
+	if(Capacity > m_Capacity)
+	{
+		m_Capacity = max(Capacity, m_Capacity * 2);
+		D3D11_BUFFER_DESC BufferDesc;
+		BufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		BufferDesc.ByteWidth = m_RecordSize * m_Capacity;
+		BufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		BufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		BufferDesc.StructureByteStride = m_RecordSize;
+		BufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+		verify(pDevice->CreateBuffer(&BufferDesc, nullptr, &m_pBuffer));
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC SrvDesc;
+		SrvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		SrvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		SrvDesc.Buffer.FirstElement = 0;
+		SrvDesc.Buffer.NumElements = m_Capacity;
+		verify(pDevice->CreateShaderResourceView(m_pBuffer, &SrvDesc, &m_pSrv));
+	}
+
+	if(IdCapacity > m_IdCapacity)
+	{
+		// The IDs never change, so the stream is immutable and only recreated when it grows
+		m_IdCapacity = max(IdCapacity, m_IdCapacity * 2);
+		std::vector<UINT> IDs(m_IdCapacity);
+		for(UINT i = 0; i < m_IdCapacity; i++)
+		{
+			IDs[i] = i;
+		}
+
+		D3D11_BUFFER_DESC BufferDesc;
+		BufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		BufferDesc.ByteWidth = sizeof(UINT) * m_IdCapacity;
+		BufferDesc.CPUAccessFlags = 0;
+		BufferDesc.MiscFlags = 0;
+		BufferDesc.StructureByteStride = 0;
+		BufferDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		D3D11_SUBRESOURCE_DATA InitData;
+		InitData.pSysMem = IDs.data();
+		InitData.SysMemPitch = 0;
+		InitData.SysMemSlicePitch = 0;
+		verify(pDevice->CreateBuffer(&BufferDesc, &InitData, &m_pDrawIdVB));
+	}
+}
+
+void CRtrDrawDataBuffer::Begin(ID3D11DeviceContext* pCtx, UINT MaxDraws, UINT MaxInstances)
+{
+	assert(m_pMapped == nullptr);
+	MaxDraws = max(MaxDraws, 1U);
+	MaxInstances = max(MaxInstances, 1U);
+
+	// Instanced draws read the ID of their first instance plus the instance ID, so the stream must extend past the last draw
+	ID3D11DevicePtr pDevice;
+	pCtx->GetDevice(&pDevice);
+	CreateBuffers(pDevice, MaxDraws, MaxDraws + MaxInstances - 1);
+
+	D3D11_MAPPED_SUBRESOURCE MapData;
+	verify(pCtx->Map(m_pBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &MapData));
+	m_pCtx = pCtx;
+	m_pMapped = (BYTE*)MapData.pData;
+	m_MaxDraws = MaxDraws;
+	m_DrawCount = 0;
+}
+
+UINT CRtrDrawDataBuffer::Add(const void* pRecord)
+{
+	assert(m_pMapped && m_DrawCount < m_MaxDraws);
+	memcpy(m_pMapped + m_DrawCount * m_RecordSize, pRecord, m_RecordSize);
+	return m_DrawCount++;
+}
+
+void CRtrDrawDataBuffer::End(CDxStateCache& State)
+{
+	assert(m_pMapped);
+	m_pCtx->Unmap(m_pBuffer, 0);
+	m_pMapped = nullptr;
+	m_pCtx = nullptr;
+	Bind(State);
+}
+
+void CRtrDrawDataBuffer::Bind(CDxStateCache& State) const
+{
+	ID3D11ShaderResourceView* pSrv = m_pSrv;
+	State.VSSetShaderResources(CRtrMesh::PER_DRAW_SRV_INDEX, 1, &pSrv);
+	ID3D11Buffer* pVB = m_pDrawIdVB;
+	UINT Stride = sizeof(UINT);
+	UINT Offset = 0;
+	State.IASetVertexBuffers(CRtrMesh::DRAW_ID_VB_INDEX, 1, &pVB, &Stride, &Offset);
+}
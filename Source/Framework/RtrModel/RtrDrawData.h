@@ -0,0 +1,86 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrDrawData.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+// Per-draw data of a whole pass in one structured buffer, uploaded with a single Map(). The draws find their record through the DRAW_ID
+// instance stream, which holds 0, 1, 2... so drawing with StartInstanceLocation = draw index hands the index to the vertex shader.
+// See GetDrawIndex() in Media\Shaders\Framework\RtrVertex.hlsli. Matrices in structured buffers are column-major, store them transposed
+class CRtrDrawDataBuffer
+{
+public:
+	// Record size must be a multiple of 16 bytes
+	CRtrDrawDataBuffer(UINT RecordSize);
+
+	// Maps the buffer for up to MaxDraws records. MaxInstances is the largest instance count of a single draw
+	void Begin(ID3D11DeviceContext* pCtx, UINT MaxDraws, UINT MaxInstances = 1);
+	// Returns the draw index, which is the StartInstanceLocation of the draw
+	template<typename T>
+	UINT Add(const T& Record)
+	{
+		static_assert((sizeof(T) % 16) == 0, "Per-draw record size must be a multiple of 16 bytes");
+		assert(sizeof(T) == m_RecordSize);
+		return Add(&Record);
+	}
+	UINT Add(const void* pRecord);
+	// Unmaps the buffer and binds it with the draw ID stream
+	void End(CDxStateCache& State);
+	// Binds the buffer and the draw ID stream again, for contexts which didn't see End()
+	void Bind(CDxStateCache& State) const;
+
+	UINT GetDrawCount() const { return m_DrawCount; }
+
+private:
+	void CreateBuffers(ID3D11Device* pDevice, UINT Capacity, UINT IdCapacity);
+
+	UINT m_RecordSize;
+	UINT m_Capacity = 0;
+	UINT m_IdCapacity = 0;
+	ID3D11BufferPtr m_pBuffer;
+	ID3D11ShaderResourceViewPtr m_pSrv;
+	ID3D11BufferPtr m_pDrawIdVB;
+
+	ID3D11DeviceContext* m_pCtx = nullptr;
+	BYTE* m_pMapped = nullptr;
+	UINT m_MaxDraws = 0;
+	UINT m_DrawCount = 0;
+};
@@ -0,0 +1,244 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrDrawStream.cpp
+---------------------------------------------------------------------------*/
+#include "RtrDrawStream.h"
+#include "RtrMeshSimplifier.h"
+#include "..\RtrModel.h"
+#include <algorithm>
+
+static const UINT gFormatShift = CRtrDrawStream::DEPTH_BITS;
+static const UINT gMaterialShift = gFormatShift + CRtrDrawStream::FORMAT_BITS;
+static const UINT gShaderShift = gMaterialShift + CRtrDrawStream::MATERIAL_BITS;
+static const UINT gPassShift = gShaderShift + CRtrDrawStream::SHADER_BITS;
+static_assert(CRtrDrawStream::PASS_BITS + CRtrDrawStream::SHADER_BITS + CRtrDrawStream::MATERIAL_BITS + CRtrDrawStream::FORMAT_BITS + CRtrDrawStream::DEPTH_BITS == 64, "Sort key fields don't add up to 64 bits");
+
+static UINT64 GetKeyField(UINT64 Key, UINT Shift, UINT Bits)
+{
+	return (Key >> Shift) & ((UINT64(1) << Bits) - 1);
+}
+
+UINT64 CRtrDrawStream::MakeSortKey(UINT Pass, UINT Shader, UINT Material, UINT VertexFormat, float Depth)
+{
+	// The bits of a non-negative float sort like the float itself
+	UINT DepthBits = 0;
+	if(Depth > 0)
+	{
+		memcpy(&DepthBits, &Depth, sizeof(DepthBits));
+	}
+
+	UINT64 Key = DepthBits;
+	Key |= UINT64(min(VertexFormat, (1u << FORMAT_BITS) - 1)) << gFormatShift;
+	Key |= UINT64(min(Material, (1u << MATERIAL_BITS) - 1)) << gMaterialShift;
+	Key |= UINT64(min(Shader, (1u << SHADER_BITS) - 1)) << gShaderShift;
+	Key |= UINT64(min(Pass, (1u << PASS_BITS) - 1)) << gPassShift;
+	return Key;
+}
+
+float CRtrDrawStream::GetViewDepth(const CRtrMesh* pMesh, const float4x4& World, const float4x4& ViewProj)
+{
+	const RTR_BOX_F& Box = pMesh->GetBoundingBox();
+	const float3 Center = (Box.Min + Box.Max) * 0.5f;
+	const float4 ClipPos = float4::Transform(float4(Center.x, Center.y, Center.z, 1), World * ViewProj);
+	return ClipPos.w;
+}
+
+void CRtrDrawStream::Add(UINT64 SortKey, const CRtrMesh* pMesh, const float4x4* pTransform, UINT FirstIndex, UINT IndexCount)
+{
+	SPacket Packet = { SortKey, pMesh, pTransform, FirstIndex, IndexCount };
+	m_Packets.push_back(Packet);
+}
+
+void CRtrDrawStream::AddDrawList(const CRtrModel* pModel, UINT Pass, const CRtrLodSelector* pLodSelector, const float4x4* pViewProj)
+{
+	for(const auto& DrawCmd : pModel->GetDrawList())
+	{
+		for(const auto pMesh : DrawCmd.pMeshes)
+		{
+			const CRtrMesh::SLod Lod = pMesh->GetLod(pLodSelector ? pLodSelector->SelectLod(pMesh, DrawCmd.Transformation) : 0);
+			const float Depth = pViewProj ? GetViewDepth(pMesh, DrawCmd.Transformation, *pViewProj) : 0;
+			const UINT64 Key = MakeSortKey(Pass, 0, pMesh->GetMaterialID(), pMesh->GetVertexFormat(), Depth);
+			Add(Key, pMesh, &DrawCmd.Transformation, Lod.FirstIndex, Lod.IndexCount);
+		}
+	}
+}
+
+void CRtrDrawStream::Sort()
+{
+	const UINT Count = UINT(m_Packets.size());
+	if(Count < 2)
+	{
+		return;
+	}
+
+	// The histograms of all the digits are gathered in a single pass over the keys
+	UINT Histograms[8][256] = {};
+	for(const auto& Packet : m_Packets)
+	{
+		for(UINT Digit = 0; Digit < 8; Digit++)
+		{
+			Histograms[Digit][(Packet.SortKey >> (Digit * 8)) & 0xFF]++;
+		}
+	}
+
+	m_Scratch.resize(Count);
+	std::vector<SPacket>* pSrc = &m_Packets;
+	std::vector<SPacket>* pDst = &m_Scratch;
+	for(UINT Digit = 0; Digit < 8; Digit++)
+	{
+		const UINT Shift = Digit * 8;
+		UINT* pOffsets = Histograms[Digit];
+		if(pOffsets[((*pSrc)[0].SortKey >> Shift) & 0xFF] == Count)
+		{
+			continue;
+		}
+
+		UINT Offset = 0;
+		for(UINT i = 0; i < 256; i++)
+		{
+			const UINT BucketSize = pOffsets[i];
+			pOffsets[i] = Offset;
+			Offset += BucketSize;
+		}
+
+		for(const auto& Packet : *pSrc)
+		{
+			(*pDst)[pOffsets[(Packet.SortKey >> Shift) & 0xFF]++] = Packet;
+		}
+		std::swap(pSrc, pDst);
+	}
+
+	if(pSrc != &m_Packets)
+	{
+		m_Packets.swap(m_Scratch);
+	}
+}
+
+CRtrDrawStream::SStats CRtrDrawStream::GetStats() const
+{
+	SStats Stats;
+	Stats.PacketCount = UINT(m_Packets.size());
+	for(UINT i = 0; i < m_Packets.size(); i++)
+	{
+		const UINT64 Key = m_Packets[i].SortKey;
+		const UINT64 PrevKey = (i > 0) ? m_Packets[i - 1].SortKey : ~Key;
+		// The pass is counted as part of the shader
+		if(GetKeyField(Key, gShaderShift, PASS_BITS + SHADER_BITS) != GetKeyField(PrevKey, gShaderShift, PASS_BITS + SHADER_BITS))
+		{
+			Stats.ShaderSwitches++;
+		}
+		if(GetKeyField(Key, gMaterialShift, MATERIAL_BITS) != GetKeyField(PrevKey, gMaterialShift, MATERIAL_BITS))
+		{
+			Stats.MaterialSwitches++;
+		}
+		if(GetKeyField(Key, gFormatShift, FORMAT_BITS) != GetKeyField(PrevKey, gFormatShift, FORMAT_BITS))
+		{
+			Stats.FormatSwitches++;
+		}
+	}
+	return Stats;
+}
+
+// Sorts the keys with Sort() and with std::stable_sort(). FirstIndex holds the recording order, so a stable sort gives the same packets
+static bool SortsLikeStableSort(const std::vector<UINT64>& Keys)
+{
+	CRtrDrawStream Stream;
+	for(UINT i = 0; i < Keys.size(); i++)
+	{
+		Stream.Add(Keys[i], nullptr, nullptr, i, 0);
+	}
+	std::vector<CRtrDrawStream::SPacket> Expected = Stream.GetPackets();
+	std::stable_sort(Expected.begin(), Expected.end(), [](const CRtrDrawStream::SPacket& a, const CRtrDrawStream::SPacket& b) { return a.SortKey < b.SortKey; });
+	Stream.Sort();
+
+	const std::vector<CRtrDrawStream::SPacket>& Sorted = Stream.GetPackets();
+	bool bMatch = (Sorted.size() == Expected.size());
+	for(UINT i = 0; bMatch && i < Sorted.size(); i++)
+	{
+		bMatch = (Sorted[i].SortKey == Expected[i].SortKey) && (Sorted[i].FirstIndex == Expected[i].FirstIndex);
+	}
+	return bMatch;
+}
+
+bool CRtrDrawStream::SelfCheck()
+{
+	CSelfCheck Check("CRtrDrawStream");
+
+	// Every field outranks all the fields after it, even when they are clamped
+	const UINT Max = UINT(-1);
+	Check(MakeSortKey(1, 0, 0, 0, 0) > MakeSortKey(0, Max, Max, Max, FLT_MAX), "the pass is the most significant field");
+	Check(MakeSortKey(0, 1, 0, 0, 0) > MakeSortKey(0, 0, Max, Max, FLT_MAX), "the shader outranks the material");
+	Check(MakeSortKey(0, 0, 1, 0, 0) > MakeSortKey(0, 0, 0, Max, FLT_MAX), "the material outranks the vertex format");
+	Check(MakeSortKey(0, 0, 0, 1, 0) > MakeSortKey(0, 0, 0, 0, FLT_MAX), "the vertex format outranks the depth");
+	Check(MakeSortKey(0, 0, 0, 0, 1.5f) > MakeSortKey(0, 0, 0, 0, 1.0f), "nearer draws come first");
+	Check(MakeSortKey(0, 0, 0, 0, -1.0f) == MakeSortKey(0, 0, 0, 0, 0), "negative depths are 0");
+
+	// Keys made of a few values per field, so that many are equal
+	std::vector<UINT64> Keys(1000);
+	std::vector<UINT> Random(Keys.size());
+	UINT Seed = 1;
+	for(UINT i = 0; i < Keys.size(); i++)
+	{
+		Seed = Seed * 1664525 + 1013904223;
+		Random[i] = Seed >> 8;
+		Keys[i] = MakeSortKey(Seed >> 30, (Seed >> 20) & 3, (Seed >> 16) & 7, (Seed >> 12) & 3, float((Seed >> 8) & 7));
+	}
+	Check(SortsLikeStableSort(Keys), "the sort is stable");
+
+	// Only the lowest digit differs, so a single pass runs and the result ends up in the scratch buffer
+	std::vector<UINT64> OneDigit(Keys.size());
+	for(UINT i = 0; i < Keys.size(); i++)
+	{
+		OneDigit[i] = 0x1234567800000000ULL | (Random[i] & 0xF);
+	}
+	Check(SortsLikeStableSort(OneDigit), "a single digit pass is sorted");
+
+	// The lowest and the highest digits differ, so the result ends up back in the packets
+	std::vector<UINT64> TwoDigits(Keys.size());
+	for(UINT i = 0; i < Keys.size(); i++)
+	{
+		TwoDigits[i] = (UINT64(Random[i] & 0x3) << 56) | ((Random[i] >> 4) & 0xF);
+	}
+	Check(SortsLikeStableSort(TwoDigits), "two digit passes are sorted");
+
+	// Every digit is skipped, the order doesn't change
+	Check(SortsLikeStableSort(std::vector<UINT64>(100, Keys[0])), "equal keys keep the recording order");
+	return Check.Passed();
+}
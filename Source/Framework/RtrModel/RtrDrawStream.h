@@ -0,0 +1,104 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrDrawStream.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+class CRtrModel;
+class CRtrLodSelector;
+
+// A per-frame stream of draw packets. Techniques record one packet per draw, sort the stream and replay it, so that consecutive draws
+// share as much state as possible. Recording and sorting don't touch the device
+class CRtrDrawStream
+{
+public:
+	// Key layout, from the most significant bits: pass | shader | material | vertex format | depth.
+	// Depth comes last so that draws which share the state are drawn front to back
+	static const UINT PASS_BITS = 4;
+	static const UINT SHADER_BITS = 10;
+	static const UINT MATERIAL_BITS = 14;
+	static const UINT FORMAT_BITS = 4;
+	static const UINT DEPTH_BITS = 32;
+
+	struct SPacket
+	{
+		UINT64 SortKey;
+		const CRtrMesh* pMesh;
+		const float4x4* pTransform;  // Must stay valid until the stream is replayed
+		UINT FirstIndex;             // Relative to the mesh's first index
+		UINT IndexCount;
+	};
+
+	// State changes when replaying the packets in their current order
+	struct SStats
+	{
+		UINT PacketCount = 0;
+		UINT ShaderSwitches = 0;
+		UINT MaterialSwitches = 0;
+		UINT FormatSwitches = 0;
+	};
+
+	// IDs which don't fit in their field are clamped. Negative depths are treated as 0
+	static UINT64 MakeSortKey(UINT Pass, UINT Shader, UINT Material, UINT VertexFormat, float Depth);
+	// Clip-space w of the center of the mesh's bounding box, which is the view depth for perspective projections
+	static float GetViewDepth(const CRtrMesh* pMesh, const float4x4& World, const float4x4& ViewProj);
+
+	void Clear() { m_Packets.clear(); }
+	void Add(UINT64 SortKey, const CRtrMesh* pMesh, const float4x4* pTransform, UINT FirstIndex, UINT IndexCount);
+	// Records every mesh of the draw list for techniques with a single shader per vertex format, keyed by material and vertex format.
+	// Depth is only part of the key when pViewProj is not null
+	void AddDrawList(const CRtrModel* pModel, UINT Pass, const CRtrLodSelector* pLodSelector = nullptr, const float4x4* pViewProj = nullptr);
+
+	// LSD radix sort on the keys, 8 bits per pass. Passes where all the keys share the digit are skipped.
+	// The sort is stable, so packets with equal keys keep the recording order
+	void Sort();
+
+	const std::vector<SPacket>& GetPackets() const { return m_Packets; }
+	SStats GetStats() const;
+
+	// Checks the key packing order, and Sort() against std::stable_sort() on streams which take the digit-skipping paths.
+	// Doesn't need a device. Returns false and traces the failing checks
+	static bool SelfCheck();
+
+private:
+	std::vector<SPacket> m_Packets;
+	std::vector<SPacket> m_Scratch;
+};
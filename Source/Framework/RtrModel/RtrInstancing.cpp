@@ -0,0 +1,97 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrInstancing.cpp
+---------------------------------------------------------------------------*/
+#include "RtrInstancing.h"
+#include "RtrMeshSimplifier.h"
+#include "..\RtrModel.h"
+#include <algorithm>
+
+void CRtrInstanceBatcher::Build(const CRtrModel* pModel, const std::vector<float4x4>& ModelTransforms, const CRtrLodSelector* pLodSelector)
+{
+	m_Instances.clear();
+	m_NodeTransforms.clear();
+	for(UINT Copy = 0; Copy < ModelTransforms.size(); Copy++)
+	{
+		for(const auto& Node : pModel->GetDrawList())
+		{
+			const float4x4 World = Node.Transformation * ModelTransforms[Copy];
+			m_NodeTransforms.push_back(World);
+			for(const auto pMesh : Node.pMeshes)
+			{
+				SInstance Instance;
+				Instance.pMesh = pMesh;
+				Instance.Lod = pLodSelector ? pLodSelector->SelectLod(pMesh, World) : 0;
+				Instance.Copy = Copy;
+				Instance.NodeTransformID = UINT(m_NodeTransforms.size() - 1);
+				m_Instances.push_back(Instance);
+			}
+		}
+	}
+
+	// Sorting by pointers only gives an arbitrary order, but a stable one, which is all the batching needs
+	std::stable_sort(m_Instances.begin(), m_Instances.end(), [](const SInstance& a, const SInstance& b) -> bool
+	{
+		if(a.pMesh->GetMaterial() != b.pMesh->GetMaterial())
+		{
+			return a.pMesh->GetMaterial() < b.pMesh->GetMaterial();
+		}
+		if(a.pMesh != b.pMesh)
+		{
+			return a.pMesh < b.pMesh;
+		}
+		return a.Lod < b.Lod;
+	});
+
+	m_Batches.clear();
+	m_Transforms.resize(m_Instances.size());
+	for(UINT i = 0; i < m_Instances.size(); i++)
+	{
+		const SInstance& Instance = m_Instances[i];
+		m_Transforms[i] = Instance.pMesh->HasBones() ? ModelTransforms[Instance.Copy] : m_NodeTransforms[Instance.NodeTransformID];
+
+		if(m_Batches.empty() || m_Batches.back().pMesh != Instance.pMesh || m_Batches.back().Lod != Instance.Lod)
+		{
+			SBatch Batch = { Instance.pMesh, Instance.Lod, i, 0 };
+			m_Batches.push_back(Batch);
+		}
+		m_Batches.back().InstanceCount++;
+	}
+}
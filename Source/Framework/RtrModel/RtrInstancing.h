@@ -0,0 +1,81 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrInstancing.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+class CRtrModel;
+class CRtrLodSelector;
+
+// Groups the draw list of a model into one batch per mesh and LOD, so that each batch can be drawn with a single DrawIndexedInstanced().
+// Batches are sorted by material, then by mesh, so that consecutive batches share as much state as possible
+class CRtrInstanceBatcher
+{
+public:
+	struct SBatch
+	{
+		const CRtrMesh* pMesh;
+		UINT Lod;
+		UINT FirstInstance;  // Into GetTransforms()
+		UINT InstanceCount;
+	};
+
+	// Adds every draw node of the model once per model transformation. Skinned meshes only get the model transformation,
+	// since their bone matrices already contain the node transformation
+	void Build(const CRtrModel* pModel, const std::vector<float4x4>& ModelTransforms, const CRtrLodSelector* pLodSelector = nullptr);
+
+	const std::vector<SBatch>& GetBatches() const { return m_Batches; }
+	const std::vector<float4x4>& GetTransforms() const { return m_Transforms; }
+
+private:
+	struct SInstance
+	{
+		const CRtrMesh* pMesh;
+		UINT Lod;
+		UINT Copy;             // Into the model transformations
+		UINT NodeTransformID;  // Into m_NodeTransforms
+	};
+
+	std::vector<SInstance> m_Instances;
+	std::vector<float4x4> m_NodeTransforms;
+	std::vector<SBatch> m_Batches;
+	std::vector<float4x4> m_Transforms;
+};
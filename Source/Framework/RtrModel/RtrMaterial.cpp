@@ -40,6 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 Filename: RtrMaterial.cpp
 ---------------------------------------------------------------------------*/
 #include "RtrMaterial.h"
+#include "RtrModelCache.h"
 #include "material.h"
 #include "..\StringUtils.h"
 
@@ -48,17 +49,43 @@ CRtrMaterial::CRtrMaterial(const std::string& Name)
     m_Name = Name;
 }
 
-CRtrMaterial::CRtrMaterial(const aiMaterial* pAiMaterial, ID3D11Device* pDevice, const std::string& Folder)
+CRtrMaterial::CRtrMaterial(const aiMaterial* pAiMaterial, ID3D11Device* pDevice, const std::string& Folder) : CRtrMaterial(CreateDesc(pAiMaterial), pDevice, Folder)
+{
+}
+
+CRtrMaterial::CRtrMaterial(const SDesc& Desc, ID3D11Device* pDevice, const std::string& Folder)
 {
+	for(int i = 0; i < MATERIAL_MAP_TYPE_COUNT; ++i)
+	{
+		if(Desc.Textures[i].size())
+		{
+			// Create the SRV
+			std::string s = Folder + '\\' + Desc.Textures[i];
+			bool bSrgb = (i == DIFFUSE_MAP);
+			m_SRV[i] = CreateShaderResourceViewFromFileThreadSafe(pDevice, string_2_wstring(s), bSrgb);
+			assert(m_SRV[i].GetInterfacePtr());
+			m_TextureNames[i] = Desc.Textures[i];
+			m_bHasTextures = true;
+		}
+	}
+
+	m_DiffuseColor = Desc.DiffuseColor;
+	m_SpecularColor = Desc.SpecularColor;
+	m_Shininess = Desc.Shininess;
+	m_bDoubleSided = Desc.bDoubleSided;
+	m_Name = Desc.Name;
+}
+
+CRtrMaterial::SDesc CRtrMaterial::CreateDesc(const aiMaterial* pAiMaterial)
+{
+	SDesc Desc;
 	for(int i = 0; i < MATERIAL_MAP_TYPE_COUNT; ++i)
 	{
 		aiTextureType aiType;
-		bool bSrgb = false;
 		switch(i)
 		{
 		case DIFFUSE_MAP:
 			aiType = aiTextureType_DIFFUSE;
-			bSrgb = true;
 			break;
 		case NORMAL_MAP:
 			aiType = aiTextureType_NORMALS;
@@ -83,36 +110,72 @@ CRtrMaterial::CRtrMaterial(const aiMaterial* pAiMaterial, ID3D11Device* pDevice,
 			if(TextureCount != 1)
 			{
 				trace(L"Can't create material with more then one texture per type");
-				return;
+				return Desc;
 			}
 
 			// Get the texture name
 			aiString path;
 			pAiMaterial->GetTexture(aiType, 0, &path);
-
-			// Create the SRV
-			std::string s(path.data);
-			s = Folder + '\\' + s;
-			m_SRV[i] = CreateShaderResourceViewFromFile(pDevice, string_2_wstring(s), bSrgb);
-			assert(m_SRV[i].GetInterfacePtr());
-			m_bHasTextures = true;
+			Desc.Textures[i] = path.data;
 		}
 	}
 
 	aiColor3D color;
 	aiString name;
 	pAiMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, color);
-    m_DiffuseColor = float3(color.r, color.g, color.b);
+    Desc.DiffuseColor = float3(color.r, color.g, color.b);
     pAiMaterial->Get(AI_MATKEY_COLOR_SPECULAR, color);
-    m_SpecularColor = float3(color.r, color.g, color.b);
-    pAiMaterial->Get(AI_MATKEY_SHININESS, m_Shininess);
+    Desc.SpecularColor = float3(color.r, color.g, color.b);
+    pAiMaterial->Get(AI_MATKEY_SHININESS, Desc.Shininess);
     
     pAiMaterial->Get(AI_MATKEY_NAME, name);
 	std::string nameStr = std::string(name.C_Str());
 	std::transform(nameStr.begin(), nameStr.end(), nameStr.begin(), ::tolower);
 
-	m_Name = nameStr;
-    int TwoSided;
+	Desc.Name = nameStr;
+    int TwoSided = 0;
     pAiMaterial->Get(AI_MATKEY_TWOSIDED, TwoSided);
-    m_bDoubleSided = (TwoSided != 0);
+    Desc.bDoubleSided = (TwoSided != 0);
+	return Desc;
+}
+
+CRtrMaterial::SDesc CRtrMaterial::GetDesc() const
+{
+	SDesc Desc;
+	for(int i = 0; i < MATERIAL_MAP_TYPE_COUNT; ++i)
+	{
+		Desc.Textures[i] = m_TextureNames[i];
+	}
+	Desc.Name = m_Name;
+	Desc.DiffuseColor = m_DiffuseColor;
+	Desc.SpecularColor = m_SpecularColor;
+	Desc.Shininess = m_Shininess;
+	Desc.bDoubleSided = m_bDoubleSided;
+	return Desc;
+}
+
+void CRtrMaterial::SDesc::Serialize(CRtrBinaryWriter& Writer) const
+{
+	Writer.WriteString(Name);
+	for(int i = 0; i < MATERIAL_MAP_TYPE_COUNT; ++i)
+	{
+		Writer.WriteString(Textures[i]);
+	}
+	Writer.Write(DiffuseColor);
+	Writer.Write(SpecularColor);
+	Writer.Write(Shininess);
+	Writer.Write(UINT(bDoubleSided));
+}
+
+void CRtrMaterial::SDesc::Deserialize(CRtrBinaryReader& Reader)
+{
+	Name = Reader.ReadString();
+	for(int i = 0; i < MATERIAL_MAP_TYPE_COUNT; ++i)
+	{
+		Textures[i] = Reader.ReadString();
+	}
+	DiffuseColor = Reader.Read<float3>();
+	SpecularColor = Reader.Read<float3>();
+	Shininess = Reader.Read<float>();
+	bDoubleSided = (Reader.Read<UINT>() != 0);
 }
\ No newline at end of file
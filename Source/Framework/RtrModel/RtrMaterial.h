@@ -43,13 +43,12 @@ Filename: RtrMaterial.h
 #include "..\Common.h"
 
 struct aiMaterial;
+class CRtrBinaryWriter;
+class CRtrBinaryReader;
 
 class CRtrMaterial
 {
 public:
-    CRtrMaterial(const std::string& Name);
-	CRtrMaterial(const aiMaterial* pAiMaterial, ID3D11Device* pDevice, const std::string& Folder);
-
 	enum MAP_TYPE
 	{
 		DIFFUSE_MAP,
@@ -61,6 +60,27 @@ public:
 		MATERIAL_MAP_TYPE_COUNT
 	};
 
+	// Everything needed to recreate the material. Texture names are relative to the model folder
+	struct SDesc
+	{
+		std::string Name;
+		std::string Textures[MATERIAL_MAP_TYPE_COUNT];
+		float3 DiffuseColor = float3(1, 1, 1);
+		float3 SpecularColor = float3(0, 0, 0);
+		float Shininess = 1;
+		bool bDoubleSided = false;
+
+		void Serialize(CRtrBinaryWriter& Writer) const;
+		void Deserialize(CRtrBinaryReader& Reader);
+	};
+
+    CRtrMaterial(const std::string& Name);
+	CRtrMaterial(const aiMaterial* pAiMaterial, ID3D11Device* pDevice, const std::string& Folder);
+	CRtrMaterial(const SDesc& Desc, ID3D11Device* pDevice, const std::string& Folder);
+
+	static SDesc CreateDesc(const aiMaterial* pAiMaterial);
+	SDesc GetDesc() const;
+
 	ID3D11ShaderResourceView* GetSRV(MAP_TYPE Type) const { return m_SRV[Type].GetInterfacePtr(); }
     bool IsDoubleSided() const {return m_bDoubleSided;}
 
@@ -80,6 +100,7 @@ public:
 private:
 	bool m_bHasTextures = false;
 	ID3D11ShaderResourceViewPtr m_SRV[MATERIAL_MAP_TYPE_COUNT];
+	std::string m_TextureNames[MATERIAL_MAP_TYPE_COUNT];
 	float3 m_DiffuseColor   = float3(1, 1, 1);
     float3 m_SpecularColor  = float3(0, 0, 0);
     float m_Shininess       = 1;
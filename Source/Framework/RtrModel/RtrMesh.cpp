@@ -40,42 +40,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 Filename: RtrMesh.cpp
 ---------------------------------------------------------------------------*/
 #include "RtrMesh.h"
+#include "RtrMeshArena.h"
+#include "RtrMeshOptimizer.h"
+#include "RtrMeshlets.h"
+#include "RtrMeshSimplifier.h"
+#include "RtrBonePartitioner.h"
 #include "..\RtrModel.h"
 #include "mesh.h"
+#include <DirectXPackedVector.h>
 
-const UINT CRtrMesh::m_MaxBonesPerVertex = 8;
-#define INVALID_VERTEX_ELEMENT_OFFSET  UINT(-1)
+static const UINT gMaxBonesPerVertex = CRtrMesh::MAX_BONES_PER_VERTEX;
 
-CRtrMesh::CRtrMesh(ID3D11Device* pDevice, const CRtrModel* pModel, const CRtrAnimationController* pAnimCtrl, const aiMesh* pAiMesh)
+static void SetVertexElementOffsets(const aiMesh* pAiMesh, CRtrMesh::SMeshDesc& Desc)
 {
-	m_VertexCount = pAiMesh->mNumVertices;
-	m_PrimitiveCount = m_VertexCount / pAiMesh->mFaces[0].mNumIndices;
-	CreateIndexBuffer(pDevice, pAiMesh);
-    CreateVertexBuffer(pDevice, pAiMesh, pAnimCtrl);
-	switch(pAiMesh->mFaces[0].mNumIndices)
-	{
-	case 1:
-		m_Topology = D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
-		break;
-	case 2:
-		m_Topology = D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
-		break;
-	case 3:
-		m_Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		break;
-	default:
-		assert(0);
-	}
-
-	m_pMaterial = pModel->GetMaterial(pAiMesh->mMaterialIndex);
-	assert(m_pMaterial);
-}
-
-void CRtrMesh::SetVertexElementOffsets(const aiMesh* pAiMesh)
-{
-	for(int i = 0; i < VERTEX_ELEMENT_COUNT; i++)
+	for(int i = 0; i < CRtrMesh::VERTEX_ELEMENT_COUNT; i++)
 	{
-		m_VertexElementsOffsets[i] = INVALID_VERTEX_ELEMENT_OFFSET;
+		Desc.VertexElementsOffsets[i] = INVALID_VERTEX_ELEMENT_OFFSET;
 	}
 
 	UINT Offset = 0;
@@ -85,27 +65,27 @@ void CRtrMesh::SetVertexElementOffsets(const aiMesh* pAiMesh)
 		trace(L"Loaded mesh with no positions!");
 		return;
 	}
-	m_VertexElementsOffsets[VERTEX_ELEMENT_POSITION] = Offset;
+	Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION] = Offset;
 	Offset += sizeof(float3);
 
 	if(pAiMesh->HasNormals())
 	{
-		m_VertexElementsOffsets[VERTEX_ELEMENT_NORMAL] = Offset;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_NORMAL] = Offset;
 		Offset += sizeof(float3);
 	}
 
 	if(pAiMesh->HasTangentsAndBitangents())
 	{
-		m_VertexElementsOffsets[VERTEX_ELEMENT_TANGENT] = Offset;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_TANGENT] = Offset;
 		Offset += sizeof(float3);
-		m_VertexElementsOffsets[VERTEX_ELEMENT_BITANGENT] = Offset;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BITANGENT] = Offset;
 		Offset += sizeof(float3);
 	}
 
 	// Supporting only tex coord0
 	if(pAiMesh->HasTextureCoords(0))
 	{
-		m_VertexElementsOffsets[VERTEX_ELEMENT_TEXCOORD_0] = Offset;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_TEXCOORD_0] = Offset;
 		Offset += sizeof(float3);
 	}
 
@@ -120,31 +100,27 @@ void CRtrMesh::SetVertexElementOffsets(const aiMesh* pAiMesh)
 
 	if(pAiMesh->HasVertexColors(0))
 	{
-		m_VertexElementsOffsets[VERTEX_ELEMENT_DIFFUSE_COLOR] = Offset;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_DIFFUSE_COLOR] = Offset;
 		Offset += sizeof(DWORD); // To save space we will store it as RGBA8_UNORM
 	}
 
 	if(pAiMesh->HasBones())
 	{
-		m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_IDS] = Offset;
-		Offset += sizeof(UINT8)*m_MaxBonesPerVertex;
-		m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_WEIGHTS] = Offset;
-		Offset += sizeof(float)*m_MaxBonesPerVertex;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_IDS] = Offset;
+		Offset += sizeof(UINT8)*gMaxBonesPerVertex;
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS] = Offset;
+		Offset += sizeof(float)*gMaxBonesPerVertex;
 	}
 
-	m_VertexStride = Offset;
+	Desc.VertexStride = Offset;
+	Desc.FullVertexStride = Offset;
 }
 
 template<typename IndexType>
-void CRtrMesh::CreateIndexBufferInternal(ID3D11Device* pDevice, const aiMesh* pAiMesh)
+static void PackIndices(const aiMesh* pAiMesh, CRtrMesh::SMeshData& Data)
 {
-	std::unique_ptr<IndexType[]> Indices = std::unique_ptr<IndexType[]>(new IndexType[m_IndexCount]);
-
-	if(Indices.get() == nullptr)
-	{
-		trace(L"Can't allocate space for indices");
-		return;
-	}
+	Data.Indices.resize(sizeof(IndexType) * Data.Desc.IndexCount);
+	IndexType* Indices = (IndexType*)Data.Indices.data();
 
 	const UINT FirstFaceIndexCount = pAiMesh->mFaces[0].mNumIndices;
 
@@ -158,43 +134,95 @@ void CRtrMesh::CreateIndexBufferInternal(ID3D11Device* pDevice, const aiMesh* pA
 
 		}
 	}
-
-	D3D11_BUFFER_DESC IbDesc;
-	IbDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	IbDesc.ByteWidth = sizeof(IndexType)*m_IndexCount;
-	IbDesc.CPUAccessFlags = 0;
-	IbDesc.MiscFlags = 0;
-	IbDesc.StructureByteStride = 0;
-	IbDesc.Usage = D3D11_USAGE_DEFAULT;
-
-	D3D11_SUBRESOURCE_DATA InitData;
-	InitData.pSysMem = Indices.get();
-	InitData.SysMemPitch = IbDesc.ByteWidth;
-	InitData.SysMemSlicePitch = IbDesc.ByteWidth;
-
-	verify(pDevice->CreateBuffer(&IbDesc, &InitData, &m_IB));	
 }
 
-void CRtrMesh::CreateIndexBuffer(ID3D11Device* pDevice, const aiMesh* pAiMesh)
+static void PackIndexBuffer(const aiMesh* pAiMesh, CRtrMesh::SMeshData& Data)
 {
 	// Assuming everything is triangles. I've never seen lines/points used directly in models
-	m_IndexCount = pAiMesh->mNumFaces * pAiMesh->mFaces[0].mNumIndices;
+	Data.Desc.IndexCount = pAiMesh->mNumFaces * pAiMesh->mFaces[0].mNumIndices;
 
 	// Save some space by choosing the best index buffer type (16/32 bit)
-	if(m_IndexCount < D3D11_16BIT_INDEX_STRIP_CUT_VALUE)
+	if(Data.Desc.IndexCount < D3D11_16BIT_INDEX_STRIP_CUT_VALUE)
 	{
-		m_IndexType = DXGI_FORMAT_R16_UINT;
-		return CreateIndexBufferInternal<UINT16>(pDevice, pAiMesh);
+		Data.Desc.IndexType = DXGI_FORMAT_R16_UINT;
+		PackIndices<UINT16>(pAiMesh, Data);
 	}
 	else
 	{
-		m_IndexType = DXGI_FORMAT_R32_UINT;
-		return CreateIndexBufferInternal<UINT32>(pDevice, pAiMesh);
+		Data.Desc.IndexType = DXGI_FORMAT_R32_UINT;
+		PackIndices<UINT32>(pAiMesh, Data);
+	}
+}
+
+static void PackBones(const aiMesh* pAiMesh, CRtrMesh::SMeshData& Data, const CRtrAnimationController* pAnimationController, std::vector<UINT>& MeshBones, std::vector<UINT>& VertexBones)
+{
+	const CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	BYTE* pVertexData = Data.Vertices.data();
+
+	// The IDs don't fit into the vertices yet. They index MeshBones, which only holds the bones with weights, and CRtrBonePartitioner
+	// turns them into palette IDs
+	VertexBones.assign(Desc.VertexCount * gMaxBonesPerVertex, 0);
+	for(UINT Bone = 0; Bone < pAiMesh->mNumBones; Bone++)
+	{
+		const aiBone* pAiBone = pAiMesh->mBones[Bone];
+		if(pAiBone->mNumWeights == 0)
+		{
+			continue;
+		}
+		const UINT MeshBoneID = UINT(MeshBones.size());
+		MeshBones.push_back(pAnimationController->GetBoneIdFromName(pAiBone->mName.C_Str()));
+
+		// The way Assimp works, the weights holds the IDs of the vertices it affects.
+		// We loop over all the weights, initializing the vertices data along the way
+		for(UINT WeightID = 0; WeightID < pAiBone->mNumWeights; WeightID++)
+		{
+			// Get the vertex the current weight affects
+			const aiVertexWeight& AiWeight = pAiBone->mWeights[WeightID];
+			BYTE* pVertex = pVertexData + (AiWeight.mVertexId * Desc.VertexStride);
+			float* pVertexWeights = (float*)(pVertex + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS]);
+
+			// Find the next unused slot in the bone array of the vertex, and initialize it with the current value
+			bool bFoundEmptySlot = false;
+			for(UINT j = 0; j < gMaxBonesPerVertex; j++)
+			{
+				if(pVertexWeights[j] == 0)
+				{
+					VertexBones[AiWeight.mVertexId * gMaxBonesPerVertex + j] = MeshBoneID;
+					pVertexWeights[j] = AiWeight.mWeight;
+					bFoundEmptySlot = true;
+					break;
+				}
+			}
+
+			if(bFoundEmptySlot == false)
+			{
+				trace(L"Too many bones");
+			}
+		}
+	}
+
+	// Now we need to normalize the weights for each vertex, since in some models the sum is larger than 1
+	for(UINT i = 0; i < Desc.VertexCount; i++)
+	{
+		BYTE* pVertex = pVertexData + (i * Desc.VertexStride);
+		float* pVertexWeights = (float*)(pVertex + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS]);
+
+		float f = 0;
+		// Sum the weights
+		for(int j = 0; j < gMaxBonesPerVertex; j++)
+		{
+			f += pVertexWeights[j];
+		}
+		// Normalize the weights
+		for(int j = 0; j < gMaxBonesPerVertex; j++)
+		{
+			pVertexWeights[j] /= f;
+		}
 	}
 }
 
 #define MESH_LOAD_INPUT(_vertex_index, _element, _field)                                            \
-    Offset = m_VertexElementsOffsets[_element];                                                     \
+    Offset = Desc.VertexElementsOffsets[_element];                                                  \
 if(Offset != INVALID_VERTEX_ELEMENT_OFFSET)                                                         \
 {                                                                                                   \
     BYTE* pDst = pVertex + Offset;                                                                  \
@@ -202,33 +230,33 @@ if(Offset != INVALID_VERTEX_ELEMENT_OFFSET)
     memcpy(pDst, pSrc, sizeof(pAiMesh->_field[0]));                                                 \
 }
 
-void CRtrMesh::CreateVertexBuffer(ID3D11Device* pDevice, const aiMesh* pAiMesh, const CRtrAnimationController* pAnimationController)
+static void PackVertexBuffer(const aiMesh* pAiMesh, CRtrMesh::SMeshData& Data, const CRtrAnimationController* pAnimationController, std::vector<UINT>& MeshBones, std::vector<UINT>& VertexBones)
 {
-	SetVertexElementOffsets(pAiMesh);
-	auto InitData = std::unique_ptr<BYTE[]>(new BYTE[m_VertexStride * m_VertexCount]);
-	ZeroMemory(InitData.get(), m_VertexStride * m_VertexCount);
+	CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	SetVertexElementOffsets(pAiMesh, Desc);
+	Data.Vertices.assign(Desc.VertexStride * Desc.VertexCount, 0);
 
-	for(UINT i = 0; i < m_VertexCount; i++)
+	for(UINT i = 0; i < Desc.VertexCount; i++)
 	{
-		BYTE* pVertex = InitData.get() + (m_VertexStride * i);
+		BYTE* pVertex = Data.Vertices.data() + (Desc.VertexStride * i);
 		UINT Offset;
 
-		MESH_LOAD_INPUT(i, VERTEX_ELEMENT_POSITION, mVertices);
-		MESH_LOAD_INPUT(i, VERTEX_ELEMENT_NORMAL, mNormals);
-		MESH_LOAD_INPUT(i, VERTEX_ELEMENT_TANGENT, mTangents);
-		MESH_LOAD_INPUT(i, VERTEX_ELEMENT_BITANGENT, mBitangents);
+		MESH_LOAD_INPUT(i, CRtrMesh::VERTEX_ELEMENT_POSITION, mVertices);
+		MESH_LOAD_INPUT(i, CRtrMesh::VERTEX_ELEMENT_NORMAL, mNormals);
+		MESH_LOAD_INPUT(i, CRtrMesh::VERTEX_ELEMENT_TANGENT, mTangents);
+		MESH_LOAD_INPUT(i, CRtrMesh::VERTEX_ELEMENT_BITANGENT, mBitangents);
 
 		for(UINT j = 0; j < pAiMesh->GetNumUVChannels(); j++)
 		{
-			MESH_LOAD_INPUT(i, VERTEX_ELEMENT_TEXCOORD_0 + j, mTextureCoords[j]);
+			MESH_LOAD_INPUT(i, CRtrMesh::VERTEX_ELEMENT_TEXCOORD_0 + j, mTextureCoords[j]);
 		}
 
 		float3 xyz(pAiMesh->mVertices[i].x, pAiMesh->mVertices[i].y, pAiMesh->mVertices[i].z);
-		m_BoundingBox.Min = float3::Min(m_BoundingBox.Min, xyz);
-		m_BoundingBox.Max = float3::Max(m_BoundingBox.Max, xyz);
+		Desc.BoundingBox.Min = float3::Min(Desc.BoundingBox.Min, xyz);
+		Desc.BoundingBox.Max = float3::Max(Desc.BoundingBox.Max, xyz);
 
 		// Colors require special handling since we need to normalize them
-		Offset = m_VertexElementsOffsets[VERTEX_ELEMENT_DIFFUSE_COLOR];
+		Offset = Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_DIFFUSE_COLOR];
 		if(Offset != INVALID_VERTEX_ELEMENT_OFFSET)
 		{
 			BYTE* pColor = pVertex + Offset;
@@ -245,141 +273,281 @@ void CRtrMesh::CreateVertexBuffer(ID3D11Device* pDevice, const aiMesh* pAiMesh,
 
 	if(pAiMesh->HasBones())
 	{
-		m_bHasBones = true;
-		LoadBones(pAiMesh, InitData.get(), pAnimationController);
+		Desc.bHasBones = TRUE;
+		PackBones(pAiMesh, Data, pAnimationController, MeshBones, VertexBones);
 	}
+}
 
-	D3D11_BUFFER_DESC vbDesc;
-	vbDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vbDesc.ByteWidth = m_VertexStride * m_VertexCount;
-	vbDesc.CPUAccessFlags = 0;
-	vbDesc.MiscFlags = 0;
-	vbDesc.StructureByteStride = m_VertexStride;
-	vbDesc.Usage = D3D11_USAGE_DEFAULT;
+void CRtrMesh::PackAiMesh(const aiMesh* pAiMesh, const CRtrAnimationController* pAnimCtrl, bool bIndexMetrics, std::vector<SMeshData>& Parts)
+{
+	SMeshData Data;
+	SMeshDesc& Desc = Data.Desc;
+	Desc.VertexCount = pAiMesh->mNumVertices;
+	Desc.PrimitiveCount = Desc.VertexCount / pAiMesh->mFaces[0].mNumIndices;
+	Desc.MaterialID = pAiMesh->mMaterialIndex;
+	PackIndexBuffer(pAiMesh, Data);
+	std::vector<UINT> MeshBones, VertexBones;
+	PackVertexBuffer(pAiMesh, Data, pAnimCtrl, MeshBones, VertexBones);
+	switch(pAiMesh->mFaces[0].mNumIndices)
+	{
+	case 1:
+		Desc.Topology = D3D11_PRIMITIVE_TOPOLOGY_POINTLIST;
+		break;
+	case 2:
+		Desc.Topology = D3D11_PRIMITIVE_TOPOLOGY_LINELIST;
+		break;
+	case 3:
+		Desc.Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		break;
+	default:
+		assert(0);
+	}
 
-	D3D11_SUBRESOURCE_DATA VbData;
-	VbData.pSysMem = InitData.get();
-	VbData.SysMemPitch = vbDesc.ByteWidth;
-	VbData.SysMemSlicePitch = vbDesc.ByteWidth;
+	Parts.clear();
+	if(Desc.bHasBones)
+	{
+		CRtrBonePartitioner::Partition(Data, MeshBones, VertexBones, Parts);
+	}
+	else
+	{
+		Parts.push_back(std::move(Data));
+	}
 
-	verify(pDevice->CreateBuffer(&vbDesc, &VbData, &m_VB));
+	for(auto& Part : Parts)
+	{
+		CRtrMeshOptimizer::Optimize(Part, bIndexMetrics);
+		CRtrMeshSimplifier::BuildLodChain(Part);
+		CRtrMeshletBuilder::Build(Part);
+	}
 }
 
-void CRtrMesh::SetDrawState(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const
+const char* CRtrMesh::GetVertexFormatDefine(UINT Format)
 {
-	pCtx->IASetIndexBuffer(m_IB, m_IndexType, 0);
-	pCtx->IASetInputLayout(GetInputLayout(pCtx, pVsBlob));
-	UINT z = 0;
-	UINT stride = m_VertexStride;
-	ID3D11Buffer* pBuf = m_VB;
-	pCtx->IASetVertexBuffers(0, 1, &pBuf, &stride, &z);
-	pCtx->IASetPrimitiveTopology(m_Topology);
+	return (Format == VERTEX_FORMAT_COMPACT) ? "_COMPACT_VERTEX" : "_FULL_VERTEX";
 }
 
+static UINT16 QuantizeUnorm16(float f)
+{
+	return UINT16(min(max(f, 0), 1) * 65535 + 0.5f);
+}
 
-ID3D11InputLayout* CRtrMesh::GetInputLayout(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const
+// Octahedral encoding maps the unit sphere onto a square, so a direction fits into two SNORM16 values
+static void OctEncode(const float3& v, INT16* pDst)
 {
-    if(m_InputElementDesc.size() == 0)
-    {
-        UINT BonesIDOffset = HasBones() ? sizeof(UINT8) * 4 : 0;
-        UINT BonesWeightOffset = HasBones() ? sizeof(float) * 4 : 0;
-
-        D3D11_INPUT_ELEMENT_DESC DescArray[] =
-        {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_POSITION], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_NORMAL], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_TANGENT], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_BITANGENT], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "BONE_WEIGHTS", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_WEIGHTS], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "BONE_WEIGHTS", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_WEIGHTS] + BonesWeightOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "BONE_IDS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_IDS], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "BONE_IDS", 1, DXGI_FORMAT_R8G8B8A8_UINT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_IDS] + BonesIDOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-            { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, m_VertexElementsOffsets[VERTEX_ELEMENT_TEXCOORD_0], D3D11_INPUT_PER_VERTEX_DATA, 0 },
-        };
-
-        // First time we got here, initialize the desc based on the used elements
-        for(UINT i = 0; i < ARRAYSIZE(DescArray); i++)
-        {
-            if(DescArray[i].AlignedByteOffset != INVALID_VERTEX_ELEMENT_OFFSET)
-            {
-                m_InputElementDesc.push_back(DescArray[i]);
-            }
-        }
-    }
-
-	if(m_InputLayouts.find(pVsBlob) == m_InputLayouts.end())
+	float L1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	float x = (L1 > 0) ? v.x / L1 : 0;
+	float y = (L1 > 0) ? v.y / L1 : 0;
+	if(v.z < 0)
 	{
-		ID3D11DevicePtr pDevice;
-		pCtx->GetDevice(&pDevice);
-        
-		ID3D11InputLayout* pLayout;
-		verify(pDevice->CreateInputLayout(&m_InputElementDesc[0], UINT(m_InputElementDesc.size()), pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), &pLayout));
-		m_InputLayouts[pVsBlob] = pLayout;
+		float FoldedX = (1 - fabsf(y)) * ((x >= 0) ? 1.0f : -1.0f);
+		float FoldedY = (1 - fabsf(x)) * ((y >= 0) ? 1.0f : -1.0f);
+		x = FoldedX;
+		y = FoldedY;
 	}
-
-	return m_InputLayouts[pVsBlob].GetInterfacePtr();
+	pDst[0] = INT16(floorf(min(max(x, -1), 1) * 32767 + 0.5f));
+	pDst[1] = INT16(floorf(min(max(y, -1), 1) * 32767 + 0.5f));
 }
 
-void CRtrMesh::LoadBones(const aiMesh* pAiMesh, BYTE* pVertexData, const CRtrAnimationController* pAnimationController)
+static void QuantizeBoneWeights(const float* pWeights, BYTE* pDst)
 {
-	if(pAiMesh->mNumBones > 0xff)
+	int Sum = 0;
+	UINT Largest = 0;
+	for(UINT i = 0; i < gMaxBonesPerVertex; i++)
 	{
-		trace(L"Too many bones");
+		pDst[i] = BYTE(min(max(pWeights[i], 0), 1) * 255 + 0.5f);
+		Sum += pDst[i];
+		Largest = (pWeights[i] > pWeights[Largest]) ? i : Largest;
 	}
 
-	for(UINT Bone = 0; Bone < pAiMesh->mNumBones; Bone++)
+	// Keep the sum at exactly 1, otherwise the skinned vertices move towards the origin
+	if(Sum > 0)
 	{
-		const aiBone* pAiBone = pAiMesh->mBones[Bone];
-		UINT AiBoneID = pAnimationController->GetBoneIdFromName(pAiBone->mName.C_Str());
+		pDst[Largest] = BYTE(min(max(int(pDst[Largest]) + 255 - Sum, 0), 255));
+	}
+}
 
-		// The way Assimp works, the weights holds the IDs of the vertices it affects.
-		// We loop over all the weights, initializing the vertices data along the way
-		for(UINT WeightID = 0; WeightID < pAiBone->mNumWeights; WeightID++)
+void CRtrMesh::CompactVertices(SMeshData& Data, const RTR_BOX_F& QuantizationBox)
+{
+	SMeshDesc& Desc = Data.Desc;
+	if(Desc.VertexFormat == VERTEX_FORMAT_COMPACT)
+	{
+		return;
+	}
+
+	const SMeshDesc FullDesc = Desc;
+	const UINT* SrcOffsets = FullDesc.VertexElementsOffsets;
+	UINT* DstOffsets = Desc.VertexElementsOffsets;
+
+	// Same element order as the full format
+	UINT Offset = 0;
+	auto AddElement = [&](UINT Element, UINT Size)
+	{
+		DstOffsets[Element] = INVALID_VERTEX_ELEMENT_OFFSET;
+		if(SrcOffsets[Element] != INVALID_VERTEX_ELEMENT_OFFSET)
 		{
-			// Get the vertex the current weight affects
-			const aiVertexWeight& AiWeight = pAiBone->mWeights[WeightID];
-			BYTE* pVertex = pVertexData + (AiWeight.mVertexId * m_VertexStride);
+			DstOffsets[Element] = Offset;
+			Offset += Size;
+		}
+	};
+	AddElement(VERTEX_ELEMENT_POSITION, sizeof(UINT16) * 4);
+	AddElement(VERTEX_ELEMENT_NORMAL, sizeof(INT16) * 2);
+	AddElement(VERTEX_ELEMENT_TANGENT, sizeof(INT16) * 2);
+	DstOffsets[VERTEX_ELEMENT_BITANGENT] = INVALID_VERTEX_ELEMENT_OFFSET;
+	AddElement(VERTEX_ELEMENT_TEXCOORD_0, sizeof(DirectX::PackedVector::HALF) * 2);
+	AddElement(VERTEX_ELEMENT_DIFFUSE_COLOR, sizeof(DWORD));
+	AddElement(VERTEX_ELEMENT_BONE_IDS, sizeof(UINT8) * gMaxBonesPerVertex);
+	AddElement(VERTEX_ELEMENT_BONE_WEIGHTS, sizeof(UINT8) * gMaxBonesPerVertex);
+	Desc.VertexStride = Offset;
+	Desc.VertexFormat = VERTEX_FORMAT_COMPACT;
+
+	float3 Extent = QuantizationBox.Max - QuantizationBox.Min;
+	Desc.PositionScale = float3(Extent.x > 0 ? Extent.x : 1, Extent.y > 0 ? Extent.y : 1, Extent.z > 0 ? Extent.z : 1);
+	Desc.PositionOffset = QuantizationBox.Min;
+
+	std::vector<BYTE> Vertices(Desc.VertexStride * Desc.VertexCount, 0);
+	for(UINT i = 0; i < Desc.VertexCount; i++)
+	{
+		const BYTE* pSrc = Data.Vertices.data() + FullDesc.VertexStride * i;
+		BYTE* pDst = Vertices.data() + Desc.VertexStride * i;
 
-			// Get the address of the Bone ID and weight for the current vertex
-			BYTE* pBoneIDs = (BYTE*)(pVertex + m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_IDS]);
-			float* pVertexWeights = (float*)(pVertex + m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_WEIGHTS]);
+		const float3& Position = *(const float3*)(pSrc + SrcOffsets[VERTEX_ELEMENT_POSITION]);
+		UINT16* pPosition = (UINT16*)(pDst + DstOffsets[VERTEX_ELEMENT_POSITION]);
+		pPosition[0] = QuantizeUnorm16((Position.x - Desc.PositionOffset.x) / Desc.PositionScale.x);
+		pPosition[1] = QuantizeUnorm16((Position.y - Desc.PositionOffset.y) / Desc.PositionScale.y);
+		pPosition[2] = QuantizeUnorm16((Position.z - Desc.PositionOffset.z) / Desc.PositionScale.z);
+		pPosition[3] = 0xFFFF;
 
-			// Find the next unused slot in the bone array of the vertex, and initialize it with the current value
-			bool bFoundEmptySlot = false;
-			for(UINT j = 0; j < m_MaxBonesPerVertex; j++)
-			{
-				if(pVertexWeights[j] == 0)
-				{
-					pBoneIDs[j] = (BYTE)AiBoneID;
-					pVertexWeights[j] = AiWeight.mWeight;
-					bFoundEmptySlot = true;
-					break;
-				}
-			}
+		if(DstOffsets[VERTEX_ELEMENT_NORMAL] != INVALID_VERTEX_ELEMENT_OFFSET)
+		{
+			const float3& Normal = *(const float3*)(pSrc + SrcOffsets[VERTEX_ELEMENT_NORMAL]);
+			OctEncode(Normal, (INT16*)(pDst + DstOffsets[VERTEX_ELEMENT_NORMAL]));
 
-			if(bFoundEmptySlot == false)
+			if(DstOffsets[VERTEX_ELEMENT_TANGENT] != INVALID_VERTEX_ELEMENT_OFFSET)
 			{
-				trace(L"Too many bones");
+				const float3& Tangent = *(const float3*)(pSrc + SrcOffsets[VERTEX_ELEMENT_TANGENT]);
+				const float3& Bitangent = *(const float3*)(pSrc + SrcOffsets[VERTEX_ELEMENT_BITANGENT]);
+				OctEncode(Tangent, (INT16*)(pDst + DstOffsets[VERTEX_ELEMENT_TANGENT]));
+				pPosition[3] = (Normal.Cross(Tangent).Dot(Bitangent) < 0) ? 0 : 0xFFFF;
 			}
 		}
+
+		if(DstOffsets[VERTEX_ELEMENT_TEXCOORD_0] != INVALID_VERTEX_ELEMENT_OFFSET)
+		{
+			const float3& TexC = *(const float3*)(pSrc + SrcOffsets[VERTEX_ELEMENT_TEXCOORD_0]);
+			DirectX::PackedVector::HALF* pTexC = (DirectX::PackedVector::HALF*)(pDst + DstOffsets[VERTEX_ELEMENT_TEXCOORD_0]);
+			pTexC[0] = DirectX::PackedVector::XMConvertFloatToHalf(TexC.x);
+			pTexC[1] = DirectX::PackedVector::XMConvertFloatToHalf(TexC.y);
+		}
+
+		if(DstOffsets[VERTEX_ELEMENT_DIFFUSE_COLOR] != INVALID_VERTEX_ELEMENT_OFFSET)
+		{
+			memcpy(pDst + DstOffsets[VERTEX_ELEMENT_DIFFUSE_COLOR], pSrc + SrcOffsets[VERTEX_ELEMENT_DIFFUSE_COLOR], sizeof(DWORD));
+		}
+
+		if(DstOffsets[VERTEX_ELEMENT_BONE_IDS] != INVALID_VERTEX_ELEMENT_OFFSET)
+		{
+			memcpy(pDst + DstOffsets[VERTEX_ELEMENT_BONE_IDS], pSrc + SrcOffsets[VERTEX_ELEMENT_BONE_IDS], sizeof(UINT8) * gMaxBonesPerVertex);
+			QuantizeBoneWeights((const float*)(pSrc + SrcOffsets[VERTEX_ELEMENT_BONE_WEIGHTS]), pDst + DstOffsets[VERTEX_ELEMENT_BONE_WEIGHTS]);
+		}
 	}
+	Data.Vertices.swap(Vertices);
+}
 
-	// Now we need to normalize the weights for each vertex, since in some models the sum is larger than 1
-	for(UINT i = 0; i < m_VertexCount; i++)
+// Same decoding as RtrVertex.hlsli
+static float3 OctDecode(const INT16* pSrc)
+{
+	const float x = max(float(pSrc[0]) / 32767.0f, -1.0f);
+	const float y = max(float(pSrc[1]) / 32767.0f, -1.0f);
+	float3 v(x, y, 1 - fabsf(x) - fabsf(y));
+	if(v.z < 0)
 	{
-		BYTE* pVertex = pVertexData + (i * m_VertexStride);
-		float* pVertexWeights = (float*)(pVertex + m_VertexElementsOffsets[VERTEX_ELEMENT_BONE_WEIGHTS]);
+		v.x = (1 - fabsf(y)) * ((x >= 0) ? 1.0f : -1.0f);
+		v.y = (1 - fabsf(x)) * ((y >= 0) ? 1.0f : -1.0f);
+	}
+	v.Normalize();
+	return v;
+}
 
-		float f = 0;
-		// Sum the weights
-		for(int j = 0; j < m_MaxBonesPerVertex; j++)
+static void DecodeSkinningVertices(const CRtrMesh::SMeshDesc& Desc, const BYTE* pVertices, const std::vector<UINT>& BonePalette, std::vector<CRtrMesh::SSkinningVertex>& Vertices)
+{
+	const UINT* Offsets = Desc.VertexElementsOffsets;
+	const bool bCompact = (Desc.VertexFormat == CRtrMesh::VERTEX_FORMAT_COMPACT);
+	Vertices.resize(Desc.VertexCount);
+	for(UINT i = 0; i < Desc.VertexCount; i++)
+	{
+		const BYTE* pSrc = pVertices + Desc.VertexStride * i;
+		CRtrMesh::SSkinningVertex& Vertex = Vertices[i];
+
+		float3 Position, Normal;
+		if(bCompact)
 		{
-			f += pVertexWeights[j];
+			const UINT16* pPosition = (const UINT16*)(pSrc + Offsets[CRtrMesh::VERTEX_ELEMENT_POSITION]);
+			Position = float3(pPosition[0], pPosition[1], pPosition[2]) / 65535.0f * Desc.PositionScale + Desc.PositionOffset;
 		}
-		// Normalize the weights
-		for(int j = 0; j < m_MaxBonesPerVertex; j++)
+		else
 		{
-			pVertexWeights[j] /= f;
+			Position = *(const float3*)(pSrc + Offsets[CRtrMesh::VERTEX_ELEMENT_POSITION]);
+		}
+
+		if(Offsets[CRtrMesh::VERTEX_ELEMENT_NORMAL] != INVALID_VERTEX_ELEMENT_OFFSET)
+		{
+			const BYTE* pNormal = pSrc + Offsets[CRtrMesh::VERTEX_ELEMENT_NORMAL];
+			Normal = bCompact ? OctDecode((const INT16*)pNormal) : *(const float3*)pNormal;
+		}
+		Vertex.Position = float4(Position.x, Position.y, Position.z, 1);
+		Vertex.Normal = float4(Normal.x, Normal.y, Normal.z, 0);
+
+		const BYTE* pBoneIDs = pSrc + Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_IDS];
+		const BYTE* pWeights = pSrc + Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS];
+		Vertex.InfluenceCount = 0;
+		for(UINT j = 0; j < gMaxBonesPerVertex; j++)
+		{
+			const float Weight = bCompact ? float(pWeights[j]) / 255.0f : ((const float*)pWeights)[j];
+			if(Weight != 0)
+			{
+				Vertex.BoneIDs[Vertex.InfluenceCount] = UINT16(BonePalette[pBoneIDs[j]]);
+				Vertex.Weights[Vertex.InfluenceCount] = Weight;
+				Vertex.InfluenceCount++;
+			}
 		}
 	}
 }
+
+CRtrMesh::CRtrMesh(const CRtrModel* pModel, const SMeshDesc& Desc, const SMeshlet* pMeshlets, const UINT* pBonePalette, const void* pVertices, const CRtrMeshArena* pArena, UINT BaseVertex, UINT FirstIndex) :
+	m_Desc(Desc), m_Meshlets(pMeshlets, pMeshlets + Desc.MeshletCount), m_BonePalette(pBonePalette, pBonePalette + Desc.BonePaletteSize), m_pArena(pArena), m_BaseVertex(BaseVertex), m_FirstIndex(FirstIndex)
+{
+	m_pMaterial = pModel->GetMaterial(m_Desc.MaterialID);
+	assert(m_pMaterial);
+	if(HasBones())
+	{
+		// The packed vertices are a fraction of the decoded ones in the compact format, and most models are never skinned on the CPU
+		const BYTE* pBytes = (const BYTE*)pVertices;
+		m_PackedVertices.assign(pBytes, pBytes + m_Desc.VertexStride * m_Desc.VertexCount);
+	}
+}
+
+const std::vector<CRtrMesh::SSkinningVertex>& CRtrMesh::GetSkinningVertices() const
+{
+	if(m_SkinningVertices.empty() && m_PackedVertices.size())
+	{
+		DecodeSkinningVertices(m_Desc, m_PackedVertices.data(), m_BonePalette, m_SkinningVertices);
+	}
+	return m_SkinningVertices;
+}
+
+CRtrMesh::SLod CRtrMesh::GetLod(UINT Lod) const
+{
+	assert(Lod < m_Desc.LodCount);
+	if(Lod == 0)
+	{
+		SLod Full;
+		Full.IndexCount = m_Desc.IndexCount;
+		return Full;
+	}
+	return m_Desc.Lods[Lod - 1];
+}
+
+void CRtrMesh::SetDrawState(CDxStateCache& State, ID3DBlob* pVsBlob) const
+{
+	m_pArena->SetDrawState(State, pVsBlob);
+}
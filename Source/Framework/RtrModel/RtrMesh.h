@@ -48,12 +48,13 @@ class CRtrModel;
 class CRtrMaterial;
 struct aiMesh;
 class CRtrAnimationController;
+class CRtrMeshArena;
+
+#define INVALID_VERTEX_ELEMENT_OFFSET  UINT(-1)
 
 class CRtrMesh
 {
 public:
-    CRtrMesh(ID3D11Device* pDevice, const CRtrModel* pModel, const CRtrAnimationController* pAnimCtrl, const aiMesh* pAiMesh);
-
 	enum
 	{
 		VERTEX_ELEMENT_POSITION,
@@ -68,42 +69,157 @@ public:
 		VERTEX_ELEMENT_COUNT
 	};
 
-	void SetDrawState(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const;
+	enum VERTEX_FORMAT
+	{
+		VERTEX_FORMAT_FULL,     // 32-bit floats
+		VERTEX_FORMAT_COMPACT,  // Quantized, see CompactVertices()
 
-	const RTR_BOX_F& GetBoundingBox() const { return m_BoundingBox; }
-	UINT GetVertexCount() const { return m_VertexCount; }
-	UINT GetPrimiveCount() const { return m_PrimitiveCount; }
-	UINT GetIndexCount() const { return m_IndexCount; }
-	const CRtrMaterial* GetMaterial() const { return m_pMaterial; }
+		VERTEX_FORMAT_COUNT
+	};
 
-	bool HasBones() const { return m_bHasBones; }
+	static const UINT MAX_BONES_PER_VERTEX = 8;
 
-    void SetMaterial(const CRtrMaterial* pMaterial) {m_pMaterial = pMaterial;}
-private:
-	UINT m_IndexCount		= 0;
-	DXGI_FORMAT m_IndexType = DXGI_FORMAT_UNKNOWN;
-	UINT m_VertexCount		= 0;
-	UINT m_PrimitiveCount	= 0;
-	UINT m_VertexStride		= 0;
-	bool m_bHasBones		= false;
-	UINT m_VertexElementsOffsets[VERTEX_ELEMENT_COUNT];
-	const CRtrMaterial* m_pMaterial = nullptr;
-	D3D11_PRIMITIVE_TOPOLOGY m_Topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
-	RTR_BOX_F m_BoundingBox;
+	// Compact arenas bind the position dequantization constants into this VS slot. See Media\Shaders\Framework\RtrVertex.hlsli
+	static const UINT VERTEX_DEQUANT_CB_INDEX = 7;
+	// The per-draw data of the techniques is bound into this VS slot, and the draw ID stream into this IA slot. See CRtrDrawDataBuffer
+	static const UINT PER_DRAW_SRV_INDEX = 8;
+	static const UINT DRAW_ID_VB_INDEX = 1;
+
+	// Shaders which draw meshes are compiled once per vertex format, with this define
+	static const char* GetVertexFormatDefine(UINT Format);
+
+	// Quality of the index buffer order, see CRtrMeshOptimizer
+	struct SIndexMetrics
+	{
+		float Acmr = 0;      // Average cache miss ratio, vertex shader invocations per triangle. 0.5 is the best case for a regular grid
+		float Atvr = 0;      // Average transformed vertex ratio, vertex shader invocations per vertex. 1 is optimal
+		float Overdraw = 0;  // Shaded pixels per covered pixel, 1 is optimal
+	};
+
+	// A contiguous range of the index buffer, culled as a unit. See CRtrMeshletBuilder
+	struct SMeshlet
+	{
+		float3 Center;        // Bounding sphere
+		float Radius;
+		float3 ConeAxis;      // Normal cone, all the triangle normals are within the cone
+		float ConeSinAngle;   // Sine of the cone's half-angle, 1 if the cone can't be used for culling
+		UINT FirstIndex = 0;  // Relative to the mesh
+		UINT IndexCount = 0;
+		UINT Pad[2];
+	};
 
-	ID3D11BufferPtr m_IB;
-	ID3D11BufferPtr m_VB;
+	// Simplified versions of the mesh, see CRtrMeshSimplifier. LOD 0 is the full mesh
+	static const UINT MAX_LODS = 5;
+	struct SLod
+	{
+		UINT FirstIndex = 0;  // Relative to the mesh. The LODs share the vertices of the full mesh
+		UINT IndexCount = 0;
+		float Error = 0;      // Upper bound of the distance to the full mesh surface, in model units
+	};
+
+	// Plain-old-data description of the mesh. It is written as-is into the model cache, so no pointers allowed
+	struct SMeshDesc
+	{
+		UINT IndexCount = 0;
+		DXGI_FORMAT IndexType = DXGI_FORMAT_UNKNOWN;
+		UINT VertexCount = 0;
+		UINT PrimitiveCount = 0;
+		UINT VertexStride = 0;
+		UINT MaterialID = 0;
+		BOOL bHasBones = FALSE;
+		D3D11_PRIMITIVE_TOPOLOGY Topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		UINT VertexElementsOffsets[VERTEX_ELEMENT_COUNT];
+		RTR_BOX_F BoundingBox;
+		UINT VertexFormat = VERTEX_FORMAT_FULL;
+		UINT FullVertexStride = 0;  // Stride of the same vertices in VERTEX_FORMAT_FULL, for the memory report
+		float3 PositionScale;       // Compact positions are UNORM16 in the range [PositionOffset, PositionOffset + PositionScale]
+		float3 PositionOffset;
+		SIndexMetrics ImportedIndexMetrics;  // Before and after CRtrMeshOptimizer::Optimize(). Only measured on request, zero otherwise
+		SIndexMetrics IndexMetrics;
+		UINT MeshletCount = 0;      // Meshlets only cover LOD 0
+		UINT LodCount = 1;
+		UINT LodIndexCount = 0;     // Indices of LOD 1 and up, stored right after the full mesh indices
+		SLod Lods[MAX_LODS - 1];    // LOD 1 and up
+		UINT BonePaletteSize = 0;   // The vertex bone IDs index the mesh's own palette, see CRtrBonePartitioner
+	};
 
-	void SetVertexElementOffsets(const aiMesh* pAiMesh);
-	void CreateIndexBuffer(ID3D11Device* pDevice, const aiMesh* pAiMesh);
-	template<typename IndexType>
-	void CreateIndexBufferInternal(ID3D11Device* pDevice, const aiMesh* pAiMesh);
-    void CreateVertexBuffer(ID3D11Device* pDevice, const aiMesh* pAiMesh, const CRtrAnimationController* pAnimationController);
-    void LoadBones(const aiMesh* pAiMesh, BYTE* pVertexData, const CRtrAnimationController* pAnimationController);
+	// CPU side mesh data, ready to be uploaded into the GPU
+	struct SMeshData
+	{
+		SMeshDesc Desc;
+		std::vector<BYTE> Vertices;
+		std::vector<BYTE> Indices;
+		std::vector<SMeshlet> Meshlets;
+		std::vector<UINT> BonePalette;  // Skeleton bone ID of each palette entry
+	};
 
-	ID3D11InputLayout* GetInputLayout(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const;
-	static const UINT m_MaxBonesPerVertex;
+	// Skinning inputs of a mesh with bones, decoded from either vertex format for CRtrCpuSkinner. See GetSkinningVertices().
+	// The influences with a 0 weight are dropped, the others keep their order
+	struct SSkinningVertex
+	{
+		float4 Position;  // w is 1
+		float4 Normal;    // w is 0
+		UINT InfluenceCount = 0;
+		UINT16 BoneIDs[MAX_BONES_PER_VERTEX];  // Skeleton bone IDs, already mapped through the mesh's palette
+		float Weights[MAX_BONES_PER_VERTEX];
+	};
+
+	// Interleaves the Assimp mesh into the vertex/index layout used by the GPU, optimizes the triangle order, builds the LOD chain and the meshlets. Doesn't access the device.
+	// A mesh that references more bones than a palette can hold is split into several parts, otherwise Parts gets a single mesh.
+	// bIndexMetrics fills the desc's index metrics, see CRtrMeshOptimizer::Optimize()
+	static void PackAiMesh(const aiMesh* pAiMesh, const CRtrAnimationController* pAnimCtrl, bool bIndexMetrics, std::vector<SMeshData>& Parts);
+
+	// Re-packs VERTEX_FORMAT_FULL data into VERTEX_FORMAT_COMPACT: UNORM16 positions, octahedral normal and tangent (the bitangent is
+	// reconstructed from its sign, stored in the position's w), half-float texcoords and UNORM8 bone weights.
+	// Positions are quantized relative to QuantizationBox, which must contain the mesh. Meshes sharing the box can share an arena
+	static void CompactVertices(SMeshData& Data, const RTR_BOX_F& QuantizationBox);
+
+	// The mesh data lives in the arena, starting at BaseVertex and FirstIndex. See CRtrMeshArena. pMeshlets holds Desc.MeshletCount meshlets.
+	// pVertices are the packed vertices, copied for meshes with bones to decode their skinning inputs on request. pBonePalette holds Desc.BonePaletteSize bone IDs
+	CRtrMesh(const CRtrModel* pModel, const SMeshDesc& Desc, const SMeshlet* pMeshlets, const UINT* pBonePalette, const void* pVertices, const CRtrMeshArena* pArena, UINT BaseVertex, UINT FirstIndex);
+
+	// Binds the arena's buffers. Use CRtrMeshBinder to skip the binds between meshes of the same arena
+	void SetDrawState(CDxStateCache& State, ID3DBlob* pVsBlob) const;
+
+	const RTR_BOX_F& GetBoundingBox() const { return m_Desc.BoundingBox; }
+	UINT GetVertexCount() const { return m_Desc.VertexCount; }
+	UINT GetPrimiveCount() const { return m_Desc.PrimitiveCount; }
+	UINT GetIndexCount() const { return m_Desc.IndexCount; }
+	UINT GetFirstIndex() const { return m_FirstIndex; }
+	INT GetBaseVertex() const { return INT(m_BaseVertex); }
+	const CRtrMeshArena* GetArena() const { return m_pArena; }
+	const CRtrMaterial* GetMaterial() const { return m_pMaterial; }
+	UINT GetMaterialID() const { return m_Desc.MaterialID; }
+
+	bool HasBones() const { return m_Desc.bHasBones != FALSE; }
+	// Decodes the skinning inputs from the packed vertices on the first call, empty for meshes without bones. Not thread-safe
+	const std::vector<SSkinningVertex>& GetSkinningVertices() const;
+	// Frees the decoded inputs once the CPU skinning is done. The next GetSkinningVertices() decodes them again
+	void ReleaseSkinningVertices() const { std::vector<SSkinningVertex>().swap(m_SkinningVertices); }
+	const std::vector<UINT>& GetBonePalette() const { return m_BonePalette; }
+	// Where the mesh's palette starts in the model's skinning palette, see CRtrModel::GetSkinningPaletteSize()
+	UINT GetBonePaletteOffset() const { return m_BonePaletteOffset; }
+	VERTEX_FORMAT GetVertexFormat() const { return VERTEX_FORMAT(m_Desc.VertexFormat); }
+	UINT GetVertexBufferSize() const { return m_Desc.VertexStride * m_Desc.VertexCount; }
+	UINT GetFullVertexBufferSize() const { return m_Desc.FullVertexStride * m_Desc.VertexCount; }
+	const SIndexMetrics& GetImportedIndexMetrics() const { return m_Desc.ImportedIndexMetrics; }
+	const SIndexMetrics& GetIndexMetrics() const { return m_Desc.IndexMetrics; }
+	const std::vector<SMeshlet>& GetMeshlets() const { return m_Meshlets; }
+	UINT GetLodCount() const { return m_Desc.LodCount; }
+	SLod GetLod(UINT Lod) const;
+
+    void SetMaterial(const CRtrMaterial* pMaterial) {m_pMaterial = pMaterial;}
+	void SetBonePaletteOffset(UINT Offset) { m_BonePaletteOffset = Offset; }
+private:
+	SMeshDesc m_Desc;
+	const CRtrMaterial* m_pMaterial = nullptr;
 
-	mutable std::map<ID3DBlob*, ID3D11InputLayoutPtr> m_InputLayouts;
-    mutable std::vector<D3D11_INPUT_ELEMENT_DESC> m_InputElementDesc;
+	std::vector<SMeshlet> m_Meshlets;
+	std::vector<BYTE> m_PackedVertices;  // Meshes with bones only
+	mutable std::vector<SSkinningVertex> m_SkinningVertices;
+	std::vector<UINT> m_BonePalette;
+	UINT m_BonePaletteOffset = 0;
+	const CRtrMeshArena* m_pArena;
+	UINT m_BaseVertex;
+	UINT m_FirstIndex;
 };
\ No newline at end of file
@@ -0,0 +1,259 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshArena.cpp
+---------------------------------------------------------------------------*/
+#include "RtrMeshArena.h"
+#include "..\ShaderUtils.h"
+
+struct SVertexDequantData
+{
+	float3 PositionScale;
+	float pad0;
+	float3 PositionOffset;
+	float pad1;
+};
+verify_cb_size_alignment(SVertexDequantData);
+
+bool CRtrMeshArena::IsCompatible(const CRtrMesh::SMeshDesc& Desc0, const CRtrMesh::SMeshDesc& Desc1)
+{
+	if((Desc0.VertexFormat != Desc1.VertexFormat) || (Desc0.VertexStride != Desc1.VertexStride) || (Desc0.Topology != Desc1.Topology))
+	{
+		return false;
+	}
+
+	if(memcmp(Desc0.VertexElementsOffsets, Desc1.VertexElementsOffsets, sizeof(Desc0.VertexElementsOffsets)) != 0)
+	{
+		return false;
+	}
+
+	// Compact positions are dequantized using a single constant buffer per arena
+	if(Desc0.VertexFormat == CRtrMesh::VERTEX_FORMAT_COMPACT)
+	{
+		return (Desc0.PositionScale == Desc1.PositionScale) && (Desc0.PositionOffset == Desc1.PositionOffset);
+	}
+	return true;
+}
+
+CRtrMeshArena::CRtrMeshArena(ID3D11Device* pDevice, const std::vector<SMeshSource*>& Meshes) : m_Layout(*Meshes[0]->pDesc)
+{
+	// 16-bit indices are relative to the base vertex, so they remain valid no matter how large the arena is.
+	// They are only widened if another mesh in the arena requires 32-bit indices
+	m_IndexType = DXGI_FORMAT_R16_UINT;
+	UINT VertexCount = 0;
+	UINT IndexCount = 0;
+	for(auto pMesh : Meshes)
+	{
+		const CRtrMesh::SMeshDesc& Desc = *pMesh->pDesc;
+		assert(IsCompatible(m_Layout, Desc));
+		pMesh->BaseVertex = VertexCount;
+		pMesh->FirstIndex = IndexCount;
+		VertexCount += Desc.VertexCount;
+		IndexCount += Desc.IndexCount + Desc.LodIndexCount;
+		if(Desc.IndexType == DXGI_FORMAT_R32_UINT)
+		{
+			m_IndexType = DXGI_FORMAT_R32_UINT;
+		}
+	}
+
+	const UINT VertexStride = m_Layout.VertexStride;
+	const UINT IndexSize = (m_IndexType == DXGI_FORMAT_R16_UINT) ? sizeof(UINT16) : sizeof(UINT32);
+	std::vector<BYTE> Vertices(VertexStride * VertexCount);
+	std::vector<BYTE> Indices(IndexSize * IndexCount);
+	for(const auto pMesh : Meshes)
+	{
+		const CRtrMesh::SMeshDesc& Desc = *pMesh->pDesc;
+		memcpy(Vertices.data() + VertexStride * pMesh->BaseVertex, pMesh->pVertices, VertexStride * Desc.VertexCount);
+
+		if(Desc.IndexType == m_IndexType)
+		{
+			memcpy(Indices.data() + IndexSize * pMesh->FirstIndex, pMesh->pIndices, IndexSize * (Desc.IndexCount + Desc.LodIndexCount));
+		}
+		else
+		{
+			const UINT16* pSrc = (const UINT16*)pMesh->pIndices;
+			UINT32* pDst = (UINT32*)Indices.data() + pMesh->FirstIndex;
+			for(UINT i = 0; i < Desc.IndexCount + Desc.LodIndexCount; i++)
+			{
+				pDst[i] = pSrc[i];
+			}
+		}
+	}
+
+	// Index buffer
+	D3D11_BUFFER_DESC IbDesc;
+	IbDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	IbDesc.ByteWidth = UINT(Indices.size());
+	IbDesc.CPUAccessFlags = 0;
+	IbDesc.MiscFlags = 0;
+	IbDesc.StructureByteStride = 0;
+	IbDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	D3D11_SUBRESOURCE_DATA InitData;
+	InitData.pSysMem = Indices.data();
+	InitData.SysMemPitch = IbDesc.ByteWidth;
+	InitData.SysMemSlicePitch = IbDesc.ByteWidth;
+
+	verify(pDevice->CreateBuffer(&IbDesc, &InitData, &m_IB));
+
+	// Vertex buffer
+	D3D11_BUFFER_DESC vbDesc;
+	vbDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vbDesc.ByteWidth = UINT(Vertices.size());
+	vbDesc.CPUAccessFlags = 0;
+	vbDesc.MiscFlags = 0;
+	vbDesc.StructureByteStride = VertexStride;
+	vbDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	D3D11_SUBRESOURCE_DATA VbData;
+	VbData.pSysMem = Vertices.data();
+	VbData.SysMemPitch = vbDesc.ByteWidth;
+	VbData.SysMemSlicePitch = vbDesc.ByteWidth;
+
+	verify(pDevice->CreateBuffer(&vbDesc, &VbData, &m_VB));
+
+	if(m_Layout.VertexFormat == CRtrMesh::VERTEX_FORMAT_COMPACT)
+	{
+		SVertexDequantData Dequant;
+		Dequant.PositionScale = m_Layout.PositionScale;
+		Dequant.PositionOffset = m_Layout.PositionOffset;
+
+		D3D11_BUFFER_DESC CbDesc;
+		CbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		CbDesc.ByteWidth = sizeof(SVertexDequantData);
+		CbDesc.CPUAccessFlags = 0;
+		CbDesc.MiscFlags = 0;
+		CbDesc.StructureByteStride = 0;
+		CbDesc.Usage = D3D11_USAGE_IMMUTABLE;
+
+		D3D11_SUBRESOURCE_DATA CbData;
+		CbData.pSysMem = &Dequant;
+		CbData.SysMemPitch = sizeof(SVertexDequantData);
+		CbData.SysMemSlicePitch = sizeof(SVertexDequantData);
+		verify(pDevice->CreateBuffer(&CbDesc, &CbData, &m_DequantCb));
+	}
+}
+
+void CRtrMeshArena::SetDrawState(CDxStateCache& State, ID3DBlob* pVsBlob) const
+{
+	State.IASetIndexBuffer(m_IB, m_IndexType, 0);
+	State.IASetInputLayout(GetInputLayout(State.GetContext(), pVsBlob));
+	UINT z = 0;
+	UINT stride = m_Layout.VertexStride;
+	ID3D11Buffer* pBuf = m_VB;
+	State.IASetVertexBuffers(0, 1, &pBuf, &stride, &z);
+	State.IASetPrimitiveTopology(m_Layout.Topology);
+
+	if(m_DequantCb)
+	{
+		ID3D11Buffer* pCb = m_DequantCb;
+		State.VSSetConstantBuffers(CRtrMesh::VERTEX_DEQUANT_CB_INDEX, 1, &pCb);
+	}
+}
+
+ID3D11InputLayout* CRtrMeshArena::GetInputLayout(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const
+{
+    std::lock_guard<std::mutex> Lock(m_InputLayoutMutex);
+    if(m_InputElementDesc.size() == 0)
+    {
+        const bool bCompact = (m_Layout.VertexFormat == CRtrMesh::VERTEX_FORMAT_COMPACT);
+        const bool bHasBones = (m_Layout.bHasBones != FALSE);
+        UINT BonesIDOffset = bHasBones ? sizeof(UINT8) * 4 : 0;
+        UINT BonesWeightOffset = bHasBones ? UINT(bCompact ? sizeof(UINT8) : sizeof(float)) * 4 : 0;
+        const UINT* Offsets = m_Layout.VertexElementsOffsets;
+
+        // The compact formats are expanded by the input assembler, except for the position scale and the octahedral directions. See RtrVertex.hlsli
+        const DXGI_FORMAT PositionFormat = bCompact ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+        const DXGI_FORMAT DirectionFormat = bCompact ? DXGI_FORMAT_R16G16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+        const DXGI_FORMAT WeightsFormat = bCompact ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_R32G32B32A32_FLOAT;
+        const DXGI_FORMAT TexCoordFormat = bCompact ? DXGI_FORMAT_R16G16_FLOAT : DXGI_FORMAT_R32G32_FLOAT;
+
+        D3D11_INPUT_ELEMENT_DESC DescArray[] =
+        {
+            { "POSITION", 0, PositionFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_POSITION], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "NORMAL", 0, DirectionFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_NORMAL], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "TANGENT", 0, DirectionFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_TANGENT], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_BITANGENT], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "BONE_WEIGHTS", 0, WeightsFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "BONE_WEIGHTS", 1, WeightsFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_WEIGHTS] + BonesWeightOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "BONE_IDS", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_IDS], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "BONE_IDS", 1, DXGI_FORMAT_R8G8B8A8_UINT, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_BONE_IDS] + BonesIDOffset, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            { "TEXCOORD", 0, TexCoordFormat, 0, Offsets[CRtrMesh::VERTEX_ELEMENT_TEXCOORD_0], D3D11_INPUT_PER_VERTEX_DATA, 0 },
+            // Not part of the vertex, see CRtrDrawDataBuffer. Shaders which don't read it ignore it
+            { "DRAW_ID", 0, DXGI_FORMAT_R32_UINT, CRtrMesh::DRAW_ID_VB_INDEX, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+        };
+
+        // First time we got here, initialize the desc based on the used elements
+        for(UINT i = 0; i < ARRAYSIZE(DescArray); i++)
+        {
+            if(DescArray[i].AlignedByteOffset != INVALID_VERTEX_ELEMENT_OFFSET)
+            {
+                m_InputElementDesc.push_back(DescArray[i]);
+            }
+        }
+    }
+
+	if(m_InputLayouts.find(pVsBlob) == m_InputLayouts.end())
+	{
+		ID3D11DevicePtr pDevice;
+		pCtx->GetDevice(&pDevice);
+        
+		ID3D11InputLayout* pLayout;
+		verify(pDevice->CreateInputLayout(&m_InputElementDesc[0], UINT(m_InputElementDesc.size()), pVsBlob->GetBufferPointer(), pVsBlob->GetBufferSize(), &pLayout));
+		m_InputLayouts[pVsBlob] = pLayout;
+	}
+
+	return m_InputLayouts[pVsBlob].GetInterfacePtr();
+}
+
+void CRtrMeshBinder::SetDrawState(CDxStateCache& State, const CRtrMesh* pMesh, ID3DBlob* pVsBlob)
+{
+	const CRtrMeshArena* pArena = pMesh->GetArena();
+	if(pArena != m_pArena)
+	{
+		pArena->SetDrawState(State, pVsBlob);
+	}
+	else if(pVsBlob != m_pVsBlob)
+	{
+		// The buffers and the dequantization constants are still bound, only the layout depends on the shader
+		State.IASetInputLayout(pArena->GetInputLayout(State.GetContext(), pVsBlob));
+	}
+	m_pArena = pArena;
+	m_pVsBlob = pVsBlob;
+}
@@ -0,0 +1,99 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshArena.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+#include <mutex>
+
+// A vertex buffer and an index buffer shared by all the meshes of a model which have the same vertex layout.
+// Meshes are ranges inside the arena, drawn with DrawIndexed(IndexCount, FirstIndex, BaseVertex)
+class CRtrMeshArena
+{
+public:
+	struct SMeshSource
+	{
+		const CRtrMesh::SMeshDesc* pDesc = nullptr;
+		const void* pVertices = nullptr;
+		const void* pIndices = nullptr;
+		const CRtrMesh::SMeshlet* pMeshlets = nullptr;
+		const UINT* pBonePalette = nullptr;
+
+		// Set by the arena
+		UINT BaseVertex = 0;
+		UINT FirstIndex = 0;
+	};
+
+	// Meshes with the same vertex layout, topology and position dequantization can share an arena. The index type doesn't matter
+	static bool IsCompatible(const CRtrMesh::SMeshDesc& Desc0, const CRtrMesh::SMeshDesc& Desc1);
+
+	// Uploads all the meshes into the arena's buffers. The meshes must be compatible with each other.
+	// The source data is only accessed during construction
+	CRtrMeshArena(ID3D11Device* pDevice, const std::vector<SMeshSource*>& Meshes);
+
+	void SetDrawState(CDxStateCache& State, ID3DBlob* pVsBlob) const;
+	// Creates the layout on first use for the shader. Safe to call from several recording threads, see CDeferredRecorder
+	ID3D11InputLayout* GetInputLayout(ID3D11DeviceContext* pCtx, ID3DBlob* pVsBlob) const;
+
+private:
+	CRtrMesh::SMeshDesc m_Layout;  // Desc of the first mesh. Only the vertex layout fields are meaningful
+	DXGI_FORMAT m_IndexType;
+
+	ID3D11BufferPtr m_IB;
+	ID3D11BufferPtr m_VB;
+	ID3D11BufferPtr m_DequantCb;
+
+	mutable std::map<ID3DBlob*, ID3D11InputLayoutPtr> m_InputLayouts;
+	mutable std::vector<D3D11_INPUT_ELEMENT_DESC> m_InputElementDesc;
+	mutable std::mutex m_InputLayoutMutex;
+};
+
+// Binds the meshes' input assembler state, skipping the binds when the previous mesh came from the same arena.
+// Techniques keep one and reset it at the start of every DrawModel(), or whenever something else might have changed the IA state
+class CRtrMeshBinder
+{
+public:
+	void Reset() { m_pArena = nullptr; m_pVsBlob = nullptr; }
+	void SetDrawState(CDxStateCache& State, const CRtrMesh* pMesh, ID3DBlob* pVsBlob);
+
+private:
+	const CRtrMeshArena* m_pArena = nullptr;
+	ID3DBlob* m_pVsBlob = nullptr;
+};
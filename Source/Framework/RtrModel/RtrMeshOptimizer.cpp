@@ -0,0 +1,509 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshOptimizer.cpp
+---------------------------------------------------------------------------*/
+#include "RtrMeshOptimizer.h"
+#include <algorithm>
+
+// A cluster is split when the ACMR since its start is within this factor of the entire cluster's ACMR.
+// Lower values keep larger clusters, which favors the vertex cache over overdraw
+static const float gSoftBoundaryThreshold = 1.05f;
+
+// Resolution of the overdraw estimation depth buffer
+static const int gOverdrawResolution = 128;
+
+static const float3& GetPosition(const BYTE* pPositions, UINT VertexStride, UINT Index)
+{
+	return *(const float3*)(pPositions + VertexStride * Index);
+}
+
+UINT CRtrMeshOptimizer::SimulateVertexCache(const std::vector<UINT>& Indices, UINT VertexCount, UINT CacheSize)
+{
+	// A vertex is in a FIFO cache if it was inserted in the last CacheSize insertions
+	std::vector<UINT> InsertTime(VertexCount, 0);
+	UINT Time = CacheSize + 1;
+	UINT Misses = 0;
+	for(UINT Index : Indices)
+	{
+		if(Time - InsertTime[Index] > CacheSize)
+		{
+			InsertTime[Index] = Time++;
+			Misses++;
+		}
+	}
+	return Misses;
+}
+
+static float EdgeFunction(const float3& a, const float3& b, float x, float y)
+{
+	return (b.x - a.x) * (y - a.y) - (x - a.x) * (b.y - a.y);
+}
+
+float CRtrMeshOptimizer::EstimateOverdraw(const std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount)
+{
+	RTR_BOX_F Box;
+	for(UINT i = 0; i < VertexCount; i++)
+	{
+		Box.Min = float3::Min(Box.Min, GetPosition(pPositions, VertexStride, i));
+		Box.Max = float3::Max(Box.Max, GetPosition(pPositions, VertexStride, i));
+	}
+	const float3 Center = (Box.Min + Box.Max) * 0.5f;
+	const float Radius = (Box.Max - Center).Length();
+	if(VertexCount == 0 || Radius <= 0)
+	{
+		return 0;
+	}
+
+	// Orthographic projection which fits the bounding sphere, so all the views use the same scale
+	const float Scale = gOverdrawResolution / (2 * Radius);
+	std::vector<float3> Projected(VertexCount);
+	std::vector<float> Depth(gOverdrawResolution * gOverdrawResolution);
+	UINT64 Shaded = 0;
+	UINT64 Covered = 0;
+
+	const float3 Axes[] = { float3(1, 0, 0), float3(0, 1, 0), float3(0, 0, 1) };
+	for(UINT View = 0; View < 6; View++)
+	{
+		const float3 Forward = Axes[View / 2] * ((View & 1) ? -1.0f : 1.0f);
+		const float3 Up = (View / 2 == 1) ? float3(0, 0, 1) : float3(0, 1, 0);
+		const float3 Right = Up.Cross(Forward);
+		for(UINT i = 0; i < VertexCount; i++)
+		{
+			float3 p = GetPosition(pPositions, VertexStride, i) - Center;
+			Projected[i] = float3((p.Dot(Right) + Radius) * Scale, (p.Dot(Up) + Radius) * Scale, p.Dot(Forward));
+		}
+		std::fill(Depth.begin(), Depth.end(), D3D11_FLOAT32_MAX);
+
+		for(size_t t = 0; t + 2 < Indices.size(); t += 3)
+		{
+			const float3& a = Projected[Indices[t + 0]];
+			const float3& b = Projected[Indices[t + 1]];
+			const float3& c = Projected[Indices[t + 2]];
+
+			// Front faces are clockwise, which is a negative area with y pointing up
+			float Area = EdgeFunction(a, b, c.x, c.y);
+			if(Area >= 0)
+			{
+				continue;
+			}
+
+			int MinX = max(int(min(min(a.x, b.x), c.x)), 0);
+			int MinY = max(int(min(min(a.y, b.y), c.y)), 0);
+			int MaxX = min(int(max(max(a.x, b.x), c.x)), gOverdrawResolution - 1);
+			int MaxY = min(int(max(max(a.y, b.y), c.y)), gOverdrawResolution - 1);
+			for(int y = MinY; y <= MaxY; y++)
+			{
+				for(int x = MinX; x <= MaxX; x++)
+				{
+					float px = x + 0.5f;
+					float py = y + 0.5f;
+					float w0 = EdgeFunction(b, c, px, py);
+					float w1 = EdgeFunction(c, a, px, py);
+					float w2 = EdgeFunction(a, b, px, py);
+					if(w0 > 0 || w1 > 0 || w2 > 0)
+					{
+						continue;
+					}
+
+					float z = (w0 * a.z + w1 * b.z + w2 * c.z) / Area;
+					float& StoredZ = Depth[y * gOverdrawResolution + x];
+					if(z < StoredZ)
+					{
+						StoredZ = z;
+						Shaded++;
+					}
+				}
+			}
+		}
+
+		for(float z : Depth)
+		{
+			Covered += (z < D3D11_FLOAT32_MAX) ? 1 : 0;
+		}
+	}
+
+	return Covered ? float(double(Shaded) / double(Covered)) : 0;
+}
+
+CRtrMesh::SIndexMetrics CRtrMeshOptimizer::Analyze(const std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT CacheSize)
+{
+	CRtrMesh::SIndexMetrics Metrics;
+	const UINT TriangleCount = UINT(Indices.size() / 3);
+	if(TriangleCount == 0)
+	{
+		return Metrics;
+	}
+
+	// ATVR is relative to the referenced vertices, otherwise unused vertices would make it look better than it is
+	std::vector<bool> bReferenced(VertexCount, false);
+	UINT ReferencedCount = 0;
+	for(UINT Index : Indices)
+	{
+		ReferencedCount += bReferenced[Index] ? 0 : 1;
+		bReferenced[Index] = true;
+	}
+
+	UINT Misses = SimulateVertexCache(Indices, VertexCount, CacheSize);
+	Metrics.Acmr = float(Misses) / float(TriangleCount);
+	Metrics.Atvr = float(Misses) / float(ReferencedCount);
+	Metrics.Overdraw = EstimateOverdraw(Indices, pPositions, VertexStride, VertexCount);
+	return Metrics;
+}
+
+void CRtrMeshOptimizer::Tipsify(const std::vector<UINT>& Indices, UINT VertexCount, UINT CacheSize, std::vector<UINT>& Result, std::vector<UINT>& ClusterStarts)
+{
+	const UINT TriangleCount = UINT(Indices.size() / 3);
+
+	// Vertex-triangle adjacency. LiveCount is the number of triangles not emitted yet
+	std::vector<UINT> LiveCount(VertexCount, 0);
+	for(UINT Index : Indices)
+	{
+		LiveCount[Index]++;
+	}
+
+	std::vector<UINT> AdjacencyOffsets(VertexCount + 1, 0);
+	for(UINT v = 0; v < VertexCount; v++)
+	{
+		AdjacencyOffsets[v + 1] = AdjacencyOffsets[v] + LiveCount[v];
+	}
+
+	std::vector<UINT> Adjacency(TriangleCount * 3);
+	std::vector<UINT> FillOffsets(AdjacencyOffsets.begin(), AdjacencyOffsets.end() - 1);
+	for(UINT i = 0; i < TriangleCount * 3; i++)
+	{
+		Adjacency[FillOffsets[Indices[i]]++] = i / 3;
+	}
+
+	std::vector<UINT> CacheTime(VertexCount, 0);
+	std::vector<bool> bEmitted(TriangleCount, false);
+	std::vector<UINT> DeadEndStack;
+	std::vector<UINT> Candidates;
+	UINT Time = CacheSize + 1;
+	UINT Cursor = 0;
+
+	Result.clear();
+	Result.reserve(TriangleCount * 3);
+	ClusterStarts.assign(1, 0);
+
+	int Fanning = (TriangleCount > 0) ? int(Indices[0]) : -1;
+	while(Fanning >= 0)
+	{
+		// Emit all the remaining triangles around the fanning vertex
+		Candidates.clear();
+		for(UINT a = AdjacencyOffsets[Fanning]; a < AdjacencyOffsets[Fanning + 1]; a++)
+		{
+			UINT Triangle = Adjacency[a];
+			if(bEmitted[Triangle])
+			{
+				continue;
+			}
+
+			for(UINT k = 0; k < 3; k++)
+			{
+				UINT v = Indices[Triangle * 3 + k];
+				Result.push_back(v);
+				DeadEndStack.push_back(v);
+				Candidates.push_back(v);
+				LiveCount[v]--;
+				if(Time - CacheTime[v] > CacheSize)
+				{
+					CacheTime[v] = Time++;
+				}
+			}
+			bEmitted[Triangle] = true;
+		}
+
+		// Prefer the oldest candidate which will still be in the cache after emitting its own triangles
+		int Next = -1;
+		int BestPriority = -1;
+		for(UINT v : Candidates)
+		{
+			if(LiveCount[v] == 0)
+			{
+				continue;
+			}
+
+			int Priority = 0;
+			if(Time - CacheTime[v] + 2 * LiveCount[v] <= CacheSize)
+			{
+				Priority = int(Time - CacheTime[v]);
+			}
+
+			if(Priority > BestPriority)
+			{
+				BestPriority = Priority;
+				Next = int(v);
+			}
+		}
+
+		if(Next == -1)
+		{
+			// Dead-end. Try the recently used vertices first, then continue in input order
+			while(Next == -1 && DeadEndStack.empty() == false)
+			{
+				UINT v = DeadEndStack.back();
+				DeadEndStack.pop_back();
+				Next = (LiveCount[v] > 0) ? int(v) : -1;
+			}
+
+			while(Next == -1 && Cursor < VertexCount)
+			{
+				Next = (LiveCount[Cursor] > 0) ? int(Cursor) : -1;
+				Cursor++;
+			}
+
+			UINT EmittedTriangles = UINT(Result.size() / 3);
+			if(Next != -1 && EmittedTriangles > ClusterStarts.back())
+			{
+				ClusterStarts.push_back(EmittedTriangles);
+			}
+		}
+		Fanning = Next;
+	}
+	assert(Result.size() == TriangleCount * 3);
+}
+
+void CRtrMeshOptimizer::SortClustersForOverdraw(std::vector<UINT>& Indices, const std::vector<UINT>& ClusterStarts, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT CacheSize)
+{
+	const UINT TriangleCount = UINT(Indices.size() / 3);
+	if(TriangleCount == 0)
+	{
+		return;
+	}
+
+	// Soft boundaries. Every cluster is simulated with a cold cache, since the sort breaks the cache state between clusters
+	std::vector<UINT> Clusters;
+	std::vector<UINT> InsertTime(VertexCount, 0);
+	UINT Time = CacheSize + 1;
+	auto CountMisses = [&](UINT Triangle) -> UINT
+	{
+		UINT Misses = 0;
+		for(UINT k = 0; k < 3; k++)
+		{
+			UINT v = Indices[Triangle * 3 + k];
+			if(Time - InsertTime[v] > CacheSize)
+			{
+				InsertTime[v] = Time++;
+				Misses++;
+			}
+		}
+		return Misses;
+	};
+
+	for(size_t c = 0; c < ClusterStarts.size(); c++)
+	{
+		UINT Start = ClusterStarts[c];
+		UINT End = (c + 1 < ClusterStarts.size()) ? ClusterStarts[c + 1] : TriangleCount;
+
+		// Advancing the time by the cache size flushes the cache
+		Time += CacheSize + 1;
+		UINT ClusterMisses = 0;
+		for(UINT t = Start; t < End; t++)
+		{
+			ClusterMisses += CountMisses(t);
+		}
+		float Threshold = gSoftBoundaryThreshold * float(ClusterMisses) / float(End - Start);
+
+		Time += CacheSize + 1;
+		UINT Misses = 0;
+		Clusters.push_back(Start);
+		for(UINT t = Start; t < End; t++)
+		{
+			Misses += CountMisses(t);
+			if((t + 1 < End) && (float(Misses) <= Threshold * float(t + 1 - Start)))
+			{
+				Start = t + 1;
+				Misses = 0;
+				Time += CacheSize + 1;
+				Clusters.push_back(Start);
+			}
+		}
+	}
+
+	// Area-weighted centroid and normal of every cluster. The cross product is twice the triangle's area
+	struct SCluster
+	{
+		UINT Start;
+		UINT End;
+		float3 Centroid;
+		float3 Normal;
+		float Area;
+		float SortKey;
+	};
+	std::vector<SCluster> ClusterData(Clusters.size());
+	float3 MeshCentroid(0, 0, 0);
+	float MeshArea = 0;
+	for(size_t c = 0; c < Clusters.size(); c++)
+	{
+		SCluster& Cluster = ClusterData[c];
+		Cluster.Start = Clusters[c];
+		Cluster.End = (c + 1 < Clusters.size()) ? Clusters[c + 1] : TriangleCount;
+		Cluster.Centroid = float3(0, 0, 0);
+		Cluster.Normal = float3(0, 0, 0);
+		Cluster.Area = 0;
+		for(UINT t = Cluster.Start; t < Cluster.End; t++)
+		{
+			const float3& a = GetPosition(pPositions, VertexStride, Indices[t * 3 + 0]);
+			const float3& b = GetPosition(pPositions, VertexStride, Indices[t * 3 + 1]);
+			const float3& c = GetPosition(pPositions, VertexStride, Indices[t * 3 + 2]);
+			float3 Normal = (b - a).Cross(c - a);
+			float Area = Normal.Length();
+			Cluster.Centroid += (a + b + c) * (Area / 3);
+			Cluster.Normal += Normal;
+			Cluster.Area += Area;
+		}
+		MeshCentroid += Cluster.Centroid;
+		MeshArea += Cluster.Area;
+	}
+	MeshCentroid = (MeshArea > 0) ? MeshCentroid / MeshArea : MeshCentroid;
+
+	// Clusters facing away from the center are likely to occlude the rest of the mesh, so they go first
+	for(auto& Cluster : ClusterData)
+	{
+		float3 Centroid = (Cluster.Area > 0) ? Cluster.Centroid / Cluster.Area : MeshCentroid;
+		float3 Normal = Cluster.Normal;
+		Normal.Normalize();
+		Cluster.SortKey = (Centroid - MeshCentroid).Dot(Normal);
+	}
+	std::stable_sort(ClusterData.begin(), ClusterData.end(), [](const SCluster& a, const SCluster& b) { return a.SortKey > b.SortKey; });
+
+	std::vector<UINT> Sorted;
+	Sorted.reserve(Indices.size());
+	for(const auto& Cluster : ClusterData)
+	{
+		Sorted.insert(Sorted.end(), Indices.begin() + Cluster.Start * 3, Indices.begin() + Cluster.End * 3);
+	}
+	Indices.swap(Sorted);
+}
+
+void CRtrMeshOptimizer::ReorderVertexFetch(std::vector<UINT>& Indices, std::vector<BYTE>& Vertices, UINT VertexStride)
+{
+	const UINT VertexCount = UINT(Vertices.size() / VertexStride);
+	const UINT Unused = UINT(-1);
+	std::vector<UINT> Remap(VertexCount, Unused);
+	UINT NextVertex = 0;
+	for(UINT& Index : Indices)
+	{
+		if(Remap[Index] == Unused)
+		{
+			Remap[Index] = NextVertex++;
+		}
+		Index = Remap[Index];
+	}
+
+	for(UINT v = 0; v < VertexCount; v++)
+	{
+		if(Remap[v] == Unused)
+		{
+			Remap[v] = NextVertex++;
+		}
+	}
+
+	std::vector<BYTE> Reordered(Vertices.size());
+	for(UINT v = 0; v < VertexCount; v++)
+	{
+		memcpy(Reordered.data() + Remap[v] * VertexStride, Vertices.data() + v * VertexStride, VertexStride);
+	}
+	Vertices.swap(Reordered);
+}
+
+template<typename IndexType>
+static void CopyIndices(const void* pSrc, std::vector<UINT>& Dst)
+{
+	const IndexType* pIndices = (const IndexType*)pSrc;
+	for(UINT& Index : Dst)
+	{
+		Index = *pIndices++;
+	}
+}
+
+template<typename IndexType>
+static void StoreIndices(const std::vector<UINT>& Src, void* pDst)
+{
+	IndexType* pIndices = (IndexType*)pDst;
+	for(UINT Index : Src)
+	{
+		*pIndices++ = IndexType(Index);
+	}
+}
+
+void CRtrMeshOptimizer::Optimize(CRtrMesh::SMeshData& Data, bool bMeasure, UINT CacheSize)
+{
+	CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	if((Desc.Topology != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) || (Desc.VertexFormat != CRtrMesh::VERTEX_FORMAT_FULL) || (Desc.IndexCount < 3))
+	{
+		return;
+	}
+
+	const bool b16Bit = (Desc.IndexType == DXGI_FORMAT_R16_UINT);
+	const UINT PositionOffset = Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION];
+	std::vector<UINT> Indices(Desc.IndexCount);
+	if(b16Bit)
+	{
+		CopyIndices<UINT16>(Data.Indices.data(), Indices);
+	}
+	else
+	{
+		CopyIndices<UINT32>(Data.Indices.data(), Indices);
+	}
+	if(bMeasure)
+	{
+		Desc.ImportedIndexMetrics = Analyze(Indices, Data.Vertices.data() + PositionOffset, Desc.VertexStride, Desc.VertexCount, CacheSize);
+	}
+
+	std::vector<UINT> Optimized;
+	std::vector<UINT> ClusterStarts;
+	Tipsify(Indices, Desc.VertexCount, CacheSize, Optimized, ClusterStarts);
+	SortClustersForOverdraw(Optimized, ClusterStarts, Data.Vertices.data() + PositionOffset, Desc.VertexStride, Desc.VertexCount, CacheSize);
+	ReorderVertexFetch(Optimized, Data.Vertices, Desc.VertexStride);
+
+	if(bMeasure)
+	{
+		Desc.IndexMetrics = Analyze(Optimized, Data.Vertices.data() + PositionOffset, Desc.VertexStride, Desc.VertexCount, CacheSize);
+	}
+	if(b16Bit)
+	{
+		StoreIndices<UINT16>(Optimized, Data.Indices.data());
+	}
+	else
+	{
+		StoreIndices<UINT32>(Optimized, Data.Indices.data());
+	}
+}
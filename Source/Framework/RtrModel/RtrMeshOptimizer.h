@@ -0,0 +1,77 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshOptimizer.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+// Reorders triangle list meshes for the post-transform vertex cache, for overdraw and for vertex fetch.
+// The cache optimization is Tipsify, the overdraw ordering is the cluster sort from the same paper:
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", Sander, Nehab and Barczak, 2007.
+// Everything runs on CPU data, including the metrics, so it can be used and tested without a device.
+class CRtrMeshOptimizer
+{
+public:
+	// Most D3D11 hardware has at least this many post-transform cache entries
+	static const UINT DEFAULT_CACHE_SIZE = 16;
+
+	// Runs the whole pipeline on a VERTEX_FORMAT_FULL triangle list. Other meshes are left untouched.
+	// bMeasure records the metrics before and after into the desc. Estimating the overdraw rasterizes the mesh 6 times, so regular imports skip it
+	static void Optimize(CRtrMesh::SMeshData& Data, bool bMeasure, UINT CacheSize = DEFAULT_CACHE_SIZE);
+
+	// Metrics of an index buffer. Positions are float3s, VertexStride bytes apart
+	static CRtrMesh::SIndexMetrics Analyze(const std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT CacheSize = DEFAULT_CACHE_SIZE);
+
+	// Simulates a FIFO post-transform cache. Returns the number of misses, which is the number of vertex shader invocations
+	static UINT SimulateVertexCache(const std::vector<UINT>& Indices, UINT VertexCount, UINT CacheSize);
+
+	// Software rasterization of the mesh from the 6 axis-aligned directions with back-face culling and a depth test.
+	// Returns shaded pixels per covered pixel, so 1 means no overdraw at all
+	static float EstimateOverdraw(const std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount);
+
+	// Linear time vertex cache optimization. ClusterStarts receives the first triangle of every run between dead-ends
+	static void Tipsify(const std::vector<UINT>& Indices, UINT VertexCount, UINT CacheSize, std::vector<UINT>& Result, std::vector<UINT>& ClusterStarts);
+
+	// Splits the clusters where the cache is already performing well, then sorts them so that outward facing clusters are drawn first
+	static void SortClustersForOverdraw(std::vector<UINT>& Indices, const std::vector<UINT>& ClusterStarts, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT CacheSize);
+
+	// Renumbers the vertices in the order they are first referenced by the indices. Unreferenced vertices are moved to the end
+	static void ReorderVertexFetch(std::vector<UINT>& Indices, std::vector<BYTE>& Vertices, UINT VertexStride);
+};
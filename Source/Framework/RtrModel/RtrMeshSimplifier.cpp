@@ -0,0 +1,428 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshSimplifier.cpp
+---------------------------------------------------------------------------*/
+#include "RtrMeshSimplifier.h"
+#include "RtrMeshOptimizer.h"
+#include "..\Camera.h"
+#include <algorithm>
+#include <iterator>
+#include <queue>
+
+const float CRtrMeshSimplifier::DEFAULT_LOD_RATIO = 0.5f;
+const float CRtrMeshSimplifier::DEFAULT_MAX_ERROR = 0.05f;
+const float CRtrLodSelector::DEFAULT_MAX_SCREEN_ERROR = 1.0f / 1080.0f;
+
+// A LOD which keeps more than this fraction of the previous LOD's triangles isn't stored, and ends the chain
+static const float gMinLodReduction = 0.85f;
+
+// Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+struct SQuadric
+{
+	double a2 = 0, ab = 0, ac = 0, ad = 0;
+	double b2 = 0, bc = 0, bd = 0;
+	double c2 = 0, cd = 0;
+	double d2 = 0;
+
+	void AddPlane(const float3& n, float d)
+	{
+		a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+		b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+		c2 += n.z * n.z; cd += n.z * d;
+		d2 += d * d;
+	}
+
+	void operator+=(const SQuadric& q)
+	{
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+	}
+
+	double Evaluate(const float3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+			+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+			+ c2 * z * z + 2 * cd * z
+			+ d2;
+	}
+};
+
+struct SCollapse
+{
+	double Cost;
+	UINT From;
+	UINT To;
+	UINT FromVersion;
+	UINT ToVersion;
+
+	bool operator>(const SCollapse& Other) const { return Cost > Other.Cost; }
+};
+
+static const float3& GetPosition(const BYTE* pPositions, UINT VertexStride, UINT Index)
+{
+	return *(const float3*)(pPositions + VertexStride * Index);
+}
+
+static void EraseTriangle(std::vector<UINT>& Triangles, UINT Triangle)
+{
+	auto it = std::find(Triangles.begin(), Triangles.end(), Triangle);
+	assert(it != Triangles.end());
+	*it = Triangles.back();
+	Triangles.pop_back();
+}
+
+float CRtrMeshSimplifier::Simplify(std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT TargetIndexCount, float MaxError)
+{
+	const UINT TriangleCount = UINT(Indices.size() / 3);
+	const UINT TargetTriangles = TargetIndexCount / 3;
+	auto Position = [&](UINT Vertex) -> const float3& { return GetPosition(pPositions, VertexStride, Vertex); };
+
+	std::vector<std::vector<UINT>> VertexTriangles(VertexCount);
+	for(UINT t = 0; t < TriangleCount; t++)
+	{
+		for(UINT k = 0; k < 3; k++)
+		{
+			VertexTriangles[Indices[t * 3 + k]].push_back(t);
+		}
+	}
+
+	// Lock the vertices of every edge which doesn't have exactly one twin with the opposite winding.
+	// These are the borders, the seams and the non-manifold edges
+	std::vector<bool> Locked(VertexCount, false);
+	for(UINT a = 0; a < VertexCount; a++)
+	{
+		for(UINT t : VertexTriangles[a])
+		{
+			UINT k = (Indices[t * 3] == a) ? 0 : ((Indices[t * 3 + 1] == a) ? 1 : 2);
+			UINT b = Indices[t * 3 + (k + 1) % 3];
+			UINT Twins = 0;
+			for(UINT s : VertexTriangles[a])
+			{
+				UINT j = (Indices[s * 3] == a) ? 0 : ((Indices[s * 3 + 1] == a) ? 1 : 2);
+				Twins += (Indices[s * 3 + (j + 2) % 3] == b) ? 1 : 0;
+			}
+			if(Twins != 1)
+			{
+				Locked[a] = true;
+				Locked[b] = true;
+			}
+		}
+	}
+
+	// Each vertex starts with the planes of its triangles
+	std::vector<SQuadric> Quadrics(VertexCount);
+	for(UINT t = 0; t < TriangleCount; t++)
+	{
+		const float3& p0 = Position(Indices[t * 3]);
+		float3 n = (Position(Indices[t * 3 + 1]) - p0).Cross(Position(Indices[t * 3 + 2]) - p0);
+		float Length = n.Length();
+		if(Length > 0)
+		{
+			n /= Length;
+			for(UINT k = 0; k < 3; k++)
+			{
+				Quadrics[Indices[t * 3 + k]].AddPlane(n, -n.Dot(p0));
+			}
+		}
+	}
+
+	// Every vertex update bumps its version, which invalidates the queued collapses that use it
+	std::vector<UINT> Versions(VertexCount, 0);
+	std::priority_queue<SCollapse, std::vector<SCollapse>, std::greater<SCollapse>> Queue;
+	auto PushCollapse = [&](UINT From, UINT To)
+	{
+		if(Locked[From] == false)
+		{
+			SQuadric q = Quadrics[From];
+			q += Quadrics[To];
+			SCollapse Collapse = { max(q.Evaluate(Position(To)), 0.0), From, To, Versions[From], Versions[To] };
+			Queue.push(Collapse);
+		}
+	};
+	for(UINT i = 0; i < Indices.size(); i++)
+	{
+		UINT a = Indices[i];
+		UINT b = Indices[(i % 3 == 2) ? i - 2 : i + 1];
+		PushCollapse(a, b);
+		PushCollapse(b, a);
+	}
+
+	std::vector<UINT> Neighbors;
+	std::vector<UINT> ToNeighbors;
+	std::vector<UINT> Common;
+	auto Contains = [&](UINT t, UINT v) -> bool { return Indices[t * 3] == v || Indices[t * 3 + 1] == v || Indices[t * 3 + 2] == v; };
+	auto IsCollapseValid = [&](UINT From, UINT To) -> bool
+	{
+		// Reject collapses which flip, degenerate or fold the remaining triangles, by rotating them more than ~75 degrees
+		UINT SharedTriangles = 0;
+		for(UINT t : VertexTriangles[From])
+		{
+			if(Contains(t, To))
+			{
+				SharedTriangles++;
+				continue;
+			}
+
+			float3 p[3], q[3];
+			for(UINT k = 0; k < 3; k++)
+			{
+				p[k] = Position(Indices[t * 3 + k]);
+				q[k] = (Indices[t * 3 + k] == From) ? Position(To) : p[k];
+			}
+			float3 Before = (p[1] - p[0]).Cross(p[2] - p[0]);
+			float3 After = (q[1] - q[0]).Cross(q[2] - q[0]);
+			if(Before.Dot(After) <= 0.25f * Before.Length() * After.Length())
+			{
+				return false;
+			}
+		}
+
+		// The link condition. The only common neighbors must be the third vertices of the shared triangles, otherwise the collapse creates non-manifold edges
+		Neighbors.clear();
+		ToNeighbors.clear();
+		Common.clear();
+		for(UINT t : VertexTriangles[From])
+		{
+			Neighbors.insert(Neighbors.end(), Indices.begin() + t * 3, Indices.begin() + t * 3 + 3);
+		}
+		for(UINT t : VertexTriangles[To])
+		{
+			ToNeighbors.insert(ToNeighbors.end(), Indices.begin() + t * 3, Indices.begin() + t * 3 + 3);
+		}
+		std::sort(Neighbors.begin(), Neighbors.end());
+		Neighbors.erase(std::unique(Neighbors.begin(), Neighbors.end()), Neighbors.end());
+		std::sort(ToNeighbors.begin(), ToNeighbors.end());
+		ToNeighbors.erase(std::unique(ToNeighbors.begin(), ToNeighbors.end()), ToNeighbors.end());
+		std::set_intersection(Neighbors.begin(), Neighbors.end(), ToNeighbors.begin(), ToNeighbors.end(), std::back_inserter(Common));
+
+		// Common includes From and To themselves
+		return (SharedTriangles > 0) && (Common.size() == SharedTriangles + 2);
+	};
+
+	std::vector<bool> Removed(TriangleCount, false);
+	UINT LiveTriangles = TriangleCount;
+	double MaxCost = 0;
+	const double CostLimit = double(MaxError) * double(MaxError);
+	while((LiveTriangles > TargetTriangles) && (Queue.empty() == false))
+	{
+		SCollapse Collapse = Queue.top();
+		Queue.pop();
+		const UINT From = Collapse.From;
+		const UINT To = Collapse.To;
+		if(Collapse.FromVersion != Versions[From] || Collapse.ToVersion != Versions[To])
+		{
+			continue;
+		}
+
+		// Quadrics only grow, so no cheaper collapse can show up later
+		if(Collapse.Cost > CostLimit)
+		{
+			break;
+		}
+
+		if(IsCollapseValid(From, To) == false)
+		{
+			continue;
+		}
+
+		for(UINT t : VertexTriangles[From])
+		{
+			if(Contains(t, To))
+			{
+				Removed[t] = true;
+				LiveTriangles--;
+				for(UINT k = 0; k < 3; k++)
+				{
+					UINT v = Indices[t * 3 + k];
+					if(v != From)
+					{
+						EraseTriangle(VertexTriangles[v], t);
+					}
+				}
+			}
+			else
+			{
+				for(UINT k = 0; k < 3; k++)
+				{
+					if(Indices[t * 3 + k] == From)
+					{
+						Indices[t * 3 + k] = To;
+					}
+				}
+				VertexTriangles[To].push_back(t);
+			}
+		}
+		VertexTriangles[From].clear();
+		Quadrics[To] += Quadrics[From];
+		Versions[From]++;
+		Versions[To]++;
+		MaxCost = max(MaxCost, Collapse.Cost);
+
+		for(UINT t : VertexTriangles[To])
+		{
+			for(UINT k = 0; k < 3; k++)
+			{
+				UINT v = Indices[t * 3 + k];
+				if(v != To)
+				{
+					PushCollapse(v, To);
+					PushCollapse(To, v);
+				}
+			}
+		}
+	}
+
+	UINT Dst = 0;
+	for(UINT t = 0; t < TriangleCount; t++)
+	{
+		if(Removed[t] == false)
+		{
+			for(UINT k = 0; k < 3; k++)
+			{
+				Indices[Dst++] = Indices[t * 3 + k];
+			}
+		}
+	}
+	Indices.resize(Dst);
+
+	// The quadric is a sum of squared distances, so its square root bounds the distance to each of the original planes
+	return float(sqrt(MaxCost));
+}
+
+void CRtrMeshSimplifier::BuildLodChain(CRtrMesh::SMeshData& Data, UINT LodCount, float LodRatio, float MaxError)
+{
+	CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	Desc.LodCount = 1;
+	Desc.LodIndexCount = 0;
+	if((Desc.Topology != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) || (Desc.VertexFormat != CRtrMesh::VERTEX_FORMAT_FULL) || (Desc.IndexCount < 3))
+	{
+		return;
+	}
+
+	const bool b16Bit = (Desc.IndexType == DXGI_FORMAT_R16_UINT);
+	std::vector<UINT> Indices(Desc.IndexCount);
+	for(UINT i = 0; i < Desc.IndexCount; i++)
+	{
+		Indices[i] = b16Bit ? ((const UINT16*)Data.Indices.data())[i] : ((const UINT32*)Data.Indices.data())[i];
+	}
+
+	const BYTE* pPositions = Data.Vertices.data() + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION];
+	const float ErrorLimit = MaxError * (Desc.BoundingBox.Max - Desc.BoundingBox.Min).Length() * 0.5f;
+	const UINT TriangleCount = Desc.IndexCount / 3;
+	LodCount = min(LodCount, CRtrMesh::MAX_LODS - 1);
+
+	// Every LOD is simplified from the previous one, so the errors add up
+	std::vector<UINT> LodIndices;
+	float Error = 0;
+	float Ratio = 1;
+	for(UINT Lod = 1; Lod <= LodCount; Lod++)
+	{
+		Ratio *= LodRatio;
+		const size_t PrevIndexCount = Indices.size();
+		Error += Simplify(Indices, pPositions, Desc.VertexStride, Desc.VertexCount, UINT(TriangleCount * Ratio) * 3, ErrorLimit - Error);
+		if((Indices.size() == 0) || (Indices.size() > PrevIndexCount * gMinLodReduction))
+		{
+			break;
+		}
+
+		std::vector<UINT> Optimized;
+		std::vector<UINT> ClusterStarts;
+		CRtrMeshOptimizer::Tipsify(Indices, Desc.VertexCount, CRtrMeshOptimizer::DEFAULT_CACHE_SIZE, Optimized, ClusterStarts);
+
+		CRtrMesh::SLod& Dst = Desc.Lods[Desc.LodCount - 1];
+		Dst.FirstIndex = Desc.IndexCount + UINT(LodIndices.size());
+		Dst.IndexCount = UINT(Optimized.size());
+		Dst.Error = Error;
+		LodIndices.insert(LodIndices.end(), Optimized.begin(), Optimized.end());
+		Desc.LodCount++;
+	}
+
+	Desc.LodIndexCount = UINT(LodIndices.size());
+	const UINT IndexSize = b16Bit ? sizeof(UINT16) : sizeof(UINT32);
+	Data.Indices.resize(IndexSize * (Desc.IndexCount + Desc.LodIndexCount));
+	for(UINT i = 0; i < Desc.LodIndexCount; i++)
+	{
+		if(b16Bit)
+		{
+			((UINT16*)Data.Indices.data())[Desc.IndexCount + i] = UINT16(LodIndices[i]);
+		}
+		else
+		{
+			((UINT32*)Data.Indices.data())[Desc.IndexCount + i] = LodIndices[i];
+		}
+	}
+}
+
+CRtrLodSelector::CRtrLodSelector(const CModelViewCamera& Camera, float MaxScreenError) : m_Camera(Camera), m_MaxScreenError(MaxScreenError)
+{
+}
+
+UINT CRtrLodSelector::SelectLod(const CRtrMesh* pMesh, const float4x4& World) const
+{
+	if(pMesh->GetLodCount() == 1)
+	{
+		return 0;
+	}
+
+	// The errors are measured at the point of the bounding sphere closest to the camera
+	RTR_BOX_F Box = pMesh->GetBoundingBox().Transform(World);
+	float3 Center = (Box.Min + Box.Max) * 0.5f;
+	float Radius = (Box.Max - Box.Min).Length() * 0.5f;
+	float3 ToMesh = Center - m_Camera.GetPosition();
+	float Distance = ToMesh.Length();
+	if(Distance <= Radius)
+	{
+		return 0;
+	}
+	float3 Nearest = m_Camera.GetPosition() + ToMesh * ((Distance - Radius) / Distance);
+
+	float Scale = max(World.Right().Length(), max(World.Up().Length(), World.Backward().Length()));
+	for(UINT Lod = pMesh->GetLodCount() - 1; Lod > 0; Lod--)
+	{
+		if(m_Camera.GetScreenSize(Nearest, pMesh->GetLod(Lod).Error * Scale) <= m_MaxScreenError)
+		{
+			return Lod;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshSimplifier.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+class CModelViewCamera;
+
+// Quadric error metric simplification, "Surface Simplification Using Quadric Error Metrics", Garland and Heckbert, 1997.
+// It collapses edges into one of their vertices, so a LOD is just another index buffer over the original vertices, and the normals,
+// texcoords and bone weights are kept as-is. Vertices on open edges never move. These are the mesh borders and the UV/normal seams,
+// where the importer split the vertices, so the LODs don't crack along the seams.
+class CRtrMeshSimplifier
+{
+public:
+	static const UINT DEFAULT_LOD_COUNT = CRtrMesh::MAX_LODS - 1;
+	static const float DEFAULT_LOD_RATIO;
+	static const float DEFAULT_MAX_ERROR;
+
+	// Appends up to LodCount simplified index buffers to a VERTEX_FORMAT_FULL triangle list. LOD i targets LodRatio^i of the triangles,
+	// so the defaults give 50/25/12/6%. The chain ends early once the error reaches MaxError, relative to the mesh bounding sphere radius,
+	// or when a LOD doesn't remove enough triangles to be worth it. Other meshes are left untouched
+	static void BuildLodChain(CRtrMesh::SMeshData& Data, UINT LodCount = DEFAULT_LOD_COUNT, float LodRatio = DEFAULT_LOD_RATIO, float MaxError = DEFAULT_MAX_ERROR);
+
+	// Collapses edges until at most TargetIndexCount indices remain, or until the next collapse would move the surface more than MaxError.
+	// Returns an upper bound of the distance between the input and the output surfaces
+	static float Simplify(std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, UINT VertexCount, UINT TargetIndexCount, float MaxError);
+};
+
+// Picks the coarsest LOD whose error, projected on the screen, is below a threshold
+class CRtrLodSelector
+{
+public:
+	// The default is about one pixel on a 1080p viewport
+	static const float DEFAULT_MAX_SCREEN_ERROR;
+
+	// MaxScreenError is a fraction of the viewport height
+	CRtrLodSelector(const CModelViewCamera& Camera, float MaxScreenError = DEFAULT_MAX_SCREEN_ERROR);
+
+	// World is the transformation of the draw node
+	UINT SelectLod(const CRtrMesh* pMesh, const float4x4& World) const;
+
+private:
+	const CModelViewCamera& m_Camera;
+	float m_MaxScreenError;
+};
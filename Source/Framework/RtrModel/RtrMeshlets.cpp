@@ -0,0 +1,222 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshlets.cpp
+---------------------------------------------------------------------------*/
+#include "RtrMeshlets.h"
+#include "RtrMeshSimplifier.h"
+#include "..\RtrModel.h"
+
+static void ComputeMeshletBounds(const std::vector<UINT>& Indices, const BYTE* pPositions, UINT VertexStride, CRtrMesh::SMeshlet& Meshlet)
+{
+	auto GetPosition = [&](UINT i) -> const float3& { return *(const float3*)(pPositions + VertexStride * Indices[i]); };
+
+	// Bounding sphere around the center of the bounding box. Not the tightest sphere, but close enough for culling
+	RTR_BOX_F Box;
+	for(UINT i = Meshlet.FirstIndex; i < Meshlet.FirstIndex + Meshlet.IndexCount; i++)
+	{
+		Box.Min = float3::Min(Box.Min, GetPosition(i));
+		Box.Max = float3::Max(Box.Max, GetPosition(i));
+	}
+	Meshlet.Center = (Box.Min + Box.Max) * 0.5f;
+	Meshlet.Radius = 0;
+	for(UINT i = Meshlet.FirstIndex; i < Meshlet.FirstIndex + Meshlet.IndexCount; i++)
+	{
+		Meshlet.Radius = max(Meshlet.Radius, (GetPosition(i) - Meshlet.Center).Length());
+	}
+
+	// Normal cone. Front faces are clockwise, so (b - a) x (c - a) points outwards
+	std::vector<float3> Normals;
+	float3 Axis(0, 0, 0);
+	for(UINT i = Meshlet.FirstIndex; i < Meshlet.FirstIndex + Meshlet.IndexCount; i += 3)
+	{
+		float3 Normal = (GetPosition(i + 1) - GetPosition(i)).Cross(GetPosition(i + 2) - GetPosition(i));
+		if(Normal.Length() > 0)
+		{
+			Normal.Normalize();
+			Normals.push_back(Normal);
+			Axis += Normal;
+		}
+	}
+
+	float MinDot = -1;
+	if(Axis.Length() > 0)
+	{
+		Axis.Normalize();
+		MinDot = 1;
+		for(const auto& Normal : Normals)
+		{
+			MinDot = min(MinDot, Normal.Dot(Axis));
+		}
+	}
+	Meshlet.ConeAxis = Axis;
+	Meshlet.ConeSinAngle = (MinDot > 0) ? sqrtf(1 - MinDot * MinDot) : 1;
+}
+
+void CRtrMeshletBuilder::Build(CRtrMesh::SMeshData& Data)
+{
+	CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	Data.Meshlets.clear();
+	Desc.MeshletCount = 0;
+	if((Desc.Topology != D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST) || (Desc.VertexFormat != CRtrMesh::VERTEX_FORMAT_FULL))
+	{
+		return;
+	}
+
+	std::vector<UINT> Indices(Desc.IndexCount);
+	for(UINT i = 0; i < Desc.IndexCount; i++)
+	{
+		Indices[i] = (Desc.IndexType == DXGI_FORMAT_R16_UINT) ? ((const UINT16*)Data.Indices.data())[i] : ((const UINT32*)Data.Indices.data())[i];
+	}
+
+	// Greedy scan. VertexTags holds the last meshlet which used each vertex
+	std::vector<UINT> VertexTags(Desc.VertexCount, UINT(-1));
+	CRtrMesh::SMeshlet Meshlet;
+	UINT MeshletVertexCount = 0;
+	auto CountNewVertices = [&](UINT Triangle) -> UINT
+	{
+		UINT a = Indices[Triangle * 3], b = Indices[Triangle * 3 + 1], c = Indices[Triangle * 3 + 2];
+		UINT MeshletID = UINT(Data.Meshlets.size());
+		UINT Count = (VertexTags[a] != MeshletID) ? 1 : 0;
+		Count += ((VertexTags[b] != MeshletID) && (b != a)) ? 1 : 0;
+		Count += ((VertexTags[c] != MeshletID) && (c != a) && (c != b)) ? 1 : 0;
+		return Count;
+	};
+
+	const BYTE* pPositions = Data.Vertices.data() + Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION];
+	for(UINT t = 0; t < Desc.IndexCount / 3; t++)
+	{
+		UINT NewVertices = CountNewVertices(t);
+		if((Meshlet.IndexCount / 3 == MAX_TRIANGLES) || (MeshletVertexCount + NewVertices > MAX_VERTICES))
+		{
+			ComputeMeshletBounds(Indices, pPositions, Desc.VertexStride, Meshlet);
+			Data.Meshlets.push_back(Meshlet);
+			Meshlet = CRtrMesh::SMeshlet();
+			Meshlet.FirstIndex = t * 3;
+			MeshletVertexCount = 0;
+			NewVertices = CountNewVertices(t);
+		}
+
+		for(UINT k = 0; k < 3; k++)
+		{
+			VertexTags[Indices[t * 3 + k]] = UINT(Data.Meshlets.size());
+		}
+		MeshletVertexCount += NewVertices;
+		Meshlet.IndexCount += 3;
+	}
+
+	if(Meshlet.IndexCount)
+	{
+		ComputeMeshletBounds(Indices, pPositions, Desc.VertexStride, Meshlet);
+		Data.Meshlets.push_back(Meshlet);
+	}
+	Desc.MeshletCount = UINT(Data.Meshlets.size());
+}
+
+void CRtrClusterCuller::Cull(const CRtrModel* pModel, const float4x4& ViewProj, const float3& CameraPosition, const CRtrLodSelector* pLodSelector)
+{
+	m_Draws.clear();
+	m_Ranges.clear();
+	m_Stats = SStats();
+
+	for(const auto& Node : pModel->GetDrawList())
+	{
+		// Culling happens in model space. The frustum planes come from the model-view-projection matrix,
+		// and the facing of a triangle is preserved by the world transform, as long as the normals are transformed correctly
+		float4x4 Mvp = Node.Transformation * ViewProj;
+		float4 Planes[6];
+		ExtractFrustumPlanes(Mvp, Planes);
+		const float3 Eye = float3::Transform(CameraPosition, Node.Transformation.Invert());
+
+		for(const auto pMesh : Node.pMeshes)
+		{
+			SMeshDraw Draw = { pMesh, &Node.Transformation, UINT(m_Ranges.size()), 0 };
+			const auto& Meshlets = pMesh->GetMeshlets();
+			const UINT Lod = pLodSelector ? pLodSelector->SelectLod(pMesh, Node.Transformation) : 0;
+			if(pMesh->HasBones() || Meshlets.empty() || (Lod != 0))
+			{
+				SIndexRange Range = { pMesh->GetLod(Lod).FirstIndex, pMesh->GetLod(Lod).IndexCount };
+				m_Ranges.push_back(Range);
+				Draw.RangeCount = 1;
+				m_Draws.push_back(Draw);
+				continue;
+			}
+
+			const bool bBackfaceCulling = (pMesh->GetMaterial()->IsDoubleSided() == false);
+			m_Stats.ClusterCount += UINT(Meshlets.size());
+			for(const auto& Meshlet : Meshlets)
+			{
+				if(IsSphereInFrustum(Planes, Meshlet.Center, Meshlet.Radius) == false)
+				{
+					m_Stats.FrustumCulled++;
+					continue;
+				}
+
+				// All the triangles are back-facing if every view direction into the bounding sphere is within 90 degrees of every normal in the cone
+				if(bBackfaceCulling)
+				{
+					float3 ToCenter = Meshlet.Center - Eye;
+					float Distance = ToCenter.Length();
+					if(ToCenter.Dot(Meshlet.ConeAxis) >= Distance * Meshlet.ConeSinAngle + Meshlet.Radius * (1 + Meshlet.ConeSinAngle))
+					{
+						m_Stats.BackfaceCulled++;
+						continue;
+					}
+				}
+
+				// Merge with the previous range if they are adjacent
+				if(Draw.RangeCount && (m_Ranges.back().FirstIndex + m_Ranges.back().IndexCount == Meshlet.FirstIndex))
+				{
+					m_Ranges.back().IndexCount += Meshlet.IndexCount;
+				}
+				else
+				{
+					SIndexRange Range = { Meshlet.FirstIndex, Meshlet.IndexCount };
+					m_Ranges.push_back(Range);
+					Draw.RangeCount++;
+				}
+			}
+
+			if(Draw.RangeCount)
+			{
+				m_Draws.push_back(Draw);
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrMeshlets.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "RtrMesh.h"
+
+class CRtrModel;
+class CRtrLodSelector;
+
+// Splits the meshes into clusters (meshlets) which can be culled individually.
+// Meshlets are built by scanning the triangles in index buffer order, so every meshlet is a contiguous index range and the vertex cache order is preserved
+class CRtrMeshletBuilder
+{
+public:
+	static const UINT MAX_VERTICES = 64;
+	static const UINT MAX_TRIANGLES = 124;
+
+	// Fills Data.Meshlets. Only VERTEX_FORMAT_FULL triangle lists get meshlets, so call it before compacting the vertices
+	static void Build(CRtrMesh::SMeshData& Data);
+};
+
+// CPU cluster culling. Rejects meshlets outside the view frustum, and meshlets whose normal cone faces away from the camera.
+// The visible meshlets are merged into as few index ranges as possible
+class CRtrClusterCuller
+{
+public:
+	// Relative to the start of the mesh in the arena
+	struct SIndexRange
+	{
+		UINT FirstIndex;
+		UINT IndexCount;
+	};
+
+	struct SMeshDraw
+	{
+		const CRtrMesh* pMesh;
+		const float4x4* pTransform;
+		UINT FirstRange;
+		UINT RangeCount;
+	};
+
+	struct SStats
+	{
+		UINT ClusterCount = 0;
+		UINT FrustumCulled = 0;
+		UINT BackfaceCulled = 0;
+		float GetCullRatio() const { return ClusterCount ? float(FrustumCulled + BackfaceCulled) / float(ClusterCount) : 0; }
+	};
+
+	// Skinned meshes and meshes without meshlets are always drawn entirely. So is the back side of double-sided materials.
+	// With a LOD selector, meshes which use a simplified LOD are drawn entirely with its index range, since meshlets only cover LOD 0
+	void Cull(const CRtrModel* pModel, const float4x4& ViewProj, const float3& CameraPosition, const CRtrLodSelector* pLodSelector = nullptr);
+
+	const std::vector<SMeshDraw>& GetDraws() const { return m_Draws; }
+	const SIndexRange* GetRanges(const SMeshDraw& Draw) const { return m_Ranges.data() + Draw.FirstRange; }
+	const SStats& GetStats() const { return m_Stats; }
+
+private:
+	std::vector<SMeshDraw> m_Draws;
+	std::vector<SIndexRange> m_Ranges;
+	SStats m_Stats;
+};
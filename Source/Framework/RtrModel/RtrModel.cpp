@@ -41,9 +41,24 @@ Filename: RtrModel.cpp
 ---------------------------------------------------------------------------*/
 #include "..\RtrModel.h"
 #include "..\StringUtils.h"
+#include "..\ThreadPool.h"
+#include "RtrModelCache.h"
+#include "RtrObjImporter.h"
 #include "Importer.hpp"
+#include "ProgressHandler.hpp"
 #include "postprocess.h"
 #include "scene.h"
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using LoadClock = std::chrono::high_resolution_clock;
+
+static float GetSecondsSince(const LoadClock::time_point& Start)
+{
+	return std::chrono::duration<float>(LoadClock::now() - Start).count();
+}
 
 float4x4 aiMatToD3D(const aiMatrix4x4& aiMat)
 {
@@ -115,8 +130,94 @@ bool VerifyScene(const aiScene* pScene)
 	return b;
 }
 
-std::unique_ptr<CRtrModel> CRtrModel::CreateFromFile(const std::wstring& Filename, ID3D11Device* pDevice)
+// aiProcess_ConvertToLeftHanded will make necessary adjustments so that the model is ready for D3D. Check the assimp documentation for more info.
+// The flags are part of the cache key, so changing them invalidates the cooked models.
+// aiProcess_ImproveCacheLocality is not used, CRtrMeshOptimizer reorders the triangles when the meshes are packed
+static const UINT gAiPostProcessFlags =
+	aiProcess_ConvertToLeftHanded |
+	aiProcess_CalcTangentSpace    |
+
+	aiProcess_GenSmoothNormals |
+	aiProcess_JoinIdenticalVertices |
+	aiProcess_LimitBoneWeights |
+	aiProcess_RemoveRedundantMaterials |
+	aiProcess_Triangulate |
+	aiProcess_SortByPType |
+	aiProcess_FindDegenerates |
+	aiProcess_FindInvalidData |
+
+	aiProcess_FindInstances |
+	aiProcess_ValidateDataStructure |
+	aiProcess_FixInfacingNormals |
+	0;
+
+struct CRtrModel::SLoadContext
 {
+	ID3D11Device* pDevice;
+	UINT Flags;
+	std::string Folder;
+	CThreadPool* pThreadPool;
+	LoadProgressCallback ProgressCallback;
+	std::mutex ProgressMutex;
+	std::atomic<bool> bCanceled;
+
+	// Returns false if the load was canceled
+	bool ReportProgress(LOAD_STAGE Stage, float Progress)
+	{
+		if(ProgressCallback && (bCanceled == false))
+		{
+			std::lock_guard<std::mutex> Lock(ProgressMutex);
+			if(ProgressCallback(Stage, Progress) == false)
+			{
+				bCanceled = true;
+			}
+		}
+		return bCanceled == false;
+	}
+
+	// Runs the tasks on the thread-pool if we have one, and reports the stage progress as the tasks complete. Returns false if the load was canceled
+	bool ParallelFor(LOAD_STAGE Stage, UINT Count, const std::function<void(UINT)>& Func)
+	{
+		std::atomic<UINT> DoneCount;
+		DoneCount = 0;
+		auto Task = [&](UINT i)
+		{
+			if(bCanceled == false)
+			{
+				Func(i);
+				ReportProgress(Stage, float(++DoneCount) / float(Count));
+			}
+		};
+
+		ReportProgress(Stage, 0);
+		if(pThreadPool)
+		{
+			pThreadPool->ParallelFor(Count, Task);
+		}
+		else
+		{
+			for(UINT i = 0; i < Count; i++)
+			{
+				Task(i);
+			}
+		}
+		return bCanceled == false;
+	}
+};
+
+// Forwards Assimp's progress updates, so that the import can be canceled mid-parse
+class CAiProgressHandler : public Assimp::ProgressHandler
+{
+public:
+	CAiProgressHandler(const std::function<bool()>& Update) : m_Update(Update) {}
+	bool Update(float Percentage) override { return m_Update(); }
+private:
+	std::function<bool()> m_Update;
+};
+
+std::unique_ptr<CRtrModel> CRtrModel::CreateFromFile(const std::wstring& Filename, ID3D11Device* pDevice, UINT Flags, CThreadPool* pThreadPool, const LoadProgressCallback& ProgressCallback)
+{
+	auto LoadStart = LoadClock::now();
 	std::wstring WideFullpath;
 	HRESULT hr = FindFileInCommonDirs(Filename, WideFullpath);
 	if(FAILED(hr))
@@ -125,27 +226,91 @@ std::unique_ptr<CRtrModel> CRtrModel::CreateFromFile(const std::wstring& Filenam
 		return nullptr;
 	}
 
-	// aiProcess_ConvertToLeftHanded will make necessary adjustments so that the model is ready for D3D. Check the assimp documentation for more info.	
 	std::string Fullpath = wstring_2_string(WideFullpath);
+
+	SLoadContext Ctx;
+	Ctx.pDevice = pDevice;
+	Ctx.Flags = Flags;
+	Ctx.pThreadPool = pThreadPool;
+	Ctx.ProgressCallback = ProgressCallback;
+	Ctx.bCanceled = false;
+
+	// Extract the folder name
+	auto last = Fullpath.find_last_of("/\\");
+	Ctx.Folder = Fullpath.substr(0, last);
+
+	// Try the cooked cache first. Only flags which affect the model content are part of the key
+	SRtrModelCacheKey CacheKey;
+	const std::wstring CacheFile = CRtrModelCache::GetCacheFilename(WideFullpath);
+	bool bUseCache = CRtrModelCache::CreateKey(WideFullpath, gAiPostProcessFlags, Flags & ~(LOAD_FLAGS_IGNORE_CACHE | LOAD_FLAGS_INDEX_METRICS), CacheKey);
+	if(bUseCache && ((Flags & (LOAD_FLAGS_IGNORE_CACHE | LOAD_FLAGS_INDEX_METRICS)) == 0))
+	{
+		CRtrModelCache Cache;
+		if(Cache.Open(CacheFile, CacheKey))
+		{
+			std::unique_ptr<CRtrModel> pModel(new CRtrModel);
+			SLoadStats& Stats = pModel->m_LoadStats;
+			Stats.ImportTime = GetSecondsSince(LoadStart);
+			if(pModel->InitFromCache(Cache.GetReader(), Ctx))
+			{
+				Stats.bFromCache = true;
+				Stats.TotalTime = GetSecondsSince(LoadStart);
+				Stats.CreateTime = Stats.TotalTime - Stats.ImportTime;
+				return pModel;
+			}
+
+			if(Ctx.bCanceled)
+			{
+				return nullptr;
+			}
+			trace(std::wstring(L"Corrupted model cache file ") + CacheFile + L". Reimporting the model.");
+		}
+	}
+
+	if(((Flags & LOAD_FLAGS_FORCE_ASSIMP) == 0) && HasSuffix(Fullpath, std::string(".obj"), false))
+	{
+		std::unique_ptr<CRtrModel> pModel(new CRtrModel);
+		std::vector<CRtrMesh::SMeshData> MeshData;
+		if(pModel->InitFromObj(WideFullpath, Ctx, MeshData) == false)
+		{
+			if(Ctx.bCanceled == false)
+			{
+				trace(std::wstring(L"Can't open model file ") + Filename);
+			}
+			return nullptr;
+		}
+
+		pModel->m_LoadStats.TotalTime = GetSecondsSince(LoadStart);
+		if(bUseCache)
+		{
+			pModel->SaveToCache(CacheFile, CacheKey, MeshData);
+		}
+		return pModel;
+	}
+
+	// Parsing and post-processing are done separately, so that we can report the progress of each
+	LOAD_STAGE AiStage = LOAD_STAGE_PARSE;
+	CAiProgressHandler AiProgress([&]() { return Ctx.ReportProgress(AiStage, 0); });
 	Assimp::Importer importer;
-	const aiScene* pScene = importer.ReadFile(std::string(Fullpath),
-		aiProcess_ConvertToLeftHanded |
-        aiProcess_CalcTangentSpace    |
-
-        aiProcess_GenSmoothNormals |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_ImproveCacheLocality |
-        aiProcess_LimitBoneWeights |
-        aiProcess_RemoveRedundantMaterials |
-        aiProcess_Triangulate |
-        aiProcess_SortByPType |
-        aiProcess_FindDegenerates |
-        aiProcess_FindInvalidData |
-
-        aiProcess_FindInstances |
-		aiProcess_ValidateDataStructure |
-        aiProcess_FixInfacingNormals |
-		0);
+	importer.SetProgressHandler(&AiProgress);
+
+	const aiScene* pScene = nullptr;
+	if(Ctx.ReportProgress(LOAD_STAGE_PARSE, 0))
+	{
+		pScene = importer.ReadFile(std::string(Fullpath), 0);
+	}
+	if(pScene && Ctx.ReportProgress(LOAD_STAGE_POST_PROCESS, 0))
+	{
+		AiStage = LOAD_STAGE_POST_PROCESS;
+		pScene = importer.ApplyPostProcessing(gAiPostProcessFlags);
+	}
+	// The importer doesn't own the handler, release it before it goes out of scope
+	importer.SetProgressHandler(nullptr);
+
+	if(Ctx.bCanceled)
+	{
+		return nullptr;
+	}
 
 	if((pScene == nullptr) || (VerifyScene(pScene) == false))
 	{
@@ -154,86 +319,91 @@ std::unique_ptr<CRtrModel> CRtrModel::CreateFromFile(const std::wstring& Filenam
 		trace(str.c_str());
 		return nullptr;
 	}
+	Ctx.ReportProgress(LOAD_STAGE_POST_PROCESS, 1);
 
 	CRtrModel* pModel = new CRtrModel;
-
-	// Extract the folder name
-	auto last = Fullpath.find_last_of("/\\");
-	std::string Folder = Fullpath.substr(0, last);
+	pModel->m_LoadStats.ImportTime = GetSecondsSince(LoadStart);
 
 	// Init the model
-	if(pModel->Init(pScene, pDevice, Folder) == false)
+	std::vector<CRtrMesh::SMeshData> MeshData;
+	if(pModel->Init(pScene, Ctx, MeshData) == false)
 	{
 		delete pModel;
 		pModel = nullptr;
 	}
+	else
+	{
+		// Writing the cache is not part of the load time
+		pModel->m_LoadStats.TotalTime = GetSecondsSince(LoadStart);
+		if(bUseCache)
+		{
+			pModel->SaveToCache(CacheFile, CacheKey, MeshData);
+		}
+	}
     return std::unique_ptr<CRtrModel>(pModel);
 }
 
-bool CRtrModel::Init(const aiScene* pScene, ID3D11Device* pDevice, const std::string& ModelFolder)
+bool CRtrModel::Init(const aiScene* pScene, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData)
 {
 	// Order of initialization matters, materials, bones and animations need to loaded before mesh initialization
-	if(CreateMaterials(pScene, pDevice, ModelFolder) == false)
+	auto MaterialsStart = LoadClock::now();
+	if(CreateMaterials(pScene, Ctx) == false)
 	{
 
 		return false;
 	}
+	float MaterialsTime = GetSecondsSince(MaterialsStart);
 
-	if(CreateDrawList(pScene, pDevice) == false)
+	if(CreateDrawList(pScene, Ctx, MeshData) == false)
 	{
 		return false;
 	}
+	m_LoadStats.CreateTime += MaterialsTime;
 
 	CalculateModelProperties();
 	return true;
 }
 
-bool CRtrModel::CreateMaterials(const aiScene* pScene, ID3D11Device* pDevice, const std::string& ModelFolder)
+bool CRtrModel::CreateMaterials(const aiScene* pScene, SLoadContext& Ctx)
 {
-	for(UINT i = 0; i < pScene->mNumMaterials; i++)
+	// Decoding the textures is the expensive part, so every material is a separate task
+	m_Materials.resize(pScene->mNumMaterials);
+	Ctx.ParallelFor(LOAD_STAGE_TEXTURE_DECODE, pScene->mNumMaterials, [&](UINT i)
 	{
-		const aiMaterial* pAiMaterial = pScene->mMaterials[i];
-		const CRtrMaterial* pRtrMaterial = new CRtrMaterial(pAiMaterial, pDevice, ModelFolder);
-		if(pRtrMaterial == nullptr)
-		{
-			trace(L"Can't allocate memory for material");
-			return false;
-		}
+		m_Materials[i] = new CRtrMaterial(pScene->mMaterials[i], Ctx.pDevice, Ctx.Folder);
+	});
 
-		m_Materials.push_back(pRtrMaterial);
-	}
+	return Ctx.bCanceled == false;
+}
 
-	return true;
+bool CRtrModel::CreateMaterials(const std::vector<CRtrMaterial::SDesc>& Descs, SLoadContext& Ctx)
+{
+	m_Materials.resize(Descs.size());
+	return Ctx.ParallelFor(LOAD_STAGE_TEXTURE_DECODE, UINT(Descs.size()), [&](UINT i)
+	{
+		m_Materials[i] = new CRtrMaterial(Descs[i], Ctx.pDevice, Ctx.Folder);
+	});
 }
 
-bool CRtrModel::ParseAiSceneNode(const aiNode* pCurrnet, const aiScene* pScene, ID3D11Device* pDevice, std::map<UINT, UINT>& AiToRtrMeshId)
+void CRtrModel::ParseAiSceneNode(const aiNode* pCurrnet, std::map<UINT, UINT>& AiToRtrMeshId, std::vector<UINT>& UniqueAiMeshes, std::vector<std::vector<UINT>>& NodeMeshIDs)
 {
 	if(pCurrnet->mNumMeshes)
 	{
 		SDrawListNode DrawNode;
         DrawNode.Name = pCurrnet->mName.C_Str();
 
-		// Initialize the meshes
+		// Find the meshes. Instanced aiMeshes are shared between the nodes
+		std::vector<UINT> MeshIDs;
 		for(UINT i = 0; i < pCurrnet->mNumMeshes; i++)
 		{
 			UINT AiId = pCurrnet->mMeshes[i];
-			CRtrMesh* pMesh;
 			if(AiToRtrMeshId.find(AiId) == AiToRtrMeshId.end())
 			{
 				// New mesh
-				pMesh = new CRtrMesh(pDevice, this, m_AnimationController.get(), pScene->mMeshes[AiId]);
-				m_Meshes.push_back(pMesh);
-			}
-			else
-			{
-				pMesh = m_Meshes[AiToRtrMeshId[AiId]];
+				AiToRtrMeshId[AiId] = UINT(UniqueAiMeshes.size());
+				UniqueAiMeshes.push_back(AiId);
 			}
-			if(!pMesh)
-			{
-				assert(0);
-				return false;
-			}
-			DrawNode.pMeshes.push_back(pMesh);
+			MeshIDs.push_back(AiToRtrMeshId[AiId]);
 		}
 
 		// Init the transformation
@@ -247,25 +417,373 @@ bool CRtrModel::ParseAiSceneNode(const aiNode* pCurrnet, const aiScene* pScene,
 
 		DrawNode.Transformation = aiMatToD3D(Transform);
 		m_DrawList.push_back(DrawNode);
+		NodeMeshIDs.push_back(MeshIDs);
 	}
 
-	bool b = true;
 	// visit the children
 	for(UINT i = 0; i < pCurrnet->mNumChildren; i++)
 	{
-		b |= ParseAiSceneNode(pCurrnet->mChildren[i], pScene, pDevice, AiToRtrMeshId);
+		ParseAiSceneNode(pCurrnet->mChildren[i], AiToRtrMeshId, UniqueAiMeshes, NodeMeshIDs);
 	}
-	return b;
 }
 
-bool CRtrModel::CreateDrawList(const aiScene* pScene, ID3D11Device* pDevice)
+bool CRtrModel::CreateDrawList(const aiScene* pScene, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData)
 {
 	// First create bones
     m_AnimationController = std::make_unique<CRtrAnimationController>(pScene);
 
 	std::map<UINT, UINT> AiToRtrMeshId;
-	aiNode* pRoot = pScene->mRootNode;
-	return ParseAiSceneNode(pRoot, pScene, pDevice, AiToRtrMeshId);
+	std::vector<UINT> UniqueAiMeshes;
+	std::vector<std::vector<UINT>> NodeMeshIDs;
+	ParseAiSceneNode(pScene->mRootNode, AiToRtrMeshId, UniqueAiMeshes, NodeMeshIDs);
+
+	// Packing the meshes only reads the scene and the animation controller, so the meshes can be packed in parallel
+	auto PackStart = LoadClock::now();
+	std::vector<std::vector<CRtrMesh::SMeshData>> MeshParts(UniqueAiMeshes.size());
+	m_LoadStats.ThreadCount = Ctx.pThreadPool ? Ctx.pThreadPool->GetThreadCount() : 1;
+	Ctx.ParallelFor(LOAD_STAGE_MESH_BUILD, UINT(MeshParts.size()), [&](UINT MeshID)
+	{
+		CRtrMesh::PackAiMesh(pScene->mMeshes[UniqueAiMeshes[MeshID]], m_AnimationController.get(), (Ctx.Flags & LOAD_FLAGS_INDEX_METRICS) != 0, MeshParts[MeshID]);
+	});
+
+	// An aiMesh with too many bones for one palette becomes several meshes, which the nodes draw together
+	std::vector<UINT> FirstPart(MeshParts.size());
+	MeshData.clear();
+	for(UINT i = 0; i < MeshParts.size(); i++)
+	{
+		FirstPart[i] = UINT(MeshData.size());
+		for(auto& Part : MeshParts[i])
+		{
+			MeshData.push_back(std::move(Part));
+		}
+	}
+	if((Ctx.Flags & LOAD_FLAGS_COMPACT_VERTICES) && (Ctx.bCanceled == false))
+	{
+		CompactMeshes(MeshData, Ctx);
+	}
+	m_LoadStats.PackTime = GetSecondsSince(PackStart);
+
+	if(Ctx.bCanceled)
+	{
+		return false;
+	}
+
+	// Buffer creation is a short serial pass
+	auto CreateStart = LoadClock::now();
+	CreateMeshes(Ctx.pDevice, MeshData);
+
+	for(UINT i = 0; i < m_DrawList.size(); i++)
+	{
+		for(UINT MeshID : NodeMeshIDs[i])
+		{
+			for(UINT Part = 0; Part < MeshParts[MeshID].size(); Part++)
+			{
+				m_DrawList[i].pMeshes.push_back(m_Meshes[FirstPart[MeshID] + Part]);
+			}
+		}
+	}
+	m_LoadStats.CreateTime = GetSecondsSince(CreateStart);
+	return true;
+}
+
+static float GetMaxExtent(const RTR_BOX_F& Box)
+{
+	const float3 Extent = Box.Max - Box.Min;
+	return max(Extent.x, max(Extent.y, Extent.z));
+}
+
+void CRtrModel::CompactMeshes(std::vector<CRtrMesh::SMeshData>& MeshData, SLoadContext& Ctx)
+{
+	// Meshes can only share an arena when they share the quantization box. A mesh joins a group as long as the group's box stays
+	// within twice the size of every mesh in it, so sharing costs each mesh at most one bit of position precision.
+	// The largest meshes are placed first, so the small ones join the groups of the meshes around them
+	struct SGroup
+	{
+		RTR_BOX_F Box;
+		float MinMeshExtent;
+	};
+	std::vector<UINT> Order(MeshData.size());
+	for(UINT i = 0; i < Order.size(); i++)
+	{
+		Order[i] = i;
+	}
+	std::sort(Order.begin(), Order.end(), [&](UINT a, UINT b) { return GetMaxExtent(MeshData[a].Desc.BoundingBox) > GetMaxExtent(MeshData[b].Desc.BoundingBox); });
+
+	std::vector<SGroup> Groups;
+	std::vector<UINT> MeshGroups(MeshData.size());
+	for(UINT MeshID : Order)
+	{
+		const RTR_BOX_F& MeshBox = MeshData[MeshID].Desc.BoundingBox;
+		const float MeshExtent = GetMaxExtent(MeshBox);
+		UINT GroupID = 0;
+		for(; GroupID < Groups.size(); GroupID++)
+		{
+			RTR_BOX_F Union;
+			Union.Min = float3::Min(Groups[GroupID].Box.Min, MeshBox.Min);
+			Union.Max = float3::Max(Groups[GroupID].Box.Max, MeshBox.Max);
+			if(GetMaxExtent(Union) <= 2 * min(Groups[GroupID].MinMeshExtent, MeshExtent))
+			{
+				Groups[GroupID].Box = Union;
+				Groups[GroupID].MinMeshExtent = min(Groups[GroupID].MinMeshExtent, MeshExtent);
+				break;
+			}
+		}
+		if(GroupID == Groups.size())
+		{
+			SGroup Group = { MeshBox, MeshExtent };
+			Groups.push_back(Group);
+		}
+		MeshGroups[MeshID] = GroupID;
+	}
+
+	Ctx.ParallelFor(LOAD_STAGE_MESH_BUILD, UINT(MeshData.size()), [&](UINT i) { CRtrMesh::CompactVertices(MeshData[i], Groups[MeshGroups[i]].Box); });
+}
+
+void CRtrModel::CreateMeshes(ID3D11Device* pDevice, std::vector<CRtrMeshArena::SMeshSource>& Meshes)
+{
+	// Group the meshes by arena. Models rarely have more than a couple of different layouts, so a linear search is enough
+	std::vector<std::vector<CRtrMeshArena::SMeshSource*>> ArenaMeshes;
+	std::vector<UINT> ArenaIDs(Meshes.size());
+	for(UINT i = 0; i < Meshes.size(); i++)
+	{
+		UINT ArenaID = 0;
+		while(ArenaID < ArenaMeshes.size() && CRtrMeshArena::IsCompatible(*ArenaMeshes[ArenaID][0]->pDesc, *Meshes[i].pDesc) == false)
+		{
+			ArenaID++;
+		}
+
+		if(ArenaID == ArenaMeshes.size())
+		{
+			ArenaMeshes.push_back(std::vector<CRtrMeshArena::SMeshSource*>());
+		}
+		ArenaMeshes[ArenaID].push_back(&Meshes[i]);
+		ArenaIDs[i] = ArenaID;
+	}
+
+	for(const auto& Group : ArenaMeshes)
+	{
+		m_Arenas.push_back(std::make_unique<CRtrMeshArena>(pDevice, Group));
+	}
+
+	for(UINT i = 0; i < Meshes.size(); i++)
+	{
+		const CRtrMeshArena::SMeshSource& Src = Meshes[i];
+		m_Meshes.push_back(new CRtrMesh(this, *Src.pDesc, Src.pMeshlets, Src.pBonePalette, Src.pVertices, m_Arenas[ArenaIDs[i]].get(), Src.BaseVertex, Src.FirstIndex));
+	}
+
+	// Every skinned mesh gets its own slice of the skinning palette
+	m_SkinningPaletteSize = 0;
+	for(auto pMesh : m_Meshes)
+	{
+		pMesh->SetBonePaletteOffset(m_SkinningPaletteSize);
+		m_SkinningPaletteSize += UINT(pMesh->GetBonePalette().size());
+	}
+}
+
+void CRtrModel::CreateMeshes(ID3D11Device* pDevice, const std::vector<CRtrMesh::SMeshData>& MeshData)
+{
+	std::vector<CRtrMeshArena::SMeshSource> Meshes(MeshData.size());
+	for(UINT i = 0; i < MeshData.size(); i++)
+	{
+		Meshes[i].pDesc = &MeshData[i].Desc;
+		Meshes[i].pVertices = MeshData[i].Vertices.data();
+		Meshes[i].pIndices = MeshData[i].Indices.data();
+		Meshes[i].pMeshlets = MeshData[i].Meshlets.data();
+		Meshes[i].pBonePalette = MeshData[i].BonePalette.data();
+	}
+	CreateMeshes(pDevice, Meshes);
+}
+
+bool CRtrModel::InitFromCache(CRtrBinaryReader& Reader, SLoadContext& Ctx)
+{
+	ID3D11Device* pDevice = Ctx.pDevice;
+
+	// Materials
+	std::vector<CRtrMaterial::SDesc> MaterialDescs;
+	UINT MaterialCount = Reader.Read<UINT>();
+	for(UINT i = 0; i < MaterialCount && Reader.IsValid(); i++)
+	{
+		MaterialDescs.push_back(CRtrMaterial::SDesc());
+		MaterialDescs.back().Deserialize(Reader);
+	}
+
+	if(Reader.IsValid() == false)
+	{
+		return false;
+	}
+
+	if((CreateMaterials(MaterialDescs, Ctx) == false) || (Ctx.ReportProgress(LOAD_STAGE_MESH_BUILD, 0) == false))
+	{
+		return false;
+	}
+
+	// Bones and animations
+	m_AnimationController = std::make_unique<CRtrAnimationController>(Reader);
+
+	// Meshes. The vertex and index data is copied into the arenas straight from the mapped file
+	UINT MeshCount = Reader.Read<UINT>();
+	std::vector<CRtrMesh::SMeshDesc> MeshDescs;
+	std::vector<CRtrMeshArena::SMeshSource> MeshSources;
+	for(UINT i = 0; i < MeshCount && Reader.IsValid(); i++)
+	{
+		CRtrMesh::SMeshDesc Desc = Reader.Read<CRtrMesh::SMeshDesc>();
+		UINT IndexSize = (Desc.IndexType == DXGI_FORMAT_R16_UINT) ? sizeof(UINT16) : sizeof(UINT32);
+		Reader.Align();
+		const void* pVertices = Reader.ReadBytes(Desc.VertexStride, Desc.VertexCount);
+		Reader.Align();
+		const void* pIndices = Reader.ReadBytes(IndexSize, UINT64(Desc.IndexCount) + Desc.LodIndexCount);
+		Reader.Align();
+		const void* pMeshlets = Reader.ReadBytes(sizeof(CRtrMesh::SMeshlet), Desc.MeshletCount);
+		Reader.Align();
+		const UINT* pBonePalette = (const UINT*)Reader.ReadBytes(sizeof(UINT), Desc.BonePaletteSize);
+		if(Reader.IsValid() == false || Desc.MaterialID >= m_Materials.size() || Desc.LodCount == 0 || Desc.LodCount > CRtrMesh::MAX_LODS)
+		{
+			return false;
+		}
+		for(UINT j = 0; j < Desc.BonePaletteSize; j++)
+		{
+			if(pBonePalette[j] >= m_AnimationController->GetBonesCount())
+			{
+				return false;
+			}
+		}
+		MeshDescs.push_back(Desc);
+		MeshSources.push_back(CRtrMeshArena::SMeshSource());
+		MeshSources.back().pVertices = pVertices;
+		MeshSources.back().pIndices = pIndices;
+		MeshSources.back().pMeshlets = (const CRtrMesh::SMeshlet*)pMeshlets;
+		MeshSources.back().pBonePalette = pBonePalette;
+	}
+
+	if(Reader.IsValid() == false)
+	{
+		return false;
+	}
+
+	for(UINT i = 0; i < MeshSources.size(); i++)
+	{
+		MeshSources[i].pDesc = &MeshDescs[i];
+	}
+	CreateMeshes(pDevice, MeshSources);
+
+	// Draw list
+	UINT NodeCount = Reader.Read<UINT>();
+	for(UINT i = 0; i < NodeCount && Reader.IsValid(); i++)
+	{
+		SDrawListNode Node;
+		Node.Name = Reader.ReadString();
+		Node.Transformation = Reader.Read<float4x4>();
+		std::vector<UINT> MeshIDs;
+		Reader.ReadArray(MeshIDs);
+		for(UINT MeshID : MeshIDs)
+		{
+			if(MeshID >= m_Meshes.size())
+			{
+				return false;
+			}
+			Node.pMeshes.push_back(m_Meshes[MeshID]);
+		}
+		m_DrawList.push_back(Node);
+	}
+
+	if(Reader.IsValid() == false)
+	{
+		return false;
+	}
+
+	CalculateModelProperties();
+	return true;
+}
+
+bool CRtrModel::InitFromObj(const std::wstring& Filename, SLoadContext& Ctx, std::vector<CRtrMesh::SMeshData>& MeshData)
+{
+	auto ImportStart = LoadClock::now();
+	auto BuildStart = ImportStart;
+	m_LoadStats.ThreadCount = Ctx.pThreadPool ? Ctx.pThreadPool->GetThreadCount() : 1;
+
+	CRtrObjImporter Importer([&](LOAD_STAGE Stage, UINT Count, const std::function<void(UINT)>& Func) -> bool
+	{
+		if(Stage == LOAD_STAGE_MESH_BUILD)
+		{
+			BuildStart = LoadClock::now();
+		}
+		return Ctx.ParallelFor(Stage, Count, Func);
+	}, m_LoadStats.ThreadCount);
+
+	if(Importer.Import(Filename, (Ctx.Flags & LOAD_FLAGS_INDEX_METRICS) != 0) == false)
+	{
+		return false;
+	}
+	m_LoadStats.ImportTime = std::chrono::duration<float>(BuildStart - ImportStart).count();
+
+	MeshData = std::move(Importer.GetMeshes());
+	if(Ctx.Flags & LOAD_FLAGS_COMPACT_VERTICES)
+	{
+		CompactMeshes(MeshData, Ctx);
+	}
+	m_LoadStats.PackTime = GetSecondsSince(BuildStart);
+
+	auto CreateStart = LoadClock::now();
+	if(CreateMaterials(Importer.GetMaterials(), Ctx) == false)
+	{
+		return false;
+	}
+
+	// OBJ files have no bones or node hierarchy, so all the meshes go into a single node
+	m_AnimationController = std::make_unique<CRtrAnimationController>();
+	SDrawListNode Node;
+	Node.Name = wstring_2_string(Filename.substr(Filename.find_last_of(L"/\\") + 1));
+	CreateMeshes(Ctx.pDevice, MeshData);
+	Node.pMeshes = m_Meshes;
+	m_DrawList.push_back(Node);
+	m_LoadStats.CreateTime = GetSecondsSince(CreateStart);
+
+	CalculateModelProperties();
+	return true;
+}
+
+void CRtrModel::SaveToCache(const std::wstring& CacheFile, const SRtrModelCacheKey& Key, const std::vector<CRtrMesh::SMeshData>& MeshData) const
+{
+	CRtrBinaryWriter Writer;
+
+	Writer.Write(UINT(m_Materials.size()));
+	for(const auto pMaterial : m_Materials)
+	{
+		pMaterial->GetDesc().Serialize(Writer);
+	}
+
+	m_AnimationController->Serialize(Writer);
+
+	std::map<const CRtrMesh*, UINT> MeshIDs;
+	Writer.Write(UINT(MeshData.size()));
+	for(UINT i = 0; i < MeshData.size(); i++)
+	{
+		MeshIDs[m_Meshes[i]] = i;
+		Writer.Write(MeshData[i].Desc);
+		Writer.Align();
+		Writer.WriteBytes(MeshData[i].Vertices.data(), MeshData[i].Vertices.size());
+		Writer.Align();
+		Writer.WriteBytes(MeshData[i].Indices.data(), MeshData[i].Indices.size());
+		Writer.Align();
+		Writer.WriteBytes(MeshData[i].Meshlets.data(), sizeof(CRtrMesh::SMeshlet) * MeshData[i].Meshlets.size());
+		Writer.Align();
+		Writer.WriteBytes(MeshData[i].BonePalette.data(), sizeof(UINT) * MeshData[i].BonePalette.size());
+	}
+
+	Writer.Write(UINT(m_DrawList.size()));
+	for(const auto& Node : m_DrawList)
+	{
+		Writer.WriteString(Node.Name);
+		Writer.Write(Node.Transformation);
+		std::vector<UINT> NodeMeshes;
+		for(const auto pMesh : Node.pMeshes)
+		{
+			NodeMeshes.push_back(MeshIDs[pMesh]);
+		}
+		Writer.WriteArray(NodeMeshes);
+	}
+
+	CRtrModelCache::Save(CacheFile, Key, Writer);
 }
 
 void CRtrModel::CalculateModelProperties()
@@ -289,6 +807,41 @@ void CRtrModel::CalculateModelProperties()
 		}
 	}
 
+	// Meshes can be shared between nodes, so the memory is counted per mesh
+	m_VertexBufferSize = 0;
+	m_FullVertexBufferSize = 0;
+	for(const auto pMesh : m_Meshes)
+	{
+		m_VertexBufferSize += pMesh->GetVertexBufferSize();
+		m_FullVertexBufferSize += pMesh->GetFullVertexBufferSize();
+	}
+
+	// The model metrics are the mesh metrics weighted by the triangle count
+	auto AddMetrics = [](CRtrMesh::SIndexMetrics& Dst, const CRtrMesh::SIndexMetrics& Src, float Weight)
+	{
+		Dst.Acmr += Src.Acmr * Weight;
+		Dst.Atvr += Src.Atvr * Weight;
+		Dst.Overdraw += Src.Overdraw * Weight;
+	};
+
+	CRtrMesh::SIndexMetrics ImportedSum, OptimizedSum;
+	float TotalTriangles = 0;
+	for(const auto pMesh : m_Meshes)
+	{
+		float Triangles = float(pMesh->GetIndexCount() / 3);
+		AddMetrics(ImportedSum, pMesh->GetImportedIndexMetrics(), Triangles);
+		AddMetrics(OptimizedSum, pMesh->GetIndexMetrics(), Triangles);
+		TotalTriangles += Triangles;
+	}
+
+	m_ImportedIndexMetrics = CRtrMesh::SIndexMetrics();
+	m_IndexMetrics = CRtrMesh::SIndexMetrics();
+	if(TotalTriangles > 0)
+	{
+		AddMetrics(m_ImportedIndexMetrics, ImportedSum, 1 / TotalTriangles);
+		AddMetrics(m_IndexMetrics, OptimizedSum, 1 / TotalTriangles);
+	}
+
 	m_Center = (BoundingBox.Max + BoundingBox.Min) * 0.5f;
 	float3 distMax = BoundingBox.Max - m_Center;
 	m_Radius = distMax.Length();
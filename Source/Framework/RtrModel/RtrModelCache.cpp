@@ -0,0 +1,221 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrModelCache.cpp
+---------------------------------------------------------------------------*/
+#include "RtrModelCache.h"
+
+static const UINT gCacheMagic = 'MRTR';
+
+struct SRtrModelCacheHeader
+{
+	UINT Magic;
+	UINT DataSize;
+	SRtrModelCacheKey Key;
+	UINT Pad[2];
+};
+
+void CRtrBinaryWriter::WriteBytes(const void* pData, size_t Size)
+{
+	const BYTE* pBytes = (const BYTE*)pData;
+	m_Data.insert(m_Data.end(), pBytes, pBytes + Size);
+}
+
+void CRtrBinaryWriter::WriteString(const std::string& Str)
+{
+	Write(UINT(Str.size()));
+	WriteBytes(Str.c_str(), Str.size());
+}
+
+void CRtrBinaryWriter::Align()
+{
+	// Arrays are 16-bytes aligned, so that we can use them straight from the mapped file
+	m_Data.resize((m_Data.size() + 15) & ~size_t(15), 0);
+}
+
+const void* CRtrBinaryReader::ReadBytes(size_t Size)
+{
+	// Align() can move the offset past the end
+	if(m_bValid == false || m_Offset > m_Size || Size > m_Size - m_Offset)
+	{
+		m_bValid = false;
+		return nullptr;
+	}
+
+	const void* p = m_pData + m_Offset;
+	m_Offset += Size;
+	return p;
+}
+
+const void* CRtrBinaryReader::ReadBytes(UINT64 ElementSize, UINT64 Count)
+{
+	// Dividing instead of multiplying, so that no count can overflow
+	if(ElementSize != 0 && Count > UINT64(m_Size) / ElementSize)
+	{
+		m_bValid = false;
+		return nullptr;
+	}
+	return ReadBytes(size_t(ElementSize * Count));
+}
+
+std::string CRtrBinaryReader::ReadString()
+{
+	UINT Length = Read<UINT>();
+	const char* pStr = (const char*)ReadBytes(Length);
+	return pStr ? std::string(pStr, Length) : std::string();
+}
+
+void CRtrBinaryReader::Align()
+{
+	m_Offset = (m_Offset + 15) & ~size_t(15);
+}
+
+CRtrModelCache::~CRtrModelCache()
+{
+	Close();
+}
+
+std::wstring CRtrModelCache::GetCacheFilename(const std::wstring& SourceFile)
+{
+	return SourceFile + L".rtrm";
+}
+
+bool CRtrModelCache::CreateKey(const std::wstring& SourceFile, UINT PostProcessFlags, UINT LoadFlags, SRtrModelCacheKey& Key)
+{
+	WIN32_FILE_ATTRIBUTE_DATA Attr;
+	if(GetFileAttributesEx(SourceFile.c_str(), GetFileExInfoStandard, &Attr) == FALSE)
+	{
+		return false;
+	}
+
+	Key.Version = RTR_MODEL_CACHE_VERSION;
+	Key.PostProcessFlags = PostProcessFlags;
+	Key.LoadFlags = LoadFlags;
+	Key.SourceFileSize = (UINT64(Attr.nFileSizeHigh) << 32) | Attr.nFileSizeLow;
+	Key.SourceWriteTime = (UINT64(Attr.ftLastWriteTime.dwHighDateTime) << 32) | Attr.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool CRtrModelCache::Save(const std::wstring& CacheFile, const SRtrModelCacheKey& Key, const CRtrBinaryWriter& Writer)
+{
+	// The media folder might be read-only. Failing to write the cache is not an error, we will just import the model again next time
+	HANDLE hFile = CreateFile(CacheFile.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	const std::vector<BYTE>& Data = Writer.GetData();
+	SRtrModelCacheHeader Header;
+	Header.Magic = gCacheMagic;
+	Header.DataSize = UINT(Data.size());
+	Header.Key = Key;
+	Header.Pad[0] = Header.Pad[1] = 0;
+
+	// The header size is a multiple of 16, so the data alignment is preserved
+	static_assert((sizeof(SRtrModelCacheHeader) % 16) == 0, "Cache header breaks data alignment");
+	DWORD Written;
+	bool b = (WriteFile(hFile, &Header, sizeof(Header), &Written, nullptr) == TRUE);
+	b = b && (WriteFile(hFile, Data.data(), DWORD(Data.size()), &Written, nullptr) == TRUE);
+	CloseHandle(hFile);
+
+	if(b == false)
+	{
+		DeleteFile(CacheFile.c_str());
+	}
+	return b;
+}
+
+bool CRtrModelCache::Open(const std::wstring& CacheFile, const SRtrModelCacheKey& Key)
+{
+	Close();
+	m_hFile = CreateFile(CacheFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(m_hFile == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER FileSize;
+	if(GetFileSizeEx(m_hFile, &FileSize) == FALSE || FileSize.QuadPart < LONGLONG(sizeof(SRtrModelCacheHeader)))
+	{
+		Close();
+		return false;
+	}
+
+	m_hMapping = CreateFileMapping(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	m_pView = m_hMapping ? (const BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if(m_pView == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	const SRtrModelCacheHeader* pHeader = (const SRtrModelCacheHeader*)m_pView;
+	bool bValid = (pHeader->Magic == gCacheMagic);
+	bValid = bValid && (pHeader->DataSize + sizeof(SRtrModelCacheHeader) == UINT64(FileSize.QuadPart));
+	bValid = bValid && (memcmp(&pHeader->Key, &Key, sizeof(Key)) == 0);
+	if(bValid == false)
+	{
+		Close();
+		return false;
+	}
+
+	m_pReader = std::make_unique<CRtrBinaryReader>(m_pView + sizeof(SRtrModelCacheHeader), pHeader->DataSize);
+	return true;
+}
+
+void CRtrModelCache::Close()
+{
+	m_pReader = nullptr;
+	if(m_pView)
+	{
+		UnmapViewOfFile(m_pView);
+		m_pView = nullptr;
+	}
+	if(m_hMapping)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = nullptr;
+	}
+	if(m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+}
@@ -0,0 +1,154 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrModelCache.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+
+// The cooked model cache (.rtrm) stores the output of the import pipeline, so that subsequent loads can skip Assimp.
+// Bump the version whenever the layout of the cache, the vertex packing or the import pipeline changes.
+#define RTR_MODEL_CACHE_VERSION 13
+
+struct SRtrModelCacheKey
+{
+	UINT Version = RTR_MODEL_CACHE_VERSION;
+	UINT PostProcessFlags = 0;
+	UINT LoadFlags = 0;
+	UINT Pad = 0;
+	UINT64 SourceFileSize = 0;
+	UINT64 SourceWriteTime = 0;
+};
+
+class CRtrBinaryWriter
+{
+public:
+	template<typename T>
+	void Write(const T& Value)
+	{
+		WriteBytes(&Value, sizeof(T));
+	}
+
+	template<typename T>
+	void WriteArray(const std::vector<T>& Array)
+	{
+		Write(UINT(Array.size()));
+		Align();
+		WriteBytes(Array.data(), sizeof(T)*Array.size());
+	}
+
+	void WriteString(const std::string& Str);
+	void WriteBytes(const void* pData, size_t Size);
+	void Align();
+
+	const std::vector<BYTE>& GetData() const { return m_Data; }
+private:
+	std::vector<BYTE> m_Data;
+};
+
+class CRtrBinaryReader
+{
+public:
+	CRtrBinaryReader(const BYTE* pData, size_t Size) : m_pData(pData), m_Size(Size) {}
+
+	template<typename T>
+	T Read()
+	{
+		T Value = T();
+		const void* pSrc = ReadBytes(sizeof(T));
+		if(pSrc)
+		{
+			memcpy(&Value, pSrc, sizeof(T));
+		}
+		return Value;
+	}
+
+	template<typename T>
+	void ReadArray(std::vector<T>& Array)
+	{
+		UINT Count = Read<UINT>();
+		Align();
+		const T* pSrc = (const T*)ReadBytes(sizeof(T), Count);
+		if(pSrc)
+		{
+			Array.assign(pSrc, pSrc + Count);
+		}
+	}
+
+	std::string ReadString();
+
+	// Returns a pointer into the mapped data, valid for as long as the cache file is open
+	const void* ReadBytes(size_t Size);
+	// Same for Count elements. Counts read from a corrupt file which would wrap the size around make the reader invalid
+	const void* ReadBytes(UINT64 ElementSize, UINT64 Count);
+	void Align();
+
+	bool IsValid() const { return m_bValid; }
+private:
+	const BYTE* m_pData;
+	size_t m_Size;
+	size_t m_Offset = 0;
+	bool m_bValid = true;
+};
+
+class CRtrModelCache
+{
+public:
+	CRtrModelCache() = default;
+	CRtrModelCache(const CRtrModelCache&) = delete;
+	CRtrModelCache& operator=(const CRtrModelCache&) = delete;
+	~CRtrModelCache();
+
+	static std::wstring GetCacheFilename(const std::wstring& SourceFile);
+	static bool CreateKey(const std::wstring& SourceFile, UINT PostProcessFlags, UINT LoadFlags, SRtrModelCacheKey& Key);
+	static bool Save(const std::wstring& CacheFile, const SRtrModelCacheKey& Key, const CRtrBinaryWriter& Writer);
+
+	// Maps the cache file. Fails if the file doesn't exist or if it was created with a different key
+	bool Open(const std::wstring& CacheFile, const SRtrModelCacheKey& Key);
+	CRtrBinaryReader& GetReader() { return *m_pReader; }
+
+private:
+	void Close();
+
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;
+	HANDLE m_hMapping = nullptr;
+	const BYTE* m_pView = nullptr;
+	std::unique_ptr<CRtrBinaryReader> m_pReader;
+};
@@ -0,0 +1,139 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrModelLoader.cpp
+---------------------------------------------------------------------------*/
+#include "RtrModelLoader.h"
+#include "..\ThreadPool.h"
+
+CRtrModelLoader::CRtrModelLoader(const std::wstring& Filename, ID3D11Device* pDevice, CThreadPool* pThreadPool, UINT Flags, const CRtrModel::LoadProgressCallback& ProgressCallback) : m_Filename(Filename)
+{
+	m_pState = std::make_shared<SState>();
+	m_pState->bReady = false;
+	m_pState->bCanceled = false;
+
+	// Resolve the path on the calling thread, so that a missing file is reported right away
+	std::wstring Fullpath;
+	if(FAILED(FindFileInCommonDirs(Filename, Fullpath)))
+	{
+		trace(std::wstring(L"Can't find model file ") + Filename);
+		m_pState->bReady = true;
+		return;
+	}
+
+	if(pThreadPool)
+	{
+		auto pState = m_pState;
+		pThreadPool->Submit([=]() { Load(pState, Fullpath, pDevice, pThreadPool, Flags, ProgressCallback); });
+	}
+	else
+	{
+		Load(m_pState, Fullpath, pDevice, nullptr, Flags, ProgressCallback);
+	}
+}
+
+CRtrModelLoader::~CRtrModelLoader()
+{
+	Cancel();
+}
+
+void CRtrModelLoader::Load(std::shared_ptr<SState> pState, std::wstring Fullpath, ID3D11Device* pDevice, CThreadPool* pThreadPool, UINT Flags, CRtrModel::LoadProgressCallback ProgressCallback)
+{
+	auto Progress = [&](CRtrModel::LOAD_STAGE Stage, float StageProgress)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(pState->Mutex);
+			pState->Stage = Stage;
+			pState->StageProgress = StageProgress;
+		}
+
+		if(pState->bCanceled)
+		{
+			return false;
+		}
+		return ProgressCallback ? ProgressCallback(Stage, StageProgress) : true;
+	};
+
+	std::unique_ptr<CRtrModel> pModel = CRtrModel::CreateFromFile(Fullpath, pDevice, Flags, pThreadPool, Progress);
+
+	std::lock_guard<std::mutex> Lock(pState->Mutex);
+	pState->pModel = std::move(pModel);
+	pState->bReady = true;
+	pState->ReadyCondition.notify_all();
+}
+
+void CRtrModelLoader::Wait() const
+{
+	std::unique_lock<std::mutex> Lock(m_pState->Mutex);
+	m_pState->ReadyCondition.wait(Lock, [this]() { return m_pState->bReady.load(); });
+}
+
+std::unique_ptr<CRtrModel> CRtrModelLoader::GetModel()
+{
+	assert(IsReady());
+	std::lock_guard<std::mutex> Lock(m_pState->Mutex);
+	return std::move(m_pState->pModel);
+}
+
+CRtrModel::LOAD_STAGE CRtrModelLoader::GetStage() const
+{
+	std::lock_guard<std::mutex> Lock(m_pState->Mutex);
+	return m_pState->Stage;
+}
+
+float CRtrModelLoader::GetStageProgress() const
+{
+	std::lock_guard<std::mutex> Lock(m_pState->Mutex);
+	return m_pState->StageProgress;
+}
+
+std::wstring CRtrModelLoader::GetProgressString() const
+{
+	static const WCHAR* StageNames[CRtrModel::LOAD_STAGE_COUNT] =
+	{
+		L"parsing",
+		L"post-processing",
+		L"decoding textures",
+		L"building meshes"
+	};
+
+	WCHAR Str[128];
+	swprintf_s(Str, ARRAYSIZE(Str), L"Loading model: %s %.0f%%", StageNames[GetStage()], GetStageProgress() * 100);
+	return Str;
+}
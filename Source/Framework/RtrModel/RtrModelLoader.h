@@ -0,0 +1,90 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrModelLoader.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\RtrModel.h"
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+class CThreadPool;
+
+// Loads a model on the thread-pool. The owner polls IsReady() once per frame and takes the model with GetModel(), so the swap happens at a frame boundary
+class CRtrModelLoader
+{
+public:
+	// If pThreadPool is null, the model is loaded synchronously. The progress callback is optional and is called from the loading threads
+	CRtrModelLoader(const std::wstring& Filename, ID3D11Device* pDevice, CThreadPool* pThreadPool, UINT Flags = CRtrModel::LOAD_FLAGS_NONE, const CRtrModel::LoadProgressCallback& ProgressCallback = nullptr);
+	// Cancels the load if it's still running. Doesn't wait for the loading thread
+	~CRtrModelLoader();
+	CRtrModelLoader(const CRtrModelLoader&) = delete;
+	CRtrModelLoader& operator=(const CRtrModelLoader&) = delete;
+
+	bool IsReady() const { return m_pState->bReady; }
+	// Returns null if the load failed or was canceled. Valid only after IsReady() returns true, and only once
+	std::unique_ptr<CRtrModel> GetModel();
+	void Cancel() { m_pState->bCanceled = true; }
+	// Blocks until the load finished or noticed it was canceled
+	void Wait() const;
+
+	const std::wstring& GetFilename() const { return m_Filename; }
+	CRtrModel::LOAD_STAGE GetStage() const;
+	float GetStageProgress() const;
+	std::wstring GetProgressString() const;
+
+private:
+	struct SState
+	{
+		std::atomic<bool> bReady;
+		std::atomic<bool> bCanceled;
+		mutable std::mutex Mutex;
+		std::condition_variable ReadyCondition;  // Signaled with Mutex held once bReady is set
+		CRtrModel::LOAD_STAGE Stage = CRtrModel::LOAD_STAGE_PARSE;
+		float StageProgress = 0;
+		std::unique_ptr<CRtrModel> pModel;
+	};
+
+	static void Load(std::shared_ptr<SState> pState, std::wstring Fullpath, ID3D11Device* pDevice, CThreadPool* pThreadPool, UINT Flags, CRtrModel::LoadProgressCallback ProgressCallback);
+
+	// The state is shared with the loading task, which might outlive the loader
+	std::shared_ptr<SState> m_pState;
+	std::wstring m_Filename;
+};
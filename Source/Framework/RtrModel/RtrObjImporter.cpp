@@ -0,0 +1,895 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrObjImporter.cpp
+---------------------------------------------------------------------------*/
+#include "RtrObjImporter.h"
+#include "RtrMeshOptimizer.h"
+#include "RtrMeshlets.h"
+#include "RtrMeshSimplifier.h"
+#include "..\StringUtils.h"
+#include <emmintrin.h>
+#include <intrin.h>
+#include <fstream>
+#include <sstream>
+
+// Files smaller than that are parsed by a single task
+static const size_t gMinChunkSize = 256 * 1024;
+static const int gMissingIndex = -1;
+static const char* gDefaultMaterial = "DefaultMaterial";
+
+struct SObjCorner
+{
+	int Position;
+	int TexCoord;
+	int Normal;
+	UINT RelativeMask;  // Negative OBJ indices are chunk-relative until all the chunks are parsed. One bit per index
+};
+
+struct SObjMaterialSwitch
+{
+	UINT FirstTriangle;
+	std::string Name;
+};
+
+struct SObjChunk
+{
+	const char* pStart;
+	const char* pEnd;
+
+	std::vector<float3> Positions;
+	std::vector<float2> TexCoords;
+	std::vector<float3> Normals;
+	std::vector<SObjCorner> Corners;    // 3 per triangle
+	std::vector<SObjMaterialSwitch> MaterialSwitches;
+	std::vector<std::string> MaterialLibs;
+	bool bValid = true;
+};
+
+// A contiguous range of triangles using the same material
+struct SObjRun
+{
+	UINT Chunk;
+	UINT FirstTriangle;
+	UINT TriangleCount;
+};
+
+static bool IsSpace(char c)
+{
+	return (c == ' ') || (c == '\t') || (c == '\r');
+}
+
+static bool IsDigit(char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+static void SkipSpaces(const char*& p)
+{
+	while((*p == ' ') || (*p == '\t'))
+	{
+		p++;
+	}
+}
+
+// Scans for the next '\n' 16 bytes at a time. The file buffer is padded, so reading past pEnd is safe
+static const char* FindLineEnd(const char* p, const char* pEnd)
+{
+	const __m128i NewLine = _mm_set1_epi8('\n');
+	while(p < pEnd)
+	{
+		__m128i Block = _mm_loadu_si128((const __m128i*)p);
+		int Mask = _mm_movemask_epi8(_mm_cmpeq_epi8(Block, NewLine));
+		if(Mask)
+		{
+			unsigned long Bit;
+			_BitScanForward(&Bit, Mask);
+			return min(p + Bit, pEnd);
+		}
+		p += 16;
+	}
+	return pEnd;
+}
+
+static const double gPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// strtod() is locale-aware and very slow. OBJ floats are simple, so we accumulate the digits into a 64-bit integer and scale it once
+static float ParseFloat(const char*& p)
+{
+	SkipSpaces(p);
+	bool bNegative = (*p == '-');
+	if(bNegative || (*p == '+'))
+	{
+		p++;
+	}
+
+	UINT64 Mantissa = 0;
+	int Digits = 0;
+	int Exponent = 0;
+	for(; IsDigit(*p); p++)
+	{
+		if(Digits < 19)
+		{
+			Mantissa = Mantissa * 10 + (*p - '0');
+			Digits += (Mantissa != 0) ? 1 : 0;
+		}
+		else
+		{
+			Exponent++;
+		}
+	}
+
+	if(*p == '.')
+	{
+		for(p++; IsDigit(*p); p++)
+		{
+			if(Digits < 19)
+			{
+				Mantissa = Mantissa * 10 + (*p - '0');
+				Digits += (Mantissa != 0) ? 1 : 0;
+				Exponent--;
+			}
+		}
+	}
+
+	if((*p == 'e') || (*p == 'E'))
+	{
+		p++;
+		bool bNegativeExp = (*p == '-');
+		if(bNegativeExp || (*p == '+'))
+		{
+			p++;
+		}
+		int e = 0;
+		for(; IsDigit(*p); p++)
+		{
+			e = min(e * 10 + (*p - '0'), 1000);
+		}
+		Exponent += bNegativeExp ? -e : e;
+	}
+
+	double Value = double(Mantissa);
+	if(Exponent < 0)
+	{
+		for(; Exponent < -22 && Value != 0; Exponent += 22)
+		{
+			Value /= gPow10[22];
+		}
+		Value /= gPow10[max(-Exponent, 0)];
+	}
+	else
+	{
+		for(; Exponent > 22; Exponent -= 22)
+		{
+			Value *= gPow10[22];
+		}
+		Value *= gPow10[Exponent];
+	}
+	return float(bNegative ? -Value : Value);
+}
+
+static int ParseInt(const char*& p)
+{
+	bool bNegative = (*p == '-');
+	if(bNegative)
+	{
+		p++;
+	}
+	int Value = 0;
+	for(; IsDigit(*p); p++)
+	{
+		Value = Value * 10 + (*p - '0');
+	}
+	return bNegative ? -Value : Value;
+}
+
+// OBJ indices are 1-based, and negative indices are relative to the current end of the list
+static int ResolveIndex(int Index, size_t Count, UINT Bit, UINT& RelativeMask)
+{
+	if(Index > 0)
+	{
+		return Index - 1;
+	}
+	else if(Index < 0)
+	{
+		RelativeMask |= Bit;
+		return int(Count) + Index;
+	}
+	return gMissingIndex;
+}
+
+// Parses a 'v', 'v/t', 'v//n' or 'v/t/n' face corner
+static bool ParseCorner(const char*& p, const SObjChunk& Chunk, SObjCorner& Corner)
+{
+	SkipSpaces(p);
+	if((*p != '-') && (IsDigit(*p) == false))
+	{
+		return false;
+	}
+
+	Corner.RelativeMask = 0;
+	Corner.Position = ResolveIndex(ParseInt(p), Chunk.Positions.size(), 0x1, Corner.RelativeMask);
+	Corner.TexCoord = gMissingIndex;
+	Corner.Normal = gMissingIndex;
+	if(*p == '/')
+	{
+		p++;
+		if(*p != '/')
+		{
+			Corner.TexCoord = ResolveIndex(ParseInt(p), Chunk.TexCoords.size(), 0x2, Corner.RelativeMask);
+		}
+		if(*p == '/')
+		{
+			p++;
+			Corner.Normal = ResolveIndex(ParseInt(p), Chunk.Normals.size(), 0x4, Corner.RelativeMask);
+		}
+	}
+	return Corner.Position != gMissingIndex;
+}
+
+static std::string GetLineArgument(const char* p, const char* pLineEnd)
+{
+	SkipSpaces(p);
+	while((pLineEnd > p) && IsSpace(pLineEnd[-1]))
+	{
+		pLineEnd--;
+	}
+	return std::string(p, pLineEnd);
+}
+
+static bool IsKeyword(const char* p, const char* pLineEnd, const char* Keyword, size_t Length)
+{
+	return (size_t(pLineEnd - p) > Length) && (memcmp(p, Keyword, Length) == 0) && IsSpace(p[Length]);
+}
+
+static void ParseChunk(SObjChunk& Chunk)
+{
+	const char* p = Chunk.pStart;
+	while(p < Chunk.pEnd)
+	{
+		const char* pLineEnd = FindLineEnd(p, Chunk.pEnd);
+		SkipSpaces(p);
+
+		if(p[0] == 'v')
+		{
+			const char* pArgs = p + 2;
+			if(IsSpace(p[1]))
+			{
+				float3 v;
+				v.x = ParseFloat(pArgs);
+				v.y = ParseFloat(pArgs);
+				v.z = ParseFloat(pArgs);
+				Chunk.Positions.push_back(v);
+			}
+			else if((p[1] == 't') && IsSpace(p[2]))
+			{
+				pArgs++;
+				float2 t;
+				t.x = ParseFloat(pArgs);
+				t.y = ParseFloat(pArgs);
+				Chunk.TexCoords.push_back(t);
+			}
+			else if((p[1] == 'n') && IsSpace(p[2]))
+			{
+				pArgs++;
+				float3 n;
+				n.x = ParseFloat(pArgs);
+				n.y = ParseFloat(pArgs);
+				n.z = ParseFloat(pArgs);
+				Chunk.Normals.push_back(n);
+			}
+		}
+		else if((p[0] == 'f') && IsSpace(p[1]))
+		{
+			// Triangulate the polygon as a fan
+			const char* pArgs = p + 2;
+			SObjCorner First, Prev, Current;
+			UINT CornerCount = 0;
+			while((pArgs < pLineEnd) && ParseCorner(pArgs, Chunk, Current))
+			{
+				if(CornerCount >= 2)
+				{
+					Chunk.Corners.push_back(First);
+					Chunk.Corners.push_back(Prev);
+					Chunk.Corners.push_back(Current);
+				}
+				if(CornerCount == 0)
+				{
+					First = Current;
+				}
+				Prev = Current;
+				CornerCount++;
+			}
+		}
+		else if(IsKeyword(p, pLineEnd, "usemtl", 6))
+		{
+			SObjMaterialSwitch Switch;
+			Switch.FirstTriangle = UINT(Chunk.Corners.size() / 3);
+			Switch.Name = GetLineArgument(p + 6, pLineEnd);
+			Chunk.MaterialSwitches.push_back(Switch);
+		}
+		else if(IsKeyword(p, pLineEnd, "mtllib", 6))
+		{
+			Chunk.MaterialLibs.push_back(GetLineArgument(p + 6, pLineEnd));
+		}
+		// Groups, objects, smoothing groups, lines and points are ignored
+
+		p = pLineEnd + 1;
+	}
+}
+
+// Open-addressing hash table which welds face corners with identical position/texcoord/normal indices into a single vertex
+class CObjVertexWelder
+{
+public:
+	CObjVertexWelder(size_t MaxVertices)
+	{
+		size_t Size = 64;
+		while(Size < MaxVertices * 2)
+		{
+			Size *= 2;
+		}
+		m_Table.assign(Size, UINT(-1));
+		m_Mask = Size - 1;
+		m_Keys.reserve(MaxVertices);
+	}
+
+	UINT Insert(const SObjCorner& Key)
+	{
+		UINT Hash = UINT(Key.Position) * 0x9E3779B1u ^ UINT(Key.TexCoord) * 0x85EBCA77u ^ UINT(Key.Normal) * 0xC2B2AE3Du;
+		size_t Slot = (Hash ^ (Hash >> 15)) & m_Mask;
+		for(;;)
+		{
+			UINT Vertex = m_Table[Slot];
+			if(Vertex == UINT(-1))
+			{
+				Vertex = UINT(m_Keys.size());
+				m_Table[Slot] = Vertex;
+				m_Keys.push_back(Key);
+				return Vertex;
+			}
+
+			const SObjCorner& Other = m_Keys[Vertex];
+			if((Other.Position == Key.Position) && (Other.TexCoord == Key.TexCoord) && (Other.Normal == Key.Normal))
+			{
+				return Vertex;
+			}
+			Slot = (Slot + 1) & m_Mask;
+		}
+	}
+
+	const std::vector<SObjCorner>& GetKeys() const { return m_Keys; }
+private:
+	std::vector<UINT> m_Table;
+	size_t m_Mask;
+	std::vector<SObjCorner> m_Keys;
+};
+
+struct SObjData
+{
+	std::vector<float3> Positions;
+	std::vector<float2> TexCoords;
+	std::vector<float3> Normals;
+};
+
+template<typename IndexType>
+static void PackObjIndices(const std::vector<UINT>& Indices, CRtrMesh::SMeshData& Data)
+{
+	Data.Indices.resize(sizeof(IndexType) * Indices.size());
+	IndexType* pDst = (IndexType*)Data.Indices.data();
+	for(size_t i = 0; i < Indices.size(); i += 3)
+	{
+		// Reverse the winding order, same as aiProcess_FlipWindingOrder
+		pDst[i + 0] = IndexType(Indices[i + 0]);
+		pDst[i + 1] = IndexType(Indices[i + 2]);
+		pDst[i + 2] = IndexType(Indices[i + 1]);
+	}
+}
+
+static void BuildObjMesh(const SObjData& Obj, const std::vector<SObjCorner>& Corners, UINT MaterialID, bool bIndexMetrics, CRtrMesh::SMeshData& Data)
+{
+	bool bHasTexCoords = true;
+	bool bHasNormals = true;
+	for(const auto& Corner : Corners)
+	{
+		bHasTexCoords = bHasTexCoords && (Corner.TexCoord != gMissingIndex);
+		bHasNormals = bHasNormals && (Corner.Normal != gMissingIndex);
+	}
+
+	// Weld the corners. Attributes which are not present on all the corners are dropped, like Assimp does
+	CObjVertexWelder Welder(Corners.size());
+	std::vector<UINT> Indices;
+	Indices.reserve(Corners.size());
+	for(size_t i = 0; i < Corners.size(); i += 3)
+	{
+		SObjCorner Tri[3];
+		for(UINT j = 0; j < 3; j++)
+		{
+			Tri[j] = Corners[i + j];
+			Tri[j].TexCoord = bHasTexCoords ? Tri[j].TexCoord : gMissingIndex;
+			Tri[j].Normal = bHasNormals ? Tri[j].Normal : gMissingIndex;
+		}
+
+		// Skip degenerate triangles
+		if((Tri[0].Position == Tri[1].Position) || (Tri[0].Position == Tri[2].Position) || (Tri[1].Position == Tri[2].Position))
+		{
+			continue;
+		}
+
+		for(UINT j = 0; j < 3; j++)
+		{
+			Indices.push_back(Welder.Insert(Tri[j]));
+		}
+	}
+
+	const auto& Vertices = Welder.GetKeys();
+	const UINT VertexCount = UINT(Vertices.size());
+	if(Indices.size() == 0)
+	{
+		return;
+	}
+
+	std::vector<float3> Positions(VertexCount);
+	std::vector<float3> Normals(VertexCount);
+	std::vector<float3> TexCoords(bHasTexCoords ? VertexCount : 0);
+	for(UINT i = 0; i < VertexCount; i++)
+	{
+		Positions[i] = Obj.Positions[Vertices[i].Position];
+		if(bHasNormals)
+		{
+			Normals[i] = Obj.Normals[Vertices[i].Normal];
+		}
+		if(bHasTexCoords)
+		{
+			const float2& t = Obj.TexCoords[Vertices[i].TexCoord];
+			TexCoords[i] = float3(t.x, t.y, 0);
+		}
+	}
+
+	if(bHasNormals == false)
+	{
+		// Smooth normals. Vertices which share a position share the normal, same as aiProcess_GenSmoothNormals
+		CObjVertexWelder PositionWelder(VertexCount);
+		std::vector<UINT> PositionIDs(VertexCount);
+		for(UINT i = 0; i < VertexCount; i++)
+		{
+			SObjCorner Key = {Vertices[i].Position, gMissingIndex, gMissingIndex, 0};
+			PositionIDs[i] = PositionWelder.Insert(Key);
+		}
+
+		std::vector<float3> SharedNormals(PositionWelder.GetKeys().size(), float3(0, 0, 0));
+		for(size_t i = 0; i < Indices.size(); i += 3)
+		{
+			const float3& p0 = Positions[Indices[i]];
+			float3 n = (Positions[Indices[i + 1]] - p0).Cross(Positions[Indices[i + 2]] - p0);
+			n.Normalize();
+			for(UINT j = 0; j < 3; j++)
+			{
+				SharedNormals[PositionIDs[Indices[i + j]]] += n;
+			}
+		}
+
+		for(UINT i = 0; i < VertexCount; i++)
+		{
+			Normals[i] = SharedNormals[PositionIDs[i]];
+			Normals[i].Normalize();
+		}
+	}
+
+	// Tangent space, using the same formulation as aiProcess_CalcTangentSpace
+	std::vector<float3> Tangents(bHasTexCoords ? VertexCount : 0, float3(0, 0, 0));
+	std::vector<float3> Bitangents(bHasTexCoords ? VertexCount : 0, float3(0, 0, 0));
+	if(bHasTexCoords)
+	{
+		for(size_t i = 0; i < Indices.size(); i += 3)
+		{
+			UINT i0 = Indices[i], i1 = Indices[i + 1], i2 = Indices[i + 2];
+			float3 v = Positions[i1] - Positions[i0];
+			float3 w = Positions[i2] - Positions[i0];
+			float sx = TexCoords[i1].x - TexCoords[i0].x, sy = TexCoords[i1].y - TexCoords[i0].y;
+			float tx = TexCoords[i2].x - TexCoords[i0].x, ty = TexCoords[i2].y - TexCoords[i0].y;
+			float DirCorrection = (tx * sy - ty * sx < 0) ? -1.0f : 1.0f;
+			if((sx == 0) && (sy == 0) && (tx == 0) && (ty == 0))
+			{
+				sx = 0; sy = 1; tx = 1; ty = 0;
+			}
+
+			float3 t = (w * sy - v * ty) * DirCorrection;
+			float3 b = (w * sx - v * tx) * DirCorrection;
+			for(UINT j = 0; j < 3; j++)
+			{
+				Tangents[Indices[i + j]] += t;
+				Bitangents[Indices[i + j]] += b;
+			}
+		}
+
+		for(UINT i = 0; i < VertexCount; i++)
+		{
+			// Project into the plane orthogonal to the normal
+			const float3& n = Normals[i];
+			Tangents[i] -= n * n.Dot(Tangents[i]);
+			Bitangents[i] -= n * n.Dot(Bitangents[i]);
+			Tangents[i].Normalize();
+			Bitangents[i].Normalize();
+		}
+	}
+
+	// Pack the vertices, using the same layout as CRtrMesh::PackAiMesh()
+	CRtrMesh::SMeshDesc& Desc = Data.Desc;
+	for(int i = 0; i < CRtrMesh::VERTEX_ELEMENT_COUNT; i++)
+	{
+		Desc.VertexElementsOffsets[i] = INVALID_VERTEX_ELEMENT_OFFSET;
+	}
+	UINT Offset = 0;
+	Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_POSITION] = Offset;
+	Offset += sizeof(float3);
+	Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_NORMAL] = Offset;
+	Offset += sizeof(float3);
+	if(bHasTexCoords)
+	{
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_TANGENT] = Offset;
+		Offset += sizeof(float3);
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_BITANGENT] = Offset;
+		Offset += sizeof(float3);
+		Desc.VertexElementsOffsets[CRtrMesh::VERTEX_ELEMENT_TEXCOORD_0] = Offset;
+		Offset += sizeof(float3);
+	}
+	Desc.VertexStride = Offset;
+	Desc.FullVertexStride = Offset;
+	Desc.VertexCount = VertexCount;
+	Desc.PrimitiveCount = VertexCount / 3;
+	Desc.MaterialID = MaterialID;
+	Desc.bHasBones = FALSE;
+	Desc.Topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+
+	// Convert to left-handed coordinates, same as aiProcess_ConvertToLeftHanded
+	auto LeftHanded = [](float3 v) { return float3(v.x, v.y, -v.z); };
+	Data.Vertices.resize(Desc.VertexStride * VertexCount);
+	BYTE* pVertex = Data.Vertices.data();
+	for(UINT i = 0; i < VertexCount; i++, pVertex += Desc.VertexStride)
+	{
+		float3* pDst = (float3*)pVertex;
+		pDst[0] = LeftHanded(Positions[i]);
+		pDst[1] = LeftHanded(Normals[i]);
+		if(bHasTexCoords)
+		{
+			pDst[2] = LeftHanded(Tangents[i]);
+			pDst[3] = LeftHanded(Bitangents[i]);
+			pDst[4] = float3(TexCoords[i].x, 1 - TexCoords[i].y, 0);
+		}
+
+		Desc.BoundingBox.Min = float3::Min(Desc.BoundingBox.Min, pDst[0]);
+		Desc.BoundingBox.Max = float3::Max(Desc.BoundingBox.Max, pDst[0]);
+	}
+
+	Desc.IndexCount = UINT(Indices.size());
+	if(Desc.IndexCount < D3D11_16BIT_INDEX_STRIP_CUT_VALUE)
+	{
+		Desc.IndexType = DXGI_FORMAT_R16_UINT;
+		PackObjIndices<UINT16>(Indices, Data);
+	}
+	else
+	{
+		Desc.IndexType = DXGI_FORMAT_R32_UINT;
+		PackObjIndices<UINT32>(Indices, Data);
+	}
+	CRtrMeshOptimizer::Optimize(Data, bIndexMetrics);
+	CRtrMeshSimplifier::BuildLodChain(Data);
+	CRtrMeshletBuilder::Build(Data);
+}
+
+static bool ReadFileData(const std::string& Filename, std::vector<char>& Data, size_t& Size)
+{
+	std::ifstream File(Filename, std::ios::binary | std::ios::ate);
+	if(File.is_open() == false)
+	{
+		return false;
+	}
+	Size = size_t(File.tellg());
+	File.seekg(0);
+
+	// Pad the buffer so that the line scanner can read 16 bytes past the end
+	Data.assign(Size + 16, 0);
+	File.read(Data.data(), Size);
+	return File.good() || File.eof();
+}
+
+CRtrObjImporter::CRtrObjImporter(const ParallelForFunc& ParallelFor, UINT ThreadCount) : m_ParallelFor(ParallelFor), m_ThreadCount(max(ThreadCount, 1U))
+{
+}
+
+bool CRtrObjImporter::LoadMaterialLibrary(const std::string& Filename)
+{
+	std::ifstream File(m_Folder + '\\' + Filename);
+	if(File.is_open() == false)
+	{
+		return false;
+	}
+
+	CRtrMaterial::SDesc* pDesc = nullptr;
+	std::string Line;
+	while(std::getline(File, Line))
+	{
+		std::istringstream Stream(Line);
+		std::string Keyword;
+		Stream >> Keyword;
+		if(Keyword == "newmtl")
+		{
+			std::string Name = GetLineArgument(Line.c_str() + Line.find("newmtl") + 6, Line.c_str() + Line.size());
+			pDesc = &m_MaterialLibrary[Name];
+			*pDesc = CRtrMaterial::SDesc();
+			std::transform(Name.begin(), Name.end(), Name.begin(), ::tolower);
+			pDesc->Name = Name;
+
+			// Assimp's OBJ defaults. Material names are lower-case, same as CRtrMaterial::CreateDesc()
+			pDesc->DiffuseColor = float3(0.6f, 0.6f, 0.6f);
+			pDesc->SpecularColor = float3(0, 0, 0);
+			pDesc->Shininess = 0;
+			continue;
+		}
+
+		if(pDesc == nullptr)
+		{
+			continue;
+		}
+
+		if(Keyword == "Kd")
+		{
+			Stream >> pDesc->DiffuseColor.x >> pDesc->DiffuseColor.y >> pDesc->DiffuseColor.z;
+		}
+		else if(Keyword == "Ks")
+		{
+			Stream >> pDesc->SpecularColor.x >> pDesc->SpecularColor.y >> pDesc->SpecularColor.z;
+		}
+		else if(Keyword == "Ns")
+		{
+			Stream >> pDesc->Shininess;
+		}
+		else
+		{
+			std::transform(Keyword.begin(), Keyword.end(), Keyword.begin(), ::tolower);
+			int MapType = -1;
+			if(Keyword == "map_kd")
+			{
+				MapType = CRtrMaterial::DIFFUSE_MAP;
+			}
+			else if((Keyword == "map_kn") || (Keyword == "norm"))
+			{
+				MapType = CRtrMaterial::NORMAL_MAP;
+			}
+			else if((Keyword == "map_bump") || (Keyword == "bump"))
+			{
+				MapType = CRtrMaterial::HEIGHT_MAP;
+			}
+			else if(Keyword == "map_ks")
+			{
+				MapType = CRtrMaterial::SPECULAR_MAP;
+			}
+			else if(Keyword == "map_d")
+			{
+				MapType = CRtrMaterial::ALPHA_MAP;
+			}
+
+			if(MapType >= 0)
+			{
+				// Texture options come before the filename
+				std::string Texture;
+				while(Stream >> Texture);
+				pDesc->Textures[MapType] = Texture;
+			}
+		}
+	}
+	return true;
+}
+
+UINT CRtrObjImporter::GetMaterialID(const std::string& Name)
+{
+	auto It = m_MaterialIDs.find(Name);
+	if(It != m_MaterialIDs.end())
+	{
+		return It->second;
+	}
+
+	// Only referenced materials are created, in order of first use. Unknown materials use the default one, same as Assimp
+	auto LibIt = m_MaterialLibrary.find(Name);
+	if(LibIt == m_MaterialLibrary.end())
+	{
+		if(Name != gDefaultMaterial)
+		{
+			return GetMaterialID(gDefaultMaterial);
+		}
+		CRtrMaterial::SDesc Default;
+		Default.Name = "defaultmaterial";
+		Default.DiffuseColor = float3(0.6f, 0.6f, 0.6f);
+		Default.SpecularColor = float3(0, 0, 0);
+		Default.Shininess = 0;
+		LibIt = m_MaterialLibrary.insert(std::make_pair(Name, Default)).first;
+	}
+
+	UINT ID = UINT(m_Materials.size());
+	m_Materials.push_back(LibIt->second);
+	m_MaterialIDs[Name] = ID;
+	return ID;
+}
+
+bool CRtrObjImporter::Import(const std::wstring& Filename, bool bIndexMetrics)
+{
+	std::string Fullpath = wstring_2_string(Filename);
+	m_Folder = Fullpath.substr(0, Fullpath.find_last_of("/\\"));
+
+	std::vector<char> FileData;
+	size_t FileSize;
+	if(ReadFileData(Fullpath, FileData, FileSize) == false)
+	{
+		return false;
+	}
+
+	// Split the file into chunks at line boundaries
+	const char* pFileStart = FileData.data();
+	const char* pFileEnd = pFileStart + FileSize;
+	size_t ChunkCount = min(size_t(m_ThreadCount) * 4, FileSize / gMinChunkSize + 1);
+	std::vector<SObjChunk> Chunks;
+	const char* pChunkStart = pFileStart;
+	for(size_t i = 1; i <= ChunkCount && pChunkStart < pFileEnd; i++)
+	{
+		const char* pChunkEnd = (i == ChunkCount) ? pFileEnd : FindLineEnd(pFileStart + (FileSize * i) / ChunkCount, pFileEnd);
+		pChunkEnd = min(pChunkEnd + 1, pFileEnd);
+		if(pChunkEnd > pChunkStart)
+		{
+			Chunks.push_back(SObjChunk());
+			Chunks.back().pStart = pChunkStart;
+			Chunks.back().pEnd = pChunkEnd;
+			pChunkStart = pChunkEnd;
+		}
+	}
+
+	if(m_ParallelFor(CRtrModel::LOAD_STAGE_PARSE, UINT(Chunks.size()), [&](UINT i) { ParseChunk(Chunks[i]); }) == false)
+	{
+		return false;
+	}
+
+	// Merge the attributes. The face indices are global, except for the negative ones which are resolved here
+	SObjData Obj;
+	std::vector<size_t> PositionBase(Chunks.size()), TexCoordBase(Chunks.size()), NormalBase(Chunks.size());
+	for(size_t i = 0; i < Chunks.size(); i++)
+	{
+		PositionBase[i] = Obj.Positions.size();
+		TexCoordBase[i] = Obj.TexCoords.size();
+		NormalBase[i] = Obj.Normals.size();
+		Obj.Positions.insert(Obj.Positions.end(), Chunks[i].Positions.begin(), Chunks[i].Positions.end());
+		Obj.TexCoords.insert(Obj.TexCoords.end(), Chunks[i].TexCoords.begin(), Chunks[i].TexCoords.end());
+		Obj.Normals.insert(Obj.Normals.end(), Chunks[i].Normals.begin(), Chunks[i].Normals.end());
+		std::vector<float3>().swap(Chunks[i].Positions);
+		std::vector<float2>().swap(Chunks[i].TexCoords);
+		std::vector<float3>().swap(Chunks[i].Normals);
+	}
+
+	bool bResolved = m_ParallelFor(CRtrModel::LOAD_STAGE_PARSE, UINT(Chunks.size()), [&](UINT i)
+	{
+		for(auto& Corner : Chunks[i].Corners)
+		{
+			Corner.Position += (Corner.RelativeMask & 0x1) ? int(PositionBase[i]) : 0;
+			Corner.TexCoord += (Corner.RelativeMask & 0x2) ? int(TexCoordBase[i]) : 0;
+			Corner.Normal += (Corner.RelativeMask & 0x4) ? int(NormalBase[i]) : 0;
+
+			bool bValid = (Corner.Position >= 0) && (size_t(Corner.Position) < Obj.Positions.size());
+			bValid = bValid && (Corner.TexCoord >= gMissingIndex) && (Corner.TexCoord < int(Obj.TexCoords.size()));
+			bValid = bValid && (Corner.Normal >= gMissingIndex) && (Corner.Normal < int(Obj.Normals.size()));
+			Chunks[i].bValid = Chunks[i].bValid && bValid;
+		}
+	});
+
+	if(bResolved == false)
+	{
+		return false;
+	}
+
+	for(const auto& Chunk : Chunks)
+	{
+		if(Chunk.bValid == false)
+		{
+			trace(L"OBJ file contains invalid face indices");
+			return false;
+		}
+		// Some of the models reference libraries which don't exist. Same as Assimp, their faces use the default material
+		for(const auto& Lib : Chunk.MaterialLibs)
+		{
+			LoadMaterialLibrary(Lib);
+		}
+	}
+
+	// Group the triangles by material. The material used at the end of a chunk carries over into the next one
+	std::vector<std::vector<SObjRun>> MeshRuns;
+	std::string CurrentMaterial = gDefaultMaterial;
+	for(UINT c = 0; c < Chunks.size(); c++)
+	{
+		const SObjChunk& Chunk = Chunks[c];
+		UINT TriangleCount = UINT(Chunk.Corners.size() / 3);
+		UINT First = 0;
+		for(size_t s = 0; s <= Chunk.MaterialSwitches.size(); s++)
+		{
+			UINT Last = (s < Chunk.MaterialSwitches.size()) ? Chunk.MaterialSwitches[s].FirstTriangle : TriangleCount;
+			if(Last > First)
+			{
+				UINT MaterialID = GetMaterialID(CurrentMaterial);
+				MeshRuns.resize(max(MeshRuns.size(), size_t(MaterialID + 1)));
+				SObjRun Run = {c, First, Last - First};
+				MeshRuns[MaterialID].push_back(Run);
+			}
+			if(s < Chunk.MaterialSwitches.size())
+			{
+				CurrentMaterial = Chunk.MaterialSwitches[s].Name;
+				First = Last;
+			}
+		}
+	}
+
+	// Every material is a separate mesh
+	std::vector<CRtrMesh::SMeshData> Meshes(MeshRuns.size());
+	bool bBuilt = m_ParallelFor(CRtrModel::LOAD_STAGE_MESH_BUILD, UINT(MeshRuns.size()), [&](UINT MaterialID)
+	{
+		std::vector<SObjCorner> Corners;
+		for(const auto& Run : MeshRuns[MaterialID])
+		{
+			auto First = Chunks[Run.Chunk].Corners.begin() + Run.FirstTriangle * 3;
+			Corners.insert(Corners.end(), First, First + Run.TriangleCount * 3);
+		}
+		BuildObjMesh(Obj, Corners, MaterialID, bIndexMetrics, Meshes[MaterialID]);
+	});
+
+	if(bBuilt == false)
+	{
+		return false;
+	}
+
+	for(auto& Mesh : Meshes)
+	{
+		if(Mesh.Desc.IndexCount)
+		{
+			m_Meshes.push_back(std::move(Mesh));
+		}
+	}
+
+	if(m_Meshes.size() == 0)
+	{
+		trace(L"OBJ file doesn't contain any faces");
+		return false;
+	}
+	return true;
+}
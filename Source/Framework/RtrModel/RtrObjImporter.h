@@ -0,0 +1,74 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrObjImporter.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\RtrModel.h"
+#include <functional>
+
+// Native Wavefront OBJ/MTL importer, used instead of Assimp for .obj files.
+// The output matches the Assimp path: same vertex layout (position, normal, tangent, bitangent, texcoord), left-handed coordinates, flipped UVs and winding.
+// The file is split into chunks which are parsed in parallel, and every material becomes a mesh which is built in parallel.
+class CRtrObjImporter
+{
+public:
+	// Calls Func(0)..Func(Count-1), possibly in parallel. Returns false if the load was canceled
+	using ParallelForFunc = std::function<bool(CRtrModel::LOAD_STAGE Stage, UINT Count, const std::function<void(UINT)>& Func)>;
+
+	CRtrObjImporter(const ParallelForFunc& ParallelFor, UINT ThreadCount);
+	// bIndexMetrics fills the meshes' index metrics, see CRtrMeshOptimizer::Optimize()
+	bool Import(const std::wstring& Filename, bool bIndexMetrics);
+
+	const std::vector<CRtrMaterial::SDesc>& GetMaterials() const { return m_Materials; }
+	std::vector<CRtrMesh::SMeshData>& GetMeshes() { return m_Meshes; }
+
+private:
+	bool LoadMaterialLibrary(const std::string& Filename);
+	UINT GetMaterialID(const std::string& Name);
+
+	ParallelForFunc m_ParallelFor;
+	UINT m_ThreadCount;
+	std::string m_Folder;
+
+	std::map<std::string, CRtrMaterial::SDesc> m_MaterialLibrary;
+	std::map<std::string, UINT> m_MaterialIDs;
+	std::vector<CRtrMaterial::SDesc> m_Materials;
+	std::vector<CRtrMesh::SMeshData> m_Meshes;
+};
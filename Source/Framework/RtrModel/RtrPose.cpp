@@ -0,0 +1,298 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrPose.cpp
+---------------------------------------------------------------------------*/
+#include "RtrPose.h"
+using namespace DirectX;
+
+static inline XMVECTOR LoadLanes(const float* pLanes)
+{
+	return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(pLanes));
+}
+
+static inline void StoreLanes(float* pLanes, FXMVECTOR V)
+{
+	XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(pLanes), V);
+}
+
+static inline XMVECTOR LerpLanes(FXMVECTOR Start, FXMVECTOR End, FXMVECTOR Ratio)
+{
+	return XMVectorMultiplyAdd(XMVectorSubtract(End, Start), Ratio, Start);
+}
+
+static inline XMVECTOR LerpLanes(const float* pStart, const float* pEnd, FXMVECTOR Ratio)
+{
+	return LerpLanes(LoadLanes(pStart), LoadLanes(pEnd), Ratio);
+}
+
+// Hamilton product a * b of 4 quaternions
+static inline void MultiplyQuaternions(FXMVECTOR ax, FXMVECTOR ay, FXMVECTOR az, GXMVECTOR aw, HXMVECTOR bx, HXMVECTOR by, CXMVECTOR bz, CXMVECTOR bw,
+	XMVECTOR& x, XMVECTOR& y, XMVECTOR& z, XMVECTOR& w)
+{
+	x = XMVectorSubtract(XMVectorAdd(XMVectorAdd(XMVectorMultiply(aw, bx), XMVectorMultiply(ax, bw)), XMVectorMultiply(ay, bz)), XMVectorMultiply(az, by));
+	y = XMVectorAdd(XMVectorAdd(XMVectorSubtract(XMVectorMultiply(aw, by), XMVectorMultiply(ax, bz)), XMVectorMultiply(ay, bw)), XMVectorMultiply(az, bx));
+	z = XMVectorAdd(XMVectorSubtract(XMVectorAdd(XMVectorMultiply(aw, bz), XMVectorMultiply(ax, by)), XMVectorMultiply(ay, bx)), XMVectorMultiply(az, bw));
+	w = XMVectorSubtract(XMVectorSubtract(XMVectorSubtract(XMVectorMultiply(aw, bw), XMVectorMultiply(ax, bx)), XMVectorMultiply(ay, by)), XMVectorMultiply(az, bz));
+}
+
+static inline void StoreNormalized(CRtrPose::SBlock& Out, FXMVECTOR Qx, FXMVECTOR Qy, FXMVECTOR Qz, GXMVECTOR Qw)
+{
+	XMVECTOR LengthSq = XMVectorMultiply(Qx, Qx);
+	LengthSq = XMVectorMultiplyAdd(Qy, Qy, LengthSq);
+	LengthSq = XMVectorMultiplyAdd(Qz, Qz, LengthSq);
+	LengthSq = XMVectorMultiplyAdd(Qw, Qw, LengthSq);
+	const XMVECTOR InvLength = XMVectorReciprocalSqrt(LengthSq);
+	StoreLanes(Out.Qx, XMVectorMultiply(Qx, InvLength));
+	StoreLanes(Out.Qy, XMVectorMultiply(Qy, InvLength));
+	StoreLanes(Out.Qz, XMVectorMultiply(Qz, InvLength));
+	StoreLanes(Out.Qw, XMVectorMultiply(Qw, InvLength));
+}
+
+void CRtrPose::Resize(UINT BoneCount)
+{
+	// The unused lanes of the last block hold the identity, so the kernels never work on garbage
+	SBlock Identity;
+	for(UINT Lane = 0; Lane < BLOCK_SIZE; Lane++)
+	{
+		Identity.SetTranslation(Lane, float3(0, 0, 0));
+		Identity.SetRotation(Lane, quaternion());
+		Identity.SetScale(Lane, float3(1, 1, 1));
+	}
+	m_BoneCount = BoneCount;
+	m_Blocks.assign((BoneCount + BLOCK_SIZE - 1) / BLOCK_SIZE, Identity);
+}
+
+void CRtrPose::SetBone(UINT BoneID, const float3& Translation, const quaternion& Rotation, const float3& Scale)
+{
+	assert(BoneID < m_BoneCount);
+	SBlock& Block = m_Blocks[BoneID / BLOCK_SIZE];
+	const UINT Lane = BoneID % BLOCK_SIZE;
+	Block.SetTranslation(Lane, Translation);
+	Block.SetRotation(Lane, Rotation);
+	Block.SetScale(Lane, Scale);
+}
+
+void CRtrPose::GetBone(UINT BoneID, float3& Translation, quaternion& Rotation, float3& Scale) const
+{
+	assert(BoneID < m_BoneCount);
+	const SBlock& Block = m_Blocks[BoneID / BLOCK_SIZE];
+	const UINT Lane = BoneID % BLOCK_SIZE;
+	Translation = float3(Block.Tx[Lane], Block.Ty[Lane], Block.Tz[Lane]);
+	Rotation = quaternion(Block.Qx[Lane], Block.Qy[Lane], Block.Qz[Lane], Block.Qw[Lane]);
+	Scale = float3(Block.Sx[Lane], Block.Sy[Lane], Block.Sz[Lane]);
+}
+
+void CRtrPose::InterpolateBlock(const SBlock& A, const SBlock& B, const float RatioT[BLOCK_SIZE], const float RatioR[BLOCK_SIZE],
+	const float RatioS[BLOCK_SIZE], ROTATION_INTERPOLATION Interpolation, SBlock& Out)
+{
+	const XMVECTOR One = XMVectorSplatOne();
+
+	XMVECTOR Ratio = LoadLanes(RatioT);
+	StoreLanes(Out.Tx, LerpLanes(A.Tx, B.Tx, Ratio));
+	StoreLanes(Out.Ty, LerpLanes(A.Ty, B.Ty, Ratio));
+	StoreLanes(Out.Tz, LerpLanes(A.Tz, B.Tz, Ratio));
+
+	Ratio = LoadLanes(RatioS);
+	StoreLanes(Out.Sx, LerpLanes(A.Sx, B.Sx, Ratio));
+	StoreLanes(Out.Sy, LerpLanes(A.Sy, B.Sy, Ratio));
+	StoreLanes(Out.Sz, LerpLanes(A.Sz, B.Sz, Ratio));
+
+	const XMVECTOR Ax = LoadLanes(A.Qx), Ay = LoadLanes(A.Qy), Az = LoadLanes(A.Qz), Aw = LoadLanes(A.Qw);
+	const XMVECTOR Bx = LoadLanes(B.Qx), By = LoadLanes(B.Qy), Bz = LoadLanes(B.Qz), Bw = LoadLanes(B.Qw);
+	XMVECTOR Dot = XMVectorMultiply(Ax, Bx);
+	Dot = XMVectorMultiplyAdd(Ay, By, Dot);
+	Dot = XMVectorMultiplyAdd(Az, Bz, Dot);
+	Dot = XMVectorMultiplyAdd(Aw, Bw, Dot);
+
+	// q and -q are the same rotation. Negating B where the dot product is negative takes the shortest path
+	const XMVECTOR Sign = XMVectorSelect(One, XMVectorNegate(One), XMVectorLess(Dot, XMVectorZero()));
+	Dot = XMVectorMultiply(Dot, Sign);
+
+	Ratio = LoadLanes(RatioR);
+	XMVECTOR WeightA = XMVectorSubtract(One, Ratio);
+	XMVECTOR WeightB = Ratio;
+	if(Interpolation == SLERP)
+	{
+		// sin((1-t)*Angle)/sin(Angle) and sin(t*Angle)/sin(Angle). Nearly identical rotations keep the linear weights
+		const XMVECTOR Angle = XMVectorACos(XMVectorMin(Dot, One));
+		const XMVECTOR InvSin = XMVectorReciprocal(XMVectorSin(Angle));
+		const XMVECTOR bSlerp = XMVectorLess(Dot, XMVectorReplicate(0.9995f));
+		WeightA = XMVectorSelect(WeightA, XMVectorMultiply(XMVectorSin(XMVectorMultiply(WeightA, Angle)), InvSin), bSlerp);
+		WeightB = XMVectorSelect(WeightB, XMVectorMultiply(XMVectorSin(XMVectorMultiply(WeightB, Angle)), InvSin), bSlerp);
+	}
+	WeightB = XMVectorMultiply(WeightB, Sign);
+
+	XMVECTOR Qx = XMVectorMultiplyAdd(Bx, WeightB, XMVectorMultiply(Ax, WeightA));
+	XMVECTOR Qy = XMVectorMultiplyAdd(By, WeightB, XMVectorMultiply(Ay, WeightA));
+	XMVECTOR Qz = XMVectorMultiplyAdd(Bz, WeightB, XMVectorMultiply(Az, WeightA));
+	XMVECTOR Qw = XMVectorMultiplyAdd(Bw, WeightB, XMVectorMultiply(Aw, WeightA));
+
+	// Nlerp results need the normalization, slerp results only drift by rounding errors
+	StoreNormalized(Out, Qx, Qy, Qz, Qw);
+}
+
+bool CRtrPose::GetBlockWeights(UINT BlockID, float Weight, const float* pMask, float Weights[BLOCK_SIZE]) const
+{
+	bool bAny = false;
+	for(UINT Lane = 0; Lane < BLOCK_SIZE; Lane++)
+	{
+		const UINT BoneID = BlockID * BLOCK_SIZE + Lane;
+		Weights[Lane] = (BoneID < m_BoneCount) ? (pMask ? Weight * pMask[BoneID] : Weight) : 0;
+		bAny = bAny || (Weights[Lane] != 0);
+	}
+	return bAny;
+}
+
+void CRtrPose::Blend(const CRtrPose& Source, float Weight, const float* pMask)
+{
+	assert(Source.GetBoneCount() == m_BoneCount);
+	float Weights[BLOCK_SIZE];
+	for(UINT BlockID = 0; BlockID < m_Blocks.size(); BlockID++)
+	{
+		if(GetBlockWeights(BlockID, Weight, pMask, Weights))
+		{
+			SBlock& Block = m_Blocks[BlockID];
+			InterpolateBlock(Block, Source.m_Blocks[BlockID], Weights, Weights, Weights, NLERP, Block);
+		}
+	}
+}
+
+void CRtrPose::Add(const CRtrPose& Additive, const CRtrPose& Reference, float Weight, const float* pMask)
+{
+	assert(Additive.GetBoneCount() == m_BoneCount && Reference.GetBoneCount() == m_BoneCount);
+	const XMVECTOR One = XMVectorSplatOne();
+	float Weights[BLOCK_SIZE];
+	for(UINT BlockID = 0; BlockID < m_Blocks.size(); BlockID++)
+	{
+		if(GetBlockWeights(BlockID, Weight, pMask, Weights) == false)
+		{
+			continue;
+		}
+
+		SBlock& Base = m_Blocks[BlockID];
+		const SBlock& Add = Additive.m_Blocks[BlockID];
+		const SBlock& Ref = Reference.m_Blocks[BlockID];
+		const XMVECTOR w = LoadLanes(Weights);
+
+		// Translations add the weighted difference, scales multiply by the weighted ratio
+		StoreLanes(Base.Tx, XMVectorMultiplyAdd(XMVectorSubtract(LoadLanes(Add.Tx), LoadLanes(Ref.Tx)), w, LoadLanes(Base.Tx)));
+		StoreLanes(Base.Ty, XMVectorMultiplyAdd(XMVectorSubtract(LoadLanes(Add.Ty), LoadLanes(Ref.Ty)), w, LoadLanes(Base.Ty)));
+		StoreLanes(Base.Tz, XMVectorMultiplyAdd(XMVectorSubtract(LoadLanes(Add.Tz), LoadLanes(Ref.Tz)), w, LoadLanes(Base.Tz)));
+		StoreLanes(Base.Sx, XMVectorMultiply(LoadLanes(Base.Sx), LerpLanes(One, XMVectorDivide(LoadLanes(Add.Sx), LoadLanes(Ref.Sx)), w)));
+		StoreLanes(Base.Sy, XMVectorMultiply(LoadLanes(Base.Sy), LerpLanes(One, XMVectorDivide(LoadLanes(Add.Sy), LoadLanes(Ref.Sy)), w)));
+		StoreLanes(Base.Sz, XMVectorMultiply(LoadLanes(Base.Sz), LerpLanes(One, XMVectorDivide(LoadLanes(Add.Sz), LoadLanes(Ref.Sz)), w)));
+
+		// Delta = conjugate(Ref) * Add, so Base * Delta == Add when Base == Ref
+		const XMVECTOR rx = XMVectorNegate(LoadLanes(Ref.Qx)), ry = XMVectorNegate(LoadLanes(Ref.Qy)), rz = XMVectorNegate(LoadLanes(Ref.Qz)), rw = LoadLanes(Ref.Qw);
+		const XMVECTOR ax = LoadLanes(Add.Qx), ay = LoadLanes(Add.Qy), az = LoadLanes(Add.Qz), aw = LoadLanes(Add.Qw);
+		XMVECTOR dx, dy, dz, dw;
+		MultiplyQuaternions(rx, ry, rz, rw, ax, ay, az, aw, dx, dy, dz, dw);
+
+		// Scale the delta by the weight: nlerp from the identity, along the shortest path
+		const XMVECTOR Sign = XMVectorSelect(One, XMVectorNegate(One), XMVectorLess(dw, XMVectorZero()));
+		const XMVECTOR wSigned = XMVectorMultiply(w, Sign);
+		dx = XMVectorMultiply(dx, wSigned);
+		dy = XMVectorMultiply(dy, wSigned);
+		dz = XMVectorMultiply(dz, wSigned);
+		dw = XMVectorMultiplyAdd(dw, wSigned, XMVectorSubtract(One, w));
+
+		XMVECTOR qx, qy, qz, qw;
+		MultiplyQuaternions(LoadLanes(Base.Qx), LoadLanes(Base.Qy), LoadLanes(Base.Qz), LoadLanes(Base.Qw), dx, dy, dz, dw, qx, qy, qz, qw);
+		StoreNormalized(Base, qx, qy, qz, qw);
+	}
+}
+
+void CRtrPose::ComposeMatrices(float4x4* pMatrices, const BYTE* pBlockMask) const
+{
+	const XMVECTOR One = XMVectorSplatOne();
+	const XMVECTOR Two = XMVectorReplicate(2);
+	const XMVECTOR Zero = XMVectorZero();
+
+	for(UINT BlockID = 0; BlockID < m_Blocks.size(); BlockID++)
+	{
+		if(pBlockMask && pBlockMask[BlockID] == 0)
+		{
+			continue;
+		}
+
+		const SBlock& Block = m_Blocks[BlockID];
+		const XMVECTOR x = LoadLanes(Block.Qx), y = LoadLanes(Block.Qy), z = LoadLanes(Block.Qz), w = LoadLanes(Block.Qw);
+		const XMVECTOR Sx = LoadLanes(Block.Sx), Sy = LoadLanes(Block.Sy), Sz = LoadLanes(Block.Sz);
+
+		const XMVECTOR xx = XMVectorMultiply(x, x), yy = XMVectorMultiply(y, y), zz = XMVectorMultiply(z, z);
+		const XMVECTOR xy = XMVectorMultiply(x, y), xz = XMVectorMultiply(x, z), yz = XMVectorMultiply(y, z);
+		const XMVECTOR wx = XMVectorMultiply(w, x), wy = XMVectorMultiply(w, y), wz = XMVectorMultiply(w, z);
+
+		// Each row holds one matrix row of the 4 bones, element by element. Same result as
+		// float4x4::CreateScale(S) * float4x4::CreateFromQuaternion(Q) * float4x4::CreateTranslation(T)
+		XMMATRIX Rows[4];
+		Rows[0].r[0] = XMVectorMultiply(Sx, XMVectorNegativeMultiplySubtract(Two, XMVectorAdd(yy, zz), One));
+		Rows[0].r[1] = XMVectorMultiply(Sx, XMVectorMultiply(Two, XMVectorAdd(xy, wz)));
+		Rows[0].r[2] = XMVectorMultiply(Sx, XMVectorMultiply(Two, XMVectorSubtract(xz, wy)));
+		Rows[0].r[3] = Zero;
+
+		Rows[1].r[0] = XMVectorMultiply(Sy, XMVectorMultiply(Two, XMVectorSubtract(xy, wz)));
+		Rows[1].r[1] = XMVectorMultiply(Sy, XMVectorNegativeMultiplySubtract(Two, XMVectorAdd(xx, zz), One));
+		Rows[1].r[2] = XMVectorMultiply(Sy, XMVectorMultiply(Two, XMVectorAdd(yz, wx)));
+		Rows[1].r[3] = Zero;
+
+		Rows[2].r[0] = XMVectorMultiply(Sz, XMVectorMultiply(Two, XMVectorAdd(xz, wy)));
+		Rows[2].r[1] = XMVectorMultiply(Sz, XMVectorMultiply(Two, XMVectorSubtract(yz, wx)));
+		Rows[2].r[2] = XMVectorMultiply(Sz, XMVectorNegativeMultiplySubtract(Two, XMVectorAdd(xx, yy), One));
+		Rows[2].r[3] = Zero;
+
+		Rows[3].r[0] = LoadLanes(Block.Tx);
+		Rows[3].r[1] = LoadLanes(Block.Ty);
+		Rows[3].r[2] = LoadLanes(Block.Tz);
+		Rows[3].r[3] = One;
+
+		// Transposing turns the lanes into bones
+		const UINT FirstBone = BlockID * BLOCK_SIZE;
+		const UINT LaneCount = min(BLOCK_SIZE, m_BoneCount - FirstBone);
+		for(UINT Row = 0; Row < 4; Row++)
+		{
+			const XMMATRIX Bones = XMMatrixTranspose(Rows[Row]);
+			for(UINT Lane = 0; Lane < LaneCount; Lane++)
+			{
+				XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(pMatrices[FirstBone + Lane].m[Row]), Bones.r[Lane]);
+			}
+		}
+	}
+}
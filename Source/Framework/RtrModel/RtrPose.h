@@ -0,0 +1,100 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrPose.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+
+// A skeleton's local transforms (translation, rotation, scale), stored as structure-of-arrays blocks of 4 bones.
+// Lane i of block b holds bone 4b+i, so the SIMD kernels below process 4 bones per instruction.
+class CRtrPose
+{
+public:
+	static const UINT BLOCK_SIZE = 4;
+
+	struct SBlock
+	{
+		float Tx[BLOCK_SIZE], Ty[BLOCK_SIZE], Tz[BLOCK_SIZE];
+		float Qx[BLOCK_SIZE], Qy[BLOCK_SIZE], Qz[BLOCK_SIZE], Qw[BLOCK_SIZE];
+		float Sx[BLOCK_SIZE], Sy[BLOCK_SIZE], Sz[BLOCK_SIZE];
+
+		void SetTranslation(UINT Lane, const float3& T) { Tx[Lane] = T.x; Ty[Lane] = T.y; Tz[Lane] = T.z; }
+		void SetRotation(UINT Lane, const quaternion& Q) { Qx[Lane] = Q.x; Qy[Lane] = Q.y; Qz[Lane] = Q.z; Qw[Lane] = Q.w; }
+		void SetScale(UINT Lane, const float3& S) { Sx[Lane] = S.x; Sy[Lane] = S.y; Sz[Lane] = S.z; }
+	};
+
+	enum ROTATION_INTERPOLATION
+	{
+		SLERP,
+		NLERP,  // Cheaper, slightly off the constant angular velocity. Good enough for densely sampled clips
+	};
+
+	void Resize(UINT BoneCount);
+	UINT GetBoneCount() const { return m_BoneCount; }
+	UINT GetBlockCount() const { return UINT(m_Blocks.size()); }
+	SBlock& GetBlock(UINT Block) { return m_Blocks[Block]; }
+	const SBlock& GetBlock(UINT Block) const { return m_Blocks[Block]; }
+
+	void SetBone(UINT BoneID, const float3& Translation, const quaternion& Rotation, const float3& Scale);
+	void GetBone(UINT BoneID, float3& Translation, quaternion& Rotation, float3& Scale) const;
+
+	// Writes Scale * Rotation * Translation for every bone. pMatrices must hold GetBoneCount() matrices.
+	// pBlockMask, if not null, holds a flag per block. Blocks with a 0 flag are skipped
+	void ComposeMatrices(float4x4* pMatrices, const BYTE* pBlockMask = nullptr) const;
+
+	// Blending, in place and 4 bones at a time. pMask holds a weight per bone and scales Weight, null means every bone gets Weight.
+	// Blocks where all the weights are 0 are skipped.
+	// Blend() moves towards Source, with nlerp for the rotations.
+	// Add() applies the difference between Additive and Reference on top of this pose, scaled by the weight
+	void Blend(const CRtrPose& Source, float Weight, const float* pMask);
+	void Add(const CRtrPose& Additive, const CRtrPose& Reference, float Weight, const float* pMask);
+
+	// Interpolates 4 bones from A to B. Translation, rotation and scale come from different channels, so each has its own ratios.
+	// Rotations take the shortest path.
+	static void InterpolateBlock(const SBlock& A, const SBlock& B, const float RatioT[BLOCK_SIZE], const float RatioR[BLOCK_SIZE],
+		const float RatioS[BLOCK_SIZE], ROTATION_INTERPOLATION Interpolation, SBlock& Out);
+
+private:
+	bool GetBlockWeights(UINT BlockID, float Weight, const float* pMask, float Weights[BLOCK_SIZE]) const;
+
+	std::vector<SBlock> m_Blocks;
+	UINT m_BoneCount = 0;
+};
@@ -0,0 +1,225 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrSkinning.cpp
+---------------------------------------------------------------------------*/
+#include "RtrSkinning.h"
+#include "..\RtrModel.h"
+#include "..\ThreadPool.h"
+#include <chrono>
+using namespace DirectX;
+
+static inline XMVECTOR LoadRow(const float4x4& M, UINT Row)
+{
+	return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(M.m[Row]));
+}
+
+void CRtrCpuSkinner::SkinRange(const CRtrMesh::SSkinningVertex* pVertices, UINT First, UINT Last, const float4x4* pPalette, float3* pPositions, float3* pNormals)
+{
+	for(UINT i = First; i < Last; i++)
+	{
+		const CRtrMesh::SSkinningVertex& Vertex = pVertices[i];
+		const XMVECTOR Position = XMLoadFloat4(&Vertex.Position);
+		const XMVECTOR Normal = XMLoadFloat4(&Vertex.Normal);
+		if(Vertex.InfluenceCount == 0)
+		{
+			XMStoreFloat3(&pPositions[i], Position);
+			XMStoreFloat3(&pNormals[i], Normal);
+			continue;
+		}
+
+		// Weighted sum of the bone matrices, row by row
+		const float4x4& Bone0 = pPalette[Vertex.BoneIDs[0]];
+		XMVECTOR Weight = XMVectorReplicate(Vertex.Weights[0]);
+		XMVECTOR r0 = XMVectorMultiply(LoadRow(Bone0, 0), Weight);
+		XMVECTOR r1 = XMVectorMultiply(LoadRow(Bone0, 1), Weight);
+		XMVECTOR r2 = XMVectorMultiply(LoadRow(Bone0, 2), Weight);
+		XMVECTOR r3 = XMVectorMultiply(LoadRow(Bone0, 3), Weight);
+		for(UINT j = 1; j < Vertex.InfluenceCount; j++)
+		{
+			const float4x4& Bone = pPalette[Vertex.BoneIDs[j]];
+			Weight = XMVectorReplicate(Vertex.Weights[j]);
+			r0 = XMVectorMultiplyAdd(LoadRow(Bone, 0), Weight, r0);
+			r1 = XMVectorMultiplyAdd(LoadRow(Bone, 1), Weight, r1);
+			r2 = XMVectorMultiplyAdd(LoadRow(Bone, 2), Weight, r2);
+			r3 = XMVectorMultiplyAdd(LoadRow(Bone, 3), Weight, r3);
+		}
+
+		// Row vectors, the position's w is 1 and the normal's is 0
+		XMVECTOR Skinned = XMVectorMultiplyAdd(XMVectorSplatX(Position), r0, r3);
+		Skinned = XMVectorMultiplyAdd(XMVectorSplatY(Position), r1, Skinned);
+		Skinned = XMVectorMultiplyAdd(XMVectorSplatZ(Position), r2, Skinned);
+		XMStoreFloat3(&pPositions[i], Skinned);
+
+		Skinned = XMVectorMultiply(XMVectorSplatX(Normal), r0);
+		Skinned = XMVectorMultiplyAdd(XMVectorSplatY(Normal), r1, Skinned);
+		Skinned = XMVectorMultiplyAdd(XMVectorSplatZ(Normal), r2, Skinned);
+		XMStoreFloat3(&pNormals[i], Skinned);
+	}
+}
+
+void CRtrCpuSkinner::Skin(const CRtrMesh* pMesh, const float4x4* pPalette, SOutput& Output, CThreadPool* pThreadPool)
+{
+	const auto& Vertices = pMesh->GetSkinningVertices();
+	const UINT VertexCount = UINT(Vertices.size());
+	Output.Positions.resize(VertexCount);
+	Output.Normals.resize(VertexCount);
+	if(VertexCount == 0)
+	{
+		return;
+	}
+
+	const CRtrMesh::SSkinningVertex* pVertices = Vertices.data();
+	float3* pPositions = Output.Positions.data();
+	float3* pNormals = Output.Normals.data();
+	const UINT ChunkCount = (VertexCount + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	auto SkinChunk = [=](UINT ChunkID)
+	{
+		const UINT First = ChunkID * CHUNK_SIZE;
+		SkinRange(pVertices, First, min(First + CHUNK_SIZE, VertexCount), pPalette, pPositions, pNormals);
+	};
+
+	if(pThreadPool && ChunkCount > 1)
+	{
+		pThreadPool->ParallelFor(ChunkCount, SkinChunk);
+	}
+	else
+	{
+		SkinRange(pVertices, 0, VertexCount, pPalette, pPositions, pNormals);
+	}
+}
+
+void CRtrCpuSkinner::SkinReference(const CRtrMesh* pMesh, const float4x4* pPalette, SOutput& Output)
+{
+	const auto& Vertices = pMesh->GetSkinningVertices();
+	Output.Positions.resize(Vertices.size());
+	Output.Normals.resize(Vertices.size());
+	for(UINT i = 0; i < Vertices.size(); i++)
+	{
+		const CRtrMesh::SSkinningVertex& Vertex = Vertices[i];
+		const float3 Position(Vertex.Position.x, Vertex.Position.y, Vertex.Position.z);
+		const float3 Normal(Vertex.Normal.x, Vertex.Normal.y, Vertex.Normal.z);
+		if(Vertex.InfluenceCount == 0)
+		{
+			Output.Positions[i] = Position;
+			Output.Normals[i] = Normal;
+			continue;
+		}
+
+		float4x4 World = pPalette[Vertex.BoneIDs[0]] * Vertex.Weights[0];
+		for(UINT j = 1; j < Vertex.InfluenceCount; j++)
+		{
+			World += pPalette[Vertex.BoneIDs[j]] * Vertex.Weights[j];
+		}
+		Output.Positions[i] = float3::Transform(Position, World);
+		Output.Normals[i] = float3::TransformNormal(Normal, World);
+	}
+}
+
+// Distance between two floats in units in the last place. Negative floats are mapped below the positive ones, so the distance
+// is correct across 0
+static UINT UlpDistance(float a, float b)
+{
+	INT32 ia, ib;
+	memcpy(&ia, &a, sizeof(a));
+	memcpy(&ib, &b, sizeof(b));
+	ia = (ia < 0) ? INT32(0x80000000) - ia : ia;
+	ib = (ib < 0) ? INT32(0x80000000) - ib : ib;
+	return UINT((ia > ib) ? INT64(ia) - ib : INT64(ib) - ia);
+}
+
+CRtrCpuSkinner::SBenchmark CRtrCpuSkinner::Benchmark(const CRtrModel* pModel, UINT IterationCount, CThreadPool* pThreadPool)
+{
+	SBenchmark Result;
+	Result.ThreadCount = pThreadPool ? pThreadPool->GetThreadCount() : 1;
+	// Also decodes the skinning inputs, so that it doesn't count in the timings
+	std::vector<const CRtrMesh*> Meshes;
+	for(UINT i = 0; i < pModel->GetMeshCount(); i++)
+	{
+		const CRtrMesh* pMesh = pModel->GetMesh(i);
+		if(pMesh->GetSkinningVertices().size())
+		{
+			Meshes.push_back(pMesh);
+			Result.VertexCount += UINT(pMesh->GetSkinningVertices().size());
+		}
+	}
+	if(Result.VertexCount == 0 || IterationCount == 0)
+	{
+		return Result;
+	}
+
+	const float4x4* pPalette = pModel->GetBonesMatrices();
+	std::vector<SOutput> Outputs(Meshes.size());
+	auto Time = [&](CThreadPool* pPool) -> float
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+		for(UINT Iteration = 0; Iteration < IterationCount; Iteration++)
+		{
+			for(UINT i = 0; i < Meshes.size(); i++)
+			{
+				Skin(Meshes[i], pPalette, Outputs[i], pPool);
+			}
+		}
+		const float Seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - Start).count();
+		return float(Result.VertexCount) * float(IterationCount) / Seconds;
+	};
+	Result.SerialVerticesPerSecond = Time(nullptr);
+	Result.ParallelVerticesPerSecond = Time(pThreadPool);
+
+	const float Size = max(pModel->GetRadius() * 2, 1e-6f);
+	SOutput Reference;
+	for(UINT i = 0; i < Meshes.size(); i++)
+	{
+		SkinReference(Meshes[i], pPalette, Reference);
+		for(UINT v = 0; v < Reference.Positions.size(); v++)
+		{
+			const float* pRef = &Reference.Positions[v].x;
+			const float* pSimd = &Outputs[i].Positions[v].x;
+			for(UINT c = 0; c < 3; c++)
+			{
+				Result.MaxError = max(Result.MaxError, fabsf(pRef[c] - pSimd[c]) / Size);
+				if(fabsf(pRef[c]) > Size * 1e-3f)
+				{
+					Result.MaxUlpError = max(Result.MaxUlpError, UlpDistance(pRef[c], pSimd[c]));
+				}
+			}
+		}
+	}
+	return Result;
+}
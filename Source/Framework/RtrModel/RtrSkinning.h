@@ -0,0 +1,84 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: RtrSkinning.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "..\Common.h"
+#include <vector>
+#include "RtrMesh.h"
+
+class CRtrModel;
+class CThreadPool;
+
+// Skins meshes on the CPU, with the linear blend of the _USE_BONES vertex shader, so that culling, picking and other CPU passes
+// can use the animated positions. Each vertex blends the rows of its palette matrices with SIMD, skipping the influences with a 0 weight
+class CRtrCpuSkinner
+{
+public:
+	static const UINT CHUNK_SIZE = 1024;  // Vertices per thread pool task
+
+	struct SOutput
+	{
+		std::vector<float3> Positions;  // Model space
+		std::vector<float3> Normals;    // Not normalized, same as the shader
+	};
+
+	// pPalette is the controller's bone palette. Runs on the thread pool, or on the calling thread if pThreadPool is null
+	static void Skin(const CRtrMesh* pMesh, const float4x4* pPalette, SOutput& Output, CThreadPool* pThreadPool);
+
+	// The vertex shader's maths, one float4x4 at a time over all the influences. Slow, used to validate Skin()
+	static void SkinReference(const CRtrMesh* pMesh, const float4x4* pPalette, SOutput& Output);
+
+	// Skins every mesh with bones using the current palette, on one thread and then on the thread pool, and compares the
+	// result with SkinReference()
+	struct SBenchmark
+	{
+		UINT VertexCount = 0;
+		UINT ThreadCount = 0;
+		float SerialVerticesPerSecond = 0;
+		float ParallelVerticesPerSecond = 0;
+		UINT MaxUlpError = 0;  // Over the components larger than 1/1000 of the model's size, so that values near 0 don't dominate
+		float MaxError = 0;    // Relative to the model's size
+	};
+	static SBenchmark Benchmark(const CRtrModel* pModel, UINT IterationCount, CThreadPool* pThreadPool);
+
+private:
+	static void SkinRange(const CRtrMesh::SSkinningVertex* pVertices, UINT First, UINT Last, const float4x4* pPalette, float3* pPositions, float3* pNormals);
+};
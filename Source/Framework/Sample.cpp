@@ -72,6 +72,9 @@ void CSample::Run(const std::wstring& Title, int Width, int Height, UINT SampleC
 	m_pDevice = std::make_unique<CDevice>(m_Window, SampleCount);
 	assert(m_pDevice);
 
+	// Worker threads for loading and other CPU-heavy work
+	m_pThreadPool = std::make_unique<CThreadPool>();
+
     // Create UI
     CreateSettingsDialog();
     m_pAppGui = std::make_unique<CGui>("Sample UI", m_pDevice->GetD3DDevice(), m_Window.GetClientWidth(), m_Window.GetClientHeight());
@@ -91,6 +94,7 @@ void CSample::Run(const std::wstring& Title, int Width, int Height, UINT SampleC
 	// Shutdown
 	m_pDevice->GetImmediateContext()->ClearState();
 	OnDestroyDevice();
+	m_pThreadPool = nullptr;
 }
 
 void CSample::CreateSettingsDialog()
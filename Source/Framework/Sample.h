@@ -49,6 +49,7 @@ Filename: Sample.h
 #include "Gui.h"
 #include "Timer.h"
 #include "FullScreenPass.h"
+#include "ThreadPool.h"
 
 struct SMouseData
 {
@@ -84,6 +85,7 @@ protected:
     std::unique_ptr<CDevice> m_pDevice;
 	std::unique_ptr<CTextRenderer> m_pTextRenderer;
 	std::unique_ptr<CGui> m_pAppGui;
+	std::unique_ptr<CThreadPool> m_pThreadPool;
 	const std::wstring GetGlobalSampleMessage();
 	const CFullScreenPass* GetFullScreenPass();
 
@@ -132,4 +132,55 @@ HRESULT CreateTgaResourceViewFromFile(ID3D11Device* pDevice,
     }
 
     return S_OK;
-}
\ No newline at end of file
+}
+
+ID3D11ShaderResourceView* CreateShaderResourceViewFromFileThreadSafe(ID3D11Device* pDevice, const std::wstring& Filename, bool bSrgb)
+{
+    std::wstring Fullpath;
+    if(FAILED(FindFileInCommonDirs(Filename, Fullpath)))
+    {
+        trace(std::wstring(L"Can't find texture file ") + Filename);
+        return nullptr;
+    }
+
+    // WIC needs COM to be initialized on the calling thread
+    HRESULT hrCom = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    TexMetadata Metadata;
+    ScratchImage Scratch;
+    HRESULT hr;
+    if(HasSuffix(Fullpath, std::wstring(L".dds"), false))
+    {
+        hr = LoadFromDDSFile(Fullpath.c_str(), DDS_FLAGS_NONE, &Metadata, Scratch);
+    }
+    else if(HasSuffix(Fullpath, std::wstring(L".tga"), false))
+    {
+        hr = LoadFromTGAFile(Fullpath.c_str(), &Metadata, Scratch);
+    }
+    else
+    {
+        hr = LoadFromWICFile(Fullpath.c_str(), WIC_FLAGS_NONE, &Metadata, Scratch);
+    }
+
+    ID3D11ShaderResourceView* pSrv = nullptr;
+    if(SUCCEEDED(hr))
+    {
+        if((Metadata.mipLevels == 1) && (IsCompressed(Metadata.format) == false))
+        {
+            ScratchImage Mipped;
+            if(SUCCEEDED(GenerateMipMaps(Scratch.GetImages(), Scratch.GetImageCount(), Metadata, TEX_FILTER_DEFAULT, 0, Mipped)))
+            {
+                Scratch = std::move(Mipped);
+                Metadata = Scratch.GetMetadata();
+            }
+        }
+        hr = CreateShaderResourceViewEx(pDevice, Scratch.GetImages(), Scratch.GetImageCount(), Metadata, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, bSrgb, &pSrv);
+    }
+    verify(hr);
+
+    if(SUCCEEDED(hrCom))
+    {
+        CoUninitialize();
+    }
+    return pSrv;
+}
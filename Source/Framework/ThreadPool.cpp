@@ -0,0 +1,185 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: ThreadPool.cpp
+---------------------------------------------------------------------------*/
+#include "ThreadPool.h"
+#include <atomic>
+
+CThreadPool::CThreadPool(UINT ThreadCount)
+{
+	SetThreadCount(ThreadCount);
+}
+
+CThreadPool::~CThreadPool()
+{
+	StopWorkers();
+}
+
+UINT CThreadPool::GetHardwareThreadCount()
+{
+	UINT Count = std::thread::hardware_concurrency();
+	return Count ? Count : 1;
+}
+
+void CThreadPool::SetThreadCount(UINT ThreadCount)
+{
+	if(ThreadCount == 0)
+	{
+		ThreadCount = GetHardwareThreadCount();
+	}
+
+	StopWorkers();
+	StartWorkers(ThreadCount - 1);
+}
+
+void CThreadPool::StartWorkers(UINT WorkerCount)
+{
+	m_bQuit = false;
+	for(UINT i = 0; i < WorkerCount; i++)
+	{
+		m_Workers.push_back(std::thread(&CThreadPool::WorkerThread, this));
+	}
+}
+
+void CThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+		m_bQuit = true;
+	}
+	m_TaskReady.notify_all();
+
+	for(auto& Worker : m_Workers)
+	{
+		Worker.join();
+	}
+	m_Workers.clear();
+}
+
+void CThreadPool::WorkerThread()
+{
+	for(;;)
+	{
+		std::function<void()> Task;
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			m_TaskReady.wait(Lock, [this]() { return m_bQuit || (m_Tasks.empty() == false); });
+
+			// Drain the queue before quitting
+			if(m_Tasks.empty())
+			{
+				return;
+			}
+			Task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+		}
+		Task();
+	}
+}
+
+void CThreadPool::Submit(const std::function<void()>& Task)
+{
+	if(m_Workers.empty())
+	{
+		Task();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+		m_Tasks.push_back(Task);
+	}
+	m_TaskReady.notify_one();
+}
+
+struct SParallelForState
+{
+	std::function<void(UINT)> Func;
+	UINT Count;
+	std::atomic<UINT> NextIndex;
+	std::atomic<UINT> DoneCount;
+	std::mutex Mutex;
+	std::condition_variable Done;
+
+	void Run()
+	{
+		for(;;)
+		{
+			UINT i = NextIndex++;
+			if(i >= Count)
+			{
+				return;
+			}
+			Func(i);
+
+			if(++DoneCount == Count)
+			{
+				std::lock_guard<std::mutex> Lock(Mutex);
+				Done.notify_all();
+			}
+		}
+	}
+};
+
+void CThreadPool::ParallelFor(UINT Count, const std::function<void(UINT)>& Func)
+{
+	if(Count == 0)
+	{
+		return;
+	}
+
+	// Helper tasks might start after the loop is done, so they hold a reference to the state
+	auto pState = std::make_shared<SParallelForState>();
+	pState->Func = Func;
+	pState->Count = Count;
+	pState->NextIndex = 0;
+	pState->DoneCount = 0;
+
+	UINT HelperCount = min(Count - 1, UINT(m_Workers.size()));
+	for(UINT i = 0; i < HelperCount; i++)
+	{
+		Submit([pState]() { pState->Run(); });
+	}
+
+	// The calling thread works too. Once there are no more indices to grab, wait for the ones still running on the workers
+	pState->Run();
+	std::unique_lock<std::mutex> Lock(pState->Mutex);
+	pState->Done.wait(Lock, [&pState]() { return pState->DoneCount == pState->Count; });
+}
@@ -0,0 +1,81 @@
+/*
+---------------------------------------------------------------------------
+Real Time Rendering Demos
+---------------------------------------------------------------------------
+
+Copyright (c) 2014 - Nir Benty
+
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the following
+conditions are met:
+
+* Redistributions of source code must retain the above
+copyright notice, this list of conditions and the
+following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+copyright notice, this list of conditions and the
+following disclaimer in the documentation and/or other
+materials provided with the distribution.
+
+* Neither the name of Nir Benty, nor the names of other
+contributors may be used to endorse or promote products
+derived from this software without specific prior
+written permission from Nir Benty.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+Filename: ThreadPool.h
+---------------------------------------------------------------------------*/
+#pragma once
+#include "Common.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+class CThreadPool
+{
+public:
+	// ThreadCount is the number of threads participating in a ParallelFor(), including the calling thread. 0 means one per core
+	CThreadPool(UINT ThreadCount = 0);
+	~CThreadPool();
+	CThreadPool(const CThreadPool&) = delete;
+	CThreadPool& operator=(const CThreadPool&) = delete;
+
+	// Waits for the queued tasks to finish before changing the number of workers
+	void SetThreadCount(UINT ThreadCount);
+	UINT GetThreadCount() const { return UINT(m_Workers.size()) + 1; }
+	static UINT GetHardwareThreadCount();
+
+	// Fire-and-forget task. Executed immediately if the pool has no workers
+	void Submit(const std::function<void()>& Task);
+
+	// Calls Func(0)..Func(Count-1) and returns when all calls are done. The calling thread executes tasks too, so it's safe to call from inside a task
+	void ParallelFor(UINT Count, const std::function<void(UINT)>& Func);
+
+private:
+	void StartWorkers(UINT WorkerCount);
+	void StopWorkers();
+	void WorkerThread();
+
+	std::vector<std::thread> m_Workers;
+	std::deque<std::function<void()>> m_Tasks;
+	std::mutex m_Mutex;
+	std::condition_variable m_TaskReady;
+	bool m_bQuit = false;
+};